@@ -16,7 +16,72 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
 
 FrameResource::~FrameResource()
 {
+    if (TerrainInstanceBuffer != nullptr)
+        TerrainInstanceBuffer->Unmap(0, nullptr);
+    if (TerrainClipmapUpload != nullptr)
+        TerrainClipmapUpload->Unmap(0, nullptr);
+    if (TerrainVTUpload != nullptr)
+        TerrainVTUpload->Unmap(0, nullptr);
+}
+
+void FrameResource::ReserveTerrainInstances(ID3D12Device* device, UINT count)
+{
+    if (count <= TerrainInstanceCapacity)
+        return;
+    if (TerrainInstanceBuffer != nullptr)
+        TerrainInstanceBuffer->Unmap(0, nullptr);
+    TerrainInstanceBuffer.Reset();
+    TerrainInstances = nullptr;
+
+    TerrainInstanceCapacity = (std::max)({ count, TerrainInstanceCapacity * 2, 256u });
+    ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer((UINT64)TerrainInstanceCapacity * sizeof(TerrainInstance)),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&TerrainInstanceBuffer)));
+    ThrowIfFailed(TerrainInstanceBuffer->Map(0, nullptr, reinterpret_cast<void**>(&TerrainInstances)));
+}
+
+void FrameResource::ReserveTerrainClipmapUpload(ID3D12Device* device, UINT64 bytes)
+{
+    if (bytes <= TerrainClipmapUploadCapacity)
+        return;
+    if (TerrainClipmapUpload != nullptr)
+        TerrainClipmapUpload->Unmap(0, nullptr);
+    TerrainClipmapUpload.Reset();
+    TerrainClipmapUploadData = nullptr;
+
+    TerrainClipmapUploadCapacity = (std::max)({ bytes, TerrainClipmapUploadCapacity * 2, (UINT64)1 << 20 });
+    ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(TerrainClipmapUploadCapacity),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&TerrainClipmapUpload)));
+    ThrowIfFailed(TerrainClipmapUpload->Map(0, nullptr, reinterpret_cast<void**>(&TerrainClipmapUploadData)));
+}
+
+void FrameResource::ReserveTerrainVTUpload(ID3D12Device* device, UINT64 bytes)
+{
+    if (bytes <= TerrainVTUploadCapacity)
+        return;
+    if (TerrainVTUpload != nullptr)
+        TerrainVTUpload->Unmap(0, nullptr);
+    TerrainVTUpload.Reset();
+    TerrainVTUploadData = nullptr;
 
+    TerrainVTUploadCapacity = (std::max)({ bytes, TerrainVTUploadCapacity * 2, (UINT64)1 << 20 });
+    ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(TerrainVTUploadCapacity),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&TerrainVTUpload)));
+    ThrowIfFailed(TerrainVTUpload->Map(0, nullptr, reinterpret_cast<void**>(&TerrainVTUploadData)));
 }
 Vertex::Vertex(DirectX::XMFLOAT3 _pos, DirectX::XMFLOAT3 _nm, DirectX::XMFLOAT2 _uv, DirectX::XMFLOAT3 _tan)
 {
@@ -3,6 +3,7 @@
 #include "../../Common/d3dUtil.h"
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
+#include "TerrainInstances.h"
 
 struct ObjectConstants
 {
@@ -90,6 +91,29 @@ public:
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
     std::unique_ptr<UploadBuffer<LightConstants>> LightCB = nullptr;
     std::unique_ptr<UploadBuffer<PassShadowConstants>> PassShadowCB = nullptr;
+
+    // Visible terrain tiles (StructuredBuffer in Terrain.hlsl), persistently mapped
+    Microsoft::WRL::ComPtr<ID3D12Resource> TerrainInstanceBuffer;
+    TerrainInstance* TerrainInstances = nullptr;
+    UINT TerrainInstanceCapacity = 0;
+    // Grow the instance buffer to hold at least count tiles (only once the GPU is done with this frame)
+    void ReserveTerrainInstances(ID3D12Device* device, UINT count);
+
+    // Staging for the clipmap heights that scrolled in this frame, persistently mapped
+    Microsoft::WRL::ComPtr<ID3D12Resource> TerrainClipmapUpload;
+    BYTE* TerrainClipmapUploadData = nullptr;
+    UINT64 TerrainClipmapUploadCapacity = 0;
+    void ReserveTerrainClipmapUpload(ID3D12Device* device, UINT64 bytes);
+
+    // Staging for the virtual texture pages and page table uploaded this frame, persistently mapped
+    Microsoft::WRL::ComPtr<ID3D12Resource> TerrainVTUpload;
+    BYTE* TerrainVTUploadData = nullptr;
+    UINT64 TerrainVTUploadCapacity = 0;
+    void ReserveTerrainVTUpload(ID3D12Device* device, UINT64 bytes);
+    // This frame's virtual texture feedback, copied back once the GPU is done with the frame;
+    // TerrainVTFeedbackTag is the tag its texels carry (0 = nothing copied)
+    Microsoft::WRL::ComPtr<ID3D12Resource> TerrainVTFeedbackReadback;
+    UINT TerrainVTFeedbackTag = 0;
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
     UINT64 Fence = 0;
@@ -0,0 +1,513 @@
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "../../Common/model.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	constexpr char kMeshCacheMagic[8] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+	constexpr uint64_t kMissingSource = ~0ull; // source size recorded for a library that did not open
+
+	struct MeshCacheHeader
+	{
+		char Magic[8];
+		uint32_t Version;
+		uint32_t HeaderBytes;
+		uint32_t ImportFlags;
+		uint32_t VertexStride;
+		uint32_t IndexBytes;
+		uint32_t Reserved;
+		uint64_t Key;
+		uint64_t PayloadHash;    // of every byte after the header
+		uint64_t FileBytes;
+		uint64_t SourcesOffset;  // uint32 count, then per source: uint64 size, uint64 hash, string path
+		uint64_t VerticesOffset;
+		uint64_t IndicesOffset;
+		uint64_t TablesOffset;   // uint32 count, submeshes; uint32 count, materials (name, diffuse, normal)
+		uint64_t VertexCount;
+		uint64_t IndexCount;
+	};
+
+	uint64_t AlignUp(uint64_t value)
+	{
+		return (value + kMeshCacheAlignment - 1) / kMeshCacheAlignment * kMeshCacheAlignment;
+	}
+
+	double MsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Little byte writer for the variable-length sections
+	struct ByteWriter
+	{
+		std::vector<char>& Bytes;
+
+		void Raw(const void* data, size_t size)
+		{
+			Bytes.insert(Bytes.end(), (const char*)data, (const char*)data + size);
+		}
+		template <typename T> void Value(T value) { Raw(&value, sizeof(value)); }
+		void String(const std::string& s)
+		{
+			Value((uint32_t)s.size());
+			Raw(s.data(), s.size());
+		}
+		void Pad() { Bytes.resize((size_t)AlignUp(Bytes.size()), 0); }
+	};
+
+	// Reads that fail once past the end instead of running off the mapping
+	struct ByteReader
+	{
+		const char* At;
+		const char* End;
+		bool Ok = true;
+
+		template <typename T> T Value()
+		{
+			T value = T();
+			if (Ok && (size_t)(End - At) >= sizeof(T))
+			{
+				std::memcpy(&value, At, sizeof(T));
+				At += sizeof(T);
+			}
+			else
+				Ok = false;
+			return value;
+		}
+		std::string String()
+		{
+			const uint32_t size = Value<uint32_t>();
+			if (!Ok || (size_t)(End - At) < size)
+			{
+				Ok = false;
+				return std::string();
+			}
+			std::string s(At, size);
+			At += size;
+			return s;
+		}
+	};
+
+	struct SourceState
+	{
+		std::string Path;
+		uint64_t Size = kMissingSource;
+		uint64_t Hash = 0;
+	};
+
+	SourceState HashSource(const std::string& path)
+	{
+		SourceState state;
+		state.Path = path;
+		MappedFile file;
+		if (file.Open(path))
+		{
+			state.Size = file.Size();
+			state.Hash = HashMeshCacheSource(file.Data(), file.Size());
+		}
+		return state;
+	}
+
+	uint64_t CacheKey(const MeshCacheLayout& layout, const std::vector<SourceState>& sources)
+	{
+		std::vector<char> bytes;
+		ByteWriter key{ bytes };
+		key.Value(kMeshCacheVersion);
+		key.Value(layout.ImportFlags);
+		key.Value(layout.VertexStride);
+		key.Value(layout.IndexBytes);
+		for (const SourceState& source : sources)
+		{
+			key.String(source.Path);
+			key.Value(source.Size);
+			key.Value(source.Hash);
+		}
+		return HashMeshCacheSource(bytes.data(), bytes.size());
+	}
+}
+
+uint64_t HashMeshCacheSource(const void* data, size_t size)
+{
+	// MurmurHash64A
+	const uint64_t m = 0xc6a4a7935bd1e995ull;
+	const int r = 47;
+	uint64_t h = 0x9e3779b97f4a7c15ull ^ (size * m);
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + size / 8 * 8;
+	for (; p != end; p += 8)
+	{
+		uint64_t k;
+		std::memcpy(&k, p, 8);
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
+	}
+	const size_t tail = size & 7;
+	if (tail)
+	{
+		uint64_t k = 0;
+		for (size_t i = 0; i < tail; ++i)
+			k |= (uint64_t)p[i] << (8 * i);
+		h ^= k;
+		h *= m;
+	}
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
+}
+
+std::filesystem::path MeshCachePath(const std::string& name)
+{
+	return std::filesystem::path("MeshCache") / (name + ".meshcache");
+}
+
+bool MeshCache::Open(const std::filesystem::path& path, const MeshCacheLayout& layout)
+{
+	Close();
+	auto reject = [this]() {
+		Close();
+		return false;
+	};
+	if (!mFile.Open(path.string()) || mFile.Size() < sizeof(MeshCacheHeader))
+		return reject();
+
+	MeshCacheHeader header;
+	std::memcpy(&header, mFile.Data(), sizeof(header));
+	if (std::memcmp(header.Magic, kMeshCacheMagic, sizeof(kMeshCacheMagic)) != 0 ||
+		header.Version != kMeshCacheVersion || header.HeaderBytes != sizeof(MeshCacheHeader) ||
+		header.ImportFlags != layout.ImportFlags || header.VertexStride != layout.VertexStride ||
+		header.IndexBytes != layout.IndexBytes || header.FileBytes != mFile.Size())
+		return reject();
+
+	// Sections in order, aligned and inside the file
+	const uint64_t size = mFile.Size();
+	const uint64_t vertexBytes = header.VertexCount * header.VertexStride;
+	const uint64_t indexBytes = header.IndexCount * header.IndexBytes;
+	if (header.VertexCount > size || header.IndexCount > size ||
+		header.SourcesOffset != AlignUp(sizeof(MeshCacheHeader)) || header.VerticesOffset < header.SourcesOffset ||
+		header.VerticesOffset % kMeshCacheAlignment != 0 || header.IndicesOffset % kMeshCacheAlignment != 0 ||
+		header.TablesOffset % kMeshCacheAlignment != 0 ||
+		header.IndicesOffset < header.VerticesOffset + vertexBytes ||
+		header.TablesOffset < header.IndicesOffset + indexBytes || header.TablesOffset > size)
+		return reject();
+
+	const char* data = mFile.Data();
+	if (HashMeshCacheSource(data + sizeof(MeshCacheHeader), (size_t)(size - sizeof(MeshCacheHeader))) != header.PayloadHash)
+		return reject();
+
+	// The key is rebuilt from the sources as they are now
+	ByteReader sources{ data + header.SourcesOffset, data + header.VerticesOffset };
+	std::vector<SourceState> current(sources.Value<uint32_t>());
+	if (!sources.Ok || current.size() > size)
+		return reject();
+	for (SourceState& source : current)
+	{
+		sources.Value<uint64_t>();
+		sources.Value<uint64_t>();
+		const std::string sourcePath = sources.String();
+		if (!sources.Ok)
+			return reject();
+		source = HashSource(sourcePath);
+	}
+	if (current.empty() || CacheKey(layout, current) != header.Key)
+		return reject();
+
+	ByteReader tables{ data + header.TablesOffset, data + size };
+	mSubmeshes.resize(std::min<uint64_t>(tables.Value<uint32_t>(), size));
+	for (MeshCacheSubmesh& submesh : mSubmeshes)
+	{
+		submesh.IndexCount = tables.Value<uint32_t>();
+		submesh.StartIndex = tables.Value<uint32_t>();
+		submesh.BaseVertex = tables.Value<int32_t>();
+		submesh.Material = tables.String();
+		if (!tables.Ok || (uint64_t)submesh.StartIndex + submesh.IndexCount > header.IndexCount ||
+			submesh.BaseVertex < 0 || (uint64_t)submesh.BaseVertex > header.VertexCount)
+			return reject();
+	}
+	mMaterials.resize(std::min<uint64_t>(tables.Value<uint32_t>(), size));
+	for (GeometryGenerator::Material& material : mMaterials)
+	{
+		material.name = tables.String();
+		material.diffFile = tables.String();
+		material.normFile = tables.String();
+	}
+	if (!tables.Ok)
+		return reject();
+
+	mVertices = data + header.VerticesOffset;
+	mVertexCount = (size_t)header.VertexCount;
+	mIndices = data + header.IndicesOffset;
+	mIndexCount = (size_t)header.IndexCount;
+	return true;
+}
+
+void MeshCache::Close()
+{
+	mFile.Close();
+	mVertices = nullptr;
+	mVertexCount = 0;
+	mIndices = nullptr;
+	mIndexCount = 0;
+	mSubmeshes.clear();
+	mMaterials.clear();
+}
+
+bool WriteMeshCache(const std::filesystem::path& path, const MeshCacheLayout& layout, const MeshCacheContents& contents)
+{
+	std::vector<SourceState> sources;
+	for (const std::string& source : contents.Sources)
+		sources.push_back(HashSource(source));
+	if (sources.empty() || sources[0].Size == kMissingSource)
+		return false;
+
+	MeshCacheHeader header = {};
+	std::memcpy(header.Magic, kMeshCacheMagic, sizeof(kMeshCacheMagic));
+	header.Version = kMeshCacheVersion;
+	header.HeaderBytes = sizeof(MeshCacheHeader);
+	header.ImportFlags = layout.ImportFlags;
+	header.VertexStride = layout.VertexStride;
+	header.IndexBytes = layout.IndexBytes;
+	header.Key = CacheKey(layout, sources);
+	header.VertexCount = contents.VertexCount;
+	header.IndexCount = contents.IndexCount;
+
+	std::vector<char> bytes(sizeof(MeshCacheHeader));
+	ByteWriter file{ bytes };
+	file.Pad();
+	header.SourcesOffset = bytes.size();
+	file.Value((uint32_t)sources.size());
+	for (const SourceState& source : sources)
+	{
+		file.Value(source.Size);
+		file.Value(source.Hash);
+		file.String(source.Path);
+	}
+	file.Pad();
+	header.VerticesOffset = bytes.size();
+	file.Raw(contents.Vertices, contents.VertexCount * layout.VertexStride);
+	file.Pad();
+	header.IndicesOffset = bytes.size();
+	file.Raw(contents.Indices, contents.IndexCount * layout.IndexBytes);
+	file.Pad();
+	header.TablesOffset = bytes.size();
+	file.Value((uint32_t)contents.Submeshes.size());
+	for (const MeshCacheSubmesh& submesh : contents.Submeshes)
+	{
+		file.Value(submesh.IndexCount);
+		file.Value(submesh.StartIndex);
+		file.Value(submesh.BaseVertex);
+		file.String(submesh.Material);
+	}
+	file.Value((uint32_t)contents.Materials.size());
+	for (const GeometryGenerator::Material& material : contents.Materials)
+	{
+		file.String(material.name);
+		file.String(material.diffFile);
+		file.String(material.normFile);
+	}
+	file.Pad();
+	header.FileBytes = bytes.size();
+	header.PayloadHash = HashMeshCacheSource(bytes.data() + sizeof(MeshCacheHeader), bytes.size() - sizeof(MeshCacheHeader));
+	std::memcpy(bytes.data(), &header, sizeof(header));
+
+	std::error_code ec;
+	if (path.has_parent_path())
+		std::filesystem::create_directories(path.parent_path(), ec);
+	std::filesystem::path temporary = path;
+	temporary += ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		if (!out.write(bytes.data(), (std::streamsize)bytes.size()))
+			return false;
+	}
+	std::filesystem::rename(temporary, path, ec);
+	if (ec)
+	{
+		std::filesystem::remove(temporary, ec);
+		return false;
+	}
+	return true;
+}
+
+namespace
+{
+	// One model in the layout the benchmark and the check cache: GeometryGenerator::Vertex, 32-bit indices
+	struct FlatModel
+	{
+		std::vector<GeometryGenerator::Vertex> Vertices;
+		std::vector<uint32_t> Indices;
+		MeshCacheContents Contents;
+	};
+
+	void FlattenModel(const ModelImport& import, FlatModel& flat)
+	{
+		flat.Contents = MeshCacheContents();
+		flat.Contents.Sources = import.Sources;
+		flat.Contents.Materials = import.Materials;
+		for (const GeometryGenerator::MeshData& mesh : import.Meshes)
+		{
+			MeshCacheSubmesh submesh;
+			submesh.Material = mesh.matName;
+			submesh.IndexCount = (uint32_t)mesh.Indices32.size();
+			submesh.StartIndex = (uint32_t)flat.Indices.size();
+			submesh.BaseVertex = (int32_t)flat.Vertices.size();
+			flat.Contents.Submeshes.push_back(submesh);
+			flat.Vertices.insert(flat.Vertices.end(), mesh.Vertices.begin(), mesh.Vertices.end());
+			flat.Indices.insert(flat.Indices.end(), mesh.Indices32.begin(), mesh.Indices32.end());
+		}
+		flat.Contents.Vertices = flat.Vertices.data();
+		flat.Contents.VertexCount = flat.Vertices.size();
+		flat.Contents.Indices = flat.Indices.data();
+		flat.Contents.IndexCount = flat.Indices.size();
+	}
+
+	const MeshCacheLayout kFlatLayout = { kModelImportDefault, (uint32_t)sizeof(GeometryGenerator::Vertex), 4 };
+}
+
+MeshCacheBenchmark BenchmarkMeshCache(const std::string& filename, int repeats)
+{
+	MeshCacheBenchmark result;
+	repeats = std::max(repeats, 1);
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "MeshCacheBenchmark.meshcache";
+	for (int r = 0; r < repeats; ++r)
+	{
+		auto start = std::chrono::steady_clock::now();
+		ModelImport import;
+		FlatModel flat;
+		if (!ImportModel(filename, kModelImportDefault, import))
+			return MeshCacheBenchmark();
+		for (GeometryGenerator::MeshData& mesh : import.Meshes)
+			OptimizeMesh(mesh);
+		FlattenModel(import, flat);
+		result.ImportMs += MsSince(start) / repeats;
+
+		start = std::chrono::steady_clock::now();
+		if (!WriteMeshCache(path, kFlatLayout, flat.Contents))
+			return MeshCacheBenchmark();
+		result.WriteMs += MsSince(start) / repeats;
+
+		start = std::chrono::steady_clock::now();
+		MeshCache cache;
+		if (!cache.Open(path, kFlatLayout))
+			return MeshCacheBenchmark();
+		std::vector<GeometryGenerator::Vertex> vertices(cache.VertexCount());
+		std::vector<uint32_t> indices(cache.IndexCount());
+		std::memcpy(vertices.data(), cache.Vertices(), vertices.size() * sizeof(GeometryGenerator::Vertex));
+		std::memcpy(indices.data(), cache.Indices(), indices.size() * sizeof(uint32_t));
+		result.LoadMs += MsSince(start) / repeats;
+	}
+	std::error_code ec;
+	result.FileBytes = (size_t)std::filesystem::file_size(path, ec);
+	std::filesystem::remove(path, ec);
+	return result;
+}
+
+bool ValidateMeshCache(std::string* error)
+{
+	const std::filesystem::path dir = std::filesystem::temp_directory_path() / "MeshCacheCheck";
+	std::error_code ec;
+	auto fail = [error, &dir, &ec](const std::string& reason) {
+		std::filesystem::remove_all(dir, ec);
+		if (error) *error = reason;
+		return false;
+	};
+	std::filesystem::remove_all(dir, ec);
+	std::filesystem::create_directories(dir, ec);
+	auto writeText = [](const std::filesystem::path& path, const std::string& text) {
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out << text;
+	};
+
+	const std::string obj = (dir / "model.obj").string();
+	const std::string mtl = (dir / "model.mtl").string();
+	const std::string extra = (dir / "extra.mtl").string();
+	writeText(obj, "mtllib model.mtl\nmtllib extra.mtl\n"
+		"v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 2 0 0\nvt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+		"usemtl stone\nf 1/1 2/2 3/3 4/4\ng other\nf 2/1 5/2 3/3\n");
+	writeText(mtl, "newmtl stone\nmap_Kd textures/stone.dds\nmap_Disp textures/stone_ddn.dds\n");
+
+	ModelImport import;
+	FlatModel flat;
+	if (!ImportModel(obj, kModelImportDefault, import))
+		return fail("synthetic OBJ did not import");
+	FlattenModel(import, flat);
+	const std::filesystem::path path = dir / "cache" / "model.meshcache";
+	if (!WriteMeshCache(path, kFlatLayout, flat.Contents))
+		return fail("cache not written");
+
+	MeshCache cache;
+	if (!cache.Open(path, kFlatLayout))
+		return fail("fresh cache rejected");
+	if (cache.VertexCount() != flat.Vertices.size() || cache.IndexCount() != flat.Indices.size() ||
+		std::memcmp(cache.Vertices(), flat.Vertices.data(), flat.Vertices.size() * sizeof(GeometryGenerator::Vertex)) != 0 ||
+		std::memcmp(cache.Indices(), flat.Indices.data(), flat.Indices.size() * sizeof(uint32_t)) != 0)
+		return fail("arrays do not read back");
+	if ((uintptr_t)cache.Vertices() % kMeshCacheAlignment != 0 || (uintptr_t)cache.Indices() % kMeshCacheAlignment != 0)
+		return fail("sections not aligned");
+	if (cache.Submeshes().size() != 2 || cache.Submeshes()[1].Material != "stone" ||
+		cache.Submeshes()[1].StartIndex != 6 || cache.Submeshes()[1].BaseVertex != cache.Submeshes()[0].BaseVertex + 4)
+		return fail("submesh table does not read back");
+	if (cache.Materials().size() != 2 || cache.Materials()[1].diffFile != "textures/stone.dds" ||
+		cache.Materials()[1].normFile != "textures/stone_ddn.dds")
+		return fail("material table does not read back");
+	cache.Close();
+
+	MeshCacheLayout otherLayout = kFlatLayout;
+	otherLayout.IndexBytes = 2;
+	if (cache.Open(path, otherLayout))
+		return fail("cache served another layout");
+	otherLayout = kFlatLayout;
+	otherLayout.ImportFlags = 0;
+	if (cache.Open(path, otherLayout))
+		return fail("cache served other import flags");
+
+	// Damage copies of the file one way each
+	std::vector<char> bytes;
+	{
+		MappedFile file(path.string());
+		bytes.assign(file.Data(), file.Data() + file.Size());
+	}
+	const std::filesystem::path damaged = dir / "damaged.meshcache";
+	auto rejects = [&](const std::vector<char>& b) {
+		{
+			std::ofstream out(damaged, std::ios::binary | std::ios::trunc);
+			out.write(b.data(), (std::streamsize)b.size());
+		}
+		MeshCache check;
+		return !check.Open(damaged, kFlatLayout);
+	};
+	std::vector<char> copy(bytes.begin(), bytes.end() - 1);
+	if (!rejects(copy))
+		return fail("truncated cache accepted");
+	copy = bytes;
+	copy[offsetof(MeshCacheHeader, Version)] ^= 1;
+	if (!rejects(copy))
+		return fail("cache of another version accepted");
+	copy = bytes;
+	copy[bytes.size() / 2] ^= 0x10;
+	if (!rejects(copy))
+		return fail("corrupted cache accepted");
+	if (rejects(bytes))
+		return fail("intact copy rejected");
+
+	// Sources changing after the bake: a library that was missing appears, then the OBJ changes
+	writeText(extra, "newmtl extra\n");
+	if (cache.Open(path, kFlatLayout))
+		return fail("cache survived a new material library");
+	if (!WriteMeshCache(path, kFlatLayout, flat.Contents) || !cache.Open(path, kFlatLayout))
+		return fail("rebuilt cache rejected");
+	cache.Close();
+	writeText(obj, "mtllib model.mtl\nmtllib extra.mtl\nv 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 3\n");
+	if (cache.Open(path, kFlatLayout))
+		return fail("cache survived an edited OBJ");
+	std::filesystem::remove_all(dir, ec);
+	return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "../../Common/GeometryGenerator.h"
+#include "../../Common/MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Bumped whenever the file layout or what the importer produces changes; older files are rebuilt
+// (2: submeshes go through OptimizeMesh)
+constexpr uint32_t kMeshCacheVersion = 2;
+// Every section starts on this boundary in the file, so the mapped arrays are aligned for SIMD copies
+constexpr uint64_t kMeshCacheAlignment = 64;
+
+// What the cached buffers were built for: a file only serves the same flags and layout
+struct MeshCacheLayout
+{
+	uint32_t ImportFlags = 0;  // kModelImport*
+	uint32_t VertexStride = 0; // bytes per vertex
+	uint32_t IndexBytes = 0;   // 2 or 4
+};
+
+struct MeshCacheSubmesh
+{
+	std::string Material;
+	uint32_t IndexCount = 0;
+	uint32_t StartIndex = 0;   // within the cached index array
+	int32_t BaseVertex = 0;    // within the cached vertex array
+};
+
+// Everything BuildCustomMeshGeometry makes of one model, ready for the upload
+struct MeshCacheContents
+{
+	std::vector<std::string> Sources; // the OBJ and its MTL libraries; the key hashes their bytes
+	const void* Vertices = nullptr;
+	size_t VertexCount = 0;
+	const void* Indices = nullptr;
+	size_t IndexCount = 0;
+	std::vector<MeshCacheSubmesh> Submeshes;
+	std::vector<GeometryGenerator::Material> Materials;
+};
+
+// A baked model file: header, source table, vertices, indices, then the submesh and material tables,
+// each section padded to kMeshCacheAlignment. The key is a hash of the version, the layout and the
+// bytes of every source; a source that was missing at bake time is recorded as such, so it appearing
+// later also invalidates the file.
+class MeshCache
+{
+public:
+	// Maps the file and checks magic, version, layout, section bounds and the source hashes; false means
+	// it has to be rebuilt (absent, stale or damaged)
+	bool Open(const std::filesystem::path& path, const MeshCacheLayout& layout);
+	void Close();
+
+	// Straight into the mapping, valid until Close
+	const void* Vertices() const { return mVertices; }
+	size_t VertexCount() const { return mVertexCount; }
+	const void* Indices() const { return mIndices; }
+	size_t IndexCount() const { return mIndexCount; }
+	const std::vector<MeshCacheSubmesh>& Submeshes() const { return mSubmeshes; }
+	const std::vector<GeometryGenerator::Material>& Materials() const { return mMaterials; }
+
+private:
+	MappedFile mFile;
+	const void* mVertices = nullptr;
+	size_t mVertexCount = 0;
+	const void* mIndices = nullptr;
+	size_t mIndexCount = 0;
+	std::vector<MeshCacheSubmesh> mSubmeshes;
+	std::vector<GeometryGenerator::Material> mMaterials;
+};
+
+// Writes through a temporary file renamed into place, so a crash never leaves a half-written cache
+bool WriteMeshCache(const std::filesystem::path& path, const MeshCacheLayout& layout, const MeshCacheContents& contents);
+
+// 64-bit hash of a source file's bytes (read 8 at a time); the cache key combines these
+uint64_t HashMeshCacheSource(const void* data, size_t size);
+
+// Where BuildCustomMeshGeometry keeps the baked file of a model: MeshCache/<name>.meshcache
+std::filesystem::path MeshCachePath(const std::string& name);
+
+struct MeshCacheBenchmark
+{
+	size_t FileBytes = 0;      // of the cache file
+	double ImportMs = 0.0;     // ImportModel, OptimizeMesh and the conversion to the upload layout (cold start)
+	double WriteMs = 0.0;      // writing the cache after it
+	double LoadMs = 0.0;       // Open (mapping, key check) and copying the arrays out (warm start)
+};
+
+// Cold (import + write) against warm (Open + copy) for one OBJ, averaged over `repeats`, using a cache
+// file in the temp directory and GeometryGenerator::Vertex with 32-bit indices as the layout
+MeshCacheBenchmark BenchmarkMeshCache(const std::string& filename, int repeats);
+
+// CPU check on a synthetic model: the cache reads back what was written, its sections are aligned,
+// and a changed source, a source that appears, another layout, another version, a truncated or a
+// corrupted file are all rejected. Returns false with a reason on failure.
+bool ValidateMeshCache(std::string* error = nullptr);
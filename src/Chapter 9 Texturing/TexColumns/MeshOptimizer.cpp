@@ -0,0 +1,537 @@
+#include "MeshOptimizer.h"
+#include "../../Common/model.h"
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <ostream>
+#include <random>
+
+namespace
+{
+	// FIFO post-transform cache: a vertex is resident while fewer than Size others were loaded after it
+	class FifoCache
+	{
+	public:
+		FifoCache(size_t vertexCount, uint32_t size) : mStamps(vertexCount, 0), mSize(size), mTime(size + 1) {}
+
+		// Misses of one triangle
+		int Triangle(const uint32_t* corners)
+		{
+			int misses = 0;
+			for (int c = 0; c < 3; ++c)
+			{
+				uint32_t& stamp = mStamps[corners[c]];
+				if (mTime - stamp > mSize)
+				{
+					stamp = mTime++;
+					++misses;
+				}
+			}
+			return misses;
+		}
+		void Flush() { mTime += mSize + 1; }
+
+	private:
+		std::vector<uint32_t> mStamps;
+		uint32_t mSize;
+		uint32_t mTime;
+	};
+
+	struct Float3
+	{
+		double X = 0.0, Y = 0.0, Z = 0.0;
+	};
+
+	Float3 TriangleNormal(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b, const DirectX::XMFLOAT3& c)
+	{
+		const double e1[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+		const double e2[3] = { c.x - a.x, c.y - a.y, c.z - a.z };
+		Float3 n;
+		n.X = e1[1] * e2[2] - e1[2] * e2[1];
+		n.Y = e1[2] * e2[0] - e1[0] * e2[2];
+		n.Z = e1[0] * e2[1] - e1[1] * e2[0];
+		return n;
+	}
+
+	double MsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+	indexCount = triangleCount * 3;
+
+	// Triangles around each vertex, and how many of them are still to be emitted
+	std::vector<uint32_t> live(vertexCount, 0);
+	for (size_t i = 0; i < indexCount; ++i)
+		++live[indices[i]];
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] = offsets[v] + live[v];
+	std::vector<uint32_t> adjacency(indexCount);
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indexCount; ++i)
+			adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+	}
+
+	const uint32_t k = kMeshOptimizerCacheSize;
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> result;
+	deadEnd.reserve(indexCount);
+	result.reserve(indexCount);
+	uint32_t time = k + 1;
+	size_t cursor = 0;
+
+	// The most recent vertex with triangles left, else the next one in input order
+	auto skipDeadEnd = [&]() -> int64_t {
+		while (!deadEnd.empty())
+		{
+			const uint32_t v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0)
+				return v;
+		}
+		for (; cursor < vertexCount; ++cursor)
+			if (live[cursor] > 0)
+				return (int64_t)cursor;
+		return -1;
+	};
+
+	int64_t fanning = skipDeadEnd();
+	while (fanning >= 0)
+	{
+		candidates.clear();
+		for (uint32_t j = offsets[fanning]; j < offsets[fanning + 1]; ++j)
+		{
+			const uint32_t t = adjacency[j];
+			if (emitted[t])
+				continue;
+			emitted[t] = 1;
+			for (int c = 0; c < 3; ++c)
+			{
+				const uint32_t v = indices[t * 3 + c];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if (time - cacheTime[v] > k)
+					cacheTime[v] = time++;
+			}
+		}
+
+		// The candidate that will still be in the cache after its remaining fan, oldest first
+		int64_t best = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t v : candidates)
+		{
+			if (live[v] == 0)
+				continue;
+			int64_t priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= k)
+				priority = time - cacheTime[v];
+			if (priority > bestPriority)
+			{
+				best = v;
+				bestPriority = priority;
+			}
+		}
+		fanning = best >= 0 ? best : skipDeadEnd();
+	}
+	std::copy(result.begin(), result.end(), indices);
+}
+
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const GeometryGenerator::Vertex* vertices,
+	size_t vertexCount, float threshold)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+		return;
+
+	// Hard boundaries: the simulated cache misses every corner
+	std::vector<size_t> hard;
+	{
+		FifoCache cache(vertexCount, kMeshOptimizerCacheSize);
+		for (size_t t = 0; t < triangleCount; ++t)
+			if (cache.Triangle(indices + t * 3) == 3 || t == 0)
+				hard.push_back(t);
+	}
+	hard.push_back(triangleCount);
+
+	// Soft boundaries inside each: wherever the running ACMR from the last cut is back to the run's
+	std::vector<size_t> clusters;
+	FifoCache cache(vertexCount, kMeshOptimizerCacheSize);
+	for (size_t h = 0; h + 1 < hard.size(); ++h)
+	{
+		const size_t begin = hard[h], end = hard[h + 1];
+		cache.Flush();
+		size_t misses = 0;
+		for (size_t t = begin; t < end; ++t)
+			misses += cache.Triangle(indices + t * 3);
+		const double clusterThreshold = threshold * (double)misses / (double)(end - begin);
+
+		cache.Flush();
+		clusters.push_back(begin);
+		size_t runMisses = 0, runTriangles = 0;
+		for (size_t t = begin; t < end; ++t)
+		{
+			runMisses += cache.Triangle(indices + t * 3);
+			++runTriangles;
+			if (t + 1 < end && (double)runMisses <= clusterThreshold * (double)runTriangles)
+			{
+				clusters.push_back(t + 1);
+				cache.Flush();
+				runMisses = runTriangles = 0;
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+	const size_t clusterCount = clusters.size() - 1;
+
+	// Sort key: how far out the cluster sits along its own normal, from the mesh centre
+	Float3 meshCentre;
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		meshCentre.X += vertices[v].Position.x;
+		meshCentre.Y += vertices[v].Position.y;
+		meshCentre.Z += vertices[v].Position.z;
+	}
+	if (vertexCount > 0)
+	{
+		meshCentre.X /= vertexCount;
+		meshCentre.Y /= vertexCount;
+		meshCentre.Z /= vertexCount;
+	}
+	std::vector<double> keys(clusterCount, 0.0);
+	for (size_t c = 0; c < clusterCount; ++c)
+	{
+		Float3 normal, centre;
+		double area = 0.0;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; ++t)
+		{
+			const DirectX::XMFLOAT3& a = vertices[indices[t * 3]].Position;
+			const DirectX::XMFLOAT3& b = vertices[indices[t * 3 + 1]].Position;
+			const DirectX::XMFLOAT3& d = vertices[indices[t * 3 + 2]].Position;
+			const Float3 n = TriangleNormal(a, b, d);
+			const double triangleArea = std::sqrt(n.X * n.X + n.Y * n.Y + n.Z * n.Z);
+			normal.X += n.X;
+			normal.Y += n.Y;
+			normal.Z += n.Z;
+			centre.X += (a.x + b.x + d.x) / 3.0 * triangleArea;
+			centre.Y += (a.y + b.y + d.y) / 3.0 * triangleArea;
+			centre.Z += (a.z + b.z + d.z) / 3.0 * triangleArea;
+			area += triangleArea;
+		}
+		const double length = std::sqrt(normal.X * normal.X + normal.Y * normal.Y + normal.Z * normal.Z);
+		if (area > 0.0 && length > 0.0)
+			keys[c] = ((centre.X / area - meshCentre.X) * normal.X + (centre.Y / area - meshCentre.Y) * normal.Y +
+				(centre.Z / area - meshCentre.Z) * normal.Z) / length;
+	}
+
+	std::vector<uint32_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c)
+		order[c] = (uint32_t)c;
+	std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(triangleCount * 3);
+	for (uint32_t c : order)
+		result.insert(result.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+	std::copy(result.begin(), result.end(), indices);
+}
+
+void OptimizeVertexFetch(GeometryGenerator::MeshData& mesh)
+{
+	std::vector<uint32_t> remap(mesh.Vertices.size(), std::numeric_limits<uint32_t>::max());
+	std::vector<GeometryGenerator::Vertex> vertices;
+	vertices.reserve(mesh.Vertices.size());
+	for (uint32_t& index : mesh.Indices32)
+	{
+		if (remap[index] == std::numeric_limits<uint32_t>::max())
+		{
+			remap[index] = (uint32_t)vertices.size();
+			vertices.push_back(mesh.Vertices[index]);
+		}
+		index = remap[index];
+	}
+	mesh.Vertices.swap(vertices);
+}
+
+void OptimizeMesh(GeometryGenerator::MeshData& mesh)
+{
+	OptimizeVertexCache(mesh.Indices32.data(), mesh.Indices32.size(), mesh.Vertices.size());
+	OptimizeOverdraw(mesh.Indices32.data(), mesh.Indices32.size(), mesh.Vertices.data(), mesh.Vertices.size());
+	OptimizeVertexFetch(mesh);
+}
+
+MeshOptimizerStats AnalyzeMesh(const GeometryGenerator::MeshData& mesh)
+{
+	MeshOptimizerStats stats;
+	const size_t triangleCount = mesh.Indices32.size() / 3;
+	if (triangleCount == 0 || mesh.Vertices.empty())
+		return stats;
+
+	FifoCache cache(mesh.Vertices.size(), kMeshOptimizerCacheSize);
+	size_t misses = 0;
+	for (size_t t = 0; t < triangleCount; ++t)
+		misses += cache.Triangle(&mesh.Indices32[t * 3]);
+	stats.ACMR = (double)misses / triangleCount;
+	stats.ATVR = (double)misses / mesh.Vertices.size();
+
+	// Orthographic views down each axis both ways, the mesh's bounding box scaled to fit the viewport
+	float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (const GeometryGenerator::Vertex& v : mesh.Vertices)
+	{
+		const float p[3] = { v.Position.x, v.Position.y, v.Position.z };
+		for (int a = 0; a < 3; ++a)
+		{
+			lo[a] = std::min(lo[a], p[a]);
+			hi[a] = std::max(hi[a], p[a]);
+		}
+	}
+	const float extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+	if (!(extent > 0.f))
+		return stats;
+	const float scale = kMeshOverdrawViewport / extent;
+	const int size = kMeshOverdrawViewport;
+	std::vector<float> depth((size_t)size * size);
+	size_t shaded = 0, covered = 0;
+	for (int axis = 0; axis < 3; ++axis)
+		for (int direction = -1; direction <= 1; direction += 2)
+		{
+			const int u = (axis + 1) % 3, w = (axis + 2) % 3;
+			std::fill(depth.begin(), depth.end(), FLT_MAX);
+			for (size_t t = 0; t < triangleCount; ++t)
+			{
+				const DirectX::XMFLOAT3* p[3];
+				for (int c = 0; c < 3; ++c)
+					p[c] = &mesh.Vertices[mesh.Indices32[t * 3 + c]].Position;
+				// Front-facing when the normal points back at the viewer, who looks along direction * axis
+				const Float3 n = TriangleNormal(*p[0], *p[1], *p[2]);
+				const double facing[3] = { n.X, n.Y, n.Z };
+				if (facing[axis] * direction >= 0.0)
+					continue;
+
+				float x[3], y[3], z[3];
+				for (int c = 0; c < 3; ++c)
+				{
+					const float q[3] = { p[c]->x, p[c]->y, p[c]->z };
+					x[c] = (q[u] - lo[u]) * scale;
+					y[c] = (q[w] - lo[w]) * scale;
+					z[c] = q[axis] * direction;
+				}
+				float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+				if (area == 0.f)
+					continue;
+				if (area < 0.f)
+				{
+					std::swap(x[1], x[2]);
+					std::swap(y[1], y[2]);
+					std::swap(z[1], z[2]);
+					area = -area;
+				}
+				const int x0 = std::max(0, (int)std::floor(std::min(x[0], std::min(x[1], x[2]))));
+				const int x1 = std::min(size - 1, (int)std::ceil(std::max(x[0], std::max(x[1], x[2]))));
+				const int y0 = std::max(0, (int)std::floor(std::min(y[0], std::min(y[1], y[2]))));
+				const int y1 = std::min(size - 1, (int)std::ceil(std::max(y[0], std::max(y[1], y[2]))));
+				for (int py = y0; py <= y1; ++py)
+					for (int px = x0; px <= x1; ++px)
+					{
+						const float cx = px + 0.5f, cy = py + 0.5f;
+						float weights[3];
+						bool inside = true;
+						for (int e = 0; e < 3 && inside; ++e)
+						{
+							// Edge from corner e+1 to e+2, weighting corner e; top-left rule on exact hits
+							const int a = (e + 1) % 3, b = (e + 2) % 3;
+							const float dx = x[b] - x[a], dy = y[b] - y[a];
+							weights[e] = dx * (cy - y[a]) - dy * (cx - x[a]);
+							inside = weights[e] > 0.f || (weights[e] == 0.f && (dy < 0.f || (dy == 0.f && dx > 0.f)));
+						}
+						if (!inside)
+							continue;
+						const float fragment = (weights[0] * z[0] + weights[1] * z[1] + weights[2] * z[2]) / area;
+						float& stored = depth[(size_t)py * size + px];
+						if (fragment < stored)
+						{
+							stored = fragment;
+							++shaded;
+						}
+					}
+			}
+			for (float d : depth)
+				covered += d != FLT_MAX;
+		}
+	stats.Overdraw = covered ? (double)shaded / covered : 0.0;
+	return stats;
+}
+
+std::vector<MeshOptimizerReport> ReportMeshOptimizer(const std::string& filename)
+{
+	std::vector<MeshOptimizerReport> reports;
+	ModelImport import;
+	if (!ImportModel(filename, kModelImportDefault, import))
+		return reports;
+	for (GeometryGenerator::MeshData& mesh : import.Meshes)
+	{
+		MeshOptimizerReport report;
+		report.Material = mesh.matName;
+		report.Triangles = mesh.Indices32.size() / 3;
+		report.Vertices = mesh.Vertices.size();
+		report.Before = AnalyzeMesh(mesh);
+		const auto start = std::chrono::steady_clock::now();
+		OptimizeMesh(mesh);
+		report.OptimizeMs = MsSince(start);
+		report.After = AnalyzeMesh(mesh);
+		reports.push_back(report);
+	}
+	return reports;
+}
+
+void PrintMeshOptimizerReport(std::ostream& out, const std::string& name, const std::vector<MeshOptimizerReport>& reports)
+{
+	char line[512];
+	if (reports.empty())
+	{
+		out << name << ": could not be imported\n";
+		return;
+	}
+	MeshOptimizerReport total;
+	for (const MeshOptimizerReport& r : reports)
+	{
+		std::snprintf(line, sizeof(line),
+			"%s / %s: %zu triangles, %zu vertices | ACMR %.3f -> %.3f | ATVR %.3f -> %.3f | overdraw %.3f -> %.3f | %.2f ms\n",
+			name.c_str(), r.Material.c_str(), r.Triangles, r.Vertices, r.Before.ACMR, r.After.ACMR, r.Before.ATVR,
+			r.After.ATVR, r.Before.Overdraw, r.After.Overdraw, r.OptimizeMs);
+		out << line;
+		total.Triangles += r.Triangles;
+		total.Vertices += r.Vertices;
+		total.OptimizeMs += r.OptimizeMs;
+	}
+	// Misses add up over submeshes, so the totals are weighted by triangles (ACMR) and vertices (ATVR)
+	for (const MeshOptimizerReport& r : reports)
+	{
+		total.Before.ACMR += r.Before.ACMR * r.Triangles / total.Triangles;
+		total.After.ACMR += r.After.ACMR * r.Triangles / total.Triangles;
+		total.Before.ATVR += r.Before.ATVR * r.Vertices / total.Vertices;
+		total.After.ATVR += r.After.ATVR * r.Vertices / total.Vertices;
+		total.Before.Overdraw += r.Before.Overdraw * r.Triangles / total.Triangles;
+		total.After.Overdraw += r.After.Overdraw * r.Triangles / total.Triangles;
+	}
+	std::snprintf(line, sizeof(line),
+		"%s total: %zu submeshes, %zu triangles | ACMR %.3f -> %.3f | ATVR %.3f -> %.3f | overdraw %.3f -> %.3f | %.2f ms\n",
+		name.c_str(), reports.size(), total.Triangles, total.Before.ACMR, total.After.ACMR, total.Before.ATVR,
+		total.After.ATVR, total.Before.Overdraw, total.After.Overdraw, total.OptimizeMs);
+	out << line;
+}
+
+namespace
+{
+	// Triangles as sorted lists of corner positions, each rotated to start at its smallest corner, so
+	// two index orders compare equal when they draw the same triangles with the same winding
+	std::vector<std::vector<float>> CanonicalTriangles(const GeometryGenerator::MeshData& mesh)
+	{
+		std::vector<std::vector<float>> triangles;
+		for (size_t t = 0; t + 2 < mesh.Indices32.size(); t += 3)
+		{
+			std::vector<float> corners[3];
+			for (int c = 0; c < 3; ++c)
+			{
+				const GeometryGenerator::Vertex& v = mesh.Vertices[mesh.Indices32[t + c]];
+				corners[c] = { v.Position.x, v.Position.y, v.Position.z, v.TexC.x, v.TexC.y };
+			}
+			const int first = (int)(std::min_element(corners, corners + 3) - corners);
+			std::vector<float> triangle;
+			for (int c = 0; c < 3; ++c)
+				triangle.insert(triangle.end(), corners[(first + c) % 3].begin(), corners[(first + c) % 3].end());
+			triangles.push_back(triangle);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	void ShuffleTriangles(GeometryGenerator::MeshData& mesh, uint32_t seed)
+	{
+		std::vector<uint32_t> order(mesh.Indices32.size() / 3);
+		for (size_t t = 0; t < order.size(); ++t)
+			order[t] = (uint32_t)t;
+		std::mt19937 random(seed);
+		std::shuffle(order.begin(), order.end(), random);
+		std::vector<uint32_t> indices;
+		for (uint32_t t : order)
+			indices.insert(indices.end(), mesh.Indices32.begin() + t * 3, mesh.Indices32.begin() + t * 3 + 3);
+		mesh.Indices32.swap(indices);
+	}
+
+	bool Fail(std::string* error, const std::string& reason)
+	{
+		if (error) *error = reason;
+		return false;
+	}
+}
+
+bool ValidateMeshOptimizer(std::string* error)
+{
+	GeometryGenerator generator;
+
+	// A quad seen from both sides of one axis and covering part of the other two views edge-on
+	GeometryGenerator::MeshData quad = generator.CreateGrid(2.f, 2.f, 2, 2);
+	MeshOptimizerStats stats = AnalyzeMesh(quad);
+	if (std::fabs(stats.ACMR - 2.0) > 1e-9 || std::fabs(stats.ATVR - 1.0) > 1e-9 || std::fabs(stats.Overdraw - 1.0) > 1e-9)
+		return Fail(error, "a single quad analyzed wrongly");
+
+	// A grid in shuffled order: every vertex misses in the cache again and again
+	GeometryGenerator::MeshData grid = generator.CreateGrid(10.f, 10.f, 41, 41);
+	ShuffleTriangles(grid, 7);
+	const std::vector<std::vector<float>> gridTriangles = CanonicalTriangles(grid);
+	const MeshOptimizerStats gridBefore = AnalyzeMesh(grid);
+	OptimizeMesh(grid);
+	const MeshOptimizerStats gridAfter = AnalyzeMesh(grid);
+	if (CanonicalTriangles(grid) != gridTriangles)
+		return Fail(error, "the grid's triangles or winding changed");
+	if (!(gridBefore.ACMR > 2.0) || !(gridAfter.ACMR < 0.85))
+		return Fail(error, "grid ACMR " + std::to_string(gridBefore.ACMR) + " -> " + std::to_string(gridAfter.ACMR));
+	uint32_t next = 0;
+	for (uint32_t index : grid.Indices32)
+	{
+		if (index > next)
+			return Fail(error, "vertices not in first-use order");
+		next = std::max(next, index + 1);
+	}
+	if (next != grid.Vertices.size())
+		return Fail(error, "unused vertices kept");
+
+	// A convex mesh covers every pixel once from outside
+	GeometryGenerator::MeshData outer = generator.CreateGeosphere(1.f, 3);
+	if (std::fabs(AnalyzeMesh(outer).Overdraw - 1.0) > 1e-9)
+		return Fail(error, "a convex mesh has overdraw");
+
+	// The outer sphere drawn after the inner one shades both wherever they overlap
+	GeometryGenerator::MeshData inner = generator.CreateGeosphere(0.6f, 3);
+	GeometryGenerator::MeshData nested = inner;
+	const uint32_t base = (uint32_t)nested.Vertices.size();
+	nested.Vertices.insert(nested.Vertices.end(), outer.Vertices.begin(), outer.Vertices.end());
+	for (uint32_t index : outer.Indices32)
+		nested.Indices32.push_back(base + index);
+	const MeshOptimizerStats nestedBefore = AnalyzeMesh(nested);
+	const std::vector<std::vector<float>> nestedTriangles = CanonicalTriangles(nested);
+	OptimizeMesh(nested);
+	const MeshOptimizerStats nestedAfter = AnalyzeMesh(nested);
+	if (CanonicalTriangles(nested) != nestedTriangles)
+		return Fail(error, "the nested spheres' triangles or winding changed");
+	if (!(nestedBefore.Overdraw > 1.3) || !(nestedAfter.Overdraw < nestedBefore.Overdraw - 0.2))
+		return Fail(error, "nested overdraw " + std::to_string(nestedBefore.Overdraw) + " -> " +
+			std::to_string(nestedAfter.Overdraw));
+	return true;
+}
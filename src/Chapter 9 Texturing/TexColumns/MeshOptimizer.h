@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../../Common/GeometryGenerator.h"
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Post-transform vertex cache the optimizer targets and the analysis simulates (FIFO, as Tipsify assumes)
+constexpr uint32_t kMeshOptimizerCacheSize = 16;
+// A cluster may end once its running ACMR is within this factor of its whole run's (Sander et al.'s lambda)
+constexpr float kMeshOptimizerOverdrawThreshold = 1.05f;
+// Side of the square buffers the overdraw estimate rasterizes into
+constexpr int kMeshOverdrawViewport = 256;
+
+// Tipsify (Sander, Nehab and Barczak 2007): fans around the vertex that stays in the cache longest,
+// and on a dead end restarts from the most recently used vertex with triangles left. Linear time; the
+// triangles keep their corner order, so the winding does not change.
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+// Cuts a cache-optimized index order into clusters (where the simulated cache runs dry, and within those
+// wherever the running ACMR is back within `threshold` of the run's), then draws clusters facing away from
+// the mesh centre first, so outer surfaces occlude the inner ones more often. Clusters keep their order
+// inside, so the ACMR only rises by about `threshold`.
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const GeometryGenerator::Vertex* vertices,
+	size_t vertexCount, float threshold = kMeshOptimizerOverdrawThreshold);
+
+// Renumbers the vertices in the order the indices first use them (dropping unused ones), so the vertex
+// fetch reads the buffer front to back
+void OptimizeVertexFetch(GeometryGenerator::MeshData& mesh);
+
+// All three, in that order, on one submesh
+void OptimizeMesh(GeometryGenerator::MeshData& mesh);
+
+struct MeshOptimizerStats
+{
+	double ACMR = 0.0;     // cache misses per triangle (0.5 is the limit for a regular grid, 3 the worst)
+	double ATVR = 0.0;     // cache misses per vertex (1 is ideal)
+	double Overdraw = 0.0; // fragments passing the depth test per covered pixel, over six axis views
+};
+
+// FIFO cache of kMeshOptimizerCacheSize, and back-face culled orthographic views down +-X, +-Y and +-Z
+MeshOptimizerStats AnalyzeMesh(const GeometryGenerator::MeshData& mesh);
+
+struct MeshOptimizerReport
+{
+	std::string Material;
+	size_t Triangles = 0;
+	size_t Vertices = 0;
+	MeshOptimizerStats Before; // as imported
+	MeshOptimizerStats After;  // after OptimizeMesh
+	double OptimizeMs = 0.0;
+};
+
+// Imports the OBJ as BuildCustomMeshGeometry does and measures each submesh before and after
+// OptimizeMesh; empty if it cannot be read
+std::vector<MeshOptimizerReport> ReportMeshOptimizer(const std::string& filename);
+
+// One line per submesh and a triangle-weighted total
+void PrintMeshOptimizerReport(std::ostream& out, const std::string& name, const std::vector<MeshOptimizerReport>& reports);
+
+// CPU check on a shuffled grid and on two nested spheres: the same triangles with the same winding come
+// out, the ACMR drops to near the grid's optimum, the vertex fetch is in first-use order, drawing the
+// outer sphere first cuts the overdraw, and the analysis gives the known values of a quad and a convex
+// mesh. Returns false with a reason on failure.
+bool ValidateMeshOptimizer(std::string* error = nullptr);
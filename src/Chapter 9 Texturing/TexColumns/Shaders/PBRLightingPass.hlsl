@@ -390,7 +390,8 @@ float4 PS(VSOut pin) : SV_TARGET
     // Read GBuffer
     float4 albedoRough = gAlbedoMap.Load(int3(pix, 0)); // rgb=baseColor, a=roughness
     float4 normalMet = gNormalMap.Load(int3(pix, 0));   // xyz=normal, a=metallic
-    float3 posW = gPositionMap.Load(int3(pix, 0)).xyz;
+    float4 positionSample = gPositionMap.Load(int3(pix, 0)); // xyz = world position, w = sun visibility (terrain horizon)
+    float3 posW = positionSample.xyz;
 
     float3 normalRaw = normalMet.xyz;
     bool hasGeom = dot(normalRaw, normalRaw) > 1e-8f;
@@ -516,7 +517,7 @@ float4 PS(VSOut pin) : SV_TARGET
     else if (light.type == 2)
     {
         L = normalize(-light.Direction);
-        radiance = light.Color * light.Strength * shadowFactor;
+        radiance = light.Color * light.Strength * shadowFactor * saturate(positionSample.w);
     }
     else if (light.type == 3)
     {
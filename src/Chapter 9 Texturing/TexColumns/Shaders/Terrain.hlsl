@@ -1,17 +1,95 @@
 // Terrain: vertex displacement from heightmap, same GBuffer output as GeometryPass
 #include "LightingUtil.hlsl"
-Texture2D gHeightMap : register(t0);
+// All heightmaps and baked normal maps of the SRV heap; each instance picks its own
+Texture2D gHeightMaps[] : register(t0, space1);
 Texture2D gDiffuseMap : register(t1);
 
 SamplerState gsamLinearClamp : register(s3);
 
-cbuffer cbPerObject : register(b0)
+// One visible tile (TerrainInstance in TerrainInstances.h)
+struct TerrainInstance
 {
-    float4x4 gWorld;
-    float4x4 gInvWorld;
-    float4x4 gTexTransform;
-    float4x4 gPrevWorld;
+    float4x4 World;
+    float4x4 PrevWorld;
+    float4 HeightmapUV; // xy = scale, zw = offset into the tile's heightmap (ancestor sub-rectangle for deep LODs)
+    float MorphFactor;
+    uint HeightmapIndex;
+    uint LOD;
+    uint NeighborMask;
+    uint NormalMapIndex; // kNoNormalMap = derive normals from the heightmap in the VS
 };
+static const uint kNoNormalMap = 0xffffffffu;
+StructuredBuffer<TerrainInstance> gTerrainInstances : register(t2);
+
+// Horizon map (TerrainHorizon.h): slopes of the 8 azimuths, slice 0 = directions 0-3, slice 1 = 4-7
+Texture2DArray gHorizonMap : register(t4);
+
+// Virtual texture (TerrainVirtualTexture.h): page table with one mip per page mip, the atlas of
+// resident pages, and the feedback texels the CPU reads back to decide which pages to compose
+Texture2D<uint> gVTPageTable : register(t5);
+Texture2D gVTAtlas : register(t6);
+RWTexture2D<uint> gVTFeedback : register(u0);
+static const uint kVTPageValid = 0x80000000u;
+
+// Clipmap mode: level L's heights, sample (x, z) of its lattice at texel (x, z) mod (gClipQuads + 1)
+Texture2DArray<float> gClipmap : register(t3);
+
+// Root constants (TerrainDrawConstants in TexColumnsApp.cpp)
+cbuffer cbTerrainDraw : register(b0)
+{
+    uint gInstanceBase;   // quadtree: tiles are drawn per stitch variant, this is the draw's first instance
+    uint gClipLevel;      // clipmap: ring drawn, its window origin in lattice samples and sample spacing
+    int2 gClipOrigin;
+    float gClipSpacing;
+    int gClipQuads;
+    float gClipHeightScale;
+    float gClipOriginY;
+};
+
+// Pixel root constants (TerrainShadeConstants in TexColumnsApp.cpp)
+cbuffer cbTerrainShade : register(b3)
+{
+    float3 gToSun;          // towards the first directional light
+    float gHorizonScale;    // heightScale / worldSizeXZ; 0 = no horizon shadows
+    float gInvWorldSize;    // world XZ -> heightfield UV
+    float gHorizonSoftness; // sun elevation band (radians) over which it fades behind the horizon
+    float gNormalScale;     // (heightScale / worldSizeXZ) / kTerrainNormalReferenceScale
+    float _padShade;
+};
+
+// Pixel root constants (TerrainVTConstants in TexColumnsApp.cpp)
+cbuffer cbTerrainVT : register(b4)
+{
+    uint gVTPagesPerSide;        // at mip 0
+    uint gVTPageSize;            // texels without the border
+    uint gVTPageBorder;
+    uint gVTPhysicalPagesPerSide;
+    uint gVTMipCount;
+    uint gVTFeedbackTag;
+    uint gVTFeedbackOffset;      // the pixel of each 8x8 block that writes feedback this frame
+    uint gVTEnabled;
+};
+
+float SampleHeight(uint heightmapIndex, float2 uv)
+{
+    return gHeightMaps[NonUniformResourceIndex(heightmapIndex)].SampleLevel(gsamLinearClamp, uv, 0).r;
+}
+
+// Quads per side of the tile grid (kTerrainGridResolution in TerrainGrid.h)
+static const float kTerrainGridDim = 64.0f;
+
+// Geomorph: collapse odd grid vertices onto their even neighbour as morph -> 1, so the tile
+// matches its parent LOD's half-resolution grid by the time the quadtree switches to it.
+// Border vertices never morph: same-LOD neighbours may have different morph factors, and a
+// coarser neighbour is handled by the stitched index buffer instead.
+float2 MorphGridUV(float2 uv, float morph)
+{
+    float2 edgeDist = min(uv, 1.0f - uv);
+    if (min(edgeDist.x, edgeDist.y) < 0.5f / kTerrainGridDim)
+        morph = 0.0f;
+    float2 fracPart = frac(uv * kTerrainGridDim * 0.5f) * 2.0f / kTerrainGridDim;
+    return uv - fracPart * morph;
+}
 
 // Must match PassConstants layout exactly (View, InvView, Proj, InvProj, ViewProj, InvViewProj, EyePosW, ...)
 cbuffer cbPass : register(b1)
@@ -40,7 +118,7 @@ cbuffer cbPass : register(b1)
     Light gLights[MaxLights];
 };
 
-// gHeightScale = Y scale from gWorld (World matrix has scale (sx, heightScale, sz))
+// heightScale = Y scale from the instance's World (World matrix has scale (sx, heightScale, sz))
 struct VertexIn
 {
     float3 PosL : POSITION;
@@ -58,36 +136,117 @@ struct VertexOut
     float3 Tan : TANGENT;
     float4 CurrClip : TEXCOORD1;
     float4 PrevClip : TEXCOORD2;
+    float2 NormalUV : TEXCOORD3;
+    nointerpolation uint NormalMapIndex : NORMALMAP;
 };
 
-VertexOut VS(VertexIn vin)
+// Displaced local position of a tile vertex, shared by the camera and shadow passes
+float3 TileVertexPosL(TerrainInstance inst, VertexIn vin, out float2 gridUV, out float2 uv)
+{
+    // Grid local XZ = (u, 1 - v)
+    gridUV = MorphGridUV(vin.TexC, inst.MorphFactor);
+    // HeightmapUV maps the tile's [0,1] UV onto its heightmap
+    uv = gridUV * inst.HeightmapUV.xy + inst.HeightmapUV.zw;
+    float h = SampleHeight(inst.HeightmapIndex, uv);
+    // World scales local Y by heightScale, so the raw heightmap value is the local height;
+    // PosL.y is 0 except on adaptive meshes' skirts, which hang below the tile edge
+    return float3(gridUV.x, h + vin.PosL.y, 1.f - gridUV.y);
+}
+
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
     VertexOut vout;
-    float gHeightScale = gWorld._22; // Y scale from world matrix
-    float h = gHeightMap.SampleLevel(gsamLinearClamp, vin.TexC, 0).r;
-    float3 posL = float3(vin.PosL.x, h * gHeightScale, vin.PosL.z);
-    float4 posW = mul(float4(posL, 1.f), gWorld);
+    TerrainInstance inst = gTerrainInstances[gInstanceBase + instanceID];
+    float heightScale = inst.World._22; // Y scale from world matrix
+    float2 gridUV, uv;
+    float3 posL = TileVertexPosL(inst, vin, gridUV, uv);
+    float4 posW = mul(float4(posL, 1.f), inst.World);
     vout.PosW = posW.xyz;
     vout.PosH = mul(posW, gViewProj);
 
-    float2 uv = vin.TexC;
-    float2 du = float2(1.f / 512.f, 0.f);
-    float2 dv = float2(0.f, 1.f / 512.f);
-    float hL = gHeightMap.SampleLevel(gsamLinearClamp, uv - du, 0).r;
-    float hR = gHeightMap.SampleLevel(gsamLinearClamp, uv + du, 0).r;
-    float hD = gHeightMap.SampleLevel(gsamLinearClamp, uv - dv, 0).r;
-    float hU = gHeightMap.SampleLevel(gsamLinearClamp, uv + dv, 0).r;
-    float3 nL = normalize(float3(-(hR - hL) * gHeightScale, 2.f, -(hU - hD) * gHeightScale));
-    vout.NormalW = mul(nL, (float3x3)gWorld);
-    vout.Tan = mul(float3(1, 0, 0), (float3x3)gWorld);
-
-    vout.TexC = mul(float4(vin.TexC, 0, 1), gTexTransform).xy;
+    // Tiles with a baked normal map shade per pixel from it (same UV as the heightmap)
+    vout.NormalUV = uv;
+    vout.NormalMapIndex = inst.NormalMapIndex;
+    vout.NormalW = float3(0.f, 1.f, 0.f);
+    if (inst.NormalMapIndex == kNoNormalMap)
+    {
+        float2 du = float2(1.f / 512.f, 0.f);
+        float2 dv = float2(0.f, 1.f / 512.f);
+        float hL = SampleHeight(inst.HeightmapIndex, uv - du);
+        float hR = SampleHeight(inst.HeightmapIndex, uv + du);
+        float hD = SampleHeight(inst.HeightmapIndex, uv - dv);
+        float hU = SampleHeight(inst.HeightmapIndex, uv + dv);
+        float3 nL = normalize(float3(-(hR - hL) * heightScale, 2.f, -(hU - hD) * heightScale));
+        vout.NormalW = mul(nL, (float3x3)inst.World);
+    }
+    vout.Tan = mul(float3(1, 0, 0), (float3x3)inst.World);
+
+    vout.TexC = gridUV;
     vout.CurrClip = mul(posW, gViewProjNoJitter);
-    float4 prevW = mul(float4(posL, 1.f), gPrevWorld);
+    float4 prevW = mul(float4(posL, 1.f), inst.PrevWorld);
     vout.PrevClip = mul(prevW, gPrevViewProjNoJitter);
     return vout;
 }
 
+// Shadow pass: the light's PassShadowConstants (FrameResource.h)
+cbuffer cbTerrainShadow : register(b5)
+{
+    float4x4 gLightViewProj;
+};
+
+// Depth only, for a light's own tile set (Terrain::UpdateViews); same surface as VS
+float4 ShadowVS(VertexIn vin, uint instanceID : SV_InstanceID) : SV_POSITION
+{
+    TerrainInstance inst = gTerrainInstances[gInstanceBase + instanceID];
+    float2 gridUV, uv;
+    float3 posL = TileVertexPosL(inst, vin, gridUV, uv);
+    return mul(mul(float4(posL, 1.f), inst.World), gLightViewProj);
+}
+
+float ClipmapHeight(int2 ij)
+{
+    int size = gClipQuads + 1;
+    int2 s = gClipOrigin + clamp(ij, 0, gClipQuads);
+    int2 t = ((s % size) + size) % size;
+    return gClipmap.Load(int4(t, gClipLevel, 0));
+}
+
+// Clipmap ring vertex: PosL.xz = grid vertex (i, j) of the level's window
+VertexOut ClipmapVS(VertexIn vin)
+{
+    VertexOut vout;
+    int2 ij = int2(round(vin.PosL.xz));
+    float h = ClipmapHeight(ij);
+    // Odd vertices on the window edge take the mean of their even neighbours, so the edge matches
+    // the coarser ring's half-resolution edge (windows start at even samples, so parity is local)
+    bool edgeX = ij.x == 0 || ij.x == gClipQuads;
+    bool edgeZ = ij.y == 0 || ij.y == gClipQuads;
+    if (edgeX && (ij.y & 1))
+        h = 0.5f * (ClipmapHeight(ij - int2(0, 1)) + ClipmapHeight(ij + int2(0, 1)));
+    else if (edgeZ && (ij.x & 1))
+        h = 0.5f * (ClipmapHeight(ij - int2(1, 0)) + ClipmapHeight(ij + int2(1, 0)));
+
+    float2 sampleXZ = float2(gClipOrigin + ij);
+    float4 posW = float4(sampleXZ.x * gClipSpacing, gClipOriginY + h * gClipHeightScale, sampleXZ.y * gClipSpacing, 1.f);
+    vout.PosW = posW.xyz;
+    vout.PosH = mul(posW, gViewProj);
+
+    float hL = ClipmapHeight(ij - int2(1, 0));
+    float hR = ClipmapHeight(ij + int2(1, 0));
+    float hD = ClipmapHeight(ij - int2(0, 1));
+    float hU = ClipmapHeight(ij + int2(0, 1));
+    vout.NormalW = normalize(float3(-(hR - hL) * gClipHeightScale, 2.f * gClipSpacing, -(hU - hD) * gClipHeightScale));
+    vout.Tan = float3(1, 0, 0);
+    vout.NormalUV = float2(0.f, 0.f);
+    vout.NormalMapIndex = kNoNormalMap;
+
+    // One diffuse UV unit per finest quadtree tile
+    vout.TexC = sampleXZ * exp2((float)gClipLevel) / kTerrainGridDim;
+    vout.CurrClip = mul(posW, gViewProjNoJitter);
+    vout.PrevClip = mul(posW, gPrevViewProjNoJitter);
+    return vout;
+}
+
 // Same PS output as GeometryPass for GBuffer
 struct PSOutput
 {
@@ -108,14 +267,77 @@ cbuffer cbMaterial : register(b2)
     float4x4 gMatTransform;
 };
 
+// Fraction of the sun above the baked horizon: interpolate the stored angles of the two azimuths
+// around the sun's, decode tan(stored * pi/2) as a slope per UV unit and scale it to world units
+float HorizonVisibility(float3 posW)
+{
+    if (gHorizonScale <= 0.f)
+        return 1.f;
+    float2 uv = float2(posW.x * gInvWorldSize + 0.5f, 0.5f - posW.z * gInvWorldSize);
+    float4 h0 = gHorizonMap.SampleLevel(gsamLinearClamp, float3(uv, 0.f), 0);
+    float4 h1 = gHorizonMap.SampleLevel(gsamLinearClamp, float3(uv, 1.f), 0);
+    float horizon[8] = { h0.x, h0.y, h0.z, h0.w, h1.x, h1.y, h1.z, h1.w };
+    float f = frac(atan2(gToSun.z, gToSun.x) / 6.28318531f) * 8.f;
+    uint k0 = (uint)f & 7u;
+    float stored = lerp(horizon[k0], horizon[(k0 + 1u) & 7u], frac(f));
+    float horizonElevation = atan(tan(min(stored, 0.999f) * 1.57079633f) * gHorizonScale);
+    float sunElevation = atan2(gToSun.y, length(gToSun.xz));
+    return smoothstep(-gHorizonSoftness, gHorizonSoftness, sunElevation - horizonElevation);
+}
+
+// Baked normal (TerrainNormals.h): x and z are stored for the reference steepness, so rebuild y
+// and rescale x, z to this terrain's height scale and size. Already in world space.
+float3 BakedNormal(uint normalMapIndex, float2 uv)
+{
+    float2 xz = gHeightMaps[NonUniformResourceIndex(normalMapIndex)].Sample(gsamLinearClamp, uv).rg;
+    float y = sqrt(saturate(1.f - dot(xz, xz)));
+    return normalize(float3(xz.x * gNormalScale, y, xz.y * gNormalScale));
+}
+
+// Surface colour from the virtual texture at terrain UV uv: pick the page mip from the UV
+// derivatives, report it in the feedback (one pixel per 8x8 block), and sample whatever the page
+// table resolves it to - the page itself or its nearest resident ancestor
+float4 SampleVirtualTexture(float2 uv, uint2 pixel)
+{
+    float2 texel = uv * (float)(gVTPagesPerSide * gVTPageSize);
+    float2 dx = ddx(texel), dy = ddy(texel);
+    float lod = 0.5f * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8f));
+    uint mip = (uint)clamp(floor(lod + 0.5f), 0.f, (float)(gVTMipCount - 1u));
+    uv = saturate(uv);
+    uint pages = gVTPagesPerSide >> mip;
+    uint2 page = min((uint2)(uv * pages), pages - 1u);
+    if (all((pixel & 7u) == uint2(gVTFeedbackOffset & 7u, gVTFeedbackOffset >> 3)))
+        gVTFeedback[pixel >> 3] = page.x | (page.y << 10) | (mip << 20) | (gVTFeedbackTag << 24);
+
+    uint entry = gVTPageTable.Load(int3(page, mip));
+    if ((entry & kVTPageValid) == 0u)
+        return float4(0.5f, 0.5f, 0.5f, 1.f); // nothing resident yet
+    uint residentMip = (entry >> 16) & 15u;
+    float residentPages = (float)(gVTPagesPerSide >> residentMip);
+    float2 inPage = uv * residentPages - min(floor(uv * residentPages), residentPages - 1.f);
+    float physicalSize = (float)(gVTPageSize + 2u * gVTPageBorder);
+    float2 slot = float2(entry & 0xffu, (entry >> 8) & 0xffu);
+    float2 atlasTexel = slot * physicalSize + gVTPageBorder + inPage * gVTPageSize;
+    return gVTAtlas.SampleLevel(gsamLinearClamp, atlasTexel / (gVTPhysicalPagesPerSide * physicalSize), 0);
+}
+
 PSOutput PS(VertexOut pin)
 {
     PSOutput outt;
-    float4 diffuseTex = gDiffuseMap.Sample(gsamLinearClamp, pin.TexC);
+    // Branch rather than ?:, so draws without the virtual texture write no feedback
+    float4 diffuseTex;
+    if (gVTEnabled != 0u)
+        diffuseTex = SampleVirtualTexture(float2(pin.PosW.x * gInvWorldSize + 0.5f, 0.5f - pin.PosW.z * gInvWorldSize), (uint2)pin.PosH.xy);
+    else
+        diffuseTex = gDiffuseMap.Sample(gsamLinearClamp, pin.TexC);
     outt.Albedo = diffuseTex * gDiffuseAlbedo;
     outt.Albedo.a = gRoughness;
-    outt.Normal = float4(normalize(pin.NormalW), gMetallic);
-    outt.Position = float4(pin.PosW, 1.f);
+    // Branch rather than ?:, which evaluates both sides and would index the heap with kNoNormalMap
+    float3 normalW = normalize(pin.NormalW);
+    if (pin.NormalMapIndex != kNoNormalMap)
+        normalW = BakedNormal(pin.NormalMapIndex, pin.NormalUV);
+    outt.Normal = float4(normalW, gMetallic);
+    outt.Position = float4(pin.PosW, HorizonVisibility(pin.PosW)); // w: sun visibility for the lighting pass
     float invWc = (abs(pin.CurrClip.w) > 1e-6f) ? (1.f / pin.CurrClip.w) : 0.f;
     float invWp = (abs(pin.PrevClip.w) > 1e-6f) ? (1.f / pin.PrevClip.w) : 0.f;
     float2 currNdc = pin.CurrClip.xy * invWc;
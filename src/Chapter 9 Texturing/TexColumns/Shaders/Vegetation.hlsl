@@ -0,0 +1,176 @@
+// Vegetation: camera-facing tree billboards on the terrain (TerrainScatter.h), same GBuffer output
+// as Terrain.hlsl. Drawn through the terrain root signature without vertex buffers: each instance
+// expands into a quad from SV_VertexID.
+#include "LightingUtil.hlsl"
+// The whole SRV heap; the single-texture species are sampled through it
+Texture2D gTextures[] : register(t0, space1);
+// treeArray2: one species per slice
+Texture2DArray gTreeArray : register(t1);
+
+SamplerState gsamLinearClamp : register(s3);
+
+// One tree (TerrainVegetationInstance in TerrainScatter.h)
+struct VegetationInstance
+{
+    float3 Position; // base on the ground
+    float Width;
+    float Height;
+    uint Variant;    // < kTreeArraySlices: slice of gTreeArray, else gTreeTextures[Variant - kTreeArraySlices]
+};
+StructuredBuffer<VegetationInstance> gVegetationInstances : register(t2);
+static const uint kTreeArraySlices = 3;
+static const uint kNoTreeTexture = 0xffffffffu;
+
+// Horizon map (TerrainHorizon.h), as in Terrain.hlsl
+Texture2DArray gHorizonMap : register(t4);
+
+// Root constants (VegetationDrawConstants in TexColumnsApp.cpp)
+cbuffer cbVegetationDraw : register(b0)
+{
+    uint gInstanceBase;   // first instance of the draw (a run of visible cells)
+    uint3 gTreeTextures;  // SRV heap indices of tree01S, tree02S, tree35S; kNoTreeTexture = use an array slice
+};
+
+// Pixel root constants (TerrainShadeConstants in TexColumnsApp.cpp)
+cbuffer cbTerrainShade : register(b3)
+{
+    float3 gToSun;
+    float gHorizonScale;
+    float gInvWorldSize;
+    float gHorizonSoftness;
+    float gNormalScale;
+    float _padShade;
+};
+
+// Must match PassConstants layout exactly (View, InvView, Proj, InvProj, ViewProj, InvViewProj, EyePosW, ...)
+cbuffer cbPass : register(b1)
+{
+    float4x4 gView;
+    float4x4 gInvView;
+    float4x4 gProj;
+    float4x4 gInvProj;
+    float4x4 gViewProj;
+    float4x4 gInvViewProj;
+    float3 gEyePosW;
+    float cbPerObjectPad1;
+    float2 gRenderTargetSize;
+    float2 gInvRenderTargetSize;
+    float gNearZ;
+    float gFarZ;
+    float gTotalTime;
+    float gDeltaTime;
+    float4 gAmbientLight;
+    float4x4 gViewProjNoJitter;
+    float4x4 gPrevViewProjNoJitter;
+    float4x4 gPrevViewProj;
+    float2 gCurrJitterUV;
+    float2 gPrevJitterUV;
+    float2 g_padTaa;
+    Light gLights[MaxLights];
+};
+
+// Material in same b2 as main geometry pass
+cbuffer cbMaterial : register(b2)
+{
+    float4 gDiffuseAlbedo;
+    float3 gFresnelR0;
+    float gRoughness;
+    float gMetallic;
+    float3 _padM;
+    float4x4 gMatTransform;
+};
+
+struct VertexOut
+{
+    float4 PosH : SV_POSITION;
+    float3 PosW : POSITION;
+    float3 NormalW : NORMAL;
+    float2 TexC : TEXCOORD;
+    float4 CurrClip : TEXCOORD1;
+    float4 PrevClip : TEXCOORD2;
+    nointerpolation uint Slice : SLICE;     // array slice, or kNoTreeTexture
+    nointerpolation uint Texture : TEXTURE; // heap index when Slice is kNoTreeTexture
+};
+
+// Two triangles per tree; corner (s, t) with s across and t up the billboard
+static const float2 kCorners[6] = { float2(0, 0), float2(0, 1), float2(1, 0), float2(1, 0), float2(0, 1), float2(1, 1) };
+
+VertexOut VS(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
+{
+    VertexOut vout;
+    VegetationInstance inst = gVegetationInstances[gInstanceBase + instanceID];
+    float2 corner = kCorners[vertexID % 6u];
+
+    // Turn about the trunk to face the camera; stays upright
+    float2 toEye = gEyePosW.xz - inst.Position.xz;
+    float len = length(toEye);
+    toEye = len > 1e-4f ? toEye / len : float2(0.f, -1.f);
+    float3 right = float3(-toEye.y, 0.f, toEye.x);
+    float3 posW = inst.Position + right * ((corner.x - 0.5f) * inst.Width) + float3(0.f, corner.y * inst.Height, 0.f);
+
+    vout.PosW = posW;
+    vout.PosH = mul(float4(posW, 1.f), gViewProj);
+    // Lit as a crown facing the camera and the sky rather than a flat card
+    vout.NormalW = normalize(float3(toEye.x, 1.f, toEye.y));
+    vout.TexC = float2(corner.x, 1.f - corner.y);
+    vout.CurrClip = mul(float4(posW, 1.f), gViewProjNoJitter);
+    vout.PrevClip = mul(float4(posW, 1.f), gPrevViewProjNoJitter);
+
+    vout.Slice = inst.Variant;
+    vout.Texture = 0u;
+    if (inst.Variant >= kTreeArraySlices)
+    {
+        uint texture = gTreeTextures[min(inst.Variant - kTreeArraySlices, 2u)];
+        vout.Slice = texture == kNoTreeTexture ? inst.Variant % kTreeArraySlices : kNoTreeTexture;
+        vout.Texture = texture;
+    }
+    return vout;
+}
+
+// Same PS output as GeometryPass for GBuffer
+struct PSOutput
+{
+    float4 Albedo : SV_Target0;
+    float4 Normal : SV_Target1;
+    float4 Position : SV_Target2;
+    float2 Velocity : SV_Target3;
+};
+
+// Fraction of the sun above the baked horizon, as HorizonVisibility in Terrain.hlsl
+float HorizonVisibility(float3 posW)
+{
+    if (gHorizonScale <= 0.f)
+        return 1.f;
+    float2 uv = float2(posW.x * gInvWorldSize + 0.5f, 0.5f - posW.z * gInvWorldSize);
+    float4 h0 = gHorizonMap.SampleLevel(gsamLinearClamp, float3(uv, 0.f), 0);
+    float4 h1 = gHorizonMap.SampleLevel(gsamLinearClamp, float3(uv, 1.f), 0);
+    float horizon[8] = { h0.x, h0.y, h0.z, h0.w, h1.x, h1.y, h1.z, h1.w };
+    float f = frac(atan2(gToSun.z, gToSun.x) / 6.28318531f) * 8.f;
+    uint k0 = (uint)f & 7u;
+    float stored = lerp(horizon[k0], horizon[(k0 + 1u) & 7u], frac(f));
+    float horizonElevation = atan(tan(min(stored, 0.999f) * 1.57079633f) * gHorizonScale);
+    float sunElevation = atan2(gToSun.y, length(gToSun.xz));
+    return smoothstep(-gHorizonSoftness, gHorizonSoftness, sunElevation - horizonElevation);
+}
+
+PSOutput PS(VertexOut pin)
+{
+    PSOutput outt;
+    // Branch rather than ?:, which would index the heap with whatever Texture holds for slices
+    float4 diffuseTex;
+    if (pin.Slice != kNoTreeTexture)
+        diffuseTex = gTreeArray.Sample(gsamLinearClamp, float3(pin.TexC, (float)pin.Slice));
+    else
+        diffuseTex = gTextures[NonUniformResourceIndex(pin.Texture)].Sample(gsamLinearClamp, pin.TexC);
+    clip(diffuseTex.a - 0.5f);
+
+    outt.Albedo = float4(diffuseTex.rgb * gDiffuseAlbedo.rgb, gRoughness);
+    outt.Normal = float4(normalize(pin.NormalW), gMetallic);
+    outt.Position = float4(pin.PosW, HorizonVisibility(pin.PosW)); // w: sun visibility for the lighting pass
+    float invWc = (abs(pin.CurrClip.w) > 1e-6f) ? (1.f / pin.CurrClip.w) : 0.f;
+    float invWp = (abs(pin.PrevClip.w) > 1e-6f) ? (1.f / pin.PrevClip.w) : 0.f;
+    float2 currNdc = pin.CurrClip.xy * invWc;
+    float2 prevNdc = pin.PrevClip.xy * invWp;
+    outt.Velocity = (prevNdc - currNdc) * float2(0.5f, -0.5f);
+    return outt;
+}
@@ -1,145 +1,1037 @@
 #include "Terrain.h"
 #include <DirectXCollision.h>
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <limits>
 
 using namespace DirectX;
 
+namespace
+{
+	// UpdateViews hands each subtree rooted at this level (64 of them) to the job pool
+	const int kTraversalSplitLevel = 3;
+
+	const double kNoExpiry = -std::numeric_limits<double>::infinity();
+
+	// Horizon culling splits each tile into this many occluder pieces per side
+	const int kOcclusionPieces = 3;
+
+	// Eye travel up to which a decision made at distance `distance` holds: the distance to an AABB
+	// changes no faster than the eye moves. The margin keeps float rounding near the threshold out.
+	double ExpiryAfter(double travel, float distance, float slackRatio)
+	{
+		return travel + (double)distance * slackRatio - (1e-4 * distance + 1e-4);
+	}
+}
+
 void Terrain::SetWorldSize(float sizeXZ)
 {
 	mWorldSizeXZ = sizeXZ;
+	UpdateQueryPlacement();
 }
 
 void Terrain::SetOriginY(float y)
 {
+	if (y == mOriginY) return;
 	mOriginY = y;
+	mTransformsDirty = true;
+	UpdateQueryPlacement();
+}
+
+void Terrain::SetHeightScale(float scale)
+{
+	if (scale == mHeightScale) return;
+	mHeightScale = scale;
+	mTransformsDirty = true;
+	mAdaptiveDirty = true;
+	UpdateQueryPlacement();
+}
+
+void Terrain::SetViewport(float fovY, float viewportHeight)
+{
+	mProjectionScale = viewportHeight / (2.f * std::tan(fovY * 0.5f));
+}
+
+void Terrain::SetHeightfield(TerrainHeightfield heightfield)
+{
+	mHeightfield = std::move(heightfield);
+	mHeightPyramid.Build(mHeightfield);
+	mHeightQuery.Build(&mHeightfield);
+	UpdateQueryPlacement();
+	mAdaptiveDirty = true;
+}
+
+void Terrain::SetAdaptiveMeshes(bool enable, float maxErrorWorld)
+{
+	maxErrorWorld = std::max(maxErrorWorld, 0.f);
+	if (enable == mAdaptiveEnabled && maxErrorWorld == mAdaptiveMeshError) return;
+	mAdaptiveEnabled = enable;
+	mAdaptiveMeshError = maxErrorWorld;
+	mAdaptiveDirty = true;
+	++mCutVersion;
+}
+
+const TerrainMeshRange& Terrain::GetAdaptiveMeshRange(uint32_t nodeIndex) const
+{
+	const size_t last = mAdaptiveMeshes.Ranges.size() - 1;
+	return mAdaptiveMeshes.Ranges[std::min((size_t)nodeIndex, last)];
+}
+
+void Terrain::BuildAdaptiveMeshes()
+{
+	mAdaptiveDirty = false;
+	mAdaptiveMeshes = TerrainMeshSet();
+	mAdaptiveStats = TerrainRtinStats();
+	mAdaptiveNodeError.clear();
+	++mCutVersion;
+	if (mNodes.empty() || mHeightfield.Empty())
+	{
+		++mAdaptiveMeshVersion;
+		return;
+	}
+
+	// One mesh per node of the first levels in node order (so range index = node index), then one
+	// full-grid mesh for every deeper node. Neighbouring tiles differ by up to both meshes' error
+	// plus the coarser one's geometric error, which the skirt has to cover.
+	const int levels = std::min(mLODLevels, kTerrainAdaptiveMaxLevels);
+	const float maxError = mAdaptiveMeshError / std::max(mHeightScale, 1e-6f);
+	std::vector<TerrainRtinTileDesc> descs(TerrainNodeCount(levels) + 1);
+	for (uint32_t i = 0; i + 1 < (uint32_t)descs.size(); ++i)
+	{
+		const TerrainNode& node = mNodes[i];
+		const float tileUV = 1.f / (float)(1 << node.LOD);
+		const float parentError = node.LOD > 0 ? mNodes[TerrainLevelOffset(node.LOD - 1) + (i - TerrainLevelOffset(node.LOD)) / 4].GeometricError : 0.f;
+		TerrainRtinTileDesc& desc = descs[i];
+		desc.U0 = node.TileX * tileUV;
+		desc.V0 = 1.f - (node.TileZ + 1) * tileUV;
+		desc.U1 = desc.U0 + tileUV;
+		desc.V1 = desc.V0 + tileUV;
+		desc.MaxError = maxError;
+		desc.SkirtDepth = 2.f * maxError + std::max(node.GeometricError, parentError);
+	}
+	// Deeper nodes are bounded by the errors of the last adaptive level
+	float deepError = 0.f;
+	for (uint32_t i = TerrainLevelOffset(levels - 1); i < TerrainLevelOffset(levels); ++i)
+		deepError = std::max(deepError, mNodes[i].GeometricError);
+	descs.back().MaxError = -1.f;
+	descs.back().SkirtDepth = maxError + deepError;
+	mAdaptiveStats = BuildTerrainRtinMeshes(mHeightfield, descs, kTerrainGridResolution, 0, mAdaptiveMeshes);
+
+	// LOD selection error, leaves first so it never shrinks going up (deeper nodes draw the full grid)
+	mAdaptiveNodeError.resize(mNodes.size());
+	for (int lod = mLODLevels - 1; lod >= 0; --lod)
+	{
+		const uint32_t first = TerrainLevelOffset(lod);
+		for (uint32_t i = first; i < TerrainLevelOffset(lod + 1); ++i)
+		{
+			float error = mNodes[i].GeometricError + (lod < levels ? mAdaptiveMeshes.Ranges[i].MaxError : 0.f);
+			if (lod + 1 < mLODLevels)
+			{
+				const uint32_t firstChild = TerrainLevelOffset(lod + 1) + 4u * (i - first);
+				for (uint32_t c = 0; c < 4; ++c)
+					error = std::max(error, mAdaptiveNodeError[firstChild + c]);
+			}
+			mAdaptiveNodeError[i] = error;
+		}
+	}
+	++mAdaptiveMeshVersion;
+}
+
+XMFLOAT3 Terrain::SampleNormal(float x, float z) const
+{
+	XMFLOAT3 normal;
+	mHeightQuery.SampleNormal(x, z, &normal.x);
+	return normal;
+}
+
+bool Terrain::Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, TerrainRayHit& hit) const
+{
+	TerrainRay ray;
+	ray.Origin[0] = origin.x; ray.Origin[1] = origin.y; ray.Origin[2] = origin.z;
+	ray.Direction[0] = direction.x; ray.Direction[1] = direction.y; ray.Direction[2] = direction.z;
+	ray.MaxT = maxDistance;
+	return mHeightQuery.Raycast(ray, hit);
+}
+
+TerrainQueryBenchmark Terrain::BenchmarkQueries(size_t count) const
+{
+	return BenchmarkTerrainQueries(mHeightQuery, mWorldSizeXZ, mOriginY, mHeightScale, count);
+}
+
+void Terrain::SetLODLevels(int levels)
+{
+	mLODLevels = std::clamp(levels, 1, kTerrainMaxLODLevels);
+}
+
+void Terrain::SetTileStreaming(TerrainTileCache* cache, int firstLevel, int levelCount)
+{
+	mTileCache = cache;
+	mStreamFirstLevel = std::max(firstLevel, 0);
+	mStreamLevelCount = std::max(levelCount, 0);
+}
+
+void Terrain::SetMode(TerrainMode mode)
+{
+	if (mode == mMode) return;
+	mMode = mode;
+	for (ViewState& view : mViews)
+		view.Tiles.clear();
+	mClipmapRegions.clear();
+	mClipmap.Invalidate();
+}
+
+void Terrain::SetClipmapLevels(int levels)
+{
+	mClipmapLevels = std::clamp(levels, 1, kTerrainClipmapMaxLevels);
 }
 
-void Terrain::SetLODDistances(float maxDistLOD1, float maxDistLOD2)
+void Terrain::SetTightHeightBounds(bool enable)
 {
-	mMaxDistLOD1 = maxDistLOD1;
-	mMaxDistLOD2 = maxDistLOD2;
+	if (enable == mTightHeightBounds) return;
+	mTightHeightBounds = enable;
+	ComputeHeightRanges();
+	mTransformsDirty = true;
 }
 
 void Terrain::BuildQuadtree()
 {
-	mRoot = std::make_unique<TerrainNode>();
-	mRoot->LOD = 0;
-	mRoot->TileX = 0;
-	mRoot->TileZ = 0;
-	// Full terrain in XZ: [-mWorldSizeXZ/2, mWorldSizeXZ/2], Y from mOriginY to mOriginY + mHeightScale
-	XMFLOAT3 center(0.f, mOriginY + mHeightScale * 0.5f, 0.f);
-	XMFLOAT3 extents(mWorldSizeXZ * 0.5f, mHeightScale * 0.5f, mWorldSizeXZ * 0.5f);
-	mRoot->Bounds = BoundingBox(center, extents);
-	BuildNode(*mRoot, 0, 0, 0, 1);
-}
-
-void Terrain::BuildNode(TerrainNode& node, int lod, int tileX, int tileZ, int tilesPerSide)
-{
-	node.LOD = lod;
-	node.TileX = tileX;
-	node.TileZ = tileZ;
-	if (lod >= 2) return; // leaf at LOD2
-	int childTiles = (lod == 0) ? 2 : 4; // LOD0 -> 2x2 children, LOD1 -> 4x4 children
-	float half = node.Bounds.Extents.x;
-	float quarter = half * 0.5f;
-	XMVECTOR c = XMLoadFloat3(&node.Bounds.Center);
-	for (int i = 0; i < 4; ++i)
-	{
-		node.Children[i] = std::make_unique<TerrainNode>();
-		int cx = i % 2;
-		int cz = i / 2;
-		float ox = (cx == 0) ? -quarter : quarter;
-		float oz = (cz == 0) ? -quarter : quarter;
-		XMFLOAT3 childCenter;
-		XMStoreFloat3(&childCenter, c + XMVectorSet(ox, 0.f, oz, 0.f));
-		node.Children[i]->Bounds = BoundingBox(childCenter, XMFLOAT3(quarter, node.Bounds.Extents.y, quarter));
-		int nt = (lod == 0) ? 2 : 4;
-		int childTileX = tileX * 2 + cx;
-		int childTileZ = tileZ * 2 + cz;
-		BuildNode(*node.Children[i], lod + 1, childTileX, childTileZ, nt);
-	}
-}
-
-bool Terrain::IntersectsFrustum(const BoundingBox& box, const XMFLOAT4X4& viewProj) const
-{
-	// PassConstants stores ViewProj as transpose (column-major in memory: col i = m[i], m[i+4], m[i+8], m[i+12])
-	// So viewProj ROW r = (m[r], m[r+4], m[r+8], m[r+12]). Hartmann-Gribb needs rows.
-	const float* m = &viewProj.m[0][0];
-	auto getRow = [m](int r) -> XMVECTOR {
-		return XMVectorSet(m[r], m[r+4], m[r+8], m[r+12]);
-	};
-	XMVECTOR R0 = getRow(0), R1 = getRow(1), R2 = getRow(2), R3 = getRow(3);
-	XMVECTOR planes[6] = {
-		XMVectorAdd(R3, R0),   // Left
-		XMVectorSubtract(R3, R0), // Right
-		XMVectorAdd(R3, R1),   // Bottom
-		XMVectorSubtract(R3, R1), // Top
-		R2,                    // Near
-		XMVectorSubtract(R3, R2)  // Far
-	};
-	for (int i = 0; i < 6; ++i)
+	const uint32_t nodeCount = TerrainNodeCount(mLODLevels);
+	mNodes.assign(nodeCount, TerrainNode());
+	for (std::vector<float>* v : { &mBounds.CenterX, &mBounds.CenterY, &mBounds.CenterZ,
+		&mBounds.ExtentX, &mBounds.ExtentY, &mBounds.ExtentZ })
+		v->assign(nodeCount, 0.f);
+	for (int lod = 0; lod < mLODLevels; ++lod)
+	{
+		const uint32_t tilesPerSide = 1u << lod;
+		const uint32_t first = TerrainLevelOffset(lod);
+		const float tileSize = mWorldSizeXZ / (float)tilesPerSide;
+		for (uint32_t m = 0; m < tilesPerSide * tilesPerSide; ++m)
+		{
+			uint32_t x, z;
+			TerrainMortonDecode(m, x, z);
+			TerrainNode& node = mNodes[first + m];
+			node.LOD = lod;
+			node.TileX = (int)x;
+			node.TileZ = (int)z;
+			// Full terrain in XZ: [-mWorldSizeXZ/2, mWorldSizeXZ/2]; Y is filled by UpdateNodeTransforms
+			node.Bounds.Center = XMFLOAT3(
+				-mWorldSizeXZ * 0.5f + ((float)x + 0.5f) * tileSize, 0.f,
+				-mWorldSizeXZ * 0.5f + ((float)z + 0.5f) * tileSize);
+			node.Bounds.Extents = XMFLOAT3(tileSize * 0.5f, 0.f, tileSize * 0.5f);
+			mBounds.CenterX[first + m] = node.Bounds.Center.x;
+			mBounds.CenterZ[first + m] = node.Bounds.Center.z;
+			mBounds.ExtentX[first + m] = node.Bounds.Extents.x;
+			mBounds.ExtentZ[first + m] = node.Bounds.Extents.z;
+		}
+	}
+	// View states are sized for the new tree by the next update
+	mViews.clear();
+	mViewCount = 0;
+	mFrameStamp = 0;
+	ComputeHeightRanges();
+	UpdateNodeTransforms();
+	ApplyHeightmapIndices();
+	ComputeGeometricErrors();
+	mAdaptiveDirty = true;
+}
+
+void Terrain::ComputeGeometricErrors()
+{
+	// Leaves first, so a parent's error can include its children's (error must not shrink going up)
+	std::vector<float> gridHeights((kTerrainGridResolution + 1) * (kTerrainGridResolution + 1));
+	for (int lod = mLODLevels - 1; lod >= 0; --lod)
+	{
+		const uint32_t tilesPerSide = 1u << lod;
+		const uint32_t first = TerrainLevelOffset(lod);
+		const bool isLeafLevel = lod + 1 >= mLODLevels;
+		const float tileUV = 1.f / (float)tilesPerSide;
+		for (uint32_t m = 0; m < tilesPerSide * tilesPerSide; ++m)
+		{
+			TerrainNode& node = mNodes[first + m];
+			float error = 0.f;
+			if (mHeightfield.Empty())
+			{
+				error = isLeafLevel ? 0.f : 0.25f * tileUV;
+			}
+			else
+			{
+				// Deviation of the heightfield from the bilinear surface through this tile's grid
+				// vertices; zero once the grid is at least as dense as the heightfield.
+				const float texels = (float)std::max(mHeightfield.Width, mHeightfield.Height) * tileUV;
+				if (texels > (float)kTerrainGridResolution)
+				{
+					const float u0 = node.TileX * tileUV;
+					const float v0 = 1.f - (node.TileZ + 1) * tileUV;
+					const float step = tileUV / kTerrainGridResolution;
+					for (int j = 0; j <= kTerrainGridResolution; ++j)
+						for (int i = 0; i <= kTerrainGridResolution; ++i)
+							gridHeights[j * (kTerrainGridResolution + 1) + i] = mHeightfield.Sample(u0 + i * step, v0 + j * step);
+					const int samples = std::min(256, (int)std::ceil(texels));
+					for (int sz = 0; sz < samples; ++sz)
+					{
+						const float gz = ((float)sz + 0.5f) / samples * kTerrainGridResolution;
+						const int j = std::min((int)gz, kTerrainGridResolution - 1);
+						const float tz = gz - (float)j;
+						for (int sx = 0; sx < samples; ++sx)
+						{
+							const float gx = ((float)sx + 0.5f) / samples * kTerrainGridResolution;
+							const int i = std::min((int)gx, kTerrainGridResolution - 1);
+							const float tx = gx - (float)i;
+							const float* g = &gridHeights[j * (kTerrainGridResolution + 1) + i];
+							const float h0 = g[0] + (g[1] - g[0]) * tx;
+							const float h1 = g[kTerrainGridResolution + 1] + (g[kTerrainGridResolution + 2] - g[kTerrainGridResolution + 1]) * tx;
+							const float coarse = h0 + (h1 - h0) * tz;
+							const float fine = mHeightfield.Sample(u0 + gx * step, v0 + gz * step);
+							error = std::max(error, std::fabs(fine - coarse));
+						}
+					}
+				}
+			}
+			if (!isLeafLevel)
+			{
+				const uint32_t firstChild = TerrainLevelOffset(lod + 1) + 4u * m;
+				for (uint32_t c = 0; c < 4; ++c)
+					error = std::max(error, mNodes[firstChild + c].GeometricError);
+			}
+			node.GeometricError = error;
+		}
+	}
+}
+
+void Terrain::ComputeHeightRanges()
+{
+	for (TerrainNode& node : mNodes)
+	{
+		node.MinHeight = 0.f;
+		node.MaxHeight = 1.f;
+		if (!mTightHeightBounds || mHeightPyramid.Empty())
+			continue;
+		const float tileUV = 1.f / (float)(1 << node.LOD);
+		const float u0 = node.TileX * tileUV;
+		const float v0 = 1.f - (node.TileZ + 1) * tileUV;
+		mHeightPyramid.QueryRange(u0, v0, u0 + tileUV, v0 + tileUV, node.MinHeight, node.MaxHeight);
+	}
+}
+
+void Terrain::UpdateNodeTransforms()
+{
+	// Heights span [mOriginY, mOriginY + mHeightScale]; the AABB covers the node's own range within it.
+	// The tile grid spans [0,1] in local XZ and the shader writes the raw heightmap value into
+	// local Y, so World maps the unit cube onto the full range.
+	for (size_t i = 0; i < mNodes.size(); ++i)
+	{
+		TerrainNode& node = mNodes[i];
+		node.Bounds.Center.y = mOriginY + mHeightScale * (node.MinHeight + node.MaxHeight) * 0.5f;
+		node.Bounds.Extents.y = mHeightScale * (node.MaxHeight - node.MinHeight) * 0.5f;
+		mBounds.CenterY[i] = node.Bounds.Center.y;
+		mBounds.ExtentY[i] = node.Bounds.Extents.y;
+		const float size = node.Bounds.Extents.x * 2.f;
+		XMMATRIX world = XMMatrixScaling(size, mHeightScale, size);
+		world = XMMatrixMultiply(world, XMMatrixTranslation(
+			node.Bounds.Center.x - node.Bounds.Extents.x, mOriginY, node.Bounds.Center.z - node.Bounds.Extents.z));
+		XMStoreFloat4x4(&node.World, XMMatrixTranspose(world));
+	}
+	mTransformsDirty = false;
+	++mCutVersion;
+}
+
+float Terrain::ProjectedError(uint32_t index, const XMFLOAT3& eyePos, float* distance) const
+{
+	const float dx = std::max(std::fabs(eyePos.x - mBounds.CenterX[index]) - mBounds.ExtentX[index], 0.f);
+	const float dy = std::max(std::fabs(eyePos.y - mBounds.CenterY[index]) - mBounds.ExtentY[index], 0.f);
+	const float dz = std::max(std::fabs(eyePos.z - mBounds.CenterZ[index]) - mBounds.ExtentZ[index], 0.f);
+	const float dist = std::max(std::sqrt(dx * dx + dy * dy + dz * dz), 1e-3f);
+	if (distance) *distance = dist;
+	const bool adaptive = mAdaptiveEnabled && mAdaptiveNodeError.size() == mNodes.size();
+	const float error = adaptive ? mAdaptiveNodeError[index] : mNodes[index].GeometricError;
+	return error * mHeightScale * mProjectionScale / dist;
+}
+
+void Terrain::TraverseViews(TraversalJob& job, const XMFLOAT3& eyePos, int splitLevel, std::vector<TraversalEntry>* deferred)
+{
+	// Hysteresis band: refine above tau, coarsen again only below tau * (1 - hysteresis).
+	const float tau = std::max(mMaxPixelError, 1e-3f);
+	const float coarsenRatio = 1.f - std::clamp(mLODHysteresis, 0.f, 0.9f);
+
+	// Stack entries are nodes visible in at least one view, together with the planes each view
+	// still straddles; a subtree fully inside a view's frustum carries an empty mask for that view
+	// and its children skip the view's plane tests. Each pop pushes at most 4 children and an exit
+	// entry, so 4 per level + 4 is enough.
+	TraversalEntry stack[4 * (kTerrainMaxLODLevels + 1)];
+	int top = 0;
+	stack[top++] = job.Root;
+	while (top > 0)
+	{
+		const TraversalEntry entry = stack[--top];
+		if (entry.Exit)
+		{
+			for (int v = 0; v < mViewCount; ++v)
+				if (entry.ViewMask & (1u << v))
+					FoldSubtreeExpiry(mViews[v], entry.Index);
+			continue;
+		}
+		const TerrainNode& node = mNodes[entry.Index];
+
+		// Views whose stored cut below this node still holds take it as it is; only a subtree
+		// entirely inside the frustum qualifies, since culling inside it may have changed
+		uint32_t evaluate = entry.ViewMask;
+		if (mTemporalCoherence)
+			for (int v = 0; v < mViewCount; ++v)
+				if ((entry.ViewMask & (1u << v)) && entry.PlaneMasks[v] == 0 && mViews[v].SubtreeExpiry[entry.Index] > mEyeTravel)
+				{
+					ReuseSubtree(mViews[v], job.Tiles[v], entry.Index, entry.ParentError, eyePos, job.NodesReused);
+					evaluate &= ~(1u << v);
+				}
+		if (!evaluate)
+			continue;
+
+		++job.NodesVisited;
+		const bool isLeaf = node.LOD + 1 >= mLODLevels;
+		// The only per-node cost all views share: they refine by the camera's error
+		float distance;
+		const float error = ProjectedError(entry.Index, eyePos, &distance);
+		const uint32_t firstChild = isLeaf ? 0u : TerrainLevelOffset(node.LOD + 1) + 4u * (entry.Index - TerrainLevelOffset(node.LOD));
+		TraversalEntry children[4] = {};
+		uint32_t refined = 0;
+		for (int v = 0; v < mViewCount; ++v)
+		{
+			if (!(evaluate & (1u << v)))
+				continue;
+			ViewState& view = mViews[v];
+			const float viewError = error * view.ErrorScale;
+			const bool refine = !isLeaf && viewError > (view.NodeRefined[entry.Index] ? tau * coarsenRatio : tau);
+			view.NodeRefined[entry.Index] = refine ? 1 : 0;
+			if (!refine)
+			{
+				// Holds until the error could rise above tau
+				view.SubtreeExpiry[entry.Index] = isLeaf ? std::numeric_limits<double>::infinity() :
+					ExpiryAfter(mEyeTravel, distance, 1.f - viewError / tau);
+				EmitTile(view, job.Tiles[v], entry.Index, node.LOD > 0 ? ComputeMorph(entry.ParentError * view.ErrorScale) : 0.f);
+				continue;
+			}
+			SetNodeState(view, entry.Index, NodeRefined);
+			view.NodeStamp[entry.Index] = mFrameStamp;
+			refined |= 1u << v;
+			uint32_t childMasks[4] = { 0, 0, 0, 0 };
+			const uint32_t planeMask = entry.PlaneMasks[v];
+			// Holds until the error could fall to the coarsen point; the children lower it on exit
+			view.SubtreeExpiry[entry.Index] = planeMask ? kNoExpiry :
+				ExpiryAfter(mEyeTravel, distance, viewError / (tau * coarsenRatio) - 1.f);
+			const uint32_t culled = planeMask ? view.Frustum.Intersects4(mBounds, firstChild, planeMask, childMasks) : 0u;
+			job.NodesCulled += (uint32_t)((culled & 1) + ((culled >> 1) & 1) + ((culled >> 2) & 1) + ((culled >> 3) & 1));
+			for (int i = 0; i < 4; ++i)
+			{
+				if (culled & (1u << i))
+				{
+					SetNodeState(view, firstChild + i, NodeUnvisited);
+					view.SubtreeExpiry[firstChild + i] = kNoExpiry;
+					continue;
+				}
+				children[i].ViewMask |= 1u << v;
+				children[i].PlaneMasks[v] = (uint8_t)childMasks[i];
+			}
+		}
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			children[i].Index = firstChild + i;
+			children[i].ParentError = error;
+		}
+		// Levels above the split fold their expiry once the jobs below them are done
+		if (deferred && node.LOD + 1 == splitLevel)
+		{
+			for (int i = 0; i < 4; ++i)
+				if (children[i].ViewMask)
+					deferred->push_back(children[i]);
+			continue;
+		}
+		if (refined && !deferred)
+		{
+			TraversalEntry& exit = stack[top++];
+			exit = TraversalEntry{};
+			exit.Index = entry.Index;
+			exit.ViewMask = refined;
+			exit.Exit = true;
+		}
+		// Push in reverse so children are emitted in Morton order
+		for (int i = 3; i >= 0; --i)
+			if (children[i].ViewMask)
+				stack[top++] = children[i];
+	}
+}
+
+void Terrain::ReuseSubtree(ViewState& view, std::vector<TerrainTile>& tiles, uint32_t index, float parentError,
+	const XMFLOAT3& eyePos, uint32_t& reused) const
+{
+	struct Item { uint32_t Index; float ParentError; };
+	Item stack[3 * kTerrainMaxLODLevels + 1];
+	int top = 0;
+	stack[top++] = { index, parentError };
+	while (top > 0)
+	{
+		const Item item = stack[--top];
+		const TerrainNode& node = mNodes[item.Index];
+		++reused;
+		const NodeState state = GetNodeState(view, item.Index);
+		if (state == NodeEmitted)
+		{
+			EmitTile(view, tiles, item.Index, node.LOD > 0 ? ComputeMorph(item.ParentError * view.ErrorScale) : 0.f);
+			continue;
+		}
+		if (state != NodeRefined)
+			continue;
+		// A refined node still costs its error, which its children's geomorph needs
+		const float error = ProjectedError(item.Index, eyePos);
+		const uint32_t firstChild = TerrainLevelOffset(node.LOD + 1) + 4u * (item.Index - TerrainLevelOffset(node.LOD));
+		for (int i = 3; i >= 0; --i)
+			stack[top++] = { firstChild + (uint32_t)i, error };
+	}
+}
+
+void Terrain::FoldSubtreeExpiry(ViewState& view, uint32_t index) const
+{
+	const TerrainNode& node = mNodes[index];
+	const uint32_t firstChild = TerrainLevelOffset(node.LOD + 1) + 4u * (index - TerrainLevelOffset(node.LOD));
+	double expiry = view.SubtreeExpiry[index];
+	for (uint32_t i = 0; i < 4; ++i)
+		expiry = std::min(expiry, view.SubtreeExpiry[firstChild + i]);
+	view.SubtreeExpiry[index] = expiry;
+}
+
+void Terrain::UndoForcedSplits(ViewState& view) const
+{
+	// Latest split first, so a tile split twice ends up as the traversal emitted it
+	for (auto it = view.SplitNodes.rbegin(); it != view.SplitNodes.rend(); ++it)
 	{
-		XMVECTOR p = planes[i];
-		float len = XMVectorGetX(XMVector3Length(p));
-		if (len < 1e-6f) continue;
-		p = XMVectorScale(p, 1.f / len);
-		float d = -XMVectorGetW(planes[i]) / len;
-		// AABB: positive vertex along plane normal
-		float nx = XMVectorGetX(p), ny = XMVectorGetY(p), nz = XMVectorGetZ(p);
-		XMFLOAT3 pVertex(
-			box.Center.x + (nx >= 0.f ? box.Extents.x : -box.Extents.x),
-			box.Center.y + (ny >= 0.f ? box.Extents.y : -box.Extents.y),
-			box.Center.z + (nz >= 0.f ? box.Extents.z : -box.Extents.z)
-		);
-		if (nx * pVertex.x + ny * pVertex.y + nz * pVertex.z + d < 0.f)
-			return false;
+		const TerrainNode& node = mNodes[*it];
+		const uint32_t firstChild = TerrainLevelOffset(node.LOD + 1) + 4u * (*it - TerrainLevelOffset(node.LOD));
+		SetNodeState(view, *it, NodeEmitted);
+		for (uint32_t i = 0; i < 4; ++i)
+			SetNodeState(view, firstChild + i, NodeUnvisited);
 	}
-	return true;
+	view.SplitNodes.clear();
+}
+
+float Terrain::ComputeMorph(float parentError) const
+{
+	// A tile morphs towards its parent's geometry as the parent's error approaches the coarsen point
+	const float tau = std::max(mMaxPixelError, 1e-3f);
+	const float coarsenRatio = 1.f - std::clamp(mLODHysteresis, 0.f, 0.9f);
+	const float morphStartRatio = 2.f;
+	const float t = parentError / tau;
+	return std::clamp((morphStartRatio - t) / (morphStartRatio - coarsenRatio), 0.f, 1.f);
 }
 
-float Terrain::DistanceToNode(const BoundingBox& box, const XMFLOAT3& eyePos) const
+void Terrain::EmitTile(ViewState& view, std::vector<TerrainTile>& tiles, uint32_t index, float morph) const
 {
-	XMVECTOR e = XMLoadFloat3(&eyePos);
-	XMVECTOR c = XMLoadFloat3(&box.Center);
-	XMVECTOR d = XMVector3LengthEst(XMVectorSubtract(e, c));
-	return XMVectorGetX(d);
+	SetNodeState(view, index, NodeEmitted);
+	view.NodeTileSlot[index] = (uint32_t)tiles.size();
+	tiles.emplace_back();
+	TerrainTile& tile = tiles.back();
+	FillTileFromNode(mNodes[index], tile);
+	tile.NodeIndex = index;
+	tile.MorphFactor = morph;
 }
 
-void Terrain::SelectLOD(const TerrainNode& node, const XMFLOAT4X4& viewProj,
-	const XMFLOAT3& eyePos, float maxDistLOD1, float maxDistLOD2)
+uint32_t Terrain::FindCoveringNode(const ViewState& view, int lod, int x, int z) const
 {
-	if (!IntersectsFrustum(node.Bounds, viewProj))
+	uint32_t index = 0;
+	for (int level = 0; level < lod; ++level)
+	{
+		if (GetNodeState(view, index) != NodeRefined)
+			return index;
+		const int shift = lod - level - 1;
+		index = TerrainLevelOffset(level + 1) + TerrainMortonEncode((uint32_t)(x >> shift), (uint32_t)(z >> shift));
+	}
+	return index;
+}
+
+namespace
+{
+	// Side order matches the TerrainEdge bits: -X, +X, -Z, +Z
+	const int kTerrainNeighborDX[4] = { -1, 1, 0, 0 };
+	const int kTerrainNeighborDZ[4] = { 0, 0, -1, 1 };
+}
+
+void Terrain::BalanceLOD(ViewState& view, const XMFLOAT3& eyePos)
+{
+	// Work list of emitted tiles whose neighbours still need checking; a forced split appends its
+	// children, since they may in turn border a tile two levels coarser
+	view.BalanceQueue.clear();
+	for (const TerrainTile& tile : view.Tiles)
+		view.BalanceQueue.push_back(tile.NodeIndex);
+	bool removedTiles = false;
+	while (!view.BalanceQueue.empty())
+	{
+		const uint32_t index = view.BalanceQueue.back();
+		view.BalanceQueue.pop_back();
+		const TerrainNode& node = mNodes[index];
+		if (node.LOD < 2 || GetNodeState(view, index) != NodeEmitted)
+			continue;
+		const int tilesPerSide = 1 << node.LOD;
+		for (int side = 0; side < 4; ++side)
+		{
+			const int x = node.TileX + kTerrainNeighborDX[side];
+			const int z = node.TileZ + kTerrainNeighborDZ[side];
+			if (x < 0 || z < 0 || x >= tilesPerSide || z >= tilesPerSide)
+				continue;
+			for (;;)
+			{
+				// Culled neighbours are not drawn, so they never need to match
+				const uint32_t cover = FindCoveringNode(view, node.LOD, x, z);
+				if (mNodes[cover].LOD + 1 >= node.LOD || GetNodeState(view, cover) != NodeEmitted)
+					break;
+
+				// Split the coarse neighbour; its slot is compacted away below
+				view.Tiles[view.NodeTileSlot[cover]].LOD = -1;
+				removedTiles = true;
+				SetNodeState(view, cover, NodeRefined);
+				view.SplitNodes.push_back(cover);
+				++view.ForcedSplits;
+				const float morph = ComputeMorph(ProjectedError(cover, eyePos) * view.ErrorScale);
+				const uint32_t firstChild = TerrainLevelOffset(mNodes[cover].LOD + 1) +
+					4u * (cover - TerrainLevelOffset(mNodes[cover].LOD));
+				for (uint32_t i = 0; i < 4; ++i)
+				{
+					// The children's stored cuts are not what the traversal would find
+					view.SubtreeExpiry[firstChild + i] = kNoExpiry;
+					uint32_t planeMask = view.Frustum.PlaneMask;
+					if (!view.Frustum.Intersects(mBounds, firstChild + i, planeMask))
+					{
+						SetNodeState(view, firstChild + i, NodeUnvisited);
+						++view.NodesCulled;
+						continue;
+					}
+					EmitTile(view, view.Tiles, firstChild + i, morph);
+					view.BalanceQueue.push_back(firstChild + i);
+				}
+			}
+		}
+	}
+	if (removedTiles)
+		view.Tiles.erase(std::remove_if(view.Tiles.begin(), view.Tiles.end(),
+			[](const TerrainTile& tile) { return tile.LOD < 0; }), view.Tiles.end());
+}
+
+void Terrain::ComputeNeighborMasks(ViewState& view)
+{
+	// After balancing, a neighbour is either finer (it stitches to us), the same LOD, or exactly
+	// one LOD coarser, in which case this tile drops the odd vertices along that side
+	for (TerrainTile& tile : view.Tiles)
+	{
+		tile.NeighborMask = 0;
+		if (tile.LOD == 0)
+			continue;
+		const int tilesPerSide = 1 << tile.LOD;
+		for (int side = 0; side < 4; ++side)
+		{
+			const int x = tile.TileX + kTerrainNeighborDX[side];
+			const int z = tile.TileZ + kTerrainNeighborDZ[side];
+			if (x < 0 || z < 0 || x >= tilesPerSide || z >= tilesPerSide)
+				continue;
+			const uint32_t cover = FindCoveringNode(view, tile.LOD, x, z);
+			if (mNodes[cover].LOD < tile.LOD && GetNodeState(view, cover) == NodeEmitted)
+				tile.NeighborMask |= 1u << side;
+		}
+	}
+}
+
+void Terrain::RequestTiles(const XMFLOAT3& eyePos)
+{
+	const int streamEnd = std::min(mStreamFirstLevel + mStreamLevelCount, mLODLevels);
+	if (streamEnd <= mStreamFirstLevel)
 		return;
-	float dist = DistanceToNode(node.Bounds, eyePos);
-	if (node.IsLeaf() || node.LOD == 2)
+	mTileRequests.clear();
+	auto request = [this, streamEnd](uint32_t index, float priority) {
+		const TerrainNode& node = mNodes[index];
+		if (node.LOD >= mStreamFirstLevel && node.LOD < streamEnd)
+			mTileRequests.push_back({ { index, node.LOD, node.TileX, node.TileZ }, priority });
+	};
+
+	// Visible tiles: the tile they want, plus the resident tile drawn in the meantime (a request
+	// for a resident tile only marks it used, so the fallback is never evicted while needed).
+	// Priorities are >= 1 here and < 1 for prefetch, so visible tiles always load first.
+	for (const TerrainTile& tile : mViews[0].Tiles)
+	{
+		uint32_t wanted = tile.NodeIndex;
+		if (tile.LOD >= streamEnd)
+		{
+			const uint32_t morton = wanted - TerrainLevelOffset(tile.LOD);
+			wanted = TerrainLevelOffset(streamEnd - 1) + (morton >> (2 * (tile.LOD - streamEnd + 1)));
+		}
+		const float priority = 1.f + ProjectedError(wanted, eyePos);
+		request(wanted, priority);
+		if (mNodes[wanted].HeightmapSource != wanted)
+			request(mNodes[wanted].HeightmapSource, priority);
+	}
+	// The other views only keep the heightmaps they draw from resident: a shadow caster never
+	// streams in detail of its own
+	for (int v = 1; v < mViewCount; ++v)
+		for (const TerrainTile& tile : mViews[v].Tiles)
+			if (tile.HeightmapSrvIndex >= 0)
+				request(mNodes[tile.NodeIndex].HeightmapSource, 1.f);
+
+	// Prefetch: run the LOD refinement (without culling) from the eye extrapolated along its
+	// per-update velocity, requesting every streamed node it would reach
+	if (mPrefetchLookahead > 0.f && mHasPrevEye)
 	{
-		TerrainTile tile;
-		FillTileFromNode(node, tile);
-		tile.HeightmapSrvIndex = node.HeightmapSrvIndex;
-		mVisibleTiles.push_back(tile);
+		XMVECTOR eye = XMLoadFloat3(&eyePos);
+		XMVECTOR ahead = (eye - XMLoadFloat3(&mPrevEyePos)) * mPrefetchLookahead;
+		const float maxAhead = mWorldSizeXZ * 0.5f; // camera teleports are not motion
+		if (XMVectorGetX(XMVector3LengthSq(ahead)) > maxAhead * maxAhead)
+			ahead = XMVectorZero();
+		if (XMVectorGetX(XMVector3LengthSq(ahead)) > 1e-6f)
+		{
+			XMFLOAT3 predicted;
+			XMStoreFloat3(&predicted, eye + ahead);
+			const float tau = std::max(mMaxPixelError, 1e-3f);
+			uint32_t stack[3 * kTerrainMaxLODLevels + 1];
+			int top = 0;
+			stack[top++] = 0;
+			while (top > 0)
+			{
+				const uint32_t index = stack[--top];
+				const TerrainNode& node = mNodes[index];
+				const float error = ProjectedError(index, predicted);
+				request(index, error / (1.f + error));
+				if (node.LOD + 1 >= streamEnd || error <= tau)
+					continue;
+				const uint32_t firstChild = TerrainLevelOffset(node.LOD + 1) + 4u * (index - TerrainLevelOffset(node.LOD));
+				for (uint32_t i = 0; i < 4; ++i)
+					stack[top++] = firstChild + i;
+			}
+		}
+	}
+	mPrevEyePos = eyePos;
+	mHasPrevEye = true;
+
+	mStats.TileRequests = (uint32_t)mTileRequests.size();
+	mTileCache->SubmitRequests(mTileRequests);
+}
+
+void Terrain::CullOccludedTiles(const TerrainView& view, const XMFLOAT3& eyePos)
+{
+	// Nearer terrain only hides what is behind it from above the surface and inside the square
+	const float half = mWorldSizeXZ * 0.5f;
+	if (std::fabs(eyePos.x) >= half || std::fabs(eyePos.z) >= half || eyePos.y <= SampleHeight(eyePos.x, eyePos.z))
 		return;
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<TerrainTile>& tiles = mViews[0].Tiles;
+	const bool adaptive = mAdaptiveEnabled && mAdaptiveNodeError.size() == mNodes.size();
+	// The tiles first, their pieces after (reserved, so the references below stay valid)
+	mOcclusionTiles.clear();
+	mOcclusionTiles.reserve(tiles.size() * (1 + kOcclusionPieces * kOcclusionPieces));
+	mOcclusionTiles.resize(tiles.size());
+	for (size_t i = 0; i < tiles.size(); ++i)
+	{
+		const TerrainTile& tile = tiles[i];
+		const TerrainNode& node = mNodes[tile.NodeIndex];
+		// The drawn surface strays from the heightfield by the node's error, or its parent's while
+		// geomorphing; errors never shrink going up, so the parent's covers both
+		uint32_t errorNode = tile.NodeIndex;
+		if (node.LOD > 0)
+			errorNode = TerrainLevelOffset(node.LOD - 1) + ((tile.NodeIndex - TerrainLevelOffset(node.LOD)) >> 2);
+		const float error = (adaptive ? mAdaptiveNodeError[errorNode] : mNodes[errorNode].GeometricError) * mHeightScale;
+		TerrainOcclusionTile& box = mOcclusionTiles[i];
+		box.MinX = tile.AABB.Center.x - tile.AABB.Extents.x;
+		box.MaxX = tile.AABB.Center.x + tile.AABB.Extents.x;
+		box.MinZ = tile.AABB.Center.z - tile.AABB.Extents.z;
+		box.MaxZ = tile.AABB.Center.z + tile.AABB.Extents.z;
+		box.GroundY = mOriginY + node.MinHeight * mHeightScale - error;
+		box.TopY = tile.AABB.Center.y + tile.AABB.Extents.y + error;
+		box.Occludee = true;
+
+		// The tile's min height is its lowest valley; pieces of it with their own min from the
+		// pyramid hide more behind crests and slopes
+		if (!mTightHeightBounds || mHeightPyramid.Empty())
+			continue;
+		const float pieceSize = (box.MaxX - box.MinX) / (float)kOcclusionPieces;
+		for (int pz = 0; pz < kOcclusionPieces; ++pz)
+			for (int px = 0; px < kOcclusionPieces; ++px)
+			{
+				TerrainOcclusionTile piece;
+				piece.MinX = box.MinX + px * pieceSize;
+				piece.MaxX = piece.MinX + pieceSize;
+				piece.MinZ = box.MinZ + pz * pieceSize;
+				piece.MaxZ = piece.MinZ + pieceSize;
+				float minHeight, maxHeight;
+				mHeightPyramid.QueryRange(piece.MinX / mWorldSizeXZ + 0.5f, 0.5f - piece.MaxZ / mWorldSizeXZ,
+					piece.MaxX / mWorldSizeXZ + 0.5f, 0.5f - piece.MinZ / mWorldSizeXZ, minHeight, maxHeight);
+				piece.GroundY = mOriginY + minHeight * mHeightScale - error;
+				piece.TopY = box.TopY;
+				piece.Occludee = false;
+				if (piece.GroundY > box.GroundY) // else the tile itself hides as much
+					mOcclusionTiles.push_back(piece);
+			}
 	}
-	bool useChild = (node.LOD == 0 && dist < maxDistLOD1) || (node.LOD == 1 && dist < maxDistLOD2);
-	if (useChild && node.Children[0])
+	// Frustum corners, so the horizon is only tested where the camera looks
+	XMVECTOR det;
+	const XMMATRIX invViewProj = XMMatrixInverse(&det, XMMatrixTranspose(XMLoadFloat4x4(&view.ViewProj)));
+	float corners[8][3];
+	for (int c = 0; c < 8; ++c)
 	{
-		for (int i = 0; i < 4; ++i)
-			SelectLOD(*node.Children[i], viewProj, eyePos, maxDistLOD1, maxDistLOD2);
+		const XMVECTOR ndc = XMVectorSet((c & 1) ? 1.f : -1.f, (c & 2) ? 1.f : -1.f, (c & 4) ? 1.f : 0.f, 1.f);
+		XMFLOAT3 corner;
+		XMStoreFloat3(&corner, XMVector3TransformCoord(ndc, invViewProj));
+		corners[c][0] = corner.x;
+		corners[c][1] = corner.y;
+		corners[c][2] = corner.z;
 	}
-	else
+	const bool invertible = XMVectorGetX(det) != 0.f;
+
+	mOcclusionVisible.resize(mOcclusionTiles.size());
+	const float eye[3] = { eyePos.x, eyePos.y, eyePos.z };
+	mStats.TilesOccluded = mHorizonCuller.Cull(eye, mOcclusionTiles.data(), mOcclusionTiles.size(), mOcclusionVisible.data(),
+		invertible ? corners : nullptr, invertible ? 8 : 0);
+	if (mStats.TilesOccluded > 0)
 	{
-		TerrainTile tile;
-		FillTileFromNode(node, tile);
-		tile.HeightmapSrvIndex = node.HeightmapSrvIndex;
-		mVisibleTiles.push_back(tile);
+		size_t kept = 0;
+		for (size_t i = 0; i < tiles.size(); ++i)
+			if (mOcclusionVisible[i])
+				tiles[kept++] = tiles[i];
+		tiles.resize(kept);
 	}
+	mStats.OcclusionMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 }
 
 void Terrain::Update(const XMFLOAT4X4& viewProj, const XMFLOAT3& eyePos)
 {
-	mVisibleTiles.clear();
-	if (!mRoot) return;
-	SelectLOD(*mRoot, viewProj, eyePos, mMaxDistLOD1, mMaxDistLOD2);
+	TerrainView view;
+	view.ViewProj = viewProj;
+	UpdateViews(&view, 1, eyePos);
+}
+
+void Terrain::SetUpdateThreads(int threads)
+{
+	mUpdateThreads = std::max(threads, 0);
+	mJobPool.SetThreadCount(mUpdateThreads);
+}
+
+const std::vector<TerrainTile>& Terrain::GetVisibleTiles(int view) const
+{
+	static const std::vector<TerrainTile> noTiles;
+	return view >= 0 && view < (int)mViews.size() ? mViews[view].Tiles : noTiles;
+}
+
+void Terrain::UpdateViews(const TerrainView* views, int viewCount, const XMFLOAT3& eyePos)
+{
+	// Not part of the per-frame cost: a rebuild happens only after a settings or heightfield change
+	if (mAdaptiveEnabled && mAdaptiveDirty && mMode == TerrainMode::Quadtree)
+		BuildAdaptiveMeshes();
+	const auto start = std::chrono::steady_clock::now();
+	viewCount = std::clamp(viewCount, 0, kTerrainMaxViews);
+	for (ViewState& view : mViews)
+		view.Tiles.clear();
+	mViewCount = viewCount;
+	mStats.Views = (uint32_t)viewCount;
+	mStats.NodesVisited = 0;
+	mStats.NodesReused = 0;
+	mStats.NodesCulled = 0;
+	mStats.ForcedSplits = 0;
+	mStats.ShadowTiles = 0;
+	mStats.TileRequests = 0;
+	mStats.ClipmapSamplesUpdated = 0;
+	mStats.TilesOccluded = 0;
+	mStats.OcclusionMs = 0.0;
+	if (mMode == TerrainMode::Clipmap)
+		UpdateClipmap(eyePos);
+	else if (!mNodes.empty() && viewCount > 0)
+	{
+		if (mTransformsDirty)
+			UpdateNodeTransforms();
+		if ((int)mViews.size() < viewCount)
+			mViews.resize(viewCount);
+		// New stamp marks the nodes this update evaluates without clearing the last update's
+		if (++mFrameStamp == 0)
+		{
+			for (ViewState& view : mViews)
+				std::fill(view.NodeStamp.begin(), view.NodeStamp.end(), 0u);
+			mFrameStamp = 1;
+		}
+		if (mJobPool.GetThreadCount() == 0)
+			mJobPool.SetThreadCount(mUpdateThreads);
+		// Stored cuts expire by how far the eye has moved along its path, whichever way it went
+		mEyeTravel += XMVectorGetX(XMVector3Length(XMLoadFloat3(&eyePos) - XMLoadFloat3(&mLastEyePos)));
+		mLastEyePos = eyePos;
+		CutSettings cut;
+		cut.Tau = std::max(mMaxPixelError, 1e-3f);
+		cut.CoarsenRatio = 1.f - std::clamp(mLODHysteresis, 0.f, 0.9f);
+		cut.ErrorFactor = mHeightScale * mProjectionScale;
+		cut.Version = mCutVersion;
+
+		// The root enters the traversal with every view whose frustum it intersects
+		if (mTraversalJobs.empty())
+			mTraversalJobs.resize(1);
+		TraversalJob& topJob = mTraversalJobs[0];
+		topJob.Root = TraversalEntry{};
+		topJob.NodesVisited = 0;
+		topJob.NodesCulled = 0;
+		topJob.NodesReused = 0;
+		for (int v = 0; v < viewCount; ++v)
+		{
+			ViewState& view = mViews[v];
+			if (view.NodeRefined.size() != mNodes.size())
+			{
+				view.NodeRefined.assign(mNodes.size(), 0);
+				view.NodeStamp.assign(mNodes.size(), 0);
+				view.NodeState.assign(mNodes.size(), NodeUnvisited);
+				view.NodeTileSlot.assign(mNodes.size(), 0);
+				view.SubtreeExpiry.assign(mNodes.size(), kNoExpiry);
+				view.SplitNodes.clear();
+			}
+			UndoForcedSplits(view);
+			view.Frustum.Extract(views[v].ViewProj);
+			view.ErrorScale = std::max(views[v].ErrorScale, 0.f);
+			cut.ErrorScale = view.ErrorScale;
+			if (!(cut == view.Cut))
+			{
+				std::fill(view.SubtreeExpiry.begin(), view.SubtreeExpiry.end(), kNoExpiry);
+				view.Cut = cut;
+			}
+			view.NodesCulled = 0;
+			view.ForcedSplits = 0;
+			topJob.Tiles[v].clear();
+			uint32_t rootMask = view.Frustum.PlaneMask;
+			if (!view.Frustum.Intersects(mBounds, 0, rootMask))
+			{
+				SetNodeState(view, 0, NodeUnvisited);
+				view.SubtreeExpiry[0] = kNoExpiry;
+				++topJob.NodesCulled;
+				continue;
+			}
+			topJob.Root.ViewMask |= 1u << v;
+			topJob.Root.PlaneMasks[v] = (uint8_t)rootMask;
+		}
+
+		// The levels above the split run here; each subtree below it is one job for the pool, so
+		// a deep tree's traversal spreads over the threads wherever the views look
+		int jobCount = 1;
+		if (topJob.Root.ViewMask)
+		{
+			const int splitLevel = mLODLevels > kTraversalSplitLevel + 1 ? kTraversalSplitLevel : 0;
+			mDeferredRoots.clear();
+			TraverseViews(topJob, eyePos, splitLevel, splitLevel > 0 ? &mDeferredRoots : nullptr);
+			jobCount += (int)mDeferredRoots.size();
+			if ((int)mTraversalJobs.size() < jobCount)
+				mTraversalJobs.resize(jobCount);
+			for (int j = 1; j < jobCount; ++j)
+			{
+				TraversalJob& job = mTraversalJobs[j];
+				job.Root = mDeferredRoots[j - 1];
+				job.NodesVisited = 0;
+				job.NodesCulled = 0;
+				job.NodesReused = 0;
+				for (int v = 0; v < viewCount; ++v)
+					job.Tiles[v].clear();
+			}
+			mJobPool.Run(jobCount - 1, [this, &eyePos](int j) {
+				TraverseViews(mTraversalJobs[j + 1], eyePos, 0, nullptr);
+			});
+			// The levels above the split, deepest first, take their expiry from the subtrees below
+			for (int lod = splitLevel - 1; lod >= 0; --lod)
+				for (uint32_t i = TerrainLevelOffset(lod); i < TerrainLevelOffset(lod + 1); ++i)
+					for (int v = 0; v < viewCount; ++v)
+						if (mViews[v].NodeStamp[i] == mFrameStamp && GetNodeState(mViews[v], i) == NodeRefined)
+							FoldSubtreeExpiry(mViews[v], i);
+		}
+
+		// Per view: gather the jobs' tiles in job order, then balance and stitch
+		mJobPool.Run(viewCount, [this, &eyePos, jobCount](int v) {
+			ViewState& view = mViews[v];
+			view.Tiles.swap(mTraversalJobs[0].Tiles[v]);
+			for (int j = 1; j < jobCount; ++j)
+				view.Tiles.insert(view.Tiles.end(), mTraversalJobs[j].Tiles[v].begin(), mTraversalJobs[j].Tiles[v].end());
+			for (uint32_t i = 0; i < (uint32_t)view.Tiles.size(); ++i)
+				view.NodeTileSlot[view.Tiles[i].NodeIndex] = i;
+			BalanceLOD(view, eyePos);
+			ComputeNeighborMasks(view);
+		});
+
+		for (int j = 0; j < jobCount; ++j)
+		{
+			mStats.NodesVisited += mTraversalJobs[j].NodesVisited;
+			mStats.NodesCulled += mTraversalJobs[j].NodesCulled;
+			mStats.NodesReused += mTraversalJobs[j].NodesReused;
+		}
+		for (int v = 0; v < viewCount; ++v)
+		{
+			mStats.NodesCulled += mViews[v].NodesCulled;
+			mStats.ForcedSplits += mViews[v].ForcedSplits;
+			if (v > 0)
+				mStats.ShadowTiles += (uint32_t)mViews[v].Tiles.size();
+		}
+		if (mTileCache)
+			RequestTiles(eyePos);
+		if (mOcclusionCulling)
+			CullOccludedTiles(views[0], eyePos);
+	}
+	mStats.UpdateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+float Terrain::GetClipmapSpacing() const
+{
+	return mWorldSizeXZ / (float)(kTerrainGridResolution << (mLODLevels - 1));
+}
+
+void Terrain::UpdateClipmap(const XMFLOAT3& eyePos)
+{
+	const float spacing = GetClipmapSpacing();
+	if (mClipmap.GetLevelCount() != mClipmapLevels || mClipmap.GetFinestSpacing() != spacing)
+	{
+		mClipmap.Configure(mClipmapLevels, kTerrainClipmapQuads, spacing);
+		mClipmapRegions.clear();
+	}
+	// Nobody uploaded for a while (e.g. a benchmark): rewrite everything once instead
+	if (mClipmapRegions.size() > 64u * (size_t)mClipmapLevels)
+	{
+		mClipmapRegions.clear();
+		mClipmap.Invalidate();
+	}
+	const size_t first = mClipmapRegions.size();
+	mClipmap.Update(eyePos.x, eyePos.z, mClipmapRegions);
+	for (size_t i = first; i < mClipmapRegions.size(); ++i)
+		mStats.ClipmapSamplesUpdated += (uint32_t)(mClipmapRegions[i].Width * mClipmapRegions[i].Height);
+}
+
+void Terrain::FillClipmapRegion(const TerrainClipmapRegion& region, float* dst, size_t rowPitch) const
+{
+	FillTerrainClipmapRegion(mHeightfield, mWorldSizeXZ, mClipmap, region, dst, rowPitch);
+}
+
+TerrainClipmapBenchmark Terrain::BenchmarkClipmap(int moves, float step) const
+{
+	return BenchmarkTerrainClipmap(mHeightfield, mWorldSizeXZ, mClipmapLevels, kTerrainClipmapQuads,
+		GetClipmapSpacing(), moves, step);
+}
+
+TerrainCameraPathBenchmark Terrain::BenchmarkCameraPath(const std::vector<TerrainView>& views, const std::vector<XMFLOAT3>& eyes)
+{
+	TerrainCameraPathBenchmark result;
+	result.Frames = (int)std::min(views.size(), eyes.size());
+	if (result.Frames == 0)
+		return result;
+	const bool coherence = mTemporalCoherence;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		mTemporalCoherence = pass == 1;
+		// Both passes start with the cut of the first frame
+		UpdateViews(&views[0], 1, eyes[0]);
+		double visited = 0.0, reused = 0.0;
+		const auto start = std::chrono::steady_clock::now();
+		for (int f = 0; f < result.Frames; ++f)
+		{
+			UpdateViews(&views[f], 1, eyes[f]);
+			visited += mStats.NodesVisited;
+			reused += mStats.NodesReused;
+		}
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / result.Frames;
+		(pass == 1 ? result.CoherentMs : result.FullMs) = ms;
+		(pass == 1 ? result.CoherentNodesVisited : result.FullNodesVisited) = visited / result.Frames;
+		if (pass == 1)
+			result.CoherentNodesReused = reused / result.Frames;
+	}
+	mTemporalCoherence = coherence;
+	return result;
 }
 
 void Terrain::FillTileFromNode(const TerrainNode& node, TerrainTile& outTile) const
@@ -148,37 +1040,84 @@ void Terrain::FillTileFromNode(const TerrainNode& node, TerrainTile& outTile) co
 	outTile.TileX = node.TileX;
 	outTile.TileZ = node.TileZ;
 	outTile.HeightmapSrvIndex = node.HeightmapSrvIndex;
+	outTile.NormalMapSrvIndex = node.NormalMapSrvIndex;
+	outTile.HeightmapUV = node.HeightmapUV;
 	outTile.AABB = node.Bounds;
-	float half = node.Bounds.Extents.x;
-	XMMATRIX world = XMMatrixScaling(half * 2.f, mHeightScale, half * 2.f);
-	world = XMMatrixMultiply(world, XMMatrixTranslationFromVector(XMLoadFloat3(&node.Bounds.Center)));
-	XMStoreFloat4x4(&outTile.World, XMMatrixTranspose(world));
-	outTile.PrevWorld = outTile.World;
+	outTile.World = node.World;
+	outTile.PrevWorld = node.World;
+}
+
+void Terrain::AssignHeightmapIndices(const std::vector<std::vector<int>>& indicesPerLevel,
+	const std::vector<std::vector<int>>& normalMapsPerLevel)
+{
+	mHeightmapIndices = indicesPerLevel;
+	mNormalMapIndices = normalMapsPerLevel;
+	ApplyHeightmapIndices();
 }
 
-void Terrain::AssignHeightmapIndicesRecursive(TerrainNode& node,
-	const std::vector<int>& lod0, const std::vector<int>& lod1, const std::vector<int>& lod2)
+void Terrain::SetTileHeightmapIndex(int lod, int tileX, int tileZ, int srvIndex, int normalMapSrvIndex)
 {
-	if (node.LOD == 0 && !lod0.empty()) node.HeightmapSrvIndex = lod0[0];
-	else if (node.LOD == 1 && node.TileX >= 0 && node.TileX < 2 && node.TileZ >= 0 && node.TileZ < 2)
+	if (lod < 0 || lod >= kTerrainMaxLODLevels)
+		return;
+	const int tilesPerSide = 1 << lod;
+	if (tileX < 0 || tileZ < 0 || tileX >= tilesPerSide || tileZ >= tilesPerSide)
+		return;
+	for (auto* perLevel : { &mHeightmapIndices, &mNormalMapIndices })
 	{
-		int idx = node.TileZ * 2 + node.TileX;
-		if (idx < (int)lod1.size()) node.HeightmapSrvIndex = lod1[idx];
+		if ((int)perLevel->size() <= lod)
+			perLevel->resize(lod + 1);
+		std::vector<int>& level = (*perLevel)[lod];
+		if ((int)level.size() < tilesPerSide * tilesPerSide)
+			level.resize(tilesPerSide * tilesPerSide, -1);
 	}
-	else if (node.LOD == 2 && node.TileX >= 0 && node.TileX < 4 && node.TileZ >= 0 && node.TileZ < 4)
+	mHeightmapIndices[lod][tileZ * tilesPerSide + tileX] = srvIndex;
+	mNormalMapIndices[lod][tileZ * tilesPerSide + tileX] = normalMapSrvIndex;
+	if (lod < mLODLevels && !mNodes.empty())
+		ApplyHeightmapIndices(TerrainLevelOffset(lod) + TerrainMortonEncode((uint32_t)tileX, (uint32_t)tileZ));
+}
+
+void Terrain::ApplyHeightmapIndices(uint32_t subtreeRoot)
+{
+	if (mNodes.empty())
+		return;
+	// A subtree is one contiguous Morton range per level; level order resolves parents first
+	const int rootLOD = mNodes[subtreeRoot].LOD;
+	const uint32_t rootMorton = subtreeRoot - TerrainLevelOffset(rootLOD);
+	for (int lod = rootLOD; lod < mLODLevels; ++lod)
 	{
-		int idx = node.TileZ * 4 + node.TileX;
-		if (idx < (int)lod2.size()) node.HeightmapSrvIndex = lod2[idx];
+		const uint32_t shift = 2u * (uint32_t)(lod - rootLOD);
+		const uint32_t first = TerrainLevelOffset(lod) + (rootMorton << shift);
+		for (uint32_t i = first; i < first + (1u << shift); ++i)
+			ResolveHeightmapIndex(i);
 	}
-	for (int i = 0; i < 4; ++i)
-		if (node.Children[i])
-			AssignHeightmapIndicesRecursive(*node.Children[i], lod0, lod1, lod2);
 }
 
-void Terrain::AssignHeightmapIndices(const std::vector<int>& lod0Indices,
-	const std::vector<int>& lod1Indices,
-	const std::vector<int>& lod2Indices)
+void Terrain::ResolveHeightmapIndex(uint32_t index)
 {
-	if (mRoot)
-		AssignHeightmapIndicesRecursive(*mRoot, lod0Indices, lod1Indices, lod2Indices);
+	TerrainNode& node = mNodes[index];
+	const int tilesPerSide = 1 << node.LOD;
+	const int idx = node.TileZ * tilesPerSide + node.TileX;
+	auto lookup = [&node, idx](const std::vector<std::vector<int>>& perLevel) {
+		return (node.LOD < (int)perLevel.size() && idx < (int)perLevel[node.LOD].size()) ? perLevel[node.LOD][idx] : -1;
+	};
+	node.HeightmapSrvIndex = lookup(mHeightmapIndices);
+	node.NormalMapSrvIndex = node.HeightmapSrvIndex >= 0 ? lookup(mNormalMapIndices) : -1;
+	node.HeightmapUV = XMFLOAT4(1.f, 1.f, 0.f, 0.f);
+	node.HeightmapSource = index;
+	if (node.HeightmapSrvIndex >= 0 || node.LOD == 0)
+		return;
+
+	// Inherit the parent's heightmap, restricted to this child's quadrant.
+	// Heightmap V runs towards -Z, so the low-Z child maps to the upper half of V.
+	const uint32_t morton = index - TerrainLevelOffset(node.LOD);
+	const TerrainNode& parent = mNodes[TerrainLevelOffset(node.LOD - 1) + (morton >> 2)];
+	const float cx = (float)(node.TileX & 1);
+	const float cz = (float)(node.TileZ & 1);
+	node.HeightmapSrvIndex = parent.HeightmapSrvIndex;
+	node.NormalMapSrvIndex = parent.NormalMapSrvIndex;
+	node.HeightmapSource = parent.HeightmapSource;
+	node.HeightmapUV = XMFLOAT4(
+		parent.HeightmapUV.x * 0.5f, parent.HeightmapUV.y * 0.5f,
+		parent.HeightmapUV.z + parent.HeightmapUV.x * 0.5f * cx,
+		parent.HeightmapUV.w + parent.HeightmapUV.y * 0.5f * (1.f - cz));
 }
@@ -2,38 +2,122 @@
 
 #include "../../Common/d3dUtil.h"
 #include "../../Common/MathHelper.h"
+#include "TerrainClipmap.h"
+#include "TerrainFrustum.h"
+#include "TerrainGrid.h"
+#include "TerrainHeightmap.h"
+#include "TerrainOcclusion.h"
+#include "TerrainQuery.h"
+#include "TerrainRtin.h"
+#include "TerrainStreaming.h"
+#include "TerrainViews.h"
 #include <DirectXCollision.h>
-#include <memory>
+#include <cstdint>
 #include <vector>
 
-// LOD levels: 0 = 001 (512), 1 = 002 (1024), 2 = 003 (2048)
-constexpr int kTerrainLODLevels = 3;
-// Tile counts per level: 1, 2x2, 4x4
-constexpr int kTerrainTilesLOD0 = 1;
-constexpr int kTerrainTilesLOD1 = 4;
-constexpr int kTerrainTilesLOD2 = 16;
+// LOD levels: 0 = 001 (512), 1 = 002 (1024), 2 = 003 (2048); deeper levels reuse an ancestor heightmap
+constexpr int kTerrainDefaultLODLevels = 3;
+// Up to 10 levels = 512x512 leaves
+constexpr int kTerrainMaxLODLevels = 10;
+
+// Adaptive (RTIN) meshes are built for levels 0 .. kTerrainAdaptiveMaxLevels-1; deeper nodes share
+// one full-grid mesh (1365 meshes at most, so even a zero error bound stays within a few hundred MB)
+constexpr int kTerrainAdaptiveMaxLevels = 6;
+
+// Flat quadtree layout: nodes are stored level by level, each level in Morton (Z) order,
+// so the 4 children of a node are contiguous and (level, morton) -> index is pure arithmetic.
+inline uint32_t TerrainLevelOffset(int lod)
+{
+	return ((1u << (2 * lod)) - 1u) / 3u;
+}
+
+inline uint32_t TerrainNodeCount(int levels)
+{
+	return TerrainLevelOffset(levels);
+}
+
+inline uint32_t TerrainMortonEncode(uint32_t x, uint32_t z)
+{
+	auto part = [](uint32_t v) {
+		v &= 0x0000ffffu;
+		v = (v | (v << 8)) & 0x00ff00ffu;
+		v = (v | (v << 4)) & 0x0f0f0f0fu;
+		v = (v | (v << 2)) & 0x33333333u;
+		v = (v | (v << 1)) & 0x55555555u;
+		return v;
+	};
+	return part(x) | (part(z) << 1);
+}
+
+inline void TerrainMortonDecode(uint32_t m, uint32_t& x, uint32_t& z)
+{
+	auto compact = [](uint32_t v) {
+		v &= 0x55555555u;
+		v = (v | (v >> 1)) & 0x33333333u;
+		v = (v | (v >> 2)) & 0x0f0f0f0fu;
+		v = (v | (v >> 4)) & 0x00ff00ffu;
+		v = (v | (v >> 8)) & 0x0000ffffu;
+		return v;
+	};
+	x = compact(m);
+	z = compact(m >> 1);
+}
 
 struct TerrainTile
 {
-	int LOD = 0;           // 0, 1, 2
-	int TileX = 0;         // tile index in X (0..1 for LOD1, 0..3 for LOD2)
+	int LOD = 0;           // 0 .. levels-1
+	int TileX = 0;         // tile index in X (0 .. 2^LOD-1)
 	int TileZ = 0;         // tile index in Z
 	int HeightmapSrvIndex = -1; // index into descriptor heap for this tile's heightmap
+	int NormalMapSrvIndex = -1; // baked normal map matching the heightmap texel for texel (-1 = none)
+	DirectX::XMFLOAT4 HeightmapUV = { 1.f, 1.f, 0.f, 0.f }; // xy = scale, zw = offset into HeightmapSrvIndex
+	float MorphFactor = 0.f;     // geomorph: 0 = own LOD, 1 = matches the parent LOD's geometry
+	uint32_t NodeIndex = 0;      // index into Terrain's node array
+	uint32_t NeighborMask = 0;   // TerrainEdge bits of sides bordering a one-LOD-coarser tile
 	DirectX::BoundingBox AABB;   // world AABB for frustum culling
 	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 PrevWorld = MathHelper::Identity4x4();
 };
 
-// Quadtree node for LOD selection
+// Quadtree node for LOD selection (element of Terrain's flat node array)
 struct TerrainNode
 {
 	DirectX::BoundingBox Bounds;
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4(); // transposed, computed once at build time
+	DirectX::XMFLOAT4 HeightmapUV = { 1.f, 1.f, 0.f, 0.f };
+	float GeometricError = 0.f; // max height deviation from the full-res heightfield, in [0,1] height units
+	float MinHeight = 0.f;      // normalized height range covered by the tile (from the min/max pyramid)
+	float MaxHeight = 1.f;
 	int LOD = 0;
 	int TileX = 0;
 	int TileZ = 0;
 	int HeightmapSrvIndex = -1;
-	std::unique_ptr<TerrainNode> Children[4];
-	bool IsLeaf() const { return !Children[0]; }
+	int NormalMapSrvIndex = -1; // the heightmap source's normal map, same UV rectangle
+	uint32_t HeightmapSource = 0; // node whose heightmap is sampled: itself or the nearest ancestor with one
+};
+
+enum class TerrainMode
+{
+	Quadtree, // frustum-culled LOD tiles over the fixed [-worldSize/2, worldSize/2] square
+	Clipmap,  // nested rings around the camera over the heightfield repeated across the plane
+};
+
+// Quads per side of every clipmap ring (the ring grid is built once by the app)
+constexpr int kTerrainClipmapQuads = 128;
+
+struct TerrainStats
+{
+	double UpdateMs = 0.0;
+	uint32_t Views = 0;        // views selected by the last update, the camera included
+	uint32_t NodesVisited = 0; // nodes the shared traversal evaluated, once however many views see them
+	uint32_t NodesReused = 0;  // node/view pairs whose last decision was kept without evaluating (temporal coherence)
+	uint32_t NodesCulled = 0;  // node/view pairs rejected by a frustum test
+	uint32_t ForcedSplits = 0; // nodes split only to keep neighbouring tiles within one LOD, all views
+	uint32_t ShadowTiles = 0;  // tiles selected for the views after the camera
+	uint32_t TileRequests = 0; // streaming requests (visible + prefetch) submitted this update
+	uint32_t ClipmapSamplesUpdated = 0; // clipmap heights that scrolled in this update
+	uint32_t TilesOccluded = 0; // camera tiles dropped behind nearer terrain (horizon culling)
+	double OcclusionMs = 0.0;
 };
 
 class Terrain
@@ -47,45 +131,265 @@ public:
 	void SetOriginY(float y);
 	float GetOriginY() const { return mOriginY; }
 	// Height scale: heightmap value 0..1 multiplied by this
-	void SetHeightScale(float scale) { mHeightScale = scale; }
+	void SetHeightScale(float scale);
 	float GetHeightScale() const { return mHeightScale; }
-	// LOD distance thresholds (distance from camera: below LOD1 use 4 tiles, below LOD2 use 16)
-	void SetLODDistances(float maxDistLOD1, float maxDistLOD2);
-	float GetMaxDistLOD1() const { return mMaxDistLOD1; }
-	float GetMaxDistLOD2() const { return mMaxDistLOD2; }
+	// Screen-space error LOD: a node refines while its geometric error projects to more than
+	// maxPixelError pixels, and once refined only coarsens below maxPixelError * (1 - hysteresis)
+	void SetViewport(float fovY, float viewportHeight);
+	void SetMaxPixelError(float pixels) { mMaxPixelError = pixels; }
+	float GetMaxPixelError() const { return mMaxPixelError; }
+	void SetLODHysteresis(float fraction) { mLODHysteresis = fraction; }
+	float GetLODHysteresis() const { return mLODHysteresis; }
+	// Number of quadtree levels (1..kTerrainMaxLODLevels), takes effect on next BuildQuadtree
+	void SetLODLevels(int levels);
+	int GetLODLevels() const { return mLODLevels; }
+
+	// CPU heightfield used to measure per-node geometric error and tight AABB heights via a
+	// min/max pyramid (takes effect on next BuildQuadtree). Without one, error is estimated as
+	// halving per level and every AABB spans the full height range.
+	void SetHeightfield(TerrainHeightfield heightfield);
+	const TerrainHeightfield& GetHeightfield() const { return mHeightfield; }
+
+	// CPU queries on the quadtree terrain's surface (same heightfield and placement as the tiles);
+	// flat at originY without a heightfield. See TerrainHeightQuery for the batched forms.
+	float SampleHeight(float x, float z) const { return mHeightQuery.SampleHeight(x, z); }
+	DirectX::XMFLOAT3 SampleNormal(float x, float z) const;
+	bool Raycast(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, TerrainRayHit& hit) const;
+	const TerrainHeightQuery& GetHeightQuery() const { return mHeightQuery; }
+	TerrainQueryBenchmark BenchmarkQueries(size_t count) const;
+	// Use the min/max pyramid for node Y extents (off = full [originY, originY + heightScale])
+	void SetTightHeightBounds(bool enable);
+	bool GetTightHeightBounds() const { return mTightHeightBounds; }
 
-	// Build quadtree: LOD0 = 1 tile, LOD1 = 4 children, LOD2 = 16 leaves
+	// Heightmap streaming: Update requests the tile each visible node wants from the cache (levels
+	// [firstLevel, firstLevel + levelCount); deeper nodes want their ancestor at the last streamed
+	// level) and touches the resident tile it currently falls back to. nullptr disables requests.
+	void SetTileStreaming(TerrainTileCache* cache, int firstLevel, int levelCount);
+	// Also request tiles around the eye extrapolated this many updates ahead (0 = no prefetch)
+	void SetPrefetchLookahead(float updates) { mPrefetchLookahead = updates; }
+	float GetPrefetchLookahead() const { return mPrefetchLookahead; }
+
+	// Clipmap mode skips the quadtree: Update recentres the rings and queues the heights to upload
+	void SetMode(TerrainMode mode);
+	TerrainMode GetMode() const { return mMode; }
+	// Ring count; the finest ring has the deepest quadtree level's vertex spacing
+	void SetClipmapLevels(int levels);
+	int GetClipmapLevels() const { return mClipmapLevels; }
+	const TerrainClipmap& GetClipmap() const { return mClipmap; }
+	// Regions queued by Update since the last ClearClipmapRegions (the owner uploads them)
+	const std::vector<TerrainClipmapRegion>& GetClipmapRegions() const { return mClipmapRegions; }
+	void ClearClipmapRegions() { mClipmapRegions.clear(); }
+	void FillClipmapRegion(const TerrainClipmapRegion& region, float* dst, size_t rowPitch) const;
+	// Cost of one camera move with the current settings (see BenchmarkTerrainClipmap)
+	TerrainClipmapBenchmark BenchmarkClipmap(int moves, float step) const;
+
+	// Error-bounded adaptive meshes: every node gets its own RTIN mesh within maxErrorWorld (world
+	// height units) of the grid heights, with a skirt hiding cracks to neighbours. Rebuilt in parallel
+	// by Update when enabled and the heightfield, tree or height scale changed; the node's mesh error
+	// is added to its geometric error for LOD selection. Without a heightfield no meshes are built.
+	void SetAdaptiveMeshes(bool enable, float maxErrorWorld);
+	bool GetAdaptiveMeshesEnabled() const { return mAdaptiveEnabled; }
+	float GetAdaptiveMeshError() const { return mAdaptiveMeshError; }
+	const TerrainMeshSet& GetAdaptiveMeshes() const { return mAdaptiveMeshes; }
+	// Range of a node's mesh in GetAdaptiveMeshes (deeper nodes than kTerrainAdaptiveMaxLevels share the last one)
+	const TerrainMeshRange& GetAdaptiveMeshRange(uint32_t nodeIndex) const;
+	// Incremented on every rebuild, so the owner knows when to upload again
+	uint32_t GetAdaptiveMeshVersion() const { return mAdaptiveMeshVersion; }
+	const TerrainRtinStats& GetAdaptiveMeshStats() const { return mAdaptiveStats; }
+
+	// Build flat quadtree: level L has 2^L x 2^L tiles, bounds and world matrices precomputed
 	void BuildQuadtree();
 
-	// Update visible tiles: frustum culling + LOD by distance, fill mVisibleTiles
+	// Update visible tiles: frustum culling + LOD by screen-space error, then a balance pass that
+	// keeps adjacent visible tiles within one LOD and sets each tile's NeighborMask
 	void Update(const DirectX::XMFLOAT4X4& viewProj, const DirectX::XMFLOAT3& eyePos);
+	// Update the tiles of up to kTerrainMaxViews views in one traversal; views[0] is the camera at
+	// eyePos and alone drives streaming. Every view refines by the camera's projected error (times
+	// its ErrorScale), so shadow casters match the geometry the camera sees and each node's error is
+	// computed once; culling, hysteresis, balancing and neighbour masks are per view. Subtrees and
+	// then views are spread over the update threads. Clipmap mode selects no tiles.
+	void UpdateViews(const TerrainView* views, int viewCount, const DirectX::XMFLOAT3& eyePos);
+	// Threads for UpdateViews including the caller (0 = one per hardware thread, at most 4)
+	void SetUpdateThreads(int threads);
+	// Keep each view's cut between updates: a subtree fully inside a view's frustum whose refine
+	// decisions cannot have flipped since they were made (the eye moved less than the distance any
+	// of its nodes had to its refine or coarsen threshold) is re-emitted from the stored cut, with
+	// only its geomorph refreshed. The tiles are the same as a full traversal's.
+	void SetTemporalCoherence(bool enable) { mTemporalCoherence = enable; }
+	bool GetTemporalCoherence() const { return mTemporalCoherence; }
+	// Drop the camera's tiles hidden behind nearer terrain (TerrainHorizonCuller), after streaming
+	// requests so hidden tiles still load. Only while the eye is above the ground inside the square;
+	// assumes the near plane clips no terrain in front of the eye, as at walking height and above.
+	void SetOcclusionCulling(bool enable) { mOcclusionCulling = enable; }
+	bool GetOcclusionCulling() const { return mOcclusionCulling; }
+	// Replay a camera path (see BuildTerrainCameraPath) with and without temporal coherence
+	TerrainCameraPathBenchmark BenchmarkCameraPath(const std::vector<TerrainView>& views, const std::vector<DirectX::XMFLOAT3>& eyes);
 
-	const std::vector<TerrainTile>& GetVisibleTiles() const { return mVisibleTiles; }
+	// Tiles of a view of the last update (0 = the camera; empty for views it did not have)
+	const std::vector<TerrainTile>& GetVisibleTiles(int view = 0) const;
+	int GetViewCount() const { return mViewCount; }
+	const TerrainStats& GetStats() const { return mStats; }
 
 	// Tile world transform and AABB for a node
 	void FillTileFromNode(const TerrainNode& node, TerrainTile& outTile) const;
-	// Assign heightmap SRV index to each node (call after textures loaded)
-	void AssignHeightmapIndices(const std::vector<int>& lod0Indices,
-		const std::vector<int>& lod1Indices,
-		const std::vector<int>& lod2Indices);
+	// Assign heightmap SRV index to each node (call after textures loaded; kept across rebuilds).
+	// indicesPerLevel[L] holds 2^L x 2^L indices in row-major (z * n + x) order; levels without
+	// their own heightmaps sample the matching sub-rectangle of the nearest ancestor's heightmap.
+	// normalMapsPerLevel has the same layout for the heightmaps' baked normal maps (-1 = none).
+	void AssignHeightmapIndices(const std::vector<std::vector<int>>& indicesPerLevel,
+		const std::vector<std::vector<int>>& normalMapsPerLevel = {});
+	// Change one tile's heightmap (-1 = not resident) and normal map; its subtree re-resolves the nearest ancestor
+	void SetTileHeightmapIndex(int lod, int tileX, int tileZ, int srvIndex, int normalMapSrvIndex = -1);
 
-	const TerrainNode* GetRoot() const { return mRoot.get(); }
+	const std::vector<TerrainNode>& GetNodes() const { return mNodes; }
+	const TerrainNode* GetRoot() const { return mNodes.empty() ? nullptr : &mNodes[0]; }
 	float GetWorldSizeXZ() const { return mWorldSizeXZ; }
 
 private:
 	float mWorldSizeXZ = 100.0f;
 	float mHeightScale = 50.0f;
 	float mOriginY = 0.0f;
-	float mMaxDistLOD1 = 60.0f;
-	float mMaxDistLOD2 = 30.0f;
-	std::unique_ptr<TerrainNode> mRoot;
-	std::vector<TerrainTile> mVisibleTiles;
-
-	void BuildNode(TerrainNode& node, int lod, int tileX, int tileZ, int tilesPerSide);
-	bool IntersectsFrustum(const DirectX::BoundingBox& box, const DirectX::XMFLOAT4X4& viewProj) const;
-	float DistanceToNode(const DirectX::BoundingBox& box, const DirectX::XMFLOAT3& eyePos) const;
-	void SelectLOD(const TerrainNode& node, const DirectX::XMFLOAT4X4& viewProj,
-		const DirectX::XMFLOAT3& eyePos, float maxDistLOD1, float maxDistLOD2);
-	void AssignHeightmapIndicesRecursive(TerrainNode& node,
-		const std::vector<int>& lod0, const std::vector<int>& lod1, const std::vector<int>& lod2);
+	float mMaxPixelError = 4.0f;
+	float mLODHysteresis = 0.2f;
+	float mProjectionScale = 500.0f; // viewportHeight / (2 * tan(fovY / 2))
+	int mLODLevels = kTerrainDefaultLODLevels;
+	bool mTransformsDirty = false;
+	bool mTightHeightBounds = true;
+	std::vector<TerrainNode> mNodes;
+	TerrainNodeBounds mBounds;
+	// What a view's refine decisions depend on besides the eye; stored cuts are dropped when it changes
+	struct CutSettings
+	{
+		float Tau = 0.f;
+		float CoarsenRatio = 0.f;
+		float ErrorScale = 0.f;
+		float ErrorFactor = 0.f; // mHeightScale * mProjectionScale
+		uint32_t Version = 0;    // mCutVersion
+		bool operator==(const CutSettings& o) const
+		{
+			return Tau == o.Tau && CoarsenRatio == o.CoarsenRatio && ErrorScale == o.ErrorScale &&
+				ErrorFactor == o.ErrorFactor && Version == o.Version;
+		}
+	};
+	// Per-view cut, sized for the tree on first use and kept between updates. Node states are valid
+	// for every node reachable from the root through refined nodes; the rest are stale and unread.
+	struct ViewState
+	{
+		TerrainFrustum Frustum;
+		float ErrorScale = 1.f;
+		CutSettings Cut;
+		std::vector<uint8_t> NodeRefined; // last frame's refine decision, for hysteresis
+		std::vector<uint32_t> NodeStamp;  // mFrameStamp of the node's last evaluation as refined
+		std::vector<uint8_t> NodeState;
+		std::vector<uint32_t> NodeTileSlot; // index into Tiles for emitted nodes
+		// mEyeTravel up to which the cut below the node (the node itself when emitted) stays as it
+		// was evaluated; -inf once it is unknown (culled inside, split by balancing, settings changed)
+		std::vector<double> SubtreeExpiry;
+		std::vector<uint32_t> SplitNodes; // forced splits of the last update, undone before the next
+		std::vector<uint32_t> BalanceQueue;
+		std::vector<TerrainTile> Tiles;
+		uint32_t NodesCulled = 0;
+		uint32_t ForcedSplits = 0;
+	};
+	// A node reached by the shared traversal, with the views that still see it and the planes
+	// each of them straddles
+	struct TraversalEntry
+	{
+		uint32_t Index;
+		uint32_t ViewMask;
+		float ParentError; // the parent's projected error at ErrorScale 1
+		uint8_t PlaneMasks[kTerrainMaxViews];
+		bool Exit; // popped after the node's subtree: fold its children's expiry into the node's
+	};
+	// Output of one traversal job; jobs are concatenated in order, so the result does not depend
+	// on which thread ran which subtree
+	struct TraversalJob
+	{
+		TraversalEntry Root;
+		std::vector<TerrainTile> Tiles[kTerrainMaxViews];
+		uint32_t NodesVisited = 0;
+		uint32_t NodesCulled = 0;
+		uint32_t NodesReused = 0;
+	};
+	std::vector<ViewState> mViews;
+	int mViewCount = 0;
+	uint32_t mFrameStamp = 0;
+	std::vector<TraversalJob> mTraversalJobs; // [0] = the levels above the split, then one per subtree
+	std::vector<TraversalEntry> mDeferredRoots;
+	TerrainJobPool mJobPool;
+	int mUpdateThreads = 0;
+	bool mTemporalCoherence = true;
+	bool mOcclusionCulling = false;
+	TerrainHorizonCuller mHorizonCuller;
+	std::vector<TerrainOcclusionTile> mOcclusionTiles;
+	std::vector<uint8_t> mOcclusionVisible;
+	uint32_t mCutVersion = 0;     // bumped when node bounds or errors change
+	double mEyeTravel = 0.0;      // path length of the eye over all updates
+	DirectX::XMFLOAT3 mLastEyePos = { 0.f, 0.f, 0.f };
+	TerrainTileCache* mTileCache = nullptr;
+	int mStreamFirstLevel = 0;
+	int mStreamLevelCount = 0;
+	float mPrefetchLookahead = 30.0f;
+	DirectX::XMFLOAT3 mPrevEyePos = { 0.f, 0.f, 0.f };
+	bool mHasPrevEye = false;
+	std::vector<TerrainTileRequest> mTileRequests;
+	TerrainMode mMode = TerrainMode::Quadtree;
+	int mClipmapLevels = 8;
+	TerrainClipmap mClipmap;
+	std::vector<TerrainClipmapRegion> mClipmapRegions;
+	TerrainHeightfield mHeightfield;
+	TerrainHeightPyramid mHeightPyramid;
+	TerrainHeightQuery mHeightQuery; // references mHeightfield
+	std::vector<std::vector<int>> mHeightmapIndices;
+	std::vector<std::vector<int>> mNormalMapIndices;
+	TerrainStats mStats;
+	bool mAdaptiveEnabled = false;
+	bool mAdaptiveDirty = true;
+	float mAdaptiveMeshError = 0.05f;
+	TerrainMeshSet mAdaptiveMeshes;
+	TerrainRtinStats mAdaptiveStats;
+	std::vector<float> mAdaptiveNodeError; // GeometricError + mesh error, never shrinking going up
+	uint32_t mAdaptiveMeshVersion = 0;
+
+	void UpdateNodeTransforms();
+	void UpdateQueryPlacement() { mHeightQuery.SetPlacement(mWorldSizeXZ, mOriginY, mHeightScale); }
+	// Resolve heightmap index, UV rectangle and source for a node and all its descendants
+	void ApplyHeightmapIndices(uint32_t subtreeRoot = 0);
+	void ResolveHeightmapIndex(uint32_t index);
+	void ComputeGeometricErrors();
+	void ComputeHeightRanges();
+	void BuildAdaptiveMeshes();
+	// Projected geometric error of a node in pixels, using the distance from the eye to its AABB
+	// (returned in distance, clamped away from 0 as the error uses it)
+	float ProjectedError(uint32_t index, const DirectX::XMFLOAT3& eyePos, float* distance = nullptr) const;
+	// Select LOD below job.Root for its views into job's tile lists; with deferred set, children at
+	// splitLevel are appended to it instead of being descended
+	void TraverseViews(TraversalJob& job, const DirectX::XMFLOAT3& eyePos, int splitLevel, std::vector<TraversalEntry>* deferred);
+
+	// Emit the view's stored cut below index (evaluated at an earlier update and still valid) in
+	// traversal order, recomputing only the tiles' geomorph
+	void ReuseSubtree(ViewState& view, std::vector<TerrainTile>& tiles, uint32_t index, float parentError,
+		const DirectX::XMFLOAT3& eyePos, uint32_t& reused) const;
+	// Lower a refined node's expiry to its children's
+	void FoldSubtreeExpiry(ViewState& view, uint32_t index) const;
+	// Restore the cut as traversed last update, before BalanceLOD split nodes of it
+	void UndoForcedSplits(ViewState& view) const;
+
+	enum NodeState : uint8_t { NodeUnvisited = 0, NodeRefined, NodeEmitted };
+	NodeState GetNodeState(const ViewState& view, uint32_t index) const { return (NodeState)view.NodeState[index]; }
+	void SetNodeState(ViewState& view, uint32_t index, NodeState state) const { view.NodeState[index] = state; }
+	// Geomorph factor of a tile from its parent's projected error
+	float ComputeMorph(float parentError) const;
+	// Append a tile for the node to tiles (the view's own list or a traversal job's)
+	void EmitTile(ViewState& view, std::vector<TerrainTile>& tiles, uint32_t index, float morph) const;
+	// Deepest node of the view's cut covering tile (x, z) of level lod (refined nodes are descended)
+	uint32_t FindCoveringNode(const ViewState& view, int lod, int x, int z) const;
+	// Restricted quadtree: split emitted tiles more than one LOD coarser than a neighbour
+	void BalanceLOD(ViewState& view, const DirectX::XMFLOAT3& eyePos);
+	void ComputeNeighborMasks(ViewState& view);
+	void RequestTiles(const DirectX::XMFLOAT3& eyePos);
+	// Horizon culling of the camera's tiles (SetOcclusionCulling)
+	void CullOccludedTiles(const TerrainView& view, const DirectX::XMFLOAT3& eyePos);
+	float GetClipmapSpacing() const;
+	void UpdateClipmap(const DirectX::XMFLOAT3& eyePos);
 };
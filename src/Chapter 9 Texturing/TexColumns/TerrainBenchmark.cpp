@@ -0,0 +1,212 @@
+#include "TerrainBenchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+
+using namespace DirectX;
+
+void TerrainPointerQuadtree::Build(float worldSizeXZ, float originY, float heightScale)
+{
+	mHeightScale = heightScale;
+	mRoot = std::make_unique<Node>();
+	mRoot->LOD = 0;
+	mRoot->TileX = 0;
+	mRoot->TileZ = 0;
+	XMFLOAT3 center(0.f, originY + heightScale * 0.5f, 0.f);
+	XMFLOAT3 extents(worldSizeXZ * 0.5f, heightScale * 0.5f, worldSizeXZ * 0.5f);
+	mRoot->Bounds = BoundingBox(center, extents);
+	BuildNode(*mRoot, 0, 0, 0);
+}
+
+void TerrainPointerQuadtree::SetLODDistances(float maxDistLOD1, float maxDistLOD2)
+{
+	mMaxDistLOD1 = maxDistLOD1;
+	mMaxDistLOD2 = maxDistLOD2;
+}
+
+void TerrainPointerQuadtree::BuildNode(Node& node, int lod, int tileX, int tileZ)
+{
+	node.LOD = lod;
+	node.TileX = tileX;
+	node.TileZ = tileZ;
+	if (lod >= kLevels - 1) return; // leaf at LOD2
+	float half = node.Bounds.Extents.x;
+	float quarter = half * 0.5f;
+	XMVECTOR c = XMLoadFloat3(&node.Bounds.Center);
+	for (int i = 0; i < 4; ++i)
+	{
+		node.Children[i] = std::make_unique<Node>();
+		int cx = i % 2;
+		int cz = i / 2;
+		float ox = (cx == 0) ? -quarter : quarter;
+		float oz = (cz == 0) ? -quarter : quarter;
+		XMFLOAT3 childCenter;
+		XMStoreFloat3(&childCenter, c + XMVectorSet(ox, 0.f, oz, 0.f));
+		node.Children[i]->Bounds = BoundingBox(childCenter, XMFLOAT3(quarter, node.Bounds.Extents.y, quarter));
+		BuildNode(*node.Children[i], lod + 1, tileX * 2 + cx, tileZ * 2 + cz);
+	}
+}
+
+float TerrainPointerQuadtree::DistanceToNode(const BoundingBox& box, const XMFLOAT3& eyePos) const
+{
+	XMVECTOR e = XMLoadFloat3(&eyePos);
+	XMVECTOR c = XMLoadFloat3(&box.Center);
+	XMVECTOR d = XMVector3LengthEst(XMVectorSubtract(e, c));
+	return XMVectorGetX(d);
+}
+
+void TerrainPointerQuadtree::SelectLOD(const Node& node, const XMFLOAT4X4& viewProj, const XMFLOAT3& eyePos)
+{
+	++mNodesVisited;
+	if (!IntersectsFrustumPerNode(node.Bounds, viewProj))
+		return;
+	float dist = DistanceToNode(node.Bounds, eyePos);
+	if (node.IsLeaf() || node.LOD == kLevels - 1)
+	{
+		TerrainTile tile;
+		FillTileFromNode(node, tile);
+		mVisibleTiles.push_back(tile);
+		return;
+	}
+	bool useChild = (node.LOD == 0 && dist < mMaxDistLOD1) || (node.LOD == 1 && dist < mMaxDistLOD2);
+	if (useChild && node.Children[0])
+	{
+		for (int i = 0; i < 4; ++i)
+			SelectLOD(*node.Children[i], viewProj, eyePos);
+	}
+	else
+	{
+		TerrainTile tile;
+		FillTileFromNode(node, tile);
+		mVisibleTiles.push_back(tile);
+	}
+}
+
+void TerrainPointerQuadtree::Update(const XMFLOAT4X4& viewProj, const XMFLOAT3& eyePos)
+{
+	mVisibleTiles.clear();
+	mNodesVisited = 0;
+	if (!mRoot) return;
+	SelectLOD(*mRoot, PerNodeViewProj(viewProj), eyePos);
+}
+
+void TerrainPointerQuadtree::FillTileFromNode(const Node& node, TerrainTile& outTile) const
+{
+	outTile.LOD = node.LOD;
+	outTile.TileX = node.TileX;
+	outTile.TileZ = node.TileZ;
+	outTile.HeightmapSrvIndex = node.HeightmapSrvIndex;
+	outTile.AABB = node.Bounds;
+	float half = node.Bounds.Extents.x;
+	XMMATRIX world = XMMatrixScaling(half * 2.f, mHeightScale, half * 2.f);
+	world = XMMatrixMultiply(world, XMMatrixTranslationFromVector(XMLoadFloat3(&node.Bounds.Center)));
+	XMStoreFloat4x4(&outTile.World, XMMatrixTranspose(world));
+	outTile.PrevWorld = outTile.World;
+}
+
+namespace
+{
+	// The app's terrain placement and LOD settings
+	const float kBenchmarkWorldSize = 100.0f;
+	const float kBenchmarkHeightScale = 50.0f;
+	const float kBenchmarkOriginY = 125.0f;
+	const float kBenchmarkLOD1Factor = 0.6f;
+	const float kBenchmarkLOD2Factor = 0.3f;
+
+	TerrainHeightfield BenchmarkHeightfield()
+	{
+		TerrainHeightfield field;
+		field.Width = field.Height = 513;
+		for (int z = 0; z < field.Height; ++z)
+			for (int x = 0; x < field.Width; ++x)
+				field.Heights.push_back(0.5f + 0.3f * std::sin(x * 0.031f) * std::cos(z * 0.027f) +
+					0.1f * std::sin((x + 2 * z) * 0.19f) + 0.02f * std::sin(x * 1.3f) * std::sin(z * 1.1f));
+		return field;
+	}
+}
+
+TerrainUpdateBenchmark BenchmarkTerrainUpdate(TerrainCameraPath path, int levels, int frames)
+{
+	TerrainUpdateBenchmark result;
+	result.Levels = std::clamp(levels, 1, kTerrainMaxLODLevels);
+
+	Terrain terrain;
+	terrain.SetWorldSize(kBenchmarkWorldSize);
+	terrain.SetHeightScale(kBenchmarkHeightScale);
+	terrain.SetOriginY(kBenchmarkOriginY);
+	terrain.SetViewport(XM_PIDIV4, 720.f);
+	terrain.SetLODLevels(result.Levels);
+	terrain.SetHeightfield(BenchmarkHeightfield());
+	terrain.BuildQuadtree();
+
+	TerrainPointerQuadtree pointerTree;
+	pointerTree.Build(kBenchmarkWorldSize, kBenchmarkOriginY, kBenchmarkHeightScale);
+	pointerTree.SetLODDistances(kBenchmarkWorldSize * kBenchmarkLOD1Factor, kBenchmarkWorldSize * kBenchmarkLOD2Factor);
+
+	std::vector<TerrainView> views;
+	std::vector<XMFLOAT3> eyes;
+	BuildTerrainCameraPath(path, kBenchmarkWorldSize, XM_PIDIV4, 16.f / 9.f, std::max(frames, 1),
+		[&terrain](float x, float z) { return terrain.SampleHeight(x, z); }, views, eyes);
+	result.Frames = (int)views.size();
+
+	double visited = 0.0, tiles = 0.0;
+	auto start = std::chrono::steady_clock::now();
+	for (int f = 0; f < result.Frames; ++f)
+	{
+		pointerTree.Update(views[f].ViewProj, eyes[f]);
+		visited += pointerTree.GetNodesVisited();
+		tiles += (double)pointerTree.GetVisibleTiles().size();
+	}
+	result.PointerTreeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / result.Frames;
+	result.PointerTreeNodesVisited = visited / result.Frames;
+	result.PointerTreeTiles = tiles / result.Frames;
+
+	for (int coherent = 0; coherent < 2; ++coherent)
+	{
+		terrain.SetTemporalCoherence(coherent != 0);
+		// Both passes start with the cut of the first frame
+		terrain.Update(views[0].ViewProj, eyes[0]);
+		visited = tiles = 0.0;
+		start = std::chrono::steady_clock::now();
+		for (int f = 0; f < result.Frames; ++f)
+		{
+			terrain.Update(views[f].ViewProj, eyes[f]);
+			visited += terrain.GetStats().NodesVisited;
+			tiles += (double)terrain.GetVisibleTiles().size();
+		}
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / result.Frames;
+		if (coherent)
+		{
+			result.CoherentMs = ms;
+			result.CoherentNodesVisited = visited / result.Frames;
+		}
+		else
+		{
+			result.UpdateMs = ms;
+			result.UpdateNodesVisited = visited / result.Frames;
+			result.UpdateTiles = tiles / result.Frames;
+		}
+	}
+	return result;
+}
+
+void PrintTerrainUpdateBenchmark(std::ostream& out, const char* name, const TerrainUpdateBenchmark& b)
+{
+	char line[512];
+	std::snprintf(line, sizeof(line),
+		"%s, %d frames: pointer tree (3 levels) %.4f ms, %.1f nodes, %.1f tiles | Update (%d levels) %.4f ms, %.1f nodes, "
+		"%.1f tiles | coherent %.4f ms, %.1f nodes\n",
+		name, b.Frames, b.PointerTreeMs, b.PointerTreeNodesVisited, b.PointerTreeTiles, b.Levels, b.UpdateMs,
+		b.UpdateNodesVisited, b.UpdateTiles, b.CoherentMs, b.CoherentNodesVisited);
+	out << line;
+}
+
+void PrintTerrainFrustumBenchmark(std::ostream& out, const TerrainFrustumBenchmark& b)
+{
+	char line[256];
+	std::snprintf(line, sizeof(line), "Frustum tests, %u nodes: per-node %.1f M/s | scalar %.1f M/s | SoA %.1f M/s\n",
+		b.Nodes, b.PerNodeNodesPerSec * 1e-6, b.ScalarNodesPerSec * 1e-6, b.SoANodesPerSec * 1e-6);
+	out << line;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Terrain.h"
+#include <DirectXCollision.h>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+// The quadtree Terrain used before the flat node array, kept only as the baseline of
+// BenchmarkTerrainUpdate: one make_unique node per tile, 3 levels (1, 2x2, 4x4 tiles), a level's children
+// chosen by the distance from the eye to the node's centre, and IntersectsFrustumPerNode on every node
+// visited. Built and updated as it was, so the comparison includes its allocations and pointer chasing;
+// only the matrix goes through PerNodeViewProj once per update, as the old test culled the wrong boxes.
+class TerrainPointerQuadtree
+{
+public:
+	static constexpr int kLevels = 3;
+
+	// Full terrain in XZ: [-worldSizeXZ/2, worldSizeXZ/2], Y from originY to originY + heightScale
+	void Build(float worldSizeXZ, float originY, float heightScale);
+	// Distance below which the root (maxDistLOD1) and level 1 nodes (maxDistLOD2) use their children
+	void SetLODDistances(float maxDistLOD1, float maxDistLOD2);
+	// viewProj is stored transposed (as in PassConstants)
+	void Update(const DirectX::XMFLOAT4X4& viewProj, const DirectX::XMFLOAT3& eyePos);
+
+	const std::vector<TerrainTile>& GetVisibleTiles() const { return mVisibleTiles; }
+	// Nodes Update tested against the frustum
+	uint32_t GetNodesVisited() const { return mNodesVisited; }
+
+private:
+	struct Node
+	{
+		DirectX::BoundingBox Bounds;
+		int LOD = 0;
+		int TileX = 0;
+		int TileZ = 0;
+		int HeightmapSrvIndex = -1;
+		std::unique_ptr<Node> Children[4];
+		bool IsLeaf() const { return !Children[0]; }
+	};
+
+	float mHeightScale = 50.0f;
+	float mMaxDistLOD1 = 60.0f;
+	float mMaxDistLOD2 = 30.0f;
+	std::unique_ptr<Node> mRoot;
+	std::vector<TerrainTile> mVisibleTiles;
+	uint32_t mNodesVisited = 0;
+
+	void BuildNode(Node& node, int lod, int tileX, int tileZ);
+	float DistanceToNode(const DirectX::BoundingBox& box, const DirectX::XMFLOAT3& eyePos) const;
+	void SelectLOD(const Node& node, const DirectX::XMFLOAT4X4& viewProj, const DirectX::XMFLOAT3& eyePos);
+	void FillTileFromNode(const Node& node, TerrainTile& outTile) const;
+};
+
+struct TerrainUpdateBenchmark
+{
+	int Frames = 0;
+	int Levels = 0;                       // of the Terrain; the pointer tree always has 3
+	double PointerTreeMs = 0.0;           // average TerrainPointerQuadtree::Update
+	double PointerTreeNodesVisited = 0.0; // average per update
+	double PointerTreeTiles = 0.0;
+	double UpdateMs = 0.0;                // average Terrain::Update, every node evaluated
+	double UpdateNodesVisited = 0.0;
+	double UpdateTiles = 0.0;
+	double CoherentMs = 0.0;              // ... with temporal coherence, as the app runs it
+	double CoherentNodesVisited = 0.0;
+};
+
+// The pointer tree (at the app's old LOD distances, 0.6 and 0.3 of the world size) against Terrain::Update
+// (the app's default settings, `levels` levels) along the same camera path over a synthetic heightfield
+TerrainUpdateBenchmark BenchmarkTerrainUpdate(TerrainCameraPath path, int levels, int frames);
+
+// One line per benchmark
+void PrintTerrainUpdateBenchmark(std::ostream& out, const char* name, const TerrainUpdateBenchmark& benchmark);
+void PrintTerrainFrustumBenchmark(std::ostream& out, const TerrainFrustumBenchmark& benchmark);
@@ -0,0 +1,278 @@
+#include "TerrainClipmap.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+namespace
+{
+	int PositiveMod(int a, int n)
+	{
+		const int m = a % n;
+		return m < 0 ? m + n : m;
+	}
+
+	// Bilinear sample of the heightfield tiled across the plane (texel centres at (i + 0.5) / size)
+	float SampleWrapped(const TerrainHeightfield& heightfield, double u, double v)
+	{
+		const double fx = u * heightfield.Width - 0.5;
+		const double fz = v * heightfield.Height - 0.5;
+		const double flx = std::floor(fx), flz = std::floor(fz);
+		const int x0 = PositiveMod((int)(int64_t)flx, heightfield.Width);
+		const int z0 = PositiveMod((int)(int64_t)flz, heightfield.Height);
+		const int x1 = x0 + 1 == heightfield.Width ? 0 : x0 + 1;
+		const int z1 = z0 + 1 == heightfield.Height ? 0 : z0 + 1;
+		const float tx = (float)(fx - flx), tz = (float)(fz - flz);
+		const float h0 = heightfield.At(x0, z0) + (heightfield.At(x1, z0) - heightfield.At(x0, z0)) * tx;
+		const float h1 = heightfield.At(x0, z1) + (heightfield.At(x1, z1) - heightfield.At(x0, z1)) * tx;
+		return h0 + (h1 - h0) * tz;
+	}
+}
+
+void TerrainClipmap::Configure(int levels, int quadsPerSide, float finestSpacing)
+{
+	mQuads = std::clamp(quadsPerSide / 4 * 4, 8, 252);
+	mLevels.assign(std::clamp(levels, 1, kTerrainClipmapMaxLevels), TerrainClipmapLevel());
+	for (size_t l = 0; l < mLevels.size(); ++l)
+		mLevels[l].Spacing = std::ldexp(finestSpacing, (int)l);
+	mValid = false;
+}
+
+void TerrainClipmap::Invalidate()
+{
+	mValid = false;
+}
+
+int TerrainClipmap::GetRingVariant(int level) const
+{
+	const int k = mQuads / 4;
+	return (mLevels[level].HoleX - k) + 2 * (mLevels[level].HoleZ - k);
+}
+
+void TerrainClipmap::Update(float eyeX, float eyeZ, std::vector<TerrainClipmapRegion>& regions)
+{
+	const int size = GetTextureSize();
+	for (int l = 0; l < (int)mLevels.size(); ++l)
+	{
+		TerrainClipmapLevel& level = mLevels[l];
+		// Centre the window on the eye, snapped to even samples (= the coarser level's lattice)
+		const int newX = 2 * (int)std::floor(((double)eyeX / level.Spacing - mQuads * 0.5) * 0.5);
+		const int newZ = 2 * (int)std::floor(((double)eyeZ / level.Spacing - mQuads * 0.5) * 0.5);
+		const int oldX = level.OriginX, oldZ = level.OriginZ;
+		level.OriginX = newX;
+		level.OriginZ = newZ;
+		const int dx = newX - oldX, dz = newZ - oldZ;
+		if (!mValid || std::abs(dx) >= size || std::abs(dz) >= size)
+		{
+			AddRegion(l, newX, newZ, size, size, regions);
+			continue;
+		}
+		// Newly exposed columns over the full new height, then rows over the remaining columns
+		int keepX0 = newX, keepX1 = newX + size;
+		if (dx > 0)
+		{
+			AddRegion(l, oldX + size, newZ, dx, size, regions);
+			keepX1 = oldX + size;
+		}
+		else if (dx < 0)
+		{
+			AddRegion(l, newX, newZ, -dx, size, regions);
+			keepX0 = oldX;
+		}
+		if (dz > 0)
+			AddRegion(l, keepX0, oldZ + size, keepX1 - keepX0, dz, regions);
+		else if (dz < 0)
+			AddRegion(l, keepX0, newZ, keepX1 - keepX0, -dz, regions);
+	}
+	// The finer window starts at sample 2 * (parent origin + hole) of its own lattice
+	for (size_t l = 1; l < mLevels.size(); ++l)
+	{
+		mLevels[l].HoleX = mLevels[l - 1].OriginX / 2 - mLevels[l].OriginX;
+		mLevels[l].HoleZ = mLevels[l - 1].OriginZ / 2 - mLevels[l].OriginZ;
+	}
+	mValid = true;
+}
+
+void TerrainClipmap::AddRegion(int level, int x, int z, int width, int height, std::vector<TerrainClipmapRegion>& regions) const
+{
+	if (width <= 0 || height <= 0)
+		return;
+	const int size = GetTextureSize();
+	const int texX = PositiveMod(x, size), texZ = PositiveMod(z, size);
+	const int w0 = std::min(width, size - texX), h0 = std::min(height, size - texZ);
+	regions.push_back({ level, x, z, w0, h0, texX, texZ });
+	if (w0 < width)
+		regions.push_back({ level, x + w0, z, width - w0, h0, 0, texZ });
+	if (h0 < height)
+	{
+		regions.push_back({ level, x, z + h0, w0, height - h0, texX, 0 });
+		if (w0 < width)
+			regions.push_back({ level, x + w0, z + h0, width - w0, height - h0, 0, 0 });
+	}
+}
+
+void BuildTerrainClipmapIndices(int quadsPerSide, int holeX, int holeZ, std::vector<uint16_t>& indices)
+{
+	const int n = quadsPerSide + 1;
+	const int hole = quadsPerSide / 2;
+	for (int j = 0; j < quadsPerSide; ++j)
+		for (int i = 0; i < quadsPerSide; ++i)
+		{
+			if (holeX >= 0 && i >= holeX && i < holeX + hole && j >= holeZ && j < holeZ + hole)
+				continue;
+			const uint16_t v00 = (uint16_t)(j * n + i), v10 = (uint16_t)(v00 + 1);
+			const uint16_t v01 = (uint16_t)(v00 + n), v11 = (uint16_t)(v01 + 1);
+			// Clockwise seen from +Y, like GeometryGenerator::CreateGrid
+			indices.insert(indices.end(), { v00, v01, v10, v10, v01, v11 });
+		}
+}
+
+void FillTerrainClipmapRegion(const TerrainHeightfield& heightfield, float worldSize, const TerrainClipmap& clipmap,
+	const TerrainClipmapRegion& region, float* dst, size_t rowPitch)
+{
+	const double spacing = clipmap.GetLevel(region.Level).Spacing;
+	for (int row = 0; row < region.Height; ++row)
+	{
+		float* out = dst + (size_t)row * rowPitch;
+		if (heightfield.Empty())
+		{
+			std::fill(out, out + region.Width, 0.f);
+			continue;
+		}
+		// Heightmap V runs towards -Z, as in the quadtree tiles
+		const double z = (region.Z + row) * spacing;
+		const double v = (worldSize * 0.5 - z) / worldSize;
+		for (int col = 0; col < region.Width; ++col)
+		{
+			const double x = (region.X + col) * spacing;
+			out[col] = SampleWrapped(heightfield, (x + worldSize * 0.5) / worldSize, v);
+		}
+	}
+}
+
+TerrainClipmapBenchmark BenchmarkTerrainClipmap(const TerrainHeightfield& heightfield, float worldSize,
+	int levels, int quadsPerSide, float finestSpacing, int moves, float step)
+{
+	TerrainClipmapBenchmark result;
+	TerrainClipmap clipmap;
+	clipmap.Configure(levels, quadsPerSide, finestSpacing);
+	std::vector<TerrainClipmapRegion> regions;
+	clipmap.Update(0.f, 0.f, regions); // initial full fill is not a move
+	std::vector<float> scratch((size_t)clipmap.GetTextureSize() * clipmap.GetTextureSize());
+
+	moves = std::max(moves, 1);
+	double updateUs = 0.0, fillUs = 0.0;
+	size_t samples = 0;
+	for (int m = 1; m <= moves; ++m)
+	{
+		regions.clear();
+		const auto t0 = std::chrono::steady_clock::now();
+		clipmap.Update(m * step * 0.8f, m * step * 0.6f, regions);
+		const auto t1 = std::chrono::steady_clock::now();
+		for (const TerrainClipmapRegion& region : regions)
+		{
+			FillTerrainClipmapRegion(heightfield, worldSize, clipmap, region, scratch.data(), (size_t)region.Width);
+			samples += (size_t)region.Width * region.Height;
+		}
+		const auto t2 = std::chrono::steady_clock::now();
+		updateUs += std::chrono::duration<double, std::micro>(t1 - t0).count();
+		fillUs += std::chrono::duration<double, std::micro>(t2 - t1).count();
+	}
+	result.UpdateUs = updateUs / moves;
+	result.FillUs = fillUs / moves;
+	result.SamplesPerMove = (double)samples / moves;
+	return result;
+}
+
+bool ValidateTerrainClipmap(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	// Ring variants: every quad but the hole covered exactly once
+	const int quads = 16, k = quads / 4;
+	for (int variant = 0; variant < kTerrainClipmapRingVariants; ++variant)
+	{
+		const int holeX = variant < 4 ? k + (variant & 1) : -1;
+		const int holeZ = variant < 4 ? k + (variant >> 1) : -1;
+		std::vector<uint16_t> indices;
+		BuildTerrainClipmapIndices(quads, holeX, holeZ, indices);
+		std::vector<int> covered(quads * quads, 0);
+		const int n = quads + 1;
+		for (size_t t = 0; t < indices.size(); t += 3)
+		{
+			const int i = std::min({ indices[t] % n, indices[t + 1] % n, indices[t + 2] % n });
+			const int j = std::min({ indices[t] / n, indices[t + 1] / n, indices[t + 2] / n });
+			++covered[j * quads + i];
+		}
+		for (int j = 0; j < quads; ++j)
+			for (int i = 0; i < quads; ++i)
+			{
+				const bool inHole = holeX >= 0 && i >= holeX && i < holeX + quads / 2 && j >= holeZ && j < holeZ + quads / 2;
+				if (covered[j * quads + i] != (inHole ? 0 : 2))
+					return fail("ring variant " + std::to_string(variant) + " covers quad (" +
+						std::to_string(i) + ", " + std::to_string(j) + ") wrongly");
+			}
+	}
+
+	TerrainHeightfield heightfield;
+	heightfield.Width = heightfield.Height = 37;
+	heightfield.Heights.resize(37 * 37);
+	for (size_t i = 0; i < heightfield.Heights.size(); ++i)
+		heightfield.Heights[i] = (float)((i * 2654435761u) % 1000u) / 1000.f;
+	const float worldSize = 50.f;
+
+	TerrainClipmap clipmap;
+	clipmap.Configure(4, quads, 0.75f);
+	const int size = clipmap.GetTextureSize();
+	std::vector<float> textures((size_t)clipmap.GetLevelCount() * size * size, -1.f);
+	std::vector<float> expected((size_t)size * size);
+	std::vector<TerrainClipmapRegion> regions;
+	uint32_t seed = 777u;
+	auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return (float)(seed >> 8) / 16777216.f; };
+	float eyeX = 3.f, eyeZ = -2.f;
+	for (int move = 0; move < 400; ++move)
+	{
+		const float r = random();
+		const float step = r < 0.05f ? 500.f : (r < 0.5f ? 1.f : 8.f); // occasional jump past all windows
+		eyeX += (random() - 0.5f) * step;
+		eyeZ += (random() - 0.5f) * step;
+		regions.clear();
+		clipmap.Update(eyeX, eyeZ, regions);
+		for (const TerrainClipmapRegion& region : regions)
+		{
+			if (region.TexX < 0 || region.TexZ < 0 || region.TexX + region.Width > size || region.TexZ + region.Height > size)
+				return fail("region crosses the texture wrap");
+			float* dst = textures.data() + ((size_t)region.Level * size + region.TexZ) * size + region.TexX;
+			FillTerrainClipmapRegion(heightfield, worldSize, clipmap, region, dst, (size_t)size);
+		}
+
+		for (int l = 0; l < clipmap.GetLevelCount(); ++l)
+		{
+			const TerrainClipmapLevel& level = clipmap.GetLevel(l);
+			if (l > 0 && (level.HoleX < k || level.HoleX > k + 1 || level.HoleZ < k || level.HoleZ > k + 1))
+				return fail("hole outside the ring variants");
+			if (l > 0 && (clipmap.GetLevel(l - 1).OriginX != 2 * (level.OriginX + level.HoleX) ||
+				clipmap.GetLevel(l - 1).OriginZ != 2 * (level.OriginZ + level.HoleZ)))
+				return fail("finer window does not fill the hole");
+			const float eyeSamplesX = eyeX / level.Spacing - level.OriginX;
+			const float eyeSamplesZ = eyeZ / level.Spacing - level.OriginZ;
+			if (eyeSamplesX < quads / 2 - 2 || eyeSamplesX > quads / 2 + 2 || eyeSamplesZ < quads / 2 - 2 || eyeSamplesZ > quads / 2 + 2)
+				return fail("window not centred on the eye");
+
+			FillTerrainClipmapRegion(heightfield, worldSize, clipmap, { l, level.OriginX, level.OriginZ, size, size, 0, 0 },
+				expected.data(), (size_t)size);
+			for (int z = 0; z < size; ++z)
+				for (int x = 0; x < size; ++x)
+				{
+					const int tx = ((level.OriginX + x) % size + size) % size;
+					const int tz = ((level.OriginZ + z) % size + size) % size;
+					if (textures[((size_t)l * size + tz) * size + tx] != expected[(size_t)z * size + x])
+						return fail("level " + std::to_string(l) + " texel stale after move " + std::to_string(move));
+				}
+		}
+	}
+	return true;
+}
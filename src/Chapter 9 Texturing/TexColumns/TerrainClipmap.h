@@ -0,0 +1,97 @@
+#pragma once
+
+#include "TerrainHeightmap.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr int kTerrainClipmapMaxLevels = 12;
+// Ring index variants: 4 hole positions (TerrainClipmap::GetRingVariant) + the full grid of level 0
+constexpr int kTerrainClipmapRingVariants = 5;
+
+// One clipmap level: a window of (quads + 1)^2 height samples on the level's lattice, where
+// sample (x, z) sits at world (x * Spacing, z * Spacing). The window starts at an even sample,
+// so its samples at even offsets coincide with the next coarser level's lattice.
+// Sample (x, z) is stored at texel (x mod size, z mod size): the texture is addressed toroidally
+// and moving the window only rewrites the samples that scrolled in.
+struct TerrainClipmapLevel
+{
+	int OriginX = 0;
+	int OriginZ = 0;
+	float Spacing = 1.f;
+	int HoleX = 0; // quad offset of the next finer level's window inside this one (levels > 0)
+	int HoleZ = 0;
+};
+
+// Samples [X, X + Width) x [Z, Z + Height) of a level's lattice that must be (re)written, stored at
+// texels [TexX, TexX + Width) x [TexZ, TexZ + Height); regions never cross the toroidal wrap.
+struct TerrainClipmapRegion
+{
+	int Level = 0;
+	int X = 0;
+	int Z = 0;
+	int Width = 0;
+	int Height = 0;
+	int TexX = 0;
+	int TexZ = 0;
+};
+
+// Nested square rings centred on the camera. Level L has spacing finestSpacing * 2^L and the same
+// sample count, so the covered area doubles per level while the vertex count stays constant.
+class TerrainClipmap
+{
+public:
+	// quadsPerSide: multiple of 4 up to 252 (16-bit indices); the finer level fills a quads/2 hole
+	void Configure(int levels, int quadsPerSide, float finestSpacing);
+	bool IsConfigured() const { return !mLevels.empty(); }
+	int GetLevelCount() const { return (int)mLevels.size(); }
+	int GetQuadsPerSide() const { return mQuads; }
+	int GetTextureSize() const { return mQuads + 1; }
+	float GetFinestSpacing() const { return mLevels.empty() ? 0.f : mLevels[0].Spacing; }
+	const TerrainClipmapLevel& GetLevel(int level) const { return mLevels[level]; }
+
+	// Recentre every level on the eye and append the samples that scrolled in: per level an
+	// L-shaped pair of strips (newly exposed columns, then rows), split at the texture wrap.
+	// The first Update after Configure/Invalidate, or a jump past a whole window, rewrites it all.
+	void Update(float eyeX, float eyeZ, std::vector<TerrainClipmapRegion>& regions);
+	void Invalidate();
+
+	// Ring index variant (0..3) of a level from its hole position; level 0 draws the full grid
+	int GetRingVariant(int level) const;
+
+private:
+	std::vector<TerrainClipmapLevel> mLevels;
+	int mQuads = 0;
+	bool mValid = false;
+
+	void AddRegion(int level, int x, int z, int width, int height, std::vector<TerrainClipmapRegion>& regions) const;
+};
+
+// Triangle list over a quads x quads grid of (quads + 1)^2 row-major vertices (vertex (i, j) at
+// index j * (quads + 1) + i, i along +X, j along +Z), skipping the quads/2 square hole at quad
+// offset (holeX, holeZ); holeX < 0 builds the full grid.
+void BuildTerrainClipmapIndices(int quadsPerSide, int holeX, int holeZ, std::vector<uint16_t>& indices);
+
+// Fill a region's heights (normalized) from a heightfield repeated every worldSize units, aligned
+// with the quadtree terrain's [-worldSize/2, worldSize/2] square. dst[row * rowPitch + col] is
+// lattice sample (X + col, Z + row). An empty heightfield gives flat ground.
+void FillTerrainClipmapRegion(const TerrainHeightfield& heightfield, float worldSize, const TerrainClipmap& clipmap,
+	const TerrainClipmapRegion& region, float* dst, size_t rowPitch);
+
+struct TerrainClipmapBenchmark
+{
+	double UpdateUs = 0.0;     // average TerrainClipmap::Update per camera move
+	double FillUs = 0.0;       // average time to fill the regions of one move
+	double SamplesPerMove = 0.0;
+};
+
+// Move the eye `moves` times by `step` world units along a fixed diagonal heading and time the
+// ring update and region refill of each move
+TerrainClipmapBenchmark BenchmarkTerrainClipmap(const TerrainHeightfield& heightfield, float worldSize,
+	int levels, int quadsPerSide, float finestSpacing, int moves, float step);
+
+// CPU check on a random walk (small steps, wraps, long jumps): after every move each level's
+// toroidal texture, updated only through the regions, equals a fresh fill of its window, every
+// finer window sits exactly in its parent's hole, and each ring variant covers every quad but the
+// hole exactly once. Returns false with a reason on failure.
+bool ValidateTerrainClipmap(std::string* error = nullptr);
@@ -0,0 +1,382 @@
+#include "TerrainCompression.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+namespace
+{
+	const int kBlockTexels = kTerrainHeightBlockSize * kTerrainHeightBlockSize;
+
+	// Where lane j of a block row starts for each offset width: the byte holding its first bit,
+	// and 2^(7 - bit within that byte) so one multiply lines every lane up for the same shift
+	struct RowLanes
+	{
+		uint32_t Byte[kTerrainHeightBlockSize];
+		alignas(16) uint32_t Mul[kTerrainHeightBlockSize];
+	};
+
+	const RowLanes* GetRowLanes()
+	{
+		static const std::vector<RowLanes> lanes = [] {
+			std::vector<RowLanes> table(17);
+			for (int bits = 0; bits <= 16; ++bits)
+				for (int j = 0; j < kTerrainHeightBlockSize; ++j)
+				{
+					const uint32_t bit = (uint32_t)(j * bits);
+					table[bits].Byte[j] = bit >> 3;
+					table[bits].Mul[j] = 1u << (7 - (bit & 7));
+				}
+			return table;
+		}();
+		return lanes.data();
+	}
+
+	uint32_t Load32(const uint8_t* p)
+	{
+		uint32_t word;
+		std::memcpy(&word, p, sizeof(word));
+		return word;
+	}
+
+	// SSE2 has no 32-bit mullo: multiply the even and odd lanes as 64-bit products and interleave
+	__m128i MulLo32(__m128i a, __m128i b)
+	{
+		const __m128i even = _mm_mul_epu32(a, b);
+		const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+
+	uint32_t Quantize(float h)
+	{
+		return (uint32_t)std::lround(std::clamp(h, 0.f, 1.f) * 65535.f);
+	}
+
+	struct CompressionRandom
+	{
+		uint32_t State = 0x9e3779b9u;
+		uint32_t Next()
+		{
+			State ^= State << 13;
+			State ^= State >> 17;
+			State ^= State << 5;
+			return State;
+		}
+		float Unit() { return (float)(Next() >> 8) / 16777216.f; }
+	};
+
+	double NsPerQuery(size_t count, std::chrono::steady_clock::time_point start)
+	{
+		const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		return ns / (double)std::max<size_t>(count, 1);
+	}
+}
+
+void TerrainCompressedHeightfield::Encode(const TerrainHeightfield& heightfield, const TerrainHeightCompressSettings& settings)
+{
+	mWidth = heightfield.Width;
+	mHeight = heightfield.Height;
+	mBlocks.clear();
+	mOffsets.clear();
+	if (heightfield.Empty())
+	{
+		mWidth = mHeight = mBlocksX = 0;
+		return;
+	}
+	mBlocksX = (mWidth + kTerrainHeightBlockSize - 1) / kTerrainHeightBlockSize;
+	const int blocksZ = (mHeight + kTerrainHeightBlockSize - 1) / kTerrainHeightBlockSize;
+	mBlocks.resize((size_t)mBlocksX * blocksZ);
+
+	// Rounding to a multiple of 2^shift errs by at most 2^(shift - 1)
+	int shift = 0;
+	while (shift < 16 && (1 << shift) <= settings.MaxErrorSteps)
+		++shift;
+	const uint32_t half = shift > 0 ? 1u << (shift - 1) : 0u;
+
+	uint32_t steps[kBlockTexels];
+	for (int bz = 0; bz < blocksZ; ++bz)
+		for (int bx = 0; bx < mBlocksX; ++bx)
+		{
+			uint32_t base = 65535;
+			for (int i = 0; i < kBlockTexels; ++i)
+			{
+				const int x = std::min(bx * kTerrainHeightBlockSize + (i & 7), mWidth - 1);
+				const int z = std::min(bz * kTerrainHeightBlockSize + (i >> 3), mHeight - 1);
+				steps[i] = Quantize(heightfield.At(x, z));
+				base = std::min(base, steps[i]);
+			}
+			uint32_t maxOffset = 0;
+			for (int i = 0; i < kBlockTexels; ++i)
+			{
+				steps[i] = (steps[i] - base + half) >> shift;
+				maxOffset = std::max(maxOffset, steps[i]);
+			}
+			int bits = 0;
+			while (bits < 16 && (1u << bits) <= maxOffset)
+				++bits;
+
+			Block& block = mBlocks[(size_t)bz * mBlocksX + bx];
+			block.ByteOffset = (uint32_t)mOffsets.size();
+			block.Base = (uint16_t)base;
+			block.Bits = (uint8_t)bits;
+			block.Shift = (uint8_t)shift;
+			if (bits == 0)
+				continue;
+			// 64 offsets of `bits` bits = 8 * bits bytes; writes spill up to 3 zero bytes past them
+			const size_t start = mOffsets.size();
+			mOffsets.resize(start + (size_t)8 * bits + 4, 0);
+			for (int i = 0; i < kBlockTexels; ++i)
+			{
+				const uint32_t bit = (uint32_t)(i * bits);
+				uint8_t* p = mOffsets.data() + start + (bit >> 3);
+				const uint32_t word = Load32(p) | (steps[i] << (bit & 7));
+				std::memcpy(p, &word, sizeof(word));
+			}
+			mOffsets.resize(start + (size_t)8 * bits);
+		}
+	mOffsets.resize(mOffsets.size() + 4, 0);
+	mOffsets.shrink_to_fit();
+}
+
+uint32_t TerrainCompressedHeightfield::AtQuantized(int x, int z) const
+{
+	const Block& block = mBlocks[(size_t)(z >> 3) * mBlocksX + (x >> 3)];
+	uint32_t step = block.Base;
+	if (block.Bits)
+	{
+		const uint32_t bit = (uint32_t)((((z & 7) << 3) | (x & 7)) * block.Bits);
+		const uint32_t word = Load32(mOffsets.data() + block.ByteOffset + (bit >> 3));
+		step += ((word >> (bit & 7)) & ((1u << block.Bits) - 1)) << block.Shift;
+	}
+	return std::min(step, 65535u);
+}
+
+float TerrainCompressedHeightfield::Sample(float u, float v) const
+{
+	if (Empty()) return 0.f;
+	const float fx = std::clamp(u * mWidth - 0.5f, 0.f, (float)(mWidth - 1));
+	const float fz = std::clamp(v * mHeight - 0.5f, 0.f, (float)(mHeight - 1));
+	const int x0 = (int)fx, z0 = (int)fz;
+	const int x1 = std::min(x0 + 1, mWidth - 1), z1 = std::min(z0 + 1, mHeight - 1);
+	const float tx = fx - (float)x0, tz = fz - (float)z0;
+	const float h00 = At(x0, z0), h10 = At(x1, z0), h01 = At(x0, z1), h11 = At(x1, z1);
+	const float h0 = h00 + (h10 - h00) * tx;
+	const float h1 = h01 + (h11 - h01) * tx;
+	return h0 + (h1 - h0) * tz;
+}
+
+void TerrainCompressedHeightfield::DecodeBlockRow(const Block& block, int row, float* out) const
+{
+	const __m128 scale = _mm_set1_ps(65535.f);
+	if (block.Bits == 0)
+	{
+		const __m128 h = _mm_div_ps(_mm_set1_ps((float)block.Base), scale);
+		_mm_storeu_ps(out, h);
+		_mm_storeu_ps(out + 4, h);
+		return;
+	}
+	const RowLanes& lanes = GetRowLanes()[block.Bits];
+	// Row `row` of the block starts at byte row * bits
+	const uint8_t* p = mOffsets.data() + block.ByteOffset + (size_t)row * block.Bits;
+	const __m128i mask = _mm_set1_epi32((int)((1u << block.Bits) - 1));
+	const __m128i shift = _mm_cvtsi32_si128(block.Shift);
+	const __m128i base = _mm_set1_epi32(block.Base);
+	for (int h = 0; h < kTerrainHeightBlockSize; h += 4)
+	{
+		// No gather in SSE2: the 4 words are loaded one by one, everything after is 4-wide
+		const __m128i words = _mm_setr_epi32((int)Load32(p + lanes.Byte[h]), (int)Load32(p + lanes.Byte[h + 1]),
+			(int)Load32(p + lanes.Byte[h + 2]), (int)Load32(p + lanes.Byte[h + 3]));
+		const __m128i aligned = _mm_srli_epi32(MulLo32(words, _mm_load_si128((const __m128i*)(lanes.Mul + h))), 7);
+		const __m128i steps = _mm_add_epi32(_mm_sll_epi32(_mm_and_si128(aligned, mask), shift), base);
+		_mm_storeu_ps(out + h, _mm_div_ps(_mm_min_ps(_mm_cvtepi32_ps(steps), scale), scale));
+	}
+}
+
+void TerrainCompressedHeightfield::DecodeRow(int z, int x0, int count, float* out) const
+{
+	const Block* blocks = mBlocks.data() + (size_t)(z >> 3) * mBlocksX;
+	const int row = z & 7;
+	alignas(16) float partial[kTerrainHeightBlockSize];
+	for (int x = x0, end = x0 + count; x < end;)
+	{
+		const int first = x & 7;
+		const int n = std::min(kTerrainHeightBlockSize - first, end - x);
+		if (n == kTerrainHeightBlockSize)
+			DecodeBlockRow(blocks[x >> 3], row, out);
+		else
+		{
+			DecodeBlockRow(blocks[x >> 3], row, partial);
+			std::memcpy(out, partial + first, sizeof(float) * n);
+		}
+		out += n;
+		x += n;
+	}
+}
+
+void TerrainCompressedHeightfield::Decode(TerrainHeightfield& out) const
+{
+	out.Width = mWidth;
+	out.Height = mHeight;
+	out.Heights.resize((size_t)mWidth * mHeight);
+	for (int z = 0; z < mHeight; ++z)
+		DecodeRow(z, 0, mWidth, out.Heights.data() + (size_t)z * mWidth);
+}
+
+TerrainHeightCompressionBenchmark BenchmarkTerrainHeightCompression(const TerrainHeightfield& source,
+	const TerrainHeightCompressSettings& settings, size_t count, TerrainCompressedHeightfield& compressed)
+{
+	TerrainHeightCompressionBenchmark result;
+	auto start = std::chrono::steady_clock::now();
+	compressed.Encode(source, settings);
+	result.EncodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (source.Empty())
+		return result;
+
+	const size_t texels = (size_t)source.Width * source.Height;
+	result.Width = source.Width;
+	result.Height = source.Height;
+	result.FloatBytes = texels * sizeof(float);
+	result.R16Bytes = texels * sizeof(uint16_t);
+	result.CompressedBytes = compressed.GetBytes();
+	result.BitsPerTexel = 8.0 * (double)result.CompressedBytes / (double)texels;
+
+	std::vector<float> row(source.Width);
+	for (int z = 0; z < source.Height; ++z)
+	{
+		compressed.DecodeRow(z, 0, source.Width, row.data());
+		for (int x = 0; x < source.Width; ++x)
+			result.MaxError = std::max(result.MaxError, std::abs(row[x] - source.At(x, z)));
+	}
+
+	count = std::max<size_t>(count, 1);
+	CompressionRandom random;
+	std::vector<int> xs(count), zs(count);
+	std::vector<float> us(count), vs(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		xs[i] = (int)(random.Next() % (uint32_t)source.Width);
+		zs[i] = (int)(random.Next() % (uint32_t)source.Height);
+		us[i] = random.Unit();
+		vs[i] = random.Unit();
+	}
+	volatile float sink = 0.f;
+	float sum = 0.f;
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count; ++i)
+		sum += source.At(xs[i], zs[i]);
+	result.FloatAtNs = NsPerQuery(count, start);
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count; ++i)
+		sum += compressed.At(xs[i], zs[i]);
+	result.CompressedAtNs = NsPerQuery(count, start);
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count; ++i)
+		sum += source.Sample(us[i], vs[i]);
+	result.FloatSampleNs = NsPerQuery(count, start);
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count; ++i)
+		sum += compressed.Sample(us[i], vs[i]);
+	result.CompressedSampleNs = NsPerQuery(count, start);
+
+	// Whole rows, as a bake reads them, until at least `count` texels
+	size_t decoded = 0;
+	start = std::chrono::steady_clock::now();
+	for (int z = 0; decoded < count; z = (z + 1) % source.Height)
+	{
+		compressed.DecodeRow(z, 0, source.Width, row.data());
+		sum += row[z % source.Width];
+		decoded += (size_t)source.Width;
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.RowDecodeMTexelsPerSecond = seconds > 0.0 ? (double)decoded / seconds * 1e-6 : 0.0;
+	sink = sum;
+	(void)sink;
+	return result;
+}
+
+bool ValidateTerrainHeightCompression(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	// Odd size (partial edge blocks), R16 steps like a loaded heightmap: hills, a flat plateau
+	// (flat blocks store nothing) and single-texel spikes over the full range (16-bit blocks)
+	TerrainHeightfield field;
+	field.Width = 45;
+	field.Height = 37;
+	CompressionRandom random;
+	for (int z = 0; z < field.Height; ++z)
+		for (int x = 0; x < field.Width; ++x)
+		{
+			float h = 0.4f + 0.3f * std::sin(x * 0.19f) * std::cos(z * 0.23f) + 0.002f * random.Unit();
+			if (x >= 24 && z < 16)
+				h = 0.75f;
+			if ((x == 3 && z == 5) || (x == 44 && z == 36))
+				h = 1.f;
+			if (x == 4 && z == 5)
+				h = 0.f;
+			field.Heights.push_back((float)Quantize(h) / 65535.f);
+		}
+
+	TerrainCompressedHeightfield lossless;
+	lossless.Encode(field);
+	if (lossless.GetWidth() != field.Width || lossless.GetHeight() != field.Height)
+		return fail("compressed heightfield has the wrong size");
+	for (int z = 0; z < field.Height; ++z)
+		for (int x = 0; x < field.Width; ++x)
+			if (lossless.At(x, z) != field.At(x, z))
+				return fail("lossless At differs at " + std::to_string(x) + ", " + std::to_string(z));
+	if (lossless.GetBytes() >= (size_t)field.Width * field.Height * sizeof(uint16_t))
+		return fail("lossless encoding is not smaller than R16");
+
+	for (int i = 0; i < 200; ++i)
+	{
+		const float u = 1.2f * random.Unit() - 0.1f, v = 1.2f * random.Unit() - 0.1f;
+		if (lossless.Sample(u, v) != field.Sample(u, v))
+			return fail("Sample differs from the float heightfield");
+	}
+	std::vector<float> row(field.Width);
+	for (int i = 0; i < 300; ++i)
+	{
+		const int z = (int)(random.Next() % (uint32_t)field.Height);
+		const int x0 = (int)(random.Next() % (uint32_t)field.Width);
+		const int count = 1 + (int)(random.Next() % (uint32_t)(field.Width - x0));
+		std::fill(row.begin(), row.end(), -1.f);
+		lossless.DecodeRow(z, x0, count, row.data());
+		for (int x = 0; x < count; ++x)
+			if (row[x] != field.At(x0 + x, z))
+				return fail("DecodeRow differs from At in row " + std::to_string(z));
+	}
+	TerrainHeightfield decoded;
+	lossless.Decode(decoded);
+	if (decoded.Width != field.Width || decoded.Heights != field.Heights)
+		return fail("Decode differs from the source");
+
+	TerrainHeightCompressSettings lossySettings;
+	lossySettings.MaxErrorSteps = 20;
+	TerrainCompressedHeightfield lossy;
+	lossy.Encode(field, lossySettings);
+	if (lossy.GetBytes() >= lossless.GetBytes())
+		return fail("lossy encoding is not smaller than lossless");
+	for (int z = 0; z < field.Height; ++z)
+	{
+		lossy.DecodeRow(z, 0, field.Width, row.data());
+		for (int x = 0; x < field.Width; ++x)
+		{
+			const int steps = std::abs((int)lossy.AtQuantized(x, z) - (int)Quantize(field.At(x, z)));
+			if (steps > lossySettings.MaxErrorSteps)
+				return fail("lossy error " + std::to_string(steps) + " steps over the bound");
+			if (row[x] != lossy.At(x, z))
+				return fail("lossy DecodeRow differs from At");
+		}
+	}
+
+	TerrainCompressedHeightfield empty;
+	empty.Encode(TerrainHeightfield());
+	if (!empty.Empty() || empty.Sample(0.5f, 0.5f) != 0.f)
+		return fail("empty heightfield does not encode to an empty one");
+	return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "TerrainHeightmap.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Block-compressed CPU heightfield. Heights are quantized to 16 bits as in an R16 heightmap and
+// stored in 8x8 blocks: the block's minimum plus bit-packed offsets from it, each block only as
+// wide as its own height range needs (smooth terrain: 6-11 bits instead of 16 or 32). A block
+// header holds the byte offset of its offsets, so any texel decodes in O(1) without touching its
+// neighbours. A block row's 8 offsets take exactly `bits` bytes, which lets DecodeRow unpack
+// 4 texels per SSE step.
+constexpr int kTerrainHeightBlockSize = 8;
+
+struct TerrainHeightCompressSettings
+{
+	// Largest error allowed, in 16-bit height steps (0 = lossless against R16). Offsets drop
+	// their low bits while rounding keeps within it.
+	int MaxErrorSteps = 0;
+};
+
+class TerrainCompressedHeightfield
+{
+public:
+	// Heights are clamped to [0,1]; partial edge blocks repeat the edge texels
+	void Encode(const TerrainHeightfield& heightfield, const TerrainHeightCompressSettings& settings = {});
+	void Decode(TerrainHeightfield& out) const;
+	bool Empty() const { return mBlocks.empty(); }
+	int GetWidth() const { return mWidth; }
+	int GetHeight() const { return mHeight; }
+
+	// Texel (x, z), row 0 = +Z edge as in TerrainHeightfield; the 16-bit step and the normalized height
+	uint32_t AtQuantized(int x, int z) const;
+	float At(int x, int z) const { return (float)AtQuantized(x, z) / 65535.f; }
+	// Bilinear sample at normalized UV, clamped to the edges (TerrainHeightfield::Sample on the decoded heights)
+	float Sample(float u, float v) const;
+	// Heights of texels [x0, x0 + count) of row z
+	void DecodeRow(int z, int x0, int count, float* out) const;
+
+	// Block headers plus packed offsets
+	size_t GetBytes() const { return mBlocks.size() * sizeof(Block) + mOffsets.size(); }
+
+private:
+	struct Block
+	{
+		uint32_t ByteOffset; // of the block's 64 offsets in mOffsets
+		uint16_t Base;       // smallest height of the block, in 16-bit steps
+		uint8_t Bits;        // per offset, 0..16 (0 = flat block, nothing stored)
+		uint8_t Shift;       // offsets are stored >> Shift
+	};
+	static_assert(sizeof(Block) == 8, "Block header must stay 8 bytes");
+
+	int mWidth = 0;
+	int mHeight = 0;
+	int mBlocksX = 0;
+	std::vector<Block> mBlocks;
+	std::vector<uint8_t> mOffsets; // padded so 4-byte reads past the last offset stay inside
+
+	// Normalized heights of the 8 texels of one block row
+	void DecodeBlockRow(const Block& block, int row, float* out) const;
+};
+
+struct TerrainHeightCompressionBenchmark
+{
+	int Width = 0;
+	int Height = 0;
+	size_t FloatBytes = 0;       // TerrainHeightfield
+	size_t R16Bytes = 0;         // an uncompressed R16 tile set
+	size_t CompressedBytes = 0;
+	double BitsPerTexel = 0.0;
+	float MaxError = 0.f;        // largest |decoded - source|, normalized
+	double EncodeMs = 0.0;
+	double FloatAtNs = 0.0;      // random texel reads, per query on the calling thread
+	double CompressedAtNs = 0.0;
+	double FloatSampleNs = 0.0;  // random bilinear samples
+	double CompressedSampleNs = 0.0;
+	double RowDecodeMTexelsPerSecond = 0.0; // whole rows through DecodeRow
+};
+
+// Encode source with settings (into compressed) and time `count` random queries of each kind on
+// both the float heightfield and the compressed one
+TerrainHeightCompressionBenchmark BenchmarkTerrainHeightCompression(const TerrainHeightfield& source,
+	const TerrainHeightCompressSettings& settings, size_t count, TerrainCompressedHeightfield& compressed);
+
+// CPU check on an odd-sized heightfield with flat blocks and full-range spikes: lossless encoding
+// returns the R16 steps exactly through At, Sample, DecodeRow (any start and length) and Decode,
+// and lossy encoding stays within its error and is smaller. Returns false with a reason on failure.
+bool ValidateTerrainHeightCompression(std::string* error = nullptr);
@@ -0,0 +1,445 @@
+#include "TerrainFrustum.h"
+#include "Terrain.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+void TerrainFrustum::Extract(const XMFLOAT4X4& viewProj)
+{
+	// viewProj is the transpose of the row-vector matrix M, so its rows are the columns of M that
+	// Gribb-Hartmann needs: column c of M = (m[4c], m[4c+1], m[4c+2], m[4c+3]).
+	const float* m = &viewProj.m[0][0];
+	auto getCol = [m](int c) -> XMVECTOR {
+		return XMVectorSet(m[4*c], m[4*c+1], m[4*c+2], m[4*c+3]);
+	};
+	XMVECTOR C0 = getCol(0), C1 = getCol(1), C2 = getCol(2), C3 = getCol(3);
+	XMVECTOR planes[6] = {
+		XMVectorAdd(C3, C0),   // Left
+		XMVectorSubtract(C3, C0), // Right
+		XMVectorAdd(C3, C1),   // Bottom
+		XMVectorSubtract(C3, C1), // Top
+		C2,                    // Near
+		XMVectorSubtract(C3, C2)  // Far
+	};
+	PlaneMask = 0;
+	for (int i = 0; i < 6; ++i)
+	{
+		XMFLOAT4 p;
+		XMStoreFloat4(&p, planes[i]);
+		float len = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+		if (len < 1e-6f)
+		{
+			Nx[i] = Ny[i] = Nz[i] = D[i] = AbsNx[i] = AbsNy[i] = AbsNz[i] = 0.f;
+			continue;
+		}
+		float inv = 1.f / len;
+		Nx[i] = p.x * inv; Ny[i] = p.y * inv; Nz[i] = p.z * inv; D[i] = p.w * inv;
+		AbsNx[i] = std::fabs(Nx[i]); AbsNy[i] = std::fabs(Ny[i]); AbsNz[i] = std::fabs(Nz[i]);
+		PlaneMask |= 1u << i;
+	}
+}
+
+bool TerrainFrustum::Intersects(const TerrainNodeBounds& bounds, uint32_t index, uint32_t& planeMask) const
+{
+	const float cx = bounds.CenterX[index], cy = bounds.CenterY[index], cz = bounds.CenterZ[index];
+	const float ex = bounds.ExtentX[index], ey = bounds.ExtentY[index], ez = bounds.ExtentZ[index];
+	uint32_t straddled = 0;
+	for (int i = 0; i < 6; ++i)
+	{
+		if (!(planeMask & (1u << i))) continue;
+		// AABB vs plane: signed distance of the centre against the projected half-extent
+		const float d = Nx[i] * cx + Ny[i] * cy + Nz[i] * cz + D[i];
+		const float r = AbsNx[i] * ex + AbsNy[i] * ey + AbsNz[i] * ez;
+		if (d + r < 0.f)
+			return false;
+		if (d - r < 0.f)
+			straddled |= 1u << i;
+	}
+	planeMask = straddled;
+	return true;
+}
+
+uint32_t TerrainFrustum::Intersects4(const TerrainNodeBounds& bounds, uint32_t first, uint32_t planeMask, uint32_t childPlaneMasks[4]) const
+{
+	const __m128 cx = _mm_loadu_ps(&bounds.CenterX[first]);
+	const __m128 cy = _mm_loadu_ps(&bounds.CenterY[first]);
+	const __m128 cz = _mm_loadu_ps(&bounds.CenterZ[first]);
+	const __m128 ex = _mm_loadu_ps(&bounds.ExtentX[first]);
+	const __m128 ey = _mm_loadu_ps(&bounds.ExtentY[first]);
+	const __m128 ez = _mm_loadu_ps(&bounds.ExtentZ[first]);
+	const __m128 zero = _mm_setzero_ps();
+	__m128 outside = zero;
+	childPlaneMasks[0] = childPlaneMasks[1] = childPlaneMasks[2] = childPlaneMasks[3] = 0;
+	for (int i = 0; i < 6; ++i)
+	{
+		if (!(planeMask & (1u << i))) continue;
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(Nx[i])),
+			_mm_mul_ps(cy, _mm_set1_ps(Ny[i]))),
+			_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(Nz[i])), _mm_set1_ps(D[i])));
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(AbsNx[i])),
+			_mm_mul_ps(ey, _mm_set1_ps(AbsNy[i]))),
+			_mm_mul_ps(ez, _mm_set1_ps(AbsNz[i])));
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+		const int straddled = _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(d, r), zero));
+		for (int c = 0; c < 4; ++c)
+			childPlaneMasks[c] |= (uint32_t)((straddled >> c) & 1) << i;
+	}
+	return (uint32_t)_mm_movemask_ps(outside);
+}
+
+bool IntersectsFrustumPerNode(const BoundingBox& box, const XMFLOAT4X4& viewProj)
+{
+	// As it was: the rows (m[r], m[r+4], m[r+8], m[r+12]) of the matrix, one normalization per plane and box
+	const float* m = &viewProj.m[0][0];
+	auto getRow = [m](int r) -> XMVECTOR {
+		return XMVectorSet(m[r], m[r+4], m[r+8], m[r+12]);
+	};
+	XMVECTOR R0 = getRow(0), R1 = getRow(1), R2 = getRow(2), R3 = getRow(3);
+	XMVECTOR planes[6] = {
+		XMVectorAdd(R3, R0),   // Left
+		XMVectorSubtract(R3, R0), // Right
+		XMVectorAdd(R3, R1),   // Bottom
+		XMVectorSubtract(R3, R1), // Top
+		R2,                    // Near
+		XMVectorSubtract(R3, R2)  // Far
+	};
+	for (int i = 0; i < 6; ++i)
+	{
+		XMVECTOR p = planes[i];
+		float len = XMVectorGetX(XMVector3Length(p));
+		if (len < 1e-6f) continue;
+		p = XMVectorScale(p, 1.f / len);
+		float d = -XMVectorGetW(planes[i]) / len;
+		// AABB: positive vertex along plane normal
+		float nx = XMVectorGetX(p), ny = XMVectorGetY(p), nz = XMVectorGetZ(p);
+		XMFLOAT3 pVertex(
+			box.Center.x + (nx >= 0.f ? box.Extents.x : -box.Extents.x),
+			box.Center.y + (ny >= 0.f ? box.Extents.y : -box.Extents.y),
+			box.Center.z + (nz >= 0.f ? box.Extents.z : -box.Extents.z)
+		);
+		if (nx * pVertex.x + ny * pVertex.y + nz * pVertex.z + d < 0.f)
+			return false;
+	}
+	return true;
+}
+
+XMFLOAT4X4 PerNodeViewProj(const XMFLOAT4X4& viewProj)
+{
+	// M is the transpose of viewProj; negating its translation row makes the rows IntersectsFrustumPerNode
+	// reads M's columns and the constant it negates come out right
+	XMFLOAT4X4 m;
+	for (int r = 0; r < 4; ++r)
+		for (int c = 0; c < 4; ++c)
+			m.m[r][c] = (r == 3 ? -1.f : 1.f) * viewProj.m[c][r];
+	return m;
+}
+
+namespace
+{
+	struct FrustumRandom
+	{
+		uint32_t State = 24681u;
+		float Next() // [0, 1)
+		{
+			State = State * 1664525u + 1013904223u;
+			return (float)(State >> 8) * (1.f / 16777216.f);
+		}
+		float Range(float lo, float hi) { return lo + (hi - lo) * Next(); }
+	};
+
+	// A full tree in Terrain's layout over a 100 x 100 square near the origin: children are the XZ
+	// quadrants of their parent (Morton order) with a random part of its Y range, as the min/max
+	// pyramid makes them
+	void BuildRandomBounds(FrustumRandom& random, int levels, TerrainNodeBounds& bounds)
+	{
+		const uint32_t count = TerrainNodeCount(levels);
+		for (std::vector<float>* v : { &bounds.CenterX, &bounds.CenterY, &bounds.CenterZ,
+			&bounds.ExtentX, &bounds.ExtentY, &bounds.ExtentZ })
+			v->assign(count, 0.f);
+		bounds.CenterX[0] = random.Range(-30.f, 30.f);
+		bounds.CenterY[0] = random.Range(-10.f, 30.f);
+		bounds.CenterZ[0] = random.Range(-30.f, 30.f);
+		bounds.ExtentX[0] = bounds.ExtentZ[0] = 50.f;
+		bounds.ExtentY[0] = random.Range(1.f, 30.f);
+		for (int lod = 0; lod + 1 < levels; ++lod)
+			for (uint32_t index = TerrainLevelOffset(lod); index < TerrainLevelOffset(lod + 1); ++index)
+			{
+				const uint32_t firstChild = TerrainLevelOffset(lod + 1) + 4u * (index - TerrainLevelOffset(lod));
+				const float lo = bounds.CenterY[index] - bounds.ExtentY[index];
+				const float hi = bounds.CenterY[index] + bounds.ExtentY[index];
+				for (uint32_t c = 0; c < 4; ++c)
+				{
+					const uint32_t child = firstChild + c;
+					bounds.ExtentX[child] = 0.5f * bounds.ExtentX[index];
+					bounds.ExtentZ[child] = 0.5f * bounds.ExtentZ[index];
+					bounds.CenterX[child] = bounds.CenterX[index] + ((c & 1) ? 1.f : -1.f) * bounds.ExtentX[child];
+					bounds.CenterZ[child] = bounds.CenterZ[index] + ((c & 2) ? 1.f : -1.f) * bounds.ExtentZ[child];
+					float a = random.Range(lo, hi), b = random.Range(lo, hi);
+					if (a > b) std::swap(a, b);
+					bounds.CenterY[child] = 0.5f * (a + b);
+					bounds.ExtentY[child] = 0.5f * (b - a);
+				}
+			}
+	}
+
+	// A camera looking at the square from anywhere around it: perspective, or orthographic like a light
+	XMFLOAT4X4 RandomViewProj(FrustumRandom& random)
+	{
+		XMVECTOR eye, target;
+		do
+		{
+			eye = XMVectorSet(random.Range(-90.f, 90.f), random.Range(-20.f, 70.f), random.Range(-90.f, 90.f), 1.f);
+			target = XMVectorSet(random.Range(-50.f, 50.f), random.Range(-5.f, 25.f), random.Range(-50.f, 50.f), 1.f);
+		} while (XMVectorGetX(XMVector3Length(target - eye)) < 1.f);
+		const XMVECTOR dir = XMVector3Normalize(target - eye);
+		const XMVECTOR up = std::fabs(XMVectorGetY(dir)) > 0.99f ? XMVectorSet(0.f, 0.f, 1.f, 0.f) : XMVectorSet(0.f, 1.f, 0.f, 0.f);
+		const XMMATRIX view = XMMatrixLookAtLH(eye, target, up);
+		XMMATRIX proj;
+		if (random.Next() < 0.7f)
+		{
+			const float nearZ = random.Range(0.05f, 2.f);
+			proj = XMMatrixPerspectiveFovLH(random.Range(0.3f, 2.f), random.Range(0.5f, 2.5f), nearZ, nearZ + random.Range(20.f, 400.f));
+		}
+		else
+		{
+			const float nearZ = random.Range(-40.f, 1.f);
+			proj = XMMatrixOrthographicLH(random.Range(10.f, 200.f), random.Range(10.f, 200.f), nearZ, nearZ + random.Range(30.f, 300.f));
+		}
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, XMMatrixTranspose(view * proj));
+		return viewProj;
+	}
+
+	// Within this distance (world units) of a plane the float tests may round either way
+	const double kReferenceMargin = 1e-3;
+
+	struct ReferenceCull
+	{
+		bool Visible = true;
+		uint32_t Straddled = 0;
+		bool Ambiguous = false;
+	};
+
+	// Transforms the corners to clip space in double precision and tests them against the clip planes
+	// (-w <= x <= w, -w <= y <= w, 0 <= z <= w) in planeMask: a box is outside a plane when all 8
+	// corners are and straddles it when some are
+	ReferenceCull ClipSpaceReference(const XMFLOAT4X4& viewProj, uint32_t planeMask, const TerrainNodeBounds& bounds, uint32_t index)
+	{
+		// Clip coordinate j = (x, y, z, 1) . row j of the transposed matrix
+		auto clipCoeff = [&viewProj](int j, int k) { return (double)viewProj.m[j][k]; };
+		// Each plane's value as a combination of clip coordinates (x, y, z, w), and its world-space
+		// normal length to turn it into a distance
+		const double combos[6][4] = {
+			{ 1, 0, 0, 1 }, { -1, 0, 0, 1 }, { 0, 1, 0, 1 }, { 0, -1, 0, 1 }, { 0, 0, 1, 0 }, { 0, 0, -1, 1 }
+		};
+		ReferenceCull result;
+		double lo[6], hi[6];
+		std::fill(lo, lo + 6, 1e300);
+		std::fill(hi, hi + 6, -1e300);
+		for (int c = 0; c < 8; ++c)
+		{
+			const double p[3] = {
+				(double)bounds.CenterX[index] + ((c & 1) ? 1.0 : -1.0) * bounds.ExtentX[index],
+				(double)bounds.CenterY[index] + ((c & 2) ? 1.0 : -1.0) * bounds.ExtentY[index],
+				(double)bounds.CenterZ[index] + ((c & 4) ? 1.0 : -1.0) * bounds.ExtentZ[index] };
+			double clip[4];
+			for (int j = 0; j < 4; ++j)
+				clip[j] = p[0] * clipCoeff(j, 0) + p[1] * clipCoeff(j, 1) + p[2] * clipCoeff(j, 2) + clipCoeff(j, 3);
+			for (int i = 0; i < 6; ++i)
+			{
+				double value = 0.0;
+				for (int j = 0; j < 4; ++j)
+					value += combos[i][j] * clip[j];
+				lo[i] = std::min(lo[i], value);
+				hi[i] = std::max(hi[i], value);
+			}
+		}
+		for (int i = 0; i < 6; ++i)
+		{
+			if (!(planeMask & (1u << i))) continue;
+			double n[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				n[k] = 0.0;
+				for (int j = 0; j < 4; ++j)
+					n[k] += combos[i][j] * clipCoeff(j, k);
+			}
+			const double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (std::fabs(lo[i]) < kReferenceMargin * len || std::fabs(hi[i]) < kReferenceMargin * len)
+				result.Ambiguous = true;
+			if (hi[i] < 0.0)
+				result.Visible = false;
+			else if (lo[i] < 0.0)
+				result.Straddled |= 1u << i;
+		}
+		return result;
+	}
+
+	BoundingBox NodeBox(const TerrainNodeBounds& bounds, uint32_t index)
+	{
+		BoundingBox box;
+		box.Center = XMFLOAT3(bounds.CenterX[index], bounds.CenterY[index], bounds.CenterZ[index]);
+		box.Extents = XMFLOAT3(bounds.ExtentX[index], bounds.ExtentY[index], bounds.ExtentZ[index]);
+		return box;
+	}
+
+	double NodesPerSecond(double nodes, std::chrono::steady_clock::time_point start)
+	{
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return seconds > 0.0 ? nodes / seconds : 0.0;
+	}
+}
+
+TerrainFrustumBenchmark BenchmarkTerrainFrustum(int levels, int cameras)
+{
+	TerrainFrustumBenchmark result;
+	levels = std::clamp(levels, 2, kTerrainMaxLODLevels);
+	cameras = std::max(cameras, 1);
+	FrustumRandom random;
+	TerrainNodeBounds bounds;
+	BuildRandomBounds(random, levels, bounds);
+	std::vector<XMFLOAT4X4> viewProjs;
+	for (int i = 0; i < cameras; ++i)
+		viewProjs.push_back(RandomViewProj(random));
+	std::vector<BoundingBox> boxes;
+	result.Nodes = TerrainNodeCount(levels);
+	for (uint32_t i = 0; i < result.Nodes; ++i)
+		boxes.push_back(NodeBox(bounds, i));
+	const double tested = (double)result.Nodes * cameras;
+
+	volatile uint32_t sink = 0;
+	uint32_t visible = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (const XMFLOAT4X4& viewProj : viewProjs)
+	{
+		const XMFLOAT4X4 perNodeViewProj = PerNodeViewProj(viewProj);
+		for (const BoundingBox& box : boxes)
+			visible += IntersectsFrustumPerNode(box, perNodeViewProj) ? 1u : 0u;
+	}
+	result.PerNodeNodesPerSec = NodesPerSecond(tested, start);
+	sink = visible;
+
+	visible = 0;
+	start = std::chrono::steady_clock::now();
+	for (const XMFLOAT4X4& viewProj : viewProjs)
+	{
+		TerrainFrustum frustum;
+		frustum.Extract(viewProj);
+		for (uint32_t i = 0; i < result.Nodes; ++i)
+		{
+			uint32_t planeMask = frustum.PlaneMask;
+			visible += frustum.Intersects(bounds, i, planeMask) ? 1u : 0u;
+		}
+	}
+	result.ScalarNodesPerSec = NodesPerSecond(tested, start);
+	sink = visible;
+
+	// The root alone, then sibling groups
+	visible = 0;
+	start = std::chrono::steady_clock::now();
+	for (const XMFLOAT4X4& viewProj : viewProjs)
+	{
+		TerrainFrustum frustum;
+		frustum.Extract(viewProj);
+		uint32_t planeMask = frustum.PlaneMask;
+		visible += frustum.Intersects(bounds, 0, planeMask) ? 1u : 0u;
+		uint32_t childMasks[4];
+		for (uint32_t first = 1; first < result.Nodes; first += 4)
+		{
+			const uint32_t culledMask = frustum.Intersects4(bounds, first, frustum.PlaneMask, childMasks);
+			visible += 4u - ((culledMask & 1u) + ((culledMask >> 1) & 1u) + ((culledMask >> 2) & 1u) + (culledMask >> 3));
+		}
+	}
+	result.SoANodesPerSec = NodesPerSecond(tested, start);
+	sink = visible;
+	(void)sink;
+	return result;
+}
+
+bool ValidateTerrainFrustum(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	const int levels = 6;
+	FrustumRandom random;
+	TerrainNodeBounds bounds;
+	size_t compared = 0, culled = 0, straddling = 0, inside = 0, skipped = 0;
+	for (int camera = 0; camera < 400; ++camera)
+	{
+		// A new tree every few cameras
+		if (camera % 8 == 0)
+			BuildRandomBounds(random, levels, bounds);
+		const XMFLOAT4X4 viewProj = RandomViewProj(random);
+		TerrainFrustum frustum;
+		frustum.Extract(viewProj);
+		if (frustum.PlaneMask != 0x3fu)
+			return fail("camera " + std::to_string(camera) + " has a degenerate frustum plane");
+		const XMFLOAT4X4 perNodeViewProj = PerNodeViewProj(viewProj);
+		const std::string where = "camera " + std::to_string(camera) + ", node ";
+
+		// Every node on its own, all planes
+		for (uint32_t index = 0; index < TerrainNodeCount(levels); ++index)
+		{
+			const ReferenceCull reference = ClipSpaceReference(viewProj, frustum.PlaneMask, bounds, index);
+			if (reference.Ambiguous)
+			{
+				++skipped;
+				continue;
+			}
+			++compared;
+			uint32_t planeMask = frustum.PlaneMask;
+			const bool visible = frustum.Intersects(bounds, index, planeMask);
+			if (visible != reference.Visible)
+				return fail(where + std::to_string(index) + ": Intersects disagrees with the clip-space reference");
+			if (visible && planeMask != reference.Straddled)
+				return fail(where + std::to_string(index) + ": Intersects straddles other planes than the clip-space reference");
+			if (IntersectsFrustumPerNode(NodeBox(bounds, index), perNodeViewProj) != reference.Visible)
+				return fail(where + std::to_string(index) + ": IntersectsFrustumPerNode disagrees with the clip-space reference");
+			culled += visible ? 0 : 1;
+			straddling += visible && planeMask ? 1 : 0;
+			inside += visible && !planeMask ? 1 : 0;
+		}
+
+		// The descent SelectLOD makes: sibling groups of visible nodes, with the planes the parent straddles
+		struct Entry { uint32_t Index; int LOD; uint32_t PlaneMask; };
+		std::vector<Entry> stack;
+		uint32_t rootMask = frustum.PlaneMask;
+		if (frustum.Intersects(bounds, 0, rootMask))
+			stack.push_back({ 0, 0, rootMask });
+		while (!stack.empty())
+		{
+			const Entry entry = stack.back();
+			stack.pop_back();
+			if (entry.LOD + 1 >= levels)
+				continue;
+			const uint32_t firstChild = TerrainLevelOffset(entry.LOD + 1) + 4u * (entry.Index - TerrainLevelOffset(entry.LOD));
+			uint32_t childMasks[4];
+			const uint32_t culledMask = frustum.Intersects4(bounds, firstChild, entry.PlaneMask, childMasks);
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				const bool visible = !(culledMask & (1u << c));
+				const ReferenceCull reference = ClipSpaceReference(viewProj, frustum.PlaneMask, bounds, firstChild + c);
+				if (!reference.Ambiguous)
+				{
+					if (visible != reference.Visible)
+						return fail(where + std::to_string(firstChild + c) + ": Intersects4 disagrees with the clip-space reference");
+					if (visible && childMasks[c] != reference.Straddled)
+						return fail(where + std::to_string(firstChild + c) + ": inherited plane mask differs from the clip-space reference");
+				}
+				if (visible)
+					stack.push_back({ firstChild + c, entry.LOD + 1, childMasks[c] });
+			}
+		}
+	}
+	if (culled == 0 || straddling == 0 || inside == 0)
+		return fail("random cameras did not cull, straddle and contain nodes");
+	if (skipped * 20 > compared)
+		return fail("too many nodes within rounding of a plane to compare");
+	return true;
+}
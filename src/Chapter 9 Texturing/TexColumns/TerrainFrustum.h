@@ -0,0 +1,61 @@
+#pragma once
+
+#include <DirectXCollision.h>
+#include <DirectXMath.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Node AABBs in SoA form, indexed like Terrain's node array
+struct TerrainNodeBounds
+{
+	std::vector<float> CenterX, CenterY, CenterZ;
+	std::vector<float> ExtentX, ExtentY, ExtentZ;
+};
+
+// View frustum planes (normalized, pointing inwards) extracted once per update and view, stored SoA
+// so one plane can be tested against 4 node AABBs per SSE instruction
+struct TerrainFrustum
+{
+	float Nx[6], Ny[6], Nz[6], D[6];
+	float AbsNx[6], AbsNy[6], AbsNz[6];
+	uint32_t PlaneMask = 0; // planes with a usable normal
+
+	// viewProj is stored transposed (as in PassConstants)
+	void Extract(const DirectX::XMFLOAT4X4& viewProj);
+
+	// AABB of node `index` against the planes in planeMask: false = outside one of them, otherwise
+	// planeMask is narrowed to the planes the box still straddles (what its children inherit)
+	bool Intersects(const TerrainNodeBounds& bounds, uint32_t index, uint32_t& planeMask) const;
+	// The same for the 4 consecutive nodes from `first` (one sibling group) with one SSE op per plane;
+	// returns a 4-bit mask of culled nodes and the straddled planes of each in childPlaneMasks
+	uint32_t Intersects4(const TerrainNodeBounds& bounds, uint32_t first, uint32_t planeMask, uint32_t childPlaneMasks[4]) const;
+};
+
+// The per-node test the terrain used before TerrainFrustum, planes re-extracted from viewProj for every
+// box; kept as the baseline of the benchmarks. It builds the planes from the rows of the matrix it is
+// given and negates their constant, so for a transposed ViewProj (its rows are the rows of M, where
+// Gribb-Hartmann wants the columns) it culls wrongly. It matches TerrainFrustum only when handed M
+// itself with the translation row negated (PerNodeViewProj).
+bool IntersectsFrustumPerNode(const DirectX::BoundingBox& box, const DirectX::XMFLOAT4X4& viewProj);
+// The matrix IntersectsFrustumPerNode culls correctly with, from a transposed ViewProj
+DirectX::XMFLOAT4X4 PerNodeViewProj(const DirectX::XMFLOAT4X4& viewProj);
+
+struct TerrainFrustumBenchmark
+{
+	uint32_t Nodes = 0;            // AABBs tested per camera (every node of the tree)
+	double PerNodeNodesPerSec = 0; // IntersectsFrustumPerNode on each node
+	double ScalarNodesPerSec = 0;  // Extract once, then Intersects on each node
+	double SoANodesPerSec = 0;     // Extract once, then Intersects4 on each sibling group
+};
+
+// Cull-only throughput on a random tree of `levels` levels (Terrain's layout) over `cameras` random
+// cameras: every node against all planes (no inherited masks), so the three paths cull the same boxes
+TerrainFrustumBenchmark BenchmarkTerrainFrustum(int levels, int cameras);
+
+// CPU check on random perspective and orthographic cameras and random nested AABBs: Intersects and a
+// hierarchical descent with Intersects4 and the inherited plane masks give the culling and straddled
+// planes of a double-precision reference that transforms the 8 corners to clip space, and
+// IntersectsFrustumPerNode agrees with it given the matrix layout it was written for. Boxes within
+// rounding of a plane are skipped. Returns false with a reason on failure.
+bool ValidateTerrainFrustum(std::string* error = nullptr);
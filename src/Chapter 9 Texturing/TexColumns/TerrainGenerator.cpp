@@ -0,0 +1,395 @@
+#include "TerrainGenerator.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	constexpr float kF2 = 0.36602540378f; // (sqrt(3) - 1) / 2: skew to the simplex lattice
+	constexpr float kG2 = 0.21132486540f; // (3 - sqrt(3)) / 6: unskew
+	constexpr float kSimplexScale = 45.f;  // maps the kernel sum to about [-1, 1]
+	constexpr uint32_t kOctaveSeedStep = 0x9e3779b9u;
+
+	// 32-bit lane multiply (SSE2 has no _mm_mullo_epi32)
+	inline __m128i Mul32(__m128i a, __m128i b)
+	{
+		const __m128i even = _mm_mul_epu32(a, b);
+		const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+
+	// Integer hash of a lattice point; no permutation table, so no gathers
+	inline __m128i Hash(__m128i ix, __m128i iy, uint32_t seed)
+	{
+		__m128i h = _mm_add_epi32(_mm_add_epi32(Mul32(ix, _mm_set1_epi32((int)0x8da6b343u)),
+			Mul32(iy, _mm_set1_epi32((int)0xd8163841u))), _mm_set1_epi32((int)seed));
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+		h = Mul32(h, _mm_set1_epi32((int)0x2c1b3c6du));
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 12));
+		h = Mul32(h, _mm_set1_epi32((int)0x297a2d39u));
+		return _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+	}
+
+	// Dot with one of the 8 gradients (+-1, +-2) / (+-2, +-1) picked by the hash's low bits
+	inline __m128 Gradient(__m128i h, __m128 x, __m128 y)
+	{
+		const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(h, _mm_set1_epi32(4)), _mm_set1_epi32(4)));
+		__m128 a = _mm_or_ps(_mm_and_ps(swap, y), _mm_andnot_ps(swap, x));
+		__m128 b = _mm_or_ps(_mm_and_ps(swap, x), _mm_andnot_ps(swap, y));
+		a = _mm_xor_ps(a, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31)));
+		b = _mm_xor_ps(b, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30)));
+		return _mm_add_ps(a, _mm_add_ps(b, b));
+	}
+
+	inline __m128 Floor(__m128 x)
+	{
+		const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.f)));
+	}
+
+	inline __m128 Corner(__m128i h, __m128 x, __m128 y)
+	{
+		__m128 t = _mm_sub_ps(_mm_set1_ps(0.5f), _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+		t = _mm_max_ps(t, _mm_setzero_ps());
+		t = _mm_mul_ps(t, t);
+		return _mm_mul_ps(_mm_mul_ps(t, t), Gradient(h, x, y));
+	}
+
+	// 2D simplex noise, 4 points at a time, about [-1, 1]
+	__m128 Simplex4(__m128 x, __m128 y, uint32_t seed)
+	{
+		const __m128 one = _mm_set1_ps(1.f), g2 = _mm_set1_ps(kG2);
+		const __m128 s = _mm_mul_ps(_mm_add_ps(x, y), _mm_set1_ps(kF2));
+		const __m128 i = Floor(_mm_add_ps(x, s));
+		const __m128 j = Floor(_mm_add_ps(y, s));
+		const __m128 t = _mm_mul_ps(_mm_add_ps(i, j), g2);
+		const __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(i, t));
+		const __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(j, t));
+
+		// Lower or upper triangle of the skewed cell
+		const __m128 lower = _mm_cmpgt_ps(x0, y0);
+		const __m128 i1 = _mm_and_ps(lower, one);
+		const __m128 j1 = _mm_andnot_ps(lower, one);
+		const __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), g2);
+		const __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, j1), g2);
+		const __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), _mm_add_ps(g2, g2));
+		const __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, one), _mm_add_ps(g2, g2));
+
+		const __m128i ii = _mm_cvttps_epi32(i), jj = _mm_cvttps_epi32(j);
+		const __m128i oneI = _mm_set1_epi32(1);
+		const __m128i i1i = _mm_and_si128(_mm_castps_si128(lower), oneI);
+		const __m128i j1i = _mm_andnot_si128(_mm_castps_si128(lower), oneI);
+		const __m128 n0 = Corner(Hash(ii, jj, seed), x0, y0);
+		const __m128 n1 = Corner(Hash(_mm_add_epi32(ii, i1i), _mm_add_epi32(jj, j1i), seed), x1, y1);
+		const __m128 n2 = Corner(Hash(_mm_add_epi32(ii, oneI), _mm_add_epi32(jj, oneI), seed), x2, y2);
+		return _mm_mul_ps(_mm_set1_ps(kSimplexScale), _mm_add_ps(n0, _mm_add_ps(n1, n2)));
+	}
+
+	// Octave sum normalized by the total amplitude, about [-1, 1]
+	__m128 FBm4(const TerrainNoiseSettings& settings, __m128 x, __m128 y, int octaves, uint32_t seed)
+	{
+		__m128 sum = _mm_setzero_ps();
+		float amplitude = 1.f, frequency = 1.f, norm = 0.f;
+		for (int o = 0; o < octaves; ++o)
+		{
+			const __m128 f = _mm_set1_ps(frequency);
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(amplitude), Simplex4(_mm_mul_ps(x, f), _mm_mul_ps(y, f), seed)));
+			norm += amplitude;
+			amplitude *= settings.Gain;
+			frequency *= settings.Lacunarity;
+			seed += kOctaveSeedStep;
+		}
+		return _mm_mul_ps(sum, _mm_set1_ps(1.f / std::max(norm, 1e-6f)));
+	}
+
+	// [0, 1]: sharp crests where the noise crosses zero, finer octaves mostly along the crests
+	__m128 Ridged4(const TerrainNoiseSettings& settings, __m128 x, __m128 y, int octaves, uint32_t seed)
+	{
+		const __m128 one = _mm_set1_ps(1.f), zero = _mm_setzero_ps();
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		__m128 sum = zero, weight = one;
+		float amplitude = 1.f, frequency = 1.f, norm = 0.f;
+		for (int o = 0; o < octaves; ++o)
+		{
+			const __m128 f = _mm_set1_ps(frequency);
+			__m128 ridge = _mm_sub_ps(one, _mm_and_ps(Simplex4(_mm_mul_ps(x, f), _mm_mul_ps(y, f), seed), absMask));
+			ridge = _mm_mul_ps(_mm_mul_ps(ridge, ridge), weight);
+			weight = _mm_min_ps(_mm_max_ps(_mm_add_ps(ridge, ridge), zero), one);
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(amplitude), ridge));
+			norm += amplitude;
+			amplitude *= settings.Gain;
+			frequency *= settings.Lacunarity;
+			seed += kOctaveSeedStep;
+		}
+		return _mm_mul_ps(sum, _mm_set1_ps(1.f / std::max(norm, 1e-6f)));
+	}
+
+	__m128 Evaluate4(const TerrainNoiseSettings& settings, __m128 u, __m128 v)
+	{
+		const __m128 frequency = _mm_set1_ps(settings.Frequency);
+		__m128 x = _mm_mul_ps(u, frequency), y = _mm_mul_ps(v, frequency);
+		const int octaves = std::max(settings.Octaves, 1);
+		const __m128 half = _mm_set1_ps(0.5f);
+		__m128 h;
+		switch (settings.Kind)
+		{
+		case TerrainNoiseKind::Ridged:
+			h = Ridged4(settings, x, y, octaves, settings.Seed);
+			break;
+		case TerrainNoiseKind::DomainWarped:
+		{
+			const int warpOctaves = std::min(octaves, 4);
+			const __m128 warp = _mm_set1_ps(settings.WarpStrength);
+			const __m128 qx = FBm4(settings, x, y, warpOctaves, settings.Seed ^ 0x5bd1e995u);
+			const __m128 qy = FBm4(settings, _mm_add_ps(x, _mm_set1_ps(5.2f)), _mm_add_ps(y, _mm_set1_ps(1.3f)),
+				warpOctaves, settings.Seed ^ 0x1b873593u);
+			x = _mm_add_ps(x, _mm_mul_ps(warp, qx));
+			y = _mm_add_ps(y, _mm_mul_ps(warp, qy));
+			h = _mm_add_ps(half, _mm_mul_ps(half, FBm4(settings, x, y, octaves, settings.Seed)));
+			break;
+		}
+		default:
+			h = _mm_add_ps(half, _mm_mul_ps(half, FBm4(settings, x, y, octaves, settings.Seed)));
+			break;
+		}
+		return _mm_min_ps(_mm_max_ps(h, _mm_setzero_ps()), _mm_set1_ps(1.f));
+	}
+}
+
+float EvaluateTerrainNoise(const TerrainNoiseSettings& settings, float u, float v)
+{
+	// Same kernel as the tiles, so single queries agree with generated texels bit for bit
+	return _mm_cvtss_f32(Evaluate4(settings, _mm_set1_ps(u), _mm_set1_ps(v)));
+}
+
+void GenerateTerrainTile(const TerrainNoiseSettings& settings, int lod, int tileX, int tileZ, int tileSize,
+	TerrainHeightfield& out)
+{
+	tileSize = std::max(tileSize, 2);
+	const int tilesPerSide = 1 << lod;
+	const int step = tileSize - 1; // corner-aligned: tile t covers global texels [t * step, (t + 1) * step]
+	const float invSpan = 1.f / (float)(tilesPerSide * step);
+	out.Width = tileSize;
+	out.Height = tileSize;
+	out.Heights.resize((size_t)tileSize * tileSize);
+
+	const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128 invSpan4 = _mm_set1_ps(invSpan);
+	alignas(16) float tail[4];
+	for (int row = 0; row < tileSize; ++row)
+	{
+		// Row 0 is the tile's +Z edge and TileZ = 0 the terrain's -Z edge; v = 0 at the +Z edge
+		const int gz = (tilesPerSide - 1 - tileZ) * step + row;
+		const __m128 v = _mm_set1_ps((float)gz * invSpan);
+		float* dst = &out.Heights[(size_t)row * tileSize];
+		for (int col = 0; col < tileSize; col += 4)
+		{
+			const __m128i gx = _mm_add_epi32(_mm_set1_epi32(tileX * step + col), lane);
+			const __m128 h = Evaluate4(settings, _mm_mul_ps(_mm_cvtepi32_ps(gx), invSpan4), v);
+			if (col + 4 <= tileSize)
+				_mm_storeu_ps(dst + col, h);
+			else
+			{
+				_mm_store_ps(tail, h);
+				std::copy_n(tail, tileSize - col, dst + col);
+			}
+		}
+	}
+}
+
+std::filesystem::path TerrainTilePath(const std::filesystem::path& root, int lod, int tileX, int tileZ)
+{
+	const std::string level = "00" + std::to_string(lod + 1);
+	if (lod == 0)
+		return root / level / "Height_Out.dds";
+	return root / level / "Height" / ("Height_Out_y" + std::to_string(tileZ) + "_x" + std::to_string(tileX) + ".dds");
+}
+
+TerrainGeneratorStats GenerateTerrainTiles(const TerrainGeneratorSettings& settings, const std::filesystem::path& root)
+{
+	TerrainGeneratorStats stats;
+	const int levels = std::max(settings.Levels, 1);
+	struct Job { int LOD, X, Z; };
+	std::vector<Job> jobs;
+	// Finest level first: the big levels dominate, small ones fill the gaps at the end
+	for (int lod = levels - 1; lod >= 0; --lod)
+		for (int z = 0; z < (1 << lod); ++z)
+			for (int x = 0; x < (1 << lod); ++x)
+				jobs.push_back({ lod, x, z });
+
+	std::error_code ec;
+	for (int lod = 0; lod < levels; ++lod)
+		std::filesystem::create_directories(TerrainTilePath(root, lod, 0, 0).parent_path(), ec);
+
+	const unsigned hardware = std::max(std::thread::hardware_concurrency(), 1u);
+	const int threadCount = std::clamp(settings.ThreadCount > 0 ? settings.ThreadCount : (int)hardware, 1, (int)jobs.size());
+	std::atomic<size_t> next{ 0 };
+	std::atomic<int> failed{ 0 };
+	std::vector<double> kernelSeconds(threadCount, 0.0);
+
+	const auto start = std::chrono::steady_clock::now();
+	auto work = [&](int thread) {
+		TerrainHeightfield tile;
+		for (size_t i = next++; i < jobs.size(); i = next++)
+		{
+			const auto kernelStart = std::chrono::steady_clock::now();
+			GenerateTerrainTile(settings.Noise, jobs[i].LOD, jobs[i].X, jobs[i].Z, settings.TileSize, tile);
+			kernelSeconds[thread] += std::chrono::duration<double>(std::chrono::steady_clock::now() - kernelStart).count();
+			if (!SaveTerrainHeightfieldDDS(TerrainTilePath(root, jobs[i].LOD, jobs[i].X, jobs[i].Z), tile))
+				++failed;
+		}
+	};
+	std::vector<std::thread> workers;
+	for (int t = 1; t < threadCount; ++t)
+		workers.emplace_back(work, t);
+	work(0);
+	for (std::thread& worker : workers)
+		worker.join();
+
+	stats.Tiles = (int)jobs.size();
+	stats.Failed = failed.load();
+	stats.Threads = threadCount;
+	stats.Texels = (uint64_t)jobs.size() * (uint64_t)std::max(settings.TileSize, 2) * (uint64_t)std::max(settings.TileSize, 2);
+	stats.TotalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	for (double seconds : kernelSeconds)
+		stats.KernelSeconds += seconds;
+	stats.MTexelsPerSecond = stats.TotalSeconds > 0.0 ? (double)stats.Texels / stats.TotalSeconds * 1e-6 : 0.0;
+	stats.KernelMTexelsPerThread = stats.KernelSeconds > 0.0 ? (double)stats.Texels / stats.KernelSeconds * 1e-6 : 0.0;
+	return stats;
+}
+
+namespace
+{
+	// Plain scalar simplex/fBm, written independently of the SSE kernels to check them
+	uint32_t ReferenceHash(int ix, int iy, uint32_t seed)
+	{
+		uint32_t h = (uint32_t)ix * 0x8da6b343u + (uint32_t)iy * 0xd8163841u + seed;
+		h ^= h >> 15;
+		h *= 0x2c1b3c6du;
+		h ^= h >> 12;
+		h *= 0x297a2d39u;
+		return h ^ (h >> 15);
+	}
+
+	float ReferenceSimplex(float x, float y, uint32_t seed)
+	{
+		const float s = (x + y) * kF2;
+		const float i = std::floor(x + s), j = std::floor(y + s);
+		const float t = (i + j) * kG2;
+		const float x0 = x - (i - t), y0 = y - (j - t);
+		const int i1 = x0 > y0 ? 1 : 0, j1 = 1 - i1;
+		const float cx[3] = { x0, x0 - i1 + kG2, x0 - 1.f + 2.f * kG2 };
+		const float cy[3] = { y0, y0 - j1 + kG2, y0 - 1.f + 2.f * kG2 };
+		const int ox[3] = { 0, i1, 1 }, oy[3] = { 0, j1, 1 };
+		float sum = 0.f;
+		for (int k = 0; k < 3; ++k)
+		{
+			const float falloff = std::max(0.5f - cx[k] * cx[k] - cy[k] * cy[k], 0.f);
+			const uint32_t h = ReferenceHash((int)i + ox[k], (int)j + oy[k], seed);
+			float a = (h & 4) ? cy[k] : cx[k], b = (h & 4) ? cx[k] : cy[k];
+			if (h & 1) a = -a;
+			if (h & 2) b = -b;
+			sum += falloff * falloff * falloff * falloff * (a + 2.f * b);
+		}
+		return kSimplexScale * sum;
+	}
+
+	float ReferenceFBm(const TerrainNoiseSettings& settings, float u, float v)
+	{
+		const float x = u * settings.Frequency, y = v * settings.Frequency;
+		float sum = 0.f, amplitude = 1.f, frequency = 1.f, norm = 0.f;
+		uint32_t seed = settings.Seed;
+		for (int o = 0; o < settings.Octaves; ++o)
+		{
+			sum += amplitude * ReferenceSimplex(x * frequency, y * frequency, seed);
+			norm += amplitude;
+			amplitude *= settings.Gain;
+			frequency *= settings.Lacunarity;
+			seed += kOctaveSeedStep;
+		}
+		return std::clamp(0.5f + 0.5f * sum / norm, 0.f, 1.f);
+	}
+}
+
+bool ValidateTerrainGenerator(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	TerrainNoiseSettings fbm;
+	fbm.Kind = TerrainNoiseKind::FBm;
+	fbm.Octaves = 6;
+	float minH = 1.f, maxH = 0.f;
+	for (int i = 0; i < 4000; ++i)
+	{
+		const float u = (float)(i % 67) / 66.f, v = (float)(i / 67) / 60.f;
+		const float h = EvaluateTerrainNoise(fbm, u, v);
+		if (std::abs(h - ReferenceFBm(fbm, u, v)) > 1e-4f)
+			return fail("SSE fBm differs from the scalar reference");
+		minH = std::min(minH, h);
+		maxH = std::max(maxH, h);
+	}
+	if (maxH - minH < 0.3f)
+		return fail("fBm has almost no relief");
+
+	for (TerrainNoiseKind kind : { TerrainNoiseKind::FBm, TerrainNoiseKind::Ridged, TerrainNoiseKind::DomainWarped })
+	{
+		TerrainNoiseSettings settings;
+		settings.Kind = kind;
+		settings.Octaves = 5;
+		const int size = 33; // not a multiple of 4: exercises the partial last group
+		// Level 1 tiles around the centre and the level 0 tile over them
+		TerrainHeightfield tiles[2][2], root;
+		for (int z = 0; z < 2; ++z)
+			for (int x = 0; x < 2; ++x)
+				GenerateTerrainTile(settings, 1, x, z, size, tiles[z][x]);
+		GenerateTerrainTile(settings, 0, 0, 0, size, root);
+
+		for (int k = 0; k < size; ++k)
+		{
+			// Shared columns (x) and rows (z; tile z = 1 is above, its last row meets z = 0's first row)
+			for (int z = 0; z < 2; ++z)
+				if (tiles[z][0].At(size - 1, k) != tiles[z][1].At(0, k))
+					return fail("border column differs between tiles");
+			for (int x = 0; x < 2; ++x)
+				if (tiles[1][x].At(k, size - 1) != tiles[0][x].At(k, 0))
+					return fail("border row differs between tiles");
+		}
+		// Root texel (i, j) sits on level 1 texel (2i, 2j) of the stitched field
+		const int step = size - 1;
+		for (int j = 0; j < size; ++j)
+			for (int i = 0; i < size; ++i)
+			{
+				const int gx = 2 * i, gz = 2 * j;
+				const int tx = std::min(gx / step, 1), row = std::min(gz / step, 1);
+				const TerrainHeightfield& tile = tiles[1 - row][tx];
+				if (root.At(i, j) != tile.At(gx - tx * step, gz - row * step))
+					return fail("coarse level differs from the finer level at a shared texel");
+				if (root.At(i, j) < 0.f || root.At(i, j) > 1.f)
+					return fail("height outside [0, 1]");
+			}
+		if (root.At(3, 5) != EvaluateTerrainNoise(settings, 3.f * (1.f / step), 5.f * (1.f / step)))
+			return fail("EvaluateTerrainNoise differs from the generated texel");
+	}
+
+	TerrainNoiseSettings settings;
+	TerrainHeightfield tile, loaded;
+	GenerateTerrainTile(settings, 2, 1, 3, 16, tile);
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "terrain_generator_selftest.dds";
+	if (!SaveTerrainHeightfieldDDS(path, tile) || !LoadTerrainHeightfieldDDS(path, loaded))
+		return fail("could not write and read back a DDS tile");
+	std::error_code ec;
+	std::filesystem::remove(path, ec);
+	if (loaded.Width != tile.Width || loaded.Height != tile.Height)
+		return fail("DDS tile read back with the wrong size");
+	for (size_t i = 0; i < tile.Heights.size(); ++i)
+		if (std::abs(loaded.Heights[i] - tile.Heights[i]) > 1.f / 65535.f)
+			return fail("DDS tile read back with different heights");
+	return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "TerrainHeightmap.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+enum class TerrainNoiseKind
+{
+	FBm,          // sum of simplex octaves
+	Ridged,       // 1 - |simplex| squared, each octave weighted by the previous one (sharp crests)
+	DomainWarped, // fBm sampled at a position displaced by two low-octave fBm fields
+};
+
+struct TerrainNoiseSettings
+{
+	TerrainNoiseKind Kind = TerrainNoiseKind::DomainWarped;
+	uint32_t Seed = 1337u;
+	int Octaves = 8;
+	float Frequency = 3.f;    // base features per terrain side
+	float Lacunarity = 2.f;
+	float Gain = 0.5f;
+	float WarpStrength = 0.6f; // DomainWarped: displacement in base-frequency units
+};
+
+// Normalized height in [0,1] at terrain coordinates (u, v) in [0,1]^2 (v = 0 at the +Z edge, as the
+// heightfield rows). Deterministic: every tile that samples the same (u, v) gets the same value.
+float EvaluateTerrainNoise(const TerrainNoiseSettings& settings, float u, float v);
+
+// One tile of LOD level lod (2^lod x 2^lod tiles, TileZ = 0 at the -Z edge), tileSize^2 texels.
+// Texels are corner-aligned: the edge texels sit exactly on the tile edges, so neighbouring tiles
+// share identical border texels and every coarser level's texel equals the finer level's texel at
+// the same position (sample positions come from integer global texel indices).
+void GenerateTerrainTile(const TerrainNoiseSettings& settings, int lod, int tileX, int tileZ, int tileSize,
+	TerrainHeightfield& out);
+
+// File of a tile in the layout the app loads: 001/Height_Out.dds for the root,
+// 00<lod+1>/Height/Height_Out_y<z>_x<x>.dds below it
+std::filesystem::path TerrainTilePath(const std::filesystem::path& root, int lod, int tileX, int tileZ);
+
+struct TerrainGeneratorSettings
+{
+	TerrainNoiseSettings Noise;
+	int Levels = 3;      // LOD levels 0 .. Levels-1
+	int TileSize = 512;
+	int ThreadCount = 0; // 0 = one per hardware thread
+};
+
+struct TerrainGeneratorStats
+{
+	int Tiles = 0;
+	int Failed = 0;          // tiles that could not be written
+	int Threads = 0;
+	uint64_t Texels = 0;
+	double TotalSeconds = 0.0;         // wall time, including quantization and file writes
+	double MTexelsPerSecond = 0.0;     // Texels / TotalSeconds
+	double KernelSeconds = 0.0;        // noise kernels only, summed over threads
+	double KernelMTexelsPerThread = 0.0; // Texels / KernelSeconds
+};
+
+// Generate and write every tile of every level, tiles spread over worker threads
+TerrainGeneratorStats GenerateTerrainTiles(const TerrainGeneratorSettings& settings, const std::filesystem::path& root);
+
+// CPU check: the SIMD kernels match a scalar reference, neighbouring tiles share bit-identical
+// border texels, coarser levels agree with finer ones and a written tile reads back through
+// LoadTerrainHeightfieldDDS. Returns false with a reason on failure.
+bool ValidateTerrainGenerator(std::string* error = nullptr);
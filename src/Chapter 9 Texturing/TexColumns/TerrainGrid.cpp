@@ -0,0 +1,151 @@
+#include "TerrainGrid.h"
+#include <cmath>
+#include <map>
+#include <utility>
+
+namespace
+{
+	struct GridEdge
+	{
+		uint32_t Bit;
+		bool AlongRow;  // edge runs along a row (constant i) or a column (constant j)
+		int Line;       // row/column index of the edge
+		int InnerLine;  // neighbouring inner row/column
+	};
+
+	void GetGridEdges(int res, GridEdge edges[4])
+	{
+		edges[0] = { TerrainEdgePosZ, true, 0, 1 };
+		edges[1] = { TerrainEdgeNegZ, true, res, res - 1 };
+		edges[2] = { TerrainEdgeNegX, false, 0, 1 };
+		edges[3] = { TerrainEdgePosX, false, res, res - 1 };
+	}
+
+	int GridIndex(int res, int i, int j)
+	{
+		return i * (res + 1) + j;
+	}
+
+	// Signed area in the XZ plane (x = j, z = -i); the regular grid winds with negative area
+	float SignedArea(int res, uint16_t a, uint16_t b, uint16_t c)
+	{
+		const int n = res + 1;
+		const float ax = (float)(a % n), az = -(float)(a / n);
+		const float bx = (float)(b % n), bz = -(float)(b / n);
+		const float cx = (float)(c % n), cz = -(float)(c / n);
+		return 0.5f * ((bx - ax) * (cz - az) - (bz - az) * (cx - ax));
+	}
+
+	void EmitTriangle(int res, std::vector<uint16_t>& indices, int a, int b, int c)
+	{
+		if (SignedArea(res, (uint16_t)a, (uint16_t)b, (uint16_t)c) > 0.f)
+			std::swap(b, c);
+		indices.push_back((uint16_t)a);
+		indices.push_back((uint16_t)b);
+		indices.push_back((uint16_t)c);
+	}
+}
+
+void BuildTerrainGridIndices(int res, uint32_t neighborMask, std::vector<uint16_t>& indices)
+{
+	// Interior quads between the four inner lines, split like GeometryGenerator::CreateGrid
+	for (int i = 1; i < res - 1; ++i)
+		for (int j = 1; j < res - 1; ++j)
+		{
+			EmitTriangle(res, indices, GridIndex(res, i, j), GridIndex(res, i, j + 1), GridIndex(res, i + 1, j));
+			EmitTriangle(res, indices, GridIndex(res, i + 1, j), GridIndex(res, i, j + 1), GridIndex(res, i + 1, j + 1));
+		}
+
+	// Border strips: zip the edge line (corner to corner) with the inner line (1 .. res-1).
+	// Neighbouring strips meet on the corner diagonals.
+	GridEdge edges[4];
+	GetGridEdges(res, edges);
+	for (const GridEdge& e : edges)
+	{
+		const int step = (neighborMask & e.Bit) ? 2 : 1;
+		auto vertex = [&](int line, int t) {
+			return e.AlongRow ? GridIndex(res, line, t) : GridIndex(res, t, line);
+		};
+		int a = 0; // position along the edge line
+		int b = 1; // position along the inner line
+		while (a < res || b < res - 1)
+		{
+			const bool advanceEdge = (b >= res - 1) || (a < res && a + step <= b + 1);
+			if (advanceEdge)
+			{
+				EmitTriangle(res, indices, vertex(e.Line, a), vertex(e.Line, a + step), vertex(e.InnerLine, b));
+				a += step;
+			}
+			else
+			{
+				EmitTriangle(res, indices, vertex(e.Line, a), vertex(e.InnerLine, b + 1), vertex(e.InnerLine, b));
+				b += 1;
+			}
+		}
+	}
+}
+
+bool ValidateTerrainGridStitching(int res, std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+	if (res < 4 || (res & 1)) return fail("grid resolution must be even and >= 4");
+
+	GridEdge edges[4];
+	GetGridEdges(res, edges);
+	for (uint32_t mask = 0; mask < (uint32_t)kTerrainStitchVariants; ++mask)
+	{
+		const std::string variant = "variant " + std::to_string(mask) + ": ";
+		std::vector<uint16_t> indices;
+		BuildTerrainGridIndices(res, mask, indices);
+
+		// Consistent winding, no degenerate triangles, total area equals the tile
+		double area = 0.0;
+		std::map<std::pair<int, int>, int> directed;
+		for (size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			const float a = SignedArea(res, indices[t], indices[t + 1], indices[t + 2]);
+			if (!(a < 0.f)) return fail(variant + "degenerate or flipped triangle");
+			area -= a;
+			for (int k = 0; k < 3; ++k)
+				if (++directed[{ indices[t + k], indices[t + (k + 1) % 3] }] > 1)
+					return fail(variant + "overlapping triangles");
+		}
+		if (std::fabs(area - (double)res * res) > 1e-3)
+			return fail(variant + "triangles do not cover the tile exactly once");
+
+		// Every edge with no opposite twin must lie on the tile border
+		std::map<std::pair<int, int>, int> borderEdges; // undirected
+		for (const auto& kv : directed)
+		{
+			if (directed.count({ kv.first.second, kv.first.first }))
+				continue;
+			const int n = res + 1;
+			const int i0 = kv.first.first / n, j0 = kv.first.first % n;
+			const int i1 = kv.first.second / n, j1 = kv.first.second % n;
+			const bool onBorder = (i0 == i1 && (i0 == 0 || i0 == res)) || (j0 == j1 && (j0 == 0 || j0 == res));
+			if (!onBorder) return fail(variant + "hole inside the tile");
+			borderEdges[{ std::min(kv.first.first, kv.first.second), std::max(kv.first.first, kv.first.second) }] = 1;
+		}
+
+		// Border edges must be exactly the consecutive shared edge vertices (step 2 when stitched)
+		size_t expected = 0;
+		for (const GridEdge& e : edges)
+		{
+			const int step = (mask & e.Bit) ? 2 : 1;
+			for (int t = 0; t < res; t += step)
+			{
+				const int a = e.AlongRow ? GridIndex(res, e.Line, t) : GridIndex(res, t, e.Line);
+				const int b = e.AlongRow ? GridIndex(res, e.Line, t + step) : GridIndex(res, t + step, e.Line);
+				if (!borderEdges.count({ std::min(a, b), std::max(a, b) }))
+					return fail(variant + "edge vertex not shared with the neighbour grid");
+				++expected;
+			}
+		}
+		if (borderEdges.size() != expected)
+			return fail(variant + "unexpected vertices on a stitched edge");
+	}
+	return true;
+}
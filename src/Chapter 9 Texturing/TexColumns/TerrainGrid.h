@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Quads per side of the shared tile grid built by BuildTerrainGeometry
+constexpr int kTerrainGridResolution = 64;
+
+// Neighbour mask bits: set when the neighbouring tile on that side is one LOD coarser,
+// so this tile drops the odd vertices of that edge to match the neighbour's grid
+enum TerrainEdge : uint32_t
+{
+	TerrainEdgeNegX = 1u << 0,
+	TerrainEdgePosX = 1u << 1,
+	TerrainEdgeNegZ = 1u << 2,
+	TerrainEdgePosZ = 1u << 3,
+};
+constexpr int kTerrainStitchVariants = 16;
+
+// Tile grid vertices are row-major, (resolution+1)^2 of them: row 0 is the +Z edge (v = 0),
+// column 0 the -X edge (u = 0), matching GeometryGenerator::CreateGrid.
+// Appends the triangle list for one neighbour mask; the interior is a regular grid and each
+// border strip is zipped between the edge (every vertex, or every other one when stitched)
+// and the first inner row, so all 16 variants share one vertex buffer.
+void BuildTerrainGridIndices(int resolution, uint32_t neighborMask, std::vector<uint16_t>& indices);
+
+// CPU check of all 16 variants: the tile is covered exactly once with consistent winding, and
+// every border edge is made of consecutive shared edge vertices (every other vertex on stitched
+// edges, so they coincide with the coarser neighbour's grid). Returns false with a reason on failure.
+bool ValidateTerrainGridStitching(int resolution, std::string* error = nullptr);
@@ -0,0 +1,439 @@
+#include "TerrainHeightmap.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	// Subset of the DDS file layout (see DDSTextureLoader.h), kept local so this file has no D3D dependency
+	constexpr uint32_t kDDSMagic = 0x20534444; // "DDS "
+	constexpr uint32_t kDDPFAlpha = 0x2;
+	constexpr uint32_t kDDPFFourCC = 0x4;
+	constexpr uint32_t kDDPFRGB = 0x40;
+	constexpr uint32_t kDDPFLuminance = 0x20000;
+
+	constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+	{
+		return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+	}
+
+	// DXGI_FORMAT values
+	constexpr uint32_t kDxgiR32Float = 41;
+	constexpr uint32_t kDxgiR16Float = 54;
+	constexpr uint32_t kDxgiR16Unorm = 56;
+	constexpr uint32_t kDxgiR8Unorm = 61;
+	constexpr uint32_t kDxgiBC1Unorm = 71;
+	constexpr uint32_t kDxgiBC1UnormSrgb = 72;
+	constexpr uint32_t kDxgiBC3Unorm = 77;
+	constexpr uint32_t kDxgiBC3UnormSrgb = 78;
+
+#pragma pack(push, 1)
+	struct DDSPixelFormat
+	{
+		uint32_t Size;
+		uint32_t Flags;
+		uint32_t FourCC;
+		uint32_t RGBBitCount;
+		uint32_t RBitMask;
+		uint32_t GBitMask;
+		uint32_t BBitMask;
+		uint32_t ABitMask;
+	};
+
+	struct DDSHeader
+	{
+		uint32_t Size;
+		uint32_t Flags;
+		uint32_t Height;
+		uint32_t Width;
+		uint32_t PitchOrLinearSize;
+		uint32_t Depth;
+		uint32_t MipMapCount;
+		uint32_t Reserved1[11];
+		DDSPixelFormat PixelFormat;
+		uint32_t Caps;
+		uint32_t Caps2;
+		uint32_t Caps3;
+		uint32_t Caps4;
+		uint32_t Reserved2;
+	};
+
+	struct DDSHeaderDX10
+	{
+		uint32_t DxgiFormat;
+		uint32_t ResourceDimension;
+		uint32_t MiscFlag;
+		uint32_t ArraySize;
+		uint32_t MiscFlags2;
+	};
+#pragma pack(pop)
+
+	float HalfToFloat(uint16_t h)
+	{
+		const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+		uint32_t exponent = (h >> 10) & 0x1f;
+		uint32_t mantissa = h & 0x3ff;
+		uint32_t bits;
+		if (exponent == 0)
+		{
+			if (mantissa == 0)
+				bits = sign;
+			else
+			{
+				// Denormal: renormalize
+				exponent = 1;
+				while (!(mantissa & 0x400)) { mantissa <<= 1; --exponent; }
+				mantissa &= 0x3ff;
+				bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+			}
+		}
+		else if (exponent == 31)
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		else
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		float f;
+		std::memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+
+	// Red channel of a BC1 colour block (also the colour half of BC3) into a 4x4 tile
+	void DecodeBCRed(const uint8_t* block, float out[16])
+	{
+		const uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+		const uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+		const float r0 = (float)(c0 >> 11) / 31.f;
+		const float r1 = (float)(c1 >> 11) / 31.f;
+		float palette[4] = { r0, r1, 0.f, 0.f };
+		if (c0 > c1)
+		{
+			palette[2] = (2.f * r0 + r1) / 3.f;
+			palette[3] = (r0 + 2.f * r1) / 3.f;
+		}
+		else
+		{
+			palette[2] = (r0 + r1) * 0.5f;
+			palette[3] = 0.f;
+		}
+		const uint32_t indices = (uint32_t)block[4] | ((uint32_t)block[5] << 8) | ((uint32_t)block[6] << 16) | ((uint32_t)block[7] << 24);
+		for (int i = 0; i < 16; ++i)
+			out[i] = palette[(indices >> (2 * i)) & 3];
+	}
+
+	enum class HeightFormat { Unknown, R8, R16, R16F, R32F, BC1, BC3 };
+
+	HeightFormat FormatFromDxgi(uint32_t dxgi)
+	{
+		switch (dxgi)
+		{
+		case kDxgiR8Unorm: return HeightFormat::R8;
+		case kDxgiR16Unorm: return HeightFormat::R16;
+		case kDxgiR16Float: return HeightFormat::R16F;
+		case kDxgiR32Float: return HeightFormat::R32F;
+		case kDxgiBC1Unorm: case kDxgiBC1UnormSrgb: return HeightFormat::BC1;
+		case kDxgiBC3Unorm: case kDxgiBC3UnormSrgb: return HeightFormat::BC3;
+		default: return HeightFormat::Unknown;
+		}
+	}
+
+	HeightFormat FormatFromLegacy(const DDSPixelFormat& pf)
+	{
+		if (pf.Flags & kDDPFFourCC)
+		{
+			if (pf.FourCC == MakeFourCC('D', 'X', 'T', '1')) return HeightFormat::BC1;
+			if (pf.FourCC == MakeFourCC('D', 'X', 'T', '4') || pf.FourCC == MakeFourCC('D', 'X', 'T', '5')) return HeightFormat::BC3;
+			if (pf.FourCC == 111) return HeightFormat::R16F; // D3DFMT_R16F
+			if (pf.FourCC == 114) return HeightFormat::R32F; // D3DFMT_R32F
+			return HeightFormat::Unknown;
+		}
+		if (pf.Flags & (kDDPFLuminance | kDDPFRGB | kDDPFAlpha))
+		{
+			if (pf.RGBBitCount == 8) return HeightFormat::R8;
+			if (pf.RGBBitCount == 16) return HeightFormat::R16;
+		}
+		return HeightFormat::Unknown;
+	}
+}
+
+float TerrainHeightfield::Sample(float u, float v) const
+{
+	if (Heights.empty()) return 0.f;
+	const float fx = std::clamp(u * Width - 0.5f, 0.f, (float)(Width - 1));
+	const float fz = std::clamp(v * Height - 0.5f, 0.f, (float)(Height - 1));
+	const int x0 = (int)fx, z0 = (int)fz;
+	const int x1 = std::min(x0 + 1, Width - 1), z1 = std::min(z0 + 1, Height - 1);
+	const float tx = fx - (float)x0, tz = fz - (float)z0;
+	const float h0 = At(x0, z0) + (At(x1, z0) - At(x0, z0)) * tx;
+	const float h1 = At(x0, z1) + (At(x1, z1) - At(x0, z1)) * tx;
+	return h0 + (h1 - h0) * tz;
+}
+
+bool LoadTerrainHeightfieldDDS(const std::filesystem::path& filename, TerrainHeightfield& out)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) return false;
+
+	uint32_t magic = 0;
+	DDSHeader header = {};
+	if (!file.read((char*)&magic, sizeof(magic)) || magic != kDDSMagic) return false;
+	if (!file.read((char*)&header, sizeof(header)) || header.Size != sizeof(DDSHeader)) return false;
+
+	HeightFormat format;
+	if ((header.PixelFormat.Flags & kDDPFFourCC) && header.PixelFormat.FourCC == MakeFourCC('D', 'X', '1', '0'))
+	{
+		DDSHeaderDX10 dx10 = {};
+		if (!file.read((char*)&dx10, sizeof(dx10))) return false;
+		format = FormatFromDxgi(dx10.DxgiFormat);
+	}
+	else
+		format = FormatFromLegacy(header.PixelFormat);
+	if (format == HeightFormat::Unknown || header.Width == 0 || header.Height == 0) return false;
+
+	const int width = (int)header.Width;
+	const int height = (int)header.Height;
+	const bool compressed = format == HeightFormat::BC1 || format == HeightFormat::BC3;
+	size_t bytes;
+	if (compressed)
+		bytes = (size_t)((width + 3) / 4) * ((height + 3) / 4) * (format == HeightFormat::BC1 ? 8 : 16);
+	else
+	{
+		const size_t texelBytes = (format == HeightFormat::R8) ? 1 : (format == HeightFormat::R32F) ? 4 : 2;
+		bytes = (size_t)width * height * texelBytes;
+	}
+	std::vector<uint8_t> data(bytes);
+	if (!file.read((char*)data.data(), (std::streamsize)bytes)) return false;
+
+	out.Width = width;
+	out.Height = height;
+	out.Heights.assign((size_t)width * height, 0.f);
+	if (compressed)
+	{
+		const int blockBytes = (format == HeightFormat::BC1) ? 8 : 16;
+		const int colorOffset = (format == HeightFormat::BC1) ? 0 : 8; // BC3: alpha block comes first
+		const int blocksX = (width + 3) / 4;
+		float texels[16];
+		for (int by = 0; by < (height + 3) / 4; ++by)
+			for (int bx = 0; bx < blocksX; ++bx)
+			{
+				DecodeBCRed(&data[((size_t)by * blocksX + bx) * blockBytes + colorOffset], texels);
+				for (int y = 0; y < 4 && by * 4 + y < height; ++y)
+					for (int x = 0; x < 4 && bx * 4 + x < width; ++x)
+						out.Heights[(size_t)(by * 4 + y) * width + bx * 4 + x] = texels[y * 4 + x];
+			}
+		return true;
+	}
+
+	const size_t count = (size_t)width * height;
+	for (size_t i = 0; i < count; ++i)
+	{
+		switch (format)
+		{
+		case HeightFormat::R8:
+			out.Heights[i] = (float)data[i] / 255.f;
+			break;
+		case HeightFormat::R16:
+			out.Heights[i] = (float)(data[2 * i] | (data[2 * i + 1] << 8)) / 65535.f;
+			break;
+		case HeightFormat::R16F:
+			out.Heights[i] = HalfToFloat((uint16_t)(data[2 * i] | (data[2 * i + 1] << 8)));
+			break;
+		default:
+			std::memcpy(&out.Heights[i], &data[4 * i], sizeof(float));
+			break;
+		}
+	}
+	return true;
+}
+
+bool SaveTerrainHeightfieldDDS(const std::filesystem::path& filename, const TerrainHeightfield& heightfield, bool mips)
+{
+	if (heightfield.Empty()) return false;
+	constexpr uint32_t kDDSDCaps = 0x1, kDDSDHeight = 0x2, kDDSDWidth = 0x4, kDDSDPitch = 0x8, kDDSDPixelFormat = 0x1000;
+	constexpr uint32_t kDDSDMipMapCount = 0x20000;
+	constexpr uint32_t kDDSCapsComplex = 0x8, kDDSCapsTexture = 0x1000, kDDSCapsMipMap = 0x400000;
+
+	// Mip chain in float, quantized once per level
+	std::vector<TerrainHeightfield> chain;
+	const TerrainHeightfield* level = &heightfield;
+	while (mips && (level->Width > 1 || level->Height > 1))
+	{
+		TerrainHeightfield next;
+		next.Width = std::max(level->Width / 2, 1);
+		next.Height = std::max(level->Height / 2, 1);
+		next.Heights.resize((size_t)next.Width * next.Height);
+		for (int z = 0; z < next.Height; ++z)
+		{
+			const int z0 = std::min(2 * z, level->Height - 1), z1 = std::min(2 * z + 1, level->Height - 1);
+			for (int x = 0; x < next.Width; ++x)
+			{
+				const int x0 = std::min(2 * x, level->Width - 1), x1 = std::min(2 * x + 1, level->Width - 1);
+				next.Heights[(size_t)z * next.Width + x] =
+					(level->At(x0, z0) + level->At(x1, z0) + level->At(x0, z1) + level->At(x1, z1)) * 0.25f;
+			}
+		}
+		chain.push_back(std::move(next));
+		level = &chain.back();
+	}
+
+	DDSHeader header = {};
+	header.Size = sizeof(DDSHeader);
+	header.Flags = kDDSDCaps | kDDSDHeight | kDDSDWidth | kDDSDPitch | kDDSDPixelFormat | (mips ? kDDSDMipMapCount : 0);
+	header.Height = (uint32_t)heightfield.Height;
+	header.Width = (uint32_t)heightfield.Width;
+	header.PitchOrLinearSize = (uint32_t)heightfield.Width * 2;
+	header.MipMapCount = 1 + (uint32_t)chain.size();
+	header.PixelFormat.Size = sizeof(DDSPixelFormat);
+	header.PixelFormat.Flags = kDDPFFourCC;
+	header.PixelFormat.FourCC = MakeFourCC('D', 'X', '1', '0');
+	header.Caps = kDDSCapsTexture | (chain.empty() ? 0 : kDDSCapsComplex | kDDSCapsMipMap);
+	DDSHeaderDX10 dx10 = {};
+	dx10.DxgiFormat = kDxgiR16Unorm;
+	dx10.ResourceDimension = 3; // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+	dx10.ArraySize = 1;
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) return false;
+	file.write((const char*)&kDDSMagic, sizeof(kDDSMagic));
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)&dx10, sizeof(dx10));
+	std::vector<uint16_t> texels;
+	for (size_t m = 0; m <= chain.size(); ++m)
+	{
+		const std::vector<float>& heights = m == 0 ? heightfield.Heights : chain[m - 1].Heights;
+		texels.resize(heights.size());
+		for (size_t i = 0; i < texels.size(); ++i)
+			texels[i] = (uint16_t)std::lround(std::clamp(heights[i], 0.f, 1.f) * 65535.f);
+		file.write((const char*)texels.data(), (std::streamsize)(texels.size() * sizeof(uint16_t)));
+	}
+	return (bool)file;
+}
+
+bool FindTerrainHeightmapR16(const std::filesystem::path& filename, TerrainR16Layout& layout)
+{
+	std::error_code ec;
+	const uint64_t fileBytes = (uint64_t)std::filesystem::file_size(filename, ec);
+	if (ec) return false;
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) return false;
+
+	uint32_t magic = 0;
+	DDSHeader header = {};
+	if (file.read((char*)&magic, sizeof(magic)) && magic == kDDSMagic &&
+		file.read((char*)&header, sizeof(header)) && header.Size == sizeof(DDSHeader))
+	{
+		HeightFormat format;
+		uint64_t offset = sizeof(magic) + sizeof(header);
+		if ((header.PixelFormat.Flags & kDDPFFourCC) && header.PixelFormat.FourCC == MakeFourCC('D', 'X', '1', '0'))
+		{
+			DDSHeaderDX10 dx10 = {};
+			if (!file.read((char*)&dx10, sizeof(dx10))) return false;
+			format = FormatFromDxgi(dx10.DxgiFormat);
+			offset += sizeof(dx10);
+		}
+		else
+			format = FormatFromLegacy(header.PixelFormat);
+		if (format != HeightFormat::R16 || header.Width == 0 || header.Height == 0) return false;
+		if (offset + (uint64_t)header.Width * header.Height * 2 > fileBytes) return false;
+		layout.Width = (int)header.Width;
+		layout.Height = (int)header.Height;
+		layout.DataOffset = offset;
+		return true;
+	}
+
+	// Headerless: only a square is unambiguous
+	const uint64_t texels = fileBytes / 2;
+	const uint64_t side = (uint64_t)std::llround(std::sqrt((double)texels));
+	if (fileBytes % 2 != 0 || side < 2 || side * side != texels) return false;
+	layout.Width = (int)side;
+	layout.Height = (int)side;
+	layout.DataOffset = 0;
+	return true;
+}
+
+bool StitchTerrainHeightfields(const std::vector<TerrainHeightfield>& tiles, int tilesPerSide, TerrainHeightfield& out)
+{
+	if (tilesPerSide <= 0 || (int)tiles.size() != tilesPerSide * tilesPerSide) return false;
+	const int tileW = tiles[0].Width, tileH = tiles[0].Height;
+	for (const TerrainHeightfield& t : tiles)
+		if (t.Empty() || t.Width != tileW || t.Height != tileH) return false;
+
+	out.Width = tileW * tilesPerSide;
+	out.Height = tileH * tilesPerSide;
+	out.Heights.assign((size_t)out.Width * out.Height, 0.f);
+	for (int tz = 0; tz < tilesPerSide; ++tz)
+		for (int tx = 0; tx < tilesPerSide; ++tx)
+		{
+			// Row 0 of the stitched field is the +Z edge, so TileZ = 0 goes to the bottom rows
+			const TerrainHeightfield& tile = tiles[tz * tilesPerSide + tx];
+			const int rowBase = (tilesPerSide - 1 - tz) * tileH;
+			for (int y = 0; y < tileH; ++y)
+				std::copy_n(&tile.Heights[(size_t)y * tileW], tileW,
+					&out.Heights[(size_t)(rowBase + y) * out.Width + (size_t)tx * tileW]);
+		}
+	return true;
+}
+
+void TerrainHeightPyramid::Build(const TerrainHeightfield& heightfield)
+{
+	mLevels.clear();
+	if (heightfield.Empty()) return;
+
+	Level base;
+	base.Width = heightfield.Width;
+	base.Height = heightfield.Height;
+	base.Min = heightfield.Heights;
+	base.Max = heightfield.Heights;
+	mLevels.push_back(std::move(base));
+	while (mLevels.back().Width > 1 || mLevels.back().Height > 1)
+	{
+		const Level& src = mLevels.back();
+		Level dst;
+		dst.Width = (src.Width + 1) / 2;
+		dst.Height = (src.Height + 1) / 2;
+		dst.Min.resize((size_t)dst.Width * dst.Height);
+		dst.Max.resize((size_t)dst.Width * dst.Height);
+		for (int z = 0; z < dst.Height; ++z)
+		{
+			const int z0 = 2 * z, z1 = std::min(2 * z + 1, src.Height - 1);
+			for (int x = 0; x < dst.Width; ++x)
+			{
+				const int x0 = 2 * x, x1 = std::min(2 * x + 1, src.Width - 1);
+				const size_t a = (size_t)z0 * src.Width + x0, b = (size_t)z0 * src.Width + x1;
+				const size_t c = (size_t)z1 * src.Width + x0, d = (size_t)z1 * src.Width + x1;
+				dst.Min[(size_t)z * dst.Width + x] = std::min(std::min(src.Min[a], src.Min[b]), std::min(src.Min[c], src.Min[d]));
+				dst.Max[(size_t)z * dst.Width + x] = std::max(std::max(src.Max[a], src.Max[b]), std::max(src.Max[c], src.Max[d]));
+			}
+		}
+		mLevels.push_back(std::move(dst));
+	}
+}
+
+void TerrainHeightPyramid::QueryRange(float u0, float v0, float u1, float v1, float& minH, float& maxH) const
+{
+	minH = 0.f;
+	maxH = 1.f;
+	if (mLevels.empty()) return;
+
+	// Texels touched by bilinear filtering anywhere in the rectangle
+	const Level& base = mLevels[0];
+	const int x0 = std::clamp((int)std::floor(u0 * base.Width - 0.5f), 0, base.Width - 1);
+	const int x1 = std::clamp((int)std::floor(u1 * base.Width - 0.5f) + 1, 0, base.Width - 1);
+	const int z0 = std::clamp((int)std::floor(v0 * base.Height - 0.5f), 0, base.Height - 1);
+	const int z1 = std::clamp((int)std::floor(v1 * base.Height - 0.5f) + 1, 0, base.Height - 1);
+
+	// Coarsest level at which the range still spans at most 4x4 cells
+	int level = 0;
+	while (level + 1 < (int)mLevels.size() && ((x1 >> level) - (x0 >> level) > 3 || (z1 >> level) - (z0 >> level) > 3))
+		++level;
+
+	const Level& l = mLevels[level];
+	minH = 1e30f;
+	maxH = -1e30f;
+	for (int z = z0 >> level; z <= (z1 >> level); ++z)
+		for (int x = x0 >> level; x <= (x1 >> level); ++x)
+		{
+			minH = std::min(minH, l.Min[(size_t)z * l.Width + x]);
+			maxH = std::max(maxH, l.Max[(size_t)z * l.Width + x]);
+		}
+}
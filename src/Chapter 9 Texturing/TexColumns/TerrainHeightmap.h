@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// CPU copy of the terrain heightfield, heights normalized to [0,1].
+// Row 0 is the +Z edge of the terrain (heightmap V runs towards -Z), matching the tile UVs.
+struct TerrainHeightfield
+{
+	int Width = 0;
+	int Height = 0;
+	std::vector<float> Heights;
+
+	bool Empty() const { return Heights.empty(); }
+	float At(int x, int z) const { return Heights[(size_t)z * Width + x]; }
+	// Bilinear sample at normalized UV over the whole terrain, clamped to the edges
+	float Sample(float u, float v) const;
+};
+
+// Decode mip 0 of a heightmap DDS into normalized heights (red channel).
+// Supports R8/R16 UNORM, R16F/R32F (DX10 or legacy headers, incl. luminance) and BC1/BC3.
+bool LoadTerrainHeightfieldDDS(const std::filesystem::path& filename, TerrainHeightfield& out);
+// Write heights (clamped to [0,1]) as an R16_UNORM DDS (DX10 header), readable by
+// LoadTerrainHeightfieldDDS and DDSTextureLoader. With mips the full chain down to 1x1 follows
+// mip 0, each mip the 2x2 box average of the one above.
+bool SaveTerrainHeightfieldDDS(const std::filesystem::path& filename, const TerrainHeightfield& heightfield,
+	bool mips = false);
+
+// Where mip 0 of an uncompressed 16-bit heightmap starts, for readers that map the file instead of
+// loading it: an R16_UNORM / L16 DDS, or a headerless little-endian square .r16/.raw (side from the size)
+struct TerrainR16Layout
+{
+	int Width = 0;
+	int Height = 0;
+	uint64_t DataOffset = 0; // row-major, 2 bytes per texel, row 0 = +Z edge
+};
+bool FindTerrainHeightmapR16(const std::filesystem::path& filename, TerrainR16Layout& layout);
+
+// Stitch an n x n grid of equally sized tiles into one heightfield.
+// tiles[z * n + x] follows the quadtree tile order (TileZ = 0 is the -Z edge).
+bool StitchTerrainHeightfields(const std::vector<TerrainHeightfield>& tiles, int tilesPerSide, TerrainHeightfield& out);
+
+// Min/max mip pyramid over a heightfield: level 0 is per texel, each level halves the
+// resolution (rounding up) and stores the min/max of its 2x2 children.
+class TerrainHeightPyramid
+{
+public:
+	void Build(const TerrainHeightfield& heightfield);
+	bool Empty() const { return mLevels.empty(); }
+	int GetLevelCount() const { return (int)mLevels.size(); }
+
+	// Conservative height range of the bilinear surface over a UV rectangle
+	void QueryRange(float u0, float v0, float u1, float v1, float& minH, float& maxH) const;
+
+private:
+	struct Level
+	{
+		int Width = 0;
+		int Height = 0;
+		std::vector<float> Min;
+		std::vector<float> Max;
+	};
+	std::vector<Level> mLevels;
+};
@@ -0,0 +1,255 @@
+#include "TerrainHorizon.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <emmintrin.h>
+
+namespace
+{
+	const float kHalfPi = 1.57079632679f;
+
+	// Grid step of azimuth k: +column = +X, +row = -Z
+	const int kStepX[kTerrainHorizonDirections] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+	const int kStepZ[kTerrainHorizonDirections] = { 0, -1, -1, -1, 0, 1, 1, 1 };
+	const int kSweepGroup = 256; // lines (or rows) per job
+
+	template <class Fn>
+	void ParallelFor(int threads, int count, const Fn& fn)
+	{
+		std::atomic<int> next{ 0 };
+		auto work = [&]() {
+			for (int i = next++; i < count; i = next++)
+				fn(i);
+		};
+		std::vector<std::thread> workers;
+		for (int t = 1; t < std::min(threads, count); ++t)
+			workers.emplace_back(work);
+		work();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	uint8_t EncodeSlope(float slope)
+	{
+		return (uint8_t)std::lround(std::atan(std::max(slope, 0.f)) / kHalfPi * 255.f);
+	}
+
+	// atan of 4 non-negative slopes: a minimax polynomial on [0, 1] and pi/2 - atan(1/x) above
+	__m128 AtanPositive(__m128 x)
+	{
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128 large = _mm_cmpgt_ps(x, one);
+		const __m128 a = _mm_or_ps(_mm_and_ps(large, _mm_div_ps(one, _mm_max_ps(x, one))), _mm_andnot_ps(large, x));
+		const __m128 a2 = _mm_mul_ps(a, a);
+		__m128 p = _mm_set1_ps(0.0208351f);
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(-0.0851330f));
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(0.1801410f));
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(-0.3302995f));
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(0.9998660f));
+		const __m128 r = _mm_mul_ps(p, a);
+		return _mm_or_ps(_mm_and_ps(large, _mm_sub_ps(_mm_set1_ps(kHalfPi), r)), _mm_andnot_ps(large, r));
+	}
+
+	// Slopes of one direction into its channel, 4 texels per SSE step
+	void EncodeSlopes(const float* slopes, size_t count, uint8_t* dst)
+	{
+		const __m128 scale = _mm_set1_ps(255.f / kHalfPi);
+		const __m128 zero = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 angle = AtanPositive(_mm_max_ps(_mm_loadu_ps(slopes + i), zero));
+			alignas(16) int32_t q[4];
+			_mm_store_si128((__m128i*)q, _mm_cvtps_epi32(_mm_mul_ps(angle, scale)));
+			for (int j = 0; j < 4; ++j)
+				dst[(i + j) * 4] = (uint8_t)std::clamp(q[j], 0, 255);
+		}
+		for (; i < count; ++i)
+			dst[i * 4] = EncodeSlope(slopes[i]);
+	}
+
+	struct HullPoint
+	{
+		int K;   // walk index along the line
+		float H;
+	};
+
+	// Next step of one line: the hull holds the texels already visited (all further along the
+	// direction) as (walk index, height); return the slope to its tangent point and add this texel.
+	float HullStep(std::vector<HullPoint>& hull, int k, float h, float stepLength)
+	{
+		// Pop while the top lies on or below the line from this texel to the one beneath it: it is
+		// hidden from here and from every texel further back
+		size_t size = hull.size();
+		while (size >= 2 &&
+			(hull[size - 1].H - h) * (float)(k - hull[size - 2].K) <= (hull[size - 2].H - h) * (float)(k - hull[size - 1].K))
+			--size;
+		hull.resize(size);
+		const float slope = size > 0 ? std::max(hull.back().H - h, 0.f) / ((float)(k - hull.back().K) * stepLength) : 0.f;
+		hull.push_back({ k, h });
+		return slope;
+	}
+
+	// Slopes of direction (dx, dz). Rows are lines when dz = 0; otherwise lines are the texels of
+	// constant x - dx * dz * z and are swept together a row at a time, starting from the row whose
+	// texels' next step leaves the heightfield, so every row is read and written contiguously.
+	void SweepDirection(const TerrainHeightfield& field, int dx, int dz, float stepLength, int threads, float* slopes)
+	{
+		const int width = field.Width, height = field.Height;
+		if (dz == 0)
+		{
+			ParallelFor(threads, (height + kSweepGroup - 1) / kSweepGroup, [&](int job) {
+				thread_local std::vector<HullPoint> hull;
+				for (int z = job * kSweepGroup; z < std::min(height, (job + 1) * kSweepGroup); ++z)
+				{
+					hull.clear();
+					const size_t row = (size_t)z * width;
+					for (int k = 0, x = dx > 0 ? width - 1 : 0; k < width; ++k, x -= dx)
+						slopes[row + x] = HullStep(hull, k, field.Heights[row + x], stepLength);
+				}
+			});
+			return;
+		}
+
+		const int shear = dx * dz;
+		const int idOffset = shear > 0 ? height - 1 : 0;
+		const int lineCount = width + (height - 1) * std::abs(shear);
+		ParallelFor(threads, (lineCount + kSweepGroup - 1) / kSweepGroup, [&](int job) {
+			thread_local std::vector<std::vector<HullPoint>> hulls;
+			hulls.resize(kSweepGroup);
+			for (std::vector<HullPoint>& hull : hulls)
+				hull.clear();
+			const int firstLine = job * kSweepGroup;
+			for (int k = 0; k < height; ++k)
+			{
+				const int z = dz < 0 ? k : height - 1 - k;
+				// Line id = x - shear * z + idOffset
+				const int x0 = std::max(firstLine - idOffset + shear * z, 0);
+				const int x1 = std::min(firstLine + kSweepGroup - idOffset + shear * z, width);
+				const size_t row = (size_t)z * width;
+				for (int x = x0; x < x1; ++x)
+					slopes[row + x] = HullStep(hulls[x + idOffset - shear * z - firstLine], k, field.Heights[row + x], stepLength);
+			}
+		});
+	}
+}
+
+float TerrainHorizonMap::Slope(int x, int z, int direction) const
+{
+	return std::tan((float)Encoded(x, z, direction) / 255.f * kHalfPi);
+}
+
+TerrainHorizonStats BakeTerrainHorizonMap(const TerrainHeightfield& heightfield, int threadCount, TerrainHorizonMap& out)
+{
+	const auto start = std::chrono::steady_clock::now();
+	TerrainHorizonStats stats;
+	out = TerrainHorizonMap();
+	if (heightfield.Empty())
+		return stats;
+	const int width = heightfield.Width, height = heightfield.Height;
+	const size_t texels = (size_t)width * height;
+	out.Width = width;
+	out.Height = height;
+	out.Texels.assign(texels * 4 * kTerrainHorizonSlices, 0);
+
+	const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+	const int threads = std::max(threadCount > 0 ? threadCount : (int)hardware, 1);
+	// Corner-aligned texels: the heightfield spans UV [0, 1]
+	const float du = 1.f / (float)std::max(width - 1, 1);
+	const float dv = 1.f / (float)std::max(height - 1, 1);
+
+	std::vector<float> slopes(texels);
+	double sweepMs = 0.0, encodeMs = 0.0;
+	for (int direction = 0; direction < kTerrainHorizonDirections; ++direction)
+	{
+		const int dx = kStepX[direction], dz = kStepZ[direction];
+		const float stepLength = std::sqrt((dx * du) * (dx * du) + (dz * dv) * (dz * dv));
+		const auto sweepStart = std::chrono::steady_clock::now();
+		SweepDirection(heightfield, dx, dz, stepLength, threads, slopes.data());
+		const auto encodeStart = std::chrono::steady_clock::now();
+		uint8_t* channel = out.Texels.data() + (size_t)(direction >> 2) * texels * 4 + (direction & 3);
+		const int rowsPerJob = 32;
+		ParallelFor(threads, (height + rowsPerJob - 1) / rowsPerJob, [&](int job) {
+			const size_t first = (size_t)job * rowsPerJob * width;
+			const size_t count = (size_t)std::min(rowsPerJob, height - job * rowsPerJob) * width;
+			EncodeSlopes(slopes.data() + first, count, channel + first * 4);
+		});
+		const auto end = std::chrono::steady_clock::now();
+		sweepMs += std::chrono::duration<double, std::milli>(encodeStart - sweepStart).count();
+		encodeMs += std::chrono::duration<double, std::milli>(end - encodeStart).count();
+	}
+
+	stats.Width = width;
+	stats.Height = height;
+	stats.Threads = threads;
+	stats.SweepMs = sweepMs;
+	stats.EncodeMs = encodeMs;
+	stats.TotalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	stats.MsPerTile = stats.TotalMs * (512.0 * 512.0) / (double)texels;
+	stats.MTexelsPerSecond = stats.TotalMs > 0.0 ? (double)texels * kTerrainHorizonDirections / (stats.TotalMs * 1000.0) : 0.0;
+	return stats;
+}
+
+bool ValidateTerrainHorizon(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	TerrainHeightfield field;
+	field.Width = 41;
+	field.Height = 33;
+	for (int z = 0; z < field.Height; ++z)
+		for (int x = 0; x < field.Width; ++x)
+		{
+			// Rolling hills, one tall spike and a steep wall near an edge
+			float h = 0.3f + 0.15f * std::sin(x * 0.37f) * std::cos(z * 0.29f);
+			if (x == 20 && z == 15)
+				h = 0.95f;
+			if (x >= 36)
+				h += 0.02f * (float)(x - 35);
+			field.Heights.push_back(h);
+		}
+
+	TerrainHorizonMap single, parallel;
+	BakeTerrainHorizonMap(field, 1, single);
+	BakeTerrainHorizonMap(field, 3, parallel);
+	if (single.Width != field.Width || single.Height != field.Height ||
+		single.Texels.size() != (size_t)field.Width * field.Height * 4 * kTerrainHorizonSlices)
+		return fail("horizon map has the wrong size");
+	if (single.Texels != parallel.Texels)
+		return fail("horizon map depends on the thread count");
+
+	const float du = 1.f / (float)(field.Width - 1), dv = 1.f / (float)(field.Height - 1);
+	for (int direction = 0; direction < kTerrainHorizonDirections; ++direction)
+	{
+		const int dx = kStepX[direction], dz = kStepZ[direction];
+		const float stepLength = std::sqrt((dx * du) * (dx * du) + (dz * dv) * (dz * dv));
+		for (int z = 0; z < field.Height; ++z)
+			for (int x = 0; x < field.Width; ++x)
+			{
+				float best = 0.f;
+				for (int t = 1, sx = x + dx, sz = z + dz; sx >= 0 && sx < field.Width && sz >= 0 && sz < field.Height;
+					++t, sx += dx, sz += dz)
+					best = std::max(best, (field.At(sx, sz) - field.At(x, z)) / ((float)t * stepLength));
+				if (std::abs((int)single.Encoded(x, z, direction) - (int)EncodeSlope(best)) > 1)
+					return fail("slope differs from a brute-force search in direction " + std::to_string(direction));
+			}
+	}
+	// Looking at the spike from two texels away along +X (direction 0)
+	const float spikeSlope = (0.95f - field.At(18, 15)) / (2.f * du);
+	if (std::abs((int)single.Encoded(18, 15, 0) - (int)EncodeSlope(spikeSlope)) > 1)
+		return fail("spike does not set the horizon next to it");
+
+	TerrainHeightfield flat;
+	flat.Width = flat.Height = 17;
+	flat.Heights.assign((size_t)17 * 17, 0.4f);
+	TerrainHorizonMap flatMap;
+	BakeTerrainHorizonMap(flat, 2, flatMap);
+	if (std::any_of(flatMap.Texels.begin(), flatMap.Texels.end(), [](uint8_t v) { return v != 0; }))
+		return fail("flat heightfield has a horizon");
+	return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "TerrainHeightmap.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Horizon map: for every heightfield texel and each of kTerrainHorizonDirections azimuths, the
+// slope of the highest terrain seen from the texel in that direction. A directional light is
+// blocked when its elevation is below the horizon in its azimuth, so terrain self-shadowing is one
+// texture lookup against the sun direction (Terrain.hlsl) instead of a shadow map or ray query.
+// Azimuth k points along (cos, sin)(k * 2pi / N) in world XZ; the 8 directions follow grid rows,
+// columns and diagonals, so every sweep line visits texels exactly.
+constexpr int kTerrainHorizonDirections = 8;
+constexpr int kTerrainHorizonSlices = kTerrainHorizonDirections / 4; // RGBA8 array slices
+
+// Slopes are normalized height per heightfield UV unit, so the map does not depend on the
+// terrain's height scale or world size: tan(world elevation) = slope * heightScale / worldSizeXZ.
+// Each is stored as atan(slope) / (pi / 2) in UNORM8; terrain below the texel counts as slope 0.
+struct TerrainHorizonMap
+{
+	int Width = 0;
+	int Height = 0;
+	// Slice s holds directions 4s .. 4s+3 in RGBA, Width x Height texels, row 0 = +Z edge
+	std::vector<uint8_t> Texels;
+
+	bool Empty() const { return Texels.empty(); }
+	uint8_t Encoded(int x, int z, int direction) const
+	{
+		const size_t slice = (size_t)(direction >> 2) * Width * Height;
+		return Texels[(slice + (size_t)z * Width + x) * 4 + (direction & 3)];
+	}
+	// Decoded slope (normalized height per UV unit)
+	float Slope(int x, int z, int direction) const;
+};
+
+struct TerrainHorizonStats
+{
+	int Width = 0;
+	int Height = 0;
+	int Threads = 0;
+	double TotalMs = 0.0;
+	double SweepMs = 0.0;   // convex-hull sweeps over all directions
+	double EncodeMs = 0.0;  // slope -> UNORM8 angle (SSE)
+	double MsPerTile = 0.0; // TotalMs scaled to one 512x512 heightmap tile
+	double MTexelsPerSecond = 0.0; // texel-directions per second
+};
+
+// Sweep every line of the heightfield in each direction, far end first, keeping the upper convex
+// hull of the heights passed so far: a texel's horizon is the hull vertex its tangent touches and
+// hull vertices below that tangent are never the horizon again, so each direction is O(texels).
+// Lines are spread over worker threads (0 = one per hardware thread).
+TerrainHorizonStats BakeTerrainHorizonMap(const TerrainHeightfield& heightfield, int threadCount, TerrainHorizonMap& out);
+
+// CPU check on generated heights: slopes match a brute-force search along every direction to
+// within one UNORM8 step, a flat field has no horizon and the map does not depend on the thread
+// count. Returns false with a reason on failure.
+bool ValidateTerrainHorizon(std::string* error = nullptr);
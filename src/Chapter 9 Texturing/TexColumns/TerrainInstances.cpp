@@ -0,0 +1,105 @@
+#include "TerrainInstances.h"
+
+namespace
+{
+	// Same fields as TerrainTile without the DirectX types
+	struct TestTile
+	{
+		float World[16];
+		float PrevWorld[16];
+		float HeightmapUV[4];
+		float MorphFactor = 0.f;
+		int LOD = 0;
+		int HeightmapSrvIndex = -1;
+		int NormalMapSrvIndex = -1;
+		uint32_t NeighborMask = 0;
+	};
+
+	std::vector<TestTile> MakeTestTiles(uint32_t count)
+	{
+		std::vector<TestTile> tiles(count);
+		uint32_t seed = 12345u;
+		auto next = [&seed]() { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			TestTile& tile = tiles[i];
+			for (int k = 0; k < 16; ++k)
+			{
+				tile.World[k] = (float)(i * 16 + k);
+				tile.PrevWorld[k] = -(float)(i * 16 + k);
+			}
+			for (int k = 0; k < 4; ++k)
+				tile.HeightmapUV[k] = (float)i + 0.25f * (float)k;
+			tile.MorphFactor = (float)i; // identifies the tile after packing
+			tile.LOD = (int)(next() % 10);
+			tile.NeighborMask = next() % 16;
+			tile.HeightmapSrvIndex = (next() % 4 == 0) ? -1 : (int)(next() % 100);
+			tile.NormalMapSrvIndex = (next() % 3 == 0) ? -1 : (int)(next() % 100);
+		}
+		return tiles;
+	}
+}
+
+bool ValidateTerrainInstancePacking(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	const std::vector<TestTile> tiles = MakeTestTiles(1000);
+	for (int fallback : { 7, -1 })
+	{
+		std::vector<TerrainInstance> instances(tiles.size());
+		std::vector<TerrainInstanceRange> ranges;
+		const uint32_t count = PackTerrainInstances(tiles, fallback, instances.data(), ranges);
+
+		uint32_t expected = 0;
+		for (const TestTile& tile : tiles)
+			expected += (tile.HeightmapSrvIndex >= 0 || fallback >= 0) ? 1u : 0u;
+		if (count != expected)
+			return fail("wrong instance count for fallback " + std::to_string(fallback));
+
+		// Ranges are non-empty, in mask order and tile [0, count) back to back
+		uint32_t covered = 0;
+		for (size_t r = 0; r < ranges.size(); ++r)
+		{
+			if (ranges[r].Count == 0 || ranges[r].First != covered || (r > 0 && ranges[r].NeighborMask <= ranges[r - 1].NeighborMask))
+				return fail("ranges are not contiguous and ordered by mask");
+			for (uint32_t i = ranges[r].First; i < ranges[r].First + ranges[r].Count; ++i)
+				if (instances[i].NeighborMask != ranges[r].NeighborMask)
+					return fail("instance in the range of another mask");
+			covered += ranges[r].Count;
+		}
+		if (covered != count)
+			return fail("ranges do not cover all instances");
+
+		// Every drawable tile appears once with its fields
+		std::vector<uint8_t> seen(tiles.size(), 0);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const TerrainInstance& instance = instances[i];
+			const uint32_t t = (uint32_t)instance.MorphFactor;
+			if (t >= tiles.size() || seen[t]++)
+				return fail("tile packed twice or unknown");
+			const TestTile& tile = tiles[t];
+			const int heightmap = tile.HeightmapSrvIndex >= 0 ? tile.HeightmapSrvIndex : fallback;
+			if (std::memcmp(instance.World, tile.World, sizeof(tile.World)) != 0 ||
+				std::memcmp(instance.PrevWorld, tile.PrevWorld, sizeof(tile.PrevWorld)) != 0 ||
+				std::memcmp(instance.HeightmapUV, tile.HeightmapUV, sizeof(tile.HeightmapUV)) != 0)
+				return fail("matrices or heightmap UV not copied");
+			if (instance.HeightmapIndex != (uint32_t)heightmap || instance.LOD != (uint32_t)tile.LOD ||
+				instance.NeighborMask != tile.NeighborMask)
+				return fail("heightmap index, LOD or mask not copied");
+			const uint32_t normalMap = (tile.HeightmapSrvIndex >= 0 && tile.NormalMapSrvIndex >= 0) ? (uint32_t)tile.NormalMapSrvIndex : ~0u;
+			if (instance.NormalMapIndex != normalMap)
+				return fail("normal map index not copied or kept on the fallback heightmap");
+		}
+	}
+
+	std::vector<TestTile> none;
+	std::vector<TerrainInstanceRange> ranges(3);
+	if (PackTerrainInstances(none, 0, nullptr, ranges) != 0 || !ranges.empty())
+		return fail("empty tile list produced instances");
+	return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// One visible terrain tile as read by Terrain.hlsl (StructuredBuffer<TerrainInstance>, must match)
+struct TerrainInstance
+{
+	float World[16];       // transposed, as stored in TerrainTile::World
+	float PrevWorld[16];
+	float HeightmapUV[4];  // xy = scale, zw = offset into the heightmap at HeightmapIndex
+	float MorphFactor;
+	uint32_t HeightmapIndex; // descriptor heap index of the tile's heightmap
+	uint32_t LOD;
+	uint32_t NeighborMask;
+	uint32_t NormalMapIndex; // descriptor heap index of the tile's baked normal map, ~0u = none
+};
+static_assert(sizeof(TerrainInstance) == 164, "TerrainInstance must match Terrain.hlsl");
+
+// Instances [First, First + Count) all use the stitch variant NeighborMask
+struct TerrainInstanceRange
+{
+	uint32_t NeighborMask = 0;
+	uint32_t First = 0;
+	uint32_t Count = 0;
+};
+
+constexpr uint32_t kTerrainInstanceMaskCount = 16; // = kTerrainStitchVariants
+
+// Pack tiles into out (room for tiles.size() instances), grouped by NeighborMask so each stitch
+// variant is one instanced draw; ranges receives the non-empty groups in mask order. Tiles
+// without a heightmap use fallbackHeightmapIndex, or are dropped if that is negative too.
+// Tile needs World/PrevWorld (16 floats), HeightmapUV (4 floats), MorphFactor, LOD,
+// HeightmapSrvIndex, NormalMapSrvIndex and NeighborMask, as TerrainTile has. Tiles on the fallback
+// heightmap get no normal map. Returns the number of instances written.
+template <class Tile>
+uint32_t PackTerrainInstances(const std::vector<Tile>& tiles, int fallbackHeightmapIndex,
+	TerrainInstance* out, std::vector<TerrainInstanceRange>& ranges)
+{
+	static_assert(sizeof(Tile::World) == sizeof(TerrainInstance::World), "World must be 4x4 floats");
+	static_assert(sizeof(Tile::HeightmapUV) == sizeof(TerrainInstance::HeightmapUV), "HeightmapUV must be 4 floats");
+	auto heightmapOf = [fallbackHeightmapIndex](const Tile& tile) {
+		return tile.HeightmapSrvIndex >= 0 ? tile.HeightmapSrvIndex : fallbackHeightmapIndex;
+	};
+
+	// Counting sort: only masks are read here, each instance is written once below
+	uint32_t next[kTerrainInstanceMaskCount] = {};
+	for (const Tile& tile : tiles)
+		if (heightmapOf(tile) >= 0)
+			++next[tile.NeighborMask & (kTerrainInstanceMaskCount - 1)];
+	ranges.clear();
+	uint32_t total = 0;
+	for (uint32_t mask = 0; mask < kTerrainInstanceMaskCount; ++mask)
+	{
+		const uint32_t count = next[mask];
+		if (count > 0)
+			ranges.push_back({ mask, total, count });
+		next[mask] = total;
+		total += count;
+	}
+
+	for (const Tile& tile : tiles)
+	{
+		const int heightmap = heightmapOf(tile);
+		if (heightmap < 0)
+			continue;
+		const uint32_t mask = tile.NeighborMask & (kTerrainInstanceMaskCount - 1);
+		TerrainInstance& instance = out[next[mask]++];
+		std::memcpy(instance.World, &tile.World, sizeof(instance.World));
+		std::memcpy(instance.PrevWorld, &tile.PrevWorld, sizeof(instance.PrevWorld));
+		std::memcpy(instance.HeightmapUV, &tile.HeightmapUV, sizeof(instance.HeightmapUV));
+		instance.MorphFactor = tile.MorphFactor;
+		instance.HeightmapIndex = (uint32_t)heightmap;
+		instance.LOD = (uint32_t)tile.LOD;
+		instance.NeighborMask = mask;
+		instance.NormalMapIndex = (tile.HeightmapSrvIndex >= 0 && tile.NormalMapSrvIndex >= 0) ? (uint32_t)tile.NormalMapSrvIndex : ~0u;
+	}
+	return total;
+}
+
+// CPU check of PackTerrainInstances on generated tiles: every drawable tile lands exactly once in
+// the range of its mask with all fields copied, fallback heightmaps are applied and tiles without
+// any heightmap are dropped. Returns false with a reason on failure.
+bool ValidateTerrainInstancePacking(std::string* error = nullptr);
@@ -0,0 +1,578 @@
+#include "TerrainNormals.h"
+#include "TerrainGenerator.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+namespace
+{
+	// Subset of the DDS file layout (see DDSTextureLoader.h), as in TerrainHeightmap.cpp
+	constexpr uint32_t kDDSMagic = 0x20534444; // "DDS "
+	constexpr uint32_t kDDPFFourCC = 0x4;
+	constexpr uint32_t kDDSDCaps = 0x1, kDDSDHeight = 0x2, kDDSDWidth = 0x4, kDDSDPitch = 0x8, kDDSDPixelFormat = 0x1000;
+	constexpr uint32_t kDDSDMipMapCount = 0x20000, kDDSDLinearSize = 0x80000;
+	constexpr uint32_t kDDSCapsComplex = 0x8, kDDSCapsTexture = 0x1000, kDDSCapsMipMap = 0x400000;
+	constexpr uint32_t kDxgiR8G8Snorm = 51;
+	constexpr uint32_t kDxgiBC5Snorm = 84;
+
+#pragma pack(push, 1)
+	struct DDSPixelFormat
+	{
+		uint32_t Size;
+		uint32_t Flags;
+		uint32_t FourCC;
+		uint32_t RGBBitCount;
+		uint32_t RBitMask;
+		uint32_t GBitMask;
+		uint32_t BBitMask;
+		uint32_t ABitMask;
+	};
+
+	struct DDSHeader
+	{
+		uint32_t Size;
+		uint32_t Flags;
+		uint32_t Height;
+		uint32_t Width;
+		uint32_t PitchOrLinearSize;
+		uint32_t Depth;
+		uint32_t MipMapCount;
+		uint32_t Reserved1[11];
+		DDSPixelFormat PixelFormat;
+		uint32_t Caps;
+		uint32_t Caps2;
+		uint32_t Caps3;
+		uint32_t Caps4;
+		uint32_t Reserved2;
+	};
+
+	struct DDSHeaderDX10
+	{
+		uint32_t DxgiFormat;
+		uint32_t ResourceDimension;
+		uint32_t MiscFlag;
+		uint32_t ArraySize;
+		uint32_t MiscFlags2;
+	};
+#pragma pack(pop)
+	constexpr size_t kDDSDataOffset = sizeof(uint32_t) + sizeof(DDSHeader) + sizeof(DDSHeaderDX10);
+
+	template <class Fn>
+	void ParallelFor(int threads, int count, const Fn& fn)
+	{
+		std::atomic<int> next{ 0 };
+		auto work = [&]() {
+			for (int i = next++; i < count; i = next++)
+				fn(i);
+		};
+		std::vector<std::thread> workers;
+		for (int t = 1; t < std::min(threads, count); ++t)
+			workers.emplace_back(work);
+		work();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	int8_t QuantizeSnorm(float value)
+	{
+		return (int8_t)std::lround(std::clamp(value, -1.f, 1.f) * 127.f);
+	}
+
+	// BC4_SNORM palette of a block (8-value mode, red0 > red1), in 1/127 units
+	void Bc4Palette(int red0, int red1, float palette[8])
+	{
+		palette[0] = (float)red0;
+		palette[1] = (float)red1;
+		for (int i = 2; i < 8; ++i)
+			palette[i] = ((float)(8 - i) * red0 + (float)(i - 1) * red1) / 7.f;
+	}
+
+	// One BC4_SNORM block of 16 values in [-1, 1]: endpoints at the block's extremes, each texel the
+	// nearest of the 8 palette entries
+	void EncodeBc4Block(const float values[16], uint8_t block[8])
+	{
+		float lo = values[0], hi = values[0];
+		for (int i = 1; i < 16; ++i)
+		{
+			lo = std::min(lo, values[i]);
+			hi = std::max(hi, values[i]);
+		}
+		const int red0 = QuantizeSnorm(hi), red1 = QuantizeSnorm(lo);
+		std::memset(block, 0, 8);
+		block[0] = (uint8_t)(int8_t)red0;
+		block[1] = (uint8_t)(int8_t)red1;
+		if (red0 == red1)
+			return; // every index 0
+		float palette[8];
+		Bc4Palette(red0, red1, palette);
+		uint64_t indices = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			const float v = values[i] * 127.f;
+			int best = 0;
+			for (int k = 1; k < 8; ++k)
+				if (std::abs(palette[k] - v) < std::abs(palette[best] - v))
+					best = k;
+			indices |= (uint64_t)best << (3 * i);
+		}
+		for (int b = 0; b < 6; ++b)
+			block[2 + b] = (uint8_t)(indices >> (8 * b));
+	}
+
+	float DecodeBc4Texel(const uint8_t block[8], int texel)
+	{
+		const int red0 = (int8_t)block[0], red1 = (int8_t)block[1];
+		uint64_t indices = 0;
+		for (int b = 0; b < 6; ++b)
+			indices |= (uint64_t)block[2 + b] << (8 * b);
+		const int index = (int)((indices >> (3 * texel)) & 7);
+		if (red0 > red1)
+		{
+			float palette[8];
+			Bc4Palette(red0, red1, palette);
+			return std::max(palette[index], -127.f) / 127.f;
+		}
+		// 6-value mode, only reached for flat blocks (red0 == red1, index 0)
+		if (index == 0) return red0 / 127.f;
+		if (index == 1) return red1 / 127.f;
+		if (index == 6) return -1.f;
+		if (index == 7) return 1.f;
+		return ((float)(6 - index) * red0 + (float)(index - 1) * red1) / 5.f / 127.f;
+	}
+
+	struct NormalLevel
+	{
+		int Width = 0;
+		int Height = 0;
+		std::vector<float> X, Z;
+	};
+
+	// 2x2 average of the unit normals, renormalized
+	NormalLevel Downsample(const NormalLevel& level)
+	{
+		NormalLevel next;
+		next.Width = std::max(level.Width / 2, 1);
+		next.Height = std::max(level.Height / 2, 1);
+		next.X.resize((size_t)next.Width * next.Height);
+		next.Z.resize(next.X.size());
+		for (int z = 0; z < next.Height; ++z)
+			for (int x = 0; x < next.Width; ++x)
+			{
+				float sx = 0.f, sy = 0.f, sz = 0.f;
+				for (int dz = 0; dz < 2; ++dz)
+					for (int dx = 0; dx < 2; ++dx)
+					{
+						const size_t i = (size_t)std::min(2 * z + dz, level.Height - 1) * level.Width + std::min(2 * x + dx, level.Width - 1);
+						sx += level.X[i];
+						sz += level.Z[i];
+						sy += std::sqrt(std::max(1.f - level.X[i] * level.X[i] - level.Z[i] * level.Z[i], 0.f));
+					}
+				const float invLength = 1.f / std::max(std::sqrt(sx * sx + sy * sy + sz * sz), 1e-12f);
+				next.X[(size_t)z * next.Width + x] = sx * invLength;
+				next.Z[(size_t)z * next.Width + x] = sz * invLength;
+			}
+		return next;
+	}
+
+	void AppendLevel(const NormalLevel& level, bool bc5, std::vector<uint8_t>& out)
+	{
+		if (!bc5)
+		{
+			for (size_t i = 0; i < level.X.size(); ++i)
+			{
+				out.push_back((uint8_t)QuantizeSnorm(level.X[i]));
+				out.push_back((uint8_t)QuantizeSnorm(level.Z[i]));
+			}
+			return;
+		}
+		// 4x4 blocks, edge texels repeated to fill blocks that overhang small mips
+		const int blocksX = (level.Width + 3) / 4, blocksZ = (level.Height + 3) / 4;
+		for (int bz = 0; bz < blocksZ; ++bz)
+			for (int bx = 0; bx < blocksX; ++bx)
+			{
+				float xs[16], zs[16];
+				for (int t = 0; t < 16; ++t)
+				{
+					const size_t i = (size_t)std::min(bz * 4 + t / 4, level.Height - 1) * level.Width + std::min(bx * 4 + t % 4, level.Width - 1);
+					xs[t] = level.X[i];
+					zs[t] = level.Z[i];
+				}
+				uint8_t blocks[16];
+				EncodeBc4Block(xs, blocks);
+				EncodeBc4Block(zs, blocks + 8);
+				out.insert(out.end(), blocks, blocks + 16);
+			}
+	}
+
+	// Mip 0 of an EncodeTerrainNormalMapDDS image back to x, z (validation)
+	bool DecodeNormalMapDDS(const std::vector<uint8_t>& dds, NormalLevel& out)
+	{
+		if (dds.size() < kDDSDataOffset)
+			return false;
+		DDSHeader header;
+		DDSHeaderDX10 dx10;
+		std::memcpy(&header, dds.data() + sizeof(uint32_t), sizeof(header));
+		std::memcpy(&dx10, dds.data() + sizeof(uint32_t) + sizeof(header), sizeof(dx10));
+		out.Width = (int)header.Width;
+		out.Height = (int)header.Height;
+		const size_t texels = (size_t)out.Width * out.Height;
+		out.X.resize(texels);
+		out.Z.resize(texels);
+		const uint8_t* data = dds.data() + kDDSDataOffset;
+		if (dx10.DxgiFormat == kDxgiR8G8Snorm)
+		{
+			if (dds.size() < kDDSDataOffset + texels * 2)
+				return false;
+			for (size_t i = 0; i < texels; ++i)
+			{
+				out.X[i] = std::max((float)(int8_t)data[2 * i], -127.f) / 127.f;
+				out.Z[i] = std::max((float)(int8_t)data[2 * i + 1], -127.f) / 127.f;
+			}
+			return true;
+		}
+		const int blocksX = (out.Width + 3) / 4, blocksZ = (out.Height + 3) / 4;
+		if (dx10.DxgiFormat != kDxgiBC5Snorm || dds.size() < kDDSDataOffset + (size_t)blocksX * blocksZ * 16)
+			return false;
+		for (int z = 0; z < out.Height; ++z)
+			for (int x = 0; x < out.Width; ++x)
+			{
+				const uint8_t* block = data + ((size_t)(z / 4) * blocksX + x / 4) * 16;
+				const int texel = (z % 4) * 4 + x % 4;
+				out.X[(size_t)z * out.Width + x] = DecodeBc4Texel(block, texel);
+				out.Z[(size_t)z * out.Width + x] = DecodeBc4Texel(block + 8, texel);
+			}
+		return true;
+	}
+
+	bool ReadFile(const std::filesystem::path& path, std::vector<uint8_t>& data)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return false;
+		data.resize((size_t)file.tellg());
+		file.seekg(0);
+		return (bool)file.read(reinterpret_cast<char*>(data.data()), (std::streamsize)data.size());
+	}
+}
+
+void ComputeTerrainTileNormals(const TerrainNormalTileInput& input, std::vector<float>& normalX, std::vector<float>& normalZ)
+{
+	const TerrainHeightfield& tile = *input.Center;
+	const int width = tile.Width, height = tile.Height;
+	normalX.resize((size_t)width * height);
+	normalZ.resize(normalX.size());
+	// Neighbours only count when they line up texel for texel
+	const TerrainHeightfield* side[4];
+	for (int s = 0; s < 4; ++s)
+	{
+		const TerrainHeightfield* n = input.Neighbours[s];
+		side[s] = (n && !n->Empty() && n->Width == width && n->Height == height && width > 2 && height > 2) ? n : nullptr;
+	}
+	const float k = kTerrainNormalReferenceScale;
+	const float invTexel = 1.f / input.TexelUV;
+
+	for (int z = 0; z < height; ++z)
+		for (int x = 0; x < width; ++x)
+		{
+			// Heights one texel away; the texel past a shared border is the neighbour's second
+			float left, right, up, down; // -u, +u, -v (row above), +v
+			float du = 2.f, dv = 2.f;    // texels between the two samples
+			if (x > 0) left = tile.At(x - 1, z);
+			else if (side[kTerrainNormalWest]) left = side[kTerrainNormalWest]->At(width - 2, z);
+			else { left = tile.At(x, z); du -= 1.f; }
+			if (x < width - 1) right = tile.At(x + 1, z);
+			else if (side[kTerrainNormalEast]) right = side[kTerrainNormalEast]->At(1, z);
+			else { right = tile.At(x, z); du -= 1.f; }
+			if (z > 0) up = tile.At(x, z - 1);
+			else if (side[kTerrainNormalNorth]) up = side[kTerrainNormalNorth]->At(x, height - 2);
+			else { up = tile.At(x, z); dv -= 1.f; }
+			if (z < height - 1) down = tile.At(x, z + 1);
+			else if (side[kTerrainNormalSouth]) down = side[kTerrainNormalSouth]->At(x, 1);
+			else { down = tile.At(x, z); dv -= 1.f; }
+
+			const float gu = du > 0.f ? (right - left) / du * invTexel : 0.f;
+			const float gv = dv > 0.f ? (down - up) / dv * invTexel : 0.f;
+			const float nx = -gu * k, nz = gv * k;
+			const float invLength = 1.f / std::sqrt(nx * nx + 1.f + nz * nz);
+			normalX[(size_t)z * width + x] = nx * invLength;
+			normalZ[(size_t)z * width + x] = nz * invLength;
+		}
+}
+
+void EncodeTerrainNormalMapDDS(int width, int height, const std::vector<float>& normalX, const std::vector<float>& normalZ,
+	bool bc5, bool mips, std::vector<uint8_t>& dds)
+{
+	std::vector<NormalLevel> chain(1);
+	chain[0].Width = width;
+	chain[0].Height = height;
+	chain[0].X = normalX;
+	chain[0].Z = normalZ;
+	while (mips && (chain.back().Width > 1 || chain.back().Height > 1))
+		chain.push_back(Downsample(chain.back()));
+
+	DDSHeader header = {};
+	header.Size = sizeof(DDSHeader);
+	header.Flags = kDDSDCaps | kDDSDHeight | kDDSDWidth | kDDSDPixelFormat | (bc5 ? kDDSDLinearSize : kDDSDPitch) |
+		(mips ? kDDSDMipMapCount : 0);
+	header.Height = (uint32_t)height;
+	header.Width = (uint32_t)width;
+	header.PitchOrLinearSize = bc5 ? (uint32_t)((width + 3) / 4 * ((height + 3) / 4) * 16) : (uint32_t)width * 2;
+	header.MipMapCount = (uint32_t)chain.size();
+	header.PixelFormat.Size = sizeof(DDSPixelFormat);
+	header.PixelFormat.Flags = kDDPFFourCC;
+	header.PixelFormat.FourCC = 0x30315844; // "DX10"
+	header.Caps = kDDSCapsTexture | (chain.size() > 1 ? kDDSCapsComplex | kDDSCapsMipMap : 0);
+	DDSHeaderDX10 dx10 = {};
+	dx10.DxgiFormat = bc5 ? kDxgiBC5Snorm : kDxgiR8G8Snorm;
+	dx10.ResourceDimension = 3; // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+	dx10.ArraySize = 1;
+
+	dds.resize(kDDSDataOffset);
+	std::memcpy(dds.data(), &kDDSMagic, sizeof(kDDSMagic));
+	std::memcpy(dds.data() + sizeof(kDDSMagic), &header, sizeof(header));
+	std::memcpy(dds.data() + sizeof(kDDSMagic) + sizeof(header), &dx10, sizeof(dx10));
+	for (const NormalLevel& level : chain)
+		AppendLevel(level, bc5, dds);
+}
+
+std::filesystem::path TerrainNormalTilePath(const std::filesystem::path& root, int lod, int tileX, int tileZ)
+{
+	const std::string level = "00" + std::to_string(lod + 1);
+	if (lod == 0)
+		return root / level / "Normal_Out.dds";
+	return root / level / "Normal" / ("Normal_Out_y" + std::to_string(tileZ) + "_x" + std::to_string(tileX) + ".dds");
+}
+
+TerrainNormalBakeStats BakeTerrainNormalMaps(const std::filesystem::path& root, const TerrainNormalBakeSettings& settings)
+{
+	const auto start = std::chrono::steady_clock::now();
+	TerrainNormalBakeStats stats;
+	struct Job { int LOD, X, Z; };
+	std::vector<Job> jobs;
+	// Finest level first: the big levels dominate, small ones fill the gaps at the end
+	for (int lod = std::max(settings.Levels, 1) - 1; lod >= 0; --lod)
+		for (int z = 0; z < (1 << lod); ++z)
+			for (int x = 0; x < (1 << lod); ++x)
+				jobs.push_back({ lod, x, z });
+
+	const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+	const int threads = std::max(settings.ThreadCount > 0 ? settings.ThreadCount : (int)hardware, 1);
+	std::atomic<int> written{ 0 }, skipped{ 0 }, failed{ 0 };
+	std::atomic<uint64_t> texels{ 0 }, jobMicroseconds{ 0 };
+
+	ParallelFor(threads, (int)jobs.size(), [&](int index) {
+		const auto jobStart = std::chrono::steady_clock::now();
+		const Job job = jobs[index];
+		const int tilesPerSide = 1 << job.LOD;
+		const int sideX[4] = { job.X - 1, job.X + 1, job.X, job.X };
+		const int sideZ[4] = { job.Z, job.Z, job.Z - 1, job.Z + 1 };
+		auto inside = [tilesPerSide](int x, int z) { return x >= 0 && z >= 0 && x < tilesPerSide && z < tilesPerSide; };
+		const std::filesystem::path output = TerrainNormalTilePath(root, job.LOD, job.X, job.Z);
+
+		std::error_code ec;
+		if (settings.OnlyStale && std::filesystem::exists(output, ec))
+		{
+			const auto normalTime = std::filesystem::last_write_time(output, ec);
+			bool stale = (bool)ec;
+			for (int s = -1; s < 4 && !stale; ++s)
+			{
+				const int x = s < 0 ? job.X : sideX[s], z = s < 0 ? job.Z : sideZ[s];
+				if (!inside(x, z))
+					continue;
+				const std::filesystem::path heightmap = TerrainTilePath(root, job.LOD, x, z);
+				std::error_code heightEc;
+				if (std::filesystem::exists(heightmap, heightEc))
+					stale = std::filesystem::last_write_time(heightmap, heightEc) > normalTime || (bool)heightEc;
+			}
+			if (!stale)
+			{
+				++skipped;
+				return;
+			}
+		}
+
+		TerrainHeightfield center, neighbours[4];
+		if (!LoadTerrainHeightfieldDDS(TerrainTilePath(root, job.LOD, job.X, job.Z), center))
+		{
+			++failed;
+			return;
+		}
+		TerrainNormalTileInput input;
+		input.Center = &center;
+		for (int s = 0; s < 4; ++s)
+			if (inside(sideX[s], sideZ[s]) && LoadTerrainHeightfieldDDS(TerrainTilePath(root, job.LOD, sideX[s], sideZ[s]), neighbours[s]))
+				input.Neighbours[s] = &neighbours[s];
+		input.TexelUV = 1.f / ((float)tilesPerSide * (float)std::max(center.Width - 1, 1));
+
+		std::vector<float> normalX, normalZ;
+		ComputeTerrainTileNormals(input, normalX, normalZ);
+		std::vector<uint8_t> dds;
+		EncodeTerrainNormalMapDDS(center.Width, center.Height, normalX, normalZ, settings.BC5, settings.Mips, dds);
+		std::filesystem::create_directories(output.parent_path(), ec);
+		std::ofstream file(output, std::ios::binary);
+		if (!file || !file.write(reinterpret_cast<const char*>(dds.data()), (std::streamsize)dds.size()))
+		{
+			++failed;
+			return;
+		}
+		++written;
+		texels += (uint64_t)center.Width * center.Height;
+		jobMicroseconds += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - jobStart).count();
+	});
+
+	stats.Tiles = written;
+	stats.Skipped = skipped;
+	stats.Failed = failed;
+	stats.Threads = threads;
+	stats.Texels = texels;
+	stats.TotalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.MsPerTile = stats.Tiles > 0 ? (double)jobMicroseconds / 1000.0 / stats.Tiles : 0.0;
+	stats.MTexelsPerSecond = stats.TotalSeconds > 0.0 ? (double)stats.Texels / (stats.TotalSeconds * 1e6) : 0.0;
+	return stats;
+}
+
+bool ValidateTerrainNormals(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	// Level 1 (2x2 tiles of 33^2) and level 0 cut from one corner-aligned 65^2 field
+	const int tileSize = 33, fieldSize = 2 * (tileSize - 1) + 1;
+	auto heightAt = [](float u, float v) { return 0.4f + 0.25f * std::sin(2.1f * u + 0.3f) * std::cos(1.7f * v) + 0.05f * u; };
+	TerrainHeightfield field;
+	field.Width = field.Height = fieldSize;
+	for (int z = 0; z < fieldSize; ++z)
+		for (int x = 0; x < fieldSize; ++x)
+			field.Heights.push_back(heightAt((float)x / (fieldSize - 1), (float)z / (fieldSize - 1)));
+	auto cut = [&field](int x0, int z0, int size, int step) {
+		TerrainHeightfield tile;
+		tile.Width = tile.Height = size;
+		for (int z = 0; z < size; ++z)
+			for (int x = 0; x < size; ++x)
+				tile.Heights.push_back(field.At(x0 + x * step, z0 + z * step));
+		return tile;
+	};
+	// TileZ = 0 is the -Z edge, the bottom rows of the field
+	TerrainHeightfield tiles[2][2]; // [tileZ][tileX]
+	for (int tz = 0; tz < 2; ++tz)
+		for (int tx = 0; tx < 2; ++tx)
+			tiles[tz][tx] = cut(tx * (tileSize - 1), (1 - tz) * (tileSize - 1), tileSize, 1);
+
+	const float texelUV = 1.f / (fieldSize - 1);
+	std::vector<float> fieldX, fieldZ;
+	TerrainNormalTileInput whole;
+	whole.Center = &field;
+	whole.TexelUV = texelUV;
+	ComputeTerrainTileNormals(whole, fieldX, fieldZ);
+
+	// Against the exact gradient: second-order inside, first-order on the terrain edge
+	const float k = kTerrainNormalReferenceScale;
+	for (int z = 0; z < fieldSize; ++z)
+		for (int x = 0; x < fieldSize; ++x)
+		{
+			const float u = (float)x / (fieldSize - 1), v = (float)z / (fieldSize - 1);
+			const float gu = 0.25f * 2.1f * std::cos(2.1f * u + 0.3f) * std::cos(1.7f * v) + 0.05f;
+			const float gv = -0.25f * 1.7f * std::sin(2.1f * u + 0.3f) * std::sin(1.7f * v);
+			const float invLength = 1.f / std::sqrt(gu * gu * k * k + 1.f + gv * gv * k * k);
+			const bool edge = x == 0 || z == 0 || x == fieldSize - 1 || z == fieldSize - 1;
+			const size_t i = (size_t)z * fieldSize + x;
+			if (std::abs(fieldX[i] + gu * k * invLength) > (edge ? 2e-2f : 1e-3f) ||
+				std::abs(fieldZ[i] - gv * k * invLength) > (edge ? 2e-2f : 1e-3f))
+				return fail("normal differs from the analytic gradient at (" + std::to_string(x) + ", " + std::to_string(z) + ")");
+		}
+
+	// Tiles read across their borders: every texel equals the stitched field's, so shared borders agree
+	for (int tz = 0; tz < 2; ++tz)
+		for (int tx = 0; tx < 2; ++tx)
+		{
+			TerrainNormalTileInput input;
+			input.Center = &tiles[tz][tx];
+			input.Neighbours[kTerrainNormalWest] = tx > 0 ? &tiles[tz][tx - 1] : nullptr;
+			input.Neighbours[kTerrainNormalEast] = tx < 1 ? &tiles[tz][tx + 1] : nullptr;
+			input.Neighbours[kTerrainNormalSouth] = tz > 0 ? &tiles[tz - 1][tx] : nullptr;
+			input.Neighbours[kTerrainNormalNorth] = tz < 1 ? &tiles[tz + 1][tx] : nullptr;
+			input.TexelUV = texelUV;
+			std::vector<float> tileX, tileZ;
+			ComputeTerrainTileNormals(input, tileX, tileZ);
+			for (int z = 0; z < tileSize; ++z)
+				for (int x = 0; x < tileSize; ++x)
+				{
+					const size_t f = (size_t)((1 - tz) * (tileSize - 1) + z) * fieldSize + tx * (tileSize - 1) + x;
+					if (tileX[(size_t)z * tileSize + x] != fieldX[f] || tileZ[(size_t)z * tileSize + x] != fieldZ[f])
+						return fail("tile normals differ from the stitched field at tile (" + std::to_string(tx) + ", " +
+							std::to_string(tz) + ") texel (" + std::to_string(x) + ", " + std::to_string(z) + ")");
+				}
+		}
+
+	// BC5 stays within a few steps of R8G8, a flat field points straight up
+	std::vector<uint8_t> r8g8, bc5;
+	EncodeTerrainNormalMapDDS(fieldSize, fieldSize, fieldX, fieldZ, false, true, r8g8);
+	EncodeTerrainNormalMapDDS(fieldSize, fieldSize, fieldX, fieldZ, true, true, bc5);
+	NormalLevel plain, compressed;
+	if (!DecodeNormalMapDDS(r8g8, plain) || !DecodeNormalMapDDS(bc5, compressed))
+		return fail("normal map DDS does not decode");
+	for (size_t i = 0; i < plain.X.size(); ++i)
+		if (std::abs(plain.X[i] - compressed.X[i]) > 3.f / 127.f || std::abs(plain.Z[i] - compressed.Z[i]) > 3.f / 127.f ||
+			std::abs(plain.X[i] - fieldX[i]) > 0.5f / 127.f + 1e-6f)
+			return fail("encoded normals differ from the computed ones");
+	TerrainHeightfield flat;
+	flat.Width = flat.Height = 9;
+	flat.Heights.assign(81, 0.3f);
+	std::vector<float> flatX, flatZ;
+	whole.Center = &flat;
+	ComputeTerrainTileNormals(whole, flatX, flatZ);
+	if (std::any_of(flatX.begin(), flatX.end(), [](float v) { return v != 0.f; }) ||
+		std::any_of(flatZ.begin(), flatZ.end(), [](float v) { return v != 0.f; }))
+		return fail("flat heightfield has tilted normals");
+
+	// The baker reads the same tiles from files, whatever the thread count
+	const std::filesystem::path dir = std::filesystem::temp_directory_path() / "TerrainNormalsCheck";
+	std::error_code ec;
+	std::filesystem::remove_all(dir, ec);
+	bool saved = std::filesystem::create_directories(dir / "001", ec) && std::filesystem::create_directories(dir / "002" / "Height", ec) &&
+		SaveTerrainHeightfieldDDS(TerrainTilePath(dir, 0, 0, 0), cut(0, 0, tileSize, 2));
+	for (int tz = 0; tz < 2; ++tz)
+		for (int tx = 0; tx < 2; ++tx)
+			saved = saved && SaveTerrainHeightfieldDDS(TerrainTilePath(dir, 1, tx, tz), tiles[tz][tx]);
+	if (!saved)
+	{
+		std::filesystem::remove_all(dir, ec);
+		return fail("could not write test heightmaps to " + dir.string());
+	}
+	TerrainNormalBakeSettings settings;
+	settings.Levels = 2;
+	settings.OnlyStale = false;
+	settings.BC5 = true;
+	std::vector<std::vector<uint8_t>> files[2];
+	for (int run = 0; run < 2; ++run)
+	{
+		settings.ThreadCount = run == 0 ? 1 : 3;
+		const TerrainNormalBakeStats stats = BakeTerrainNormalMaps(dir, settings);
+		if (stats.Tiles != 5 || stats.Failed != 0)
+		{
+			std::filesystem::remove_all(dir, ec);
+			return fail("baker wrote " + std::to_string(stats.Tiles) + " of 5 normal maps");
+		}
+		for (int lod = 0; lod < 2; ++lod)
+			for (int z = 0; z < (1 << lod); ++z)
+				for (int x = 0; x < (1 << lod); ++x)
+				{
+					files[run].emplace_back();
+					ReadFile(TerrainNormalTilePath(dir, lod, x, z), files[run].back());
+				}
+	}
+	settings.OnlyStale = true;
+	const TerrainNormalBakeStats again = BakeTerrainNormalMaps(dir, settings);
+	std::filesystem::remove_all(dir, ec);
+	if (files[0] != files[1])
+		return fail("baked normal maps depend on the thread count");
+	if (again.Skipped != 5 || again.Tiles != 0)
+		return fail("up-to-date normal maps were baked again");
+	return true;
+}
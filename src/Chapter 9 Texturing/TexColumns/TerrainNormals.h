@@ -0,0 +1,77 @@
+#pragma once
+
+#include "TerrainHeightmap.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Baked terrain normal maps: one per heightmap tile, texel for texel, so Terrain.hlsl fetches a
+// pixel's normal with one sample instead of differencing four heights per vertex.
+//
+// Normals are stored for a reference steepness: n = normalize(-dh/du * k, 1, dh/dv * k) with
+// dh/du, dh/dv the gradient of the normalized height per terrain UV unit (the whole terrain spans
+// UV [0,1], v towards -Z) and k = kTerrainNormalReferenceScale. Only x and z are kept (signed
+// 8-bit, R8G8_SNORM or BC5_SNORM); the shader rebuilds y and rescales x, z by
+// (heightScale / worldSizeXZ) / k, so the maps do not depend on the terrain's placement.
+// The tangent frame follows from the normal (T = normalize(n.y, -n.x, 0) along +X), so no
+// separate tangent map is stored.
+constexpr float kTerrainNormalReferenceScale = 0.5f; // the default 50 height over 100 world units
+
+// Edge neighbours of a tile, indexed by side: -X, +X, -Z, +Z (nullptr at the terrain edge)
+enum TerrainNormalSide { kTerrainNormalWest, kTerrainNormalEast, kTerrainNormalSouth, kTerrainNormalNorth };
+
+// Heights of one tile (row 0 = +Z edge, corner-aligned like the heightmap tiles) and its edge
+// neighbours, which share its border texels; texelUV is the terrain UV between two texels
+// (1 / (2^lod * (size - 1)) for a level-lod tile)
+struct TerrainNormalTileInput
+{
+	const TerrainHeightfield* Center = nullptr;
+	const TerrainHeightfield* Neighbours[4] = {};
+	float TexelUV = 1.f;
+};
+
+// Central differences everywhere: a border texel's missing neighbour is read from the adjacent tile
+// (the texel next to their shared border), so neighbouring tiles get identical border normals; only
+// the terrain's outer edge falls back to one-sided differences. Writes Width * Height normals'
+// x and z at the reference scale.
+void ComputeTerrainTileNormals(const TerrainNormalTileInput& input, std::vector<float>& normalX, std::vector<float>& normalZ);
+
+// Normal map DDS (DX10 header) of the normals' x and z, R8G8_SNORM or BC5_SNORM, with the full mip
+// chain of renormalized 2x2 averages when mips is set. Written to memory so tests need no files.
+void EncodeTerrainNormalMapDDS(int width, int height, const std::vector<float>& normalX, const std::vector<float>& normalZ,
+	bool bc5, bool mips, std::vector<uint8_t>& dds);
+
+// File next to a tile's heightmap: 001/Normal_Out.dds for the root,
+// 00<lod+1>/Normal/Normal_Out_y<z>_x<x>.dds below it
+std::filesystem::path TerrainNormalTilePath(const std::filesystem::path& root, int lod, int tileX, int tileZ);
+
+struct TerrainNormalBakeSettings
+{
+	int Levels = 3;          // LOD levels 0 .. Levels-1 of the heightmap tiles
+	int ThreadCount = 0;     // 0 = one per hardware thread
+	bool BC5 = false;        // BC5_SNORM instead of R8G8_SNORM (half the size, about 1/255 more error)
+	bool Mips = true;
+	bool OnlyStale = true;   // skip tiles whose normal map is newer than its and its neighbours' heightmaps
+};
+
+struct TerrainNormalBakeStats
+{
+	int Tiles = 0;           // normal maps written
+	int Skipped = 0;         // up to date
+	int Failed = 0;          // heightmap missing or unreadable, or the file could not be written
+	int Threads = 0;
+	uint64_t Texels = 0;
+	double TotalSeconds = 0.0;    // wall time, including reading the heightmaps and writing the maps
+	double MsPerTile = 0.0;       // TotalSeconds per written tile, summed over threads
+	double MTexelsPerSecond = 0.0;
+};
+
+// Bake the normal map of every heightmap tile of every level, tiles spread over worker threads;
+// each job reads its tile and the four edge neighbours through LoadTerrainHeightfieldDDS
+TerrainNormalBakeStats BakeTerrainNormalMaps(const std::filesystem::path& root, const TerrainNormalBakeSettings& settings);
+
+// CPU check on analytic heights: normals match the exact gradient, neighbouring tiles agree on
+// their shared border texels and with normals of the stitched field, BC5 decodes to within a few
+// steps of R8G8, and baked files do not depend on the thread count. Returns false with a reason on failure.
+bool ValidateTerrainNormals(std::string* error = nullptr);
@@ -0,0 +1,530 @@
+#include "TerrainOcclusion.h"
+#include "Terrain.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace DirectX;
+
+namespace
+{
+	// Azimuth as a pseudo-angle in [0, 4): monotonic around the circle like the angle and a half
+	// turn apart for opposite directions, for one division instead of an atan2. The bins are equal
+	// in it rather than in the angle, which only makes them up to twice as wide on the diagonals.
+	float PseudoAngle(float x, float z)
+	{
+		const float d = x / (std::fabs(x) + std::fabs(z));
+		return z >= 0.f ? 1.f - d : 3.f + d;
+	}
+
+	// Bin coordinates per pseudo-angle unit
+	const float kBinsPerUnit = (float)kTerrainHorizonBins / 4.f;
+	// Rounding kept out of the bin ranges (fraction of a bin): outer ranges grow, inner ones shrink
+	const float kBinMargin = 1e-3f;
+
+	// Pseudo-angle of (x, z) relative to reference, in (-2, 2]
+	float RelativeAngle(float x, float z, float reference)
+	{
+		float d = PseudoAngle(x, z) - reference;
+		if (d > 2.f) d -= 4.f;
+		if (d <= -2.f) d += 4.f;
+		return d;
+	}
+
+	// Heightfield for the benchmark and the check: hills, or ridges across X with valleys between;
+	// small bumps all over keep the tiles near the eye refining
+	TerrainHeightfield SyntheticHeightfield(TerrainOcclusionScene scene, int size)
+	{
+		TerrainHeightfield field;
+		field.Width = field.Height = size;
+		field.Heights.resize((size_t)size * size);
+		for (int z = 0; z < size; ++z)
+			for (int x = 0; x < size; ++x)
+			{
+				const float u = (float)x / (float)(size - 1), v = (float)z / (float)(size - 1);
+				float h;
+				if (scene == TerrainOcclusionScene::Hills)
+					h = 0.3f + 0.08f * std::sin(u * 9.f) * std::cos(v * 7.f) + 0.04f * std::sin((u + 2.f * v) * 23.f) +
+						0.02f * std::sin(u * 211.f) * std::sin(v * 173.f);
+				else
+				{
+					// Flat-topped ridges about a fifth of the square apart, wavering so they are not all
+					// parallel
+					const float wave = 0.5f - 0.5f * std::cos(u * 30.f + 1.2f * std::sin(v * 5.f));
+					const float ridge = std::clamp(1.8f * wave - 0.4f, 0.f, 1.f);
+					h = 0.05f + 0.8f * ridge + 0.02f * std::sin(u * 211.f) * std::sin(v * 173.f);
+				}
+				field.Heights[(size_t)z * size + x] = std::clamp(h, 0.f, 1.f);
+			}
+		return field;
+	}
+
+	struct OcclusionRandom
+	{
+		uint32_t State = 12345u;
+		float Next() // [0, 1)
+		{
+			State = State * 1664525u + 1013904223u;
+			return (float)(State >> 8) * (1.f / 16777216.f);
+		}
+		float Range(float lo, float hi) { return lo + (hi - lo) * Next(); }
+	};
+
+	// Blocky heightfield for the check: solid columns of cellSize-wide cells
+	struct BlockyField
+	{
+		int Cells = 0;
+		float CellSize = 1.f;
+		float Origin = 0.f; // X and Z of the grid's first corner
+		std::vector<float> Heights;
+
+		// Whether the segment from eye to p (p excluded) passes under a column top: 2D DDA over the cells
+		bool Hidden(const float eye[3], const float p[3]) const
+		{
+			const float ox = (eye[0] - Origin) / CellSize, oz = (eye[2] - Origin) / CellSize;
+			const float dx = (p[0] - Origin) / CellSize - ox, dz = (p[2] - Origin) / CellSize - oz;
+			int x = std::clamp((int)std::floor(ox), 0, Cells - 1), z = std::clamp((int)std::floor(oz), 0, Cells - 1);
+			const int stepX = dx > 0.f ? 1 : -1, stepZ = dz > 0.f ? 1 : -1;
+			const float inf = std::numeric_limits<float>::infinity();
+			const float deltaX = dx != 0.f ? std::fabs(1.f / dx) : inf, deltaZ = dz != 0.f ? std::fabs(1.f / dz) : inf;
+			float nextX = dx != 0.f ? ((dx > 0.f ? (float)(x + 1) : (float)x) - ox) / dx : inf;
+			float nextZ = dz != 0.f ? ((dz > 0.f ? (float)(z + 1) : (float)z) - oz) / dz : inf;
+			float t = 0.f;
+			const float end = 1.f - 1e-6f;
+			while (t < end && x >= 0 && x < Cells && z >= 0 && z < Cells)
+			{
+				const float exit = std::min(std::min(nextX, nextZ), end);
+				const float y = std::min(eye[1] + t * (p[1] - eye[1]), eye[1] + exit * (p[1] - eye[1]));
+				if (y < Heights[(size_t)z * Cells + x] - 1e-4f)
+					return true;
+				t = exit;
+				if (nextX < nextZ)
+				{
+					x += stepX;
+					nextX += deltaX;
+				}
+				else
+				{
+					z += stepZ;
+					nextZ += deltaZ;
+				}
+			}
+			return false;
+		}
+	};
+
+	void SetupTerrain(Terrain& terrain, TerrainHeightfield field, int levels)
+	{
+		terrain.SetWorldSize(1000.f);
+		terrain.SetHeightScale(150.f);
+		terrain.SetLODLevels(levels);
+		terrain.SetViewport(XM_PIDIV4, 720.f);
+		terrain.SetMaxPixelError(2.f);
+		terrain.SetHeightfield(std::move(field));
+		terrain.BuildQuadtree();
+		terrain.SetUpdateThreads(1);
+	}
+}
+
+bool TerrainHorizonCuller::AzimuthBins(const float eye[3], const TerrainOcclusionTile& tile, bool inner, int& first, int& last) const
+{
+	if (eye[0] >= tile.MinX && eye[0] <= tile.MaxX && eye[2] >= tile.MinZ && eye[2] <= tile.MaxZ)
+		return false;
+	// Corner angles relative to the centre's; outside the footprint they span less than a half turn
+	const float centre = PseudoAngle(0.5f * (tile.MinX + tile.MaxX) - eye[0], 0.5f * (tile.MinZ + tile.MaxZ) - eye[2]);
+	float lo = 0.f, hi = 0.f;
+	for (int corner = 0; corner < 4; ++corner)
+	{
+		const float d = RelativeAngle(((corner & 1) ? tile.MaxX : tile.MinX) - eye[0],
+			((corner & 2) ? tile.MaxZ : tile.MinZ) - eye[2], centre);
+		lo = std::min(lo, d);
+		hi = std::max(hi, d);
+	}
+	// Bin b covers [b, b + 1) in bin coordinates
+	const float f0 = (centre + lo) * kBinsPerUnit;
+	const float f1 = (centre + hi) * kBinsPerUnit;
+	int b0, b1;
+	if (inner)
+	{
+		b0 = (int)std::ceil(f0 + kBinMargin);
+		b1 = (int)std::floor(f1 - kBinMargin) - 1;
+		if (b1 < b0)
+			return false;
+	}
+	else
+	{
+		b0 = (int)std::floor(f0 - kBinMargin);
+		b1 = (int)std::floor(f1 + kBinMargin);
+	}
+	if (b1 - b0 >= kTerrainHorizonBins - 1)
+		return false; // the eye is on the footprint's edge
+	first = (b0 + kTerrainHorizonBins) % kTerrainHorizonBins;
+	last = (b1 + kTerrainHorizonBins) % kTerrainHorizonBins;
+	return true;
+}
+
+void TerrainHorizonCuller::AddOccluder(const float eye[3], const TerrainOcclusionTile& tile, float nearDistance, float farDistance)
+{
+	int first, last;
+	if (!AzimuthBins(eye, tile, true, first, last))
+		return;
+	// A ray in the range crosses the footprint somewhere in [near, far]; below this slope it is
+	// under GroundY wherever that is
+	const float rise = tile.GroundY - eye[1];
+	const float slope = rise / (rise < 0.f ? nearDistance : farDistance);
+	float* horizon = mHorizon.data();
+	if (first <= last)
+		for (int b = first; b <= last; ++b)
+			horizon[b] = std::max(horizon[b], slope);
+	else
+	{
+		for (int b = first; b < kTerrainHorizonBins; ++b)
+			horizon[b] = std::max(horizon[b], slope);
+		for (int b = 0; b <= last; ++b)
+			horizon[b] = std::max(horizon[b], slope);
+	}
+}
+
+uint32_t TerrainHorizonCuller::Cull(const float eye[3], const TerrainOcclusionTile* tiles, size_t count, uint8_t* visible,
+	const float (*viewCorners)[3], int cornerCount)
+{
+	mHorizon.assign(kTerrainHorizonBins, -std::numeric_limits<float>::infinity());
+
+	// Azimuths of the view: the wedge of its corners around the eye, or all of them when the corners
+	// surround the eye (looking steeply up or down)
+	mInView.assign(kTerrainHorizonBins, 1);
+	if (viewCorners && cornerCount > 0)
+	{
+		bool surrounds = false;
+		float reference = 0.f, lo = 0.f, hi = 0.f;
+		for (int i = 0; i < cornerCount && !surrounds; ++i)
+		{
+			const float x = viewCorners[i][0] - eye[0], z = viewCorners[i][2] - eye[2];
+			if (x * x + z * z < 1e-12f)
+			{
+				surrounds = true;
+				continue;
+			}
+			if (i == 0)
+				reference = PseudoAngle(x, z);
+			const float d = RelativeAngle(x, z, reference);
+			lo = std::min(lo, d);
+			hi = std::max(hi, d);
+			surrounds = hi - lo >= 2.f;
+		}
+		if (!surrounds)
+		{
+			const int b0 = (int)std::floor((reference + lo) * kBinsPerUnit - kBinMargin);
+			const int b1 = (int)std::floor((reference + hi) * kBinsPerUnit + kBinMargin);
+			mInView.assign(kTerrainHorizonBins, 0);
+			for (int b = b0; b <= b1; ++b)
+				mInView[(b + kTerrainHorizonBins) % kTerrainHorizonBins] = 1;
+		}
+	}
+
+	// Occludees front to back by their nearest point; every entry joins the horizon once it lies
+	// wholly nearer than the occludee being tested
+	mNear.resize(count);
+	mFar.resize(count);
+	mOrder.clear();
+	mOccluders.clear();
+	float lastNear = 0.f;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const TerrainOcclusionTile& tile = tiles[i];
+		const float dx = std::max(std::max(tile.MinX - eye[0], eye[0] - tile.MaxX), 0.f);
+		const float dz = std::max(std::max(tile.MinZ - eye[2], eye[2] - tile.MaxZ), 0.f);
+		const float fx = std::max(std::fabs(tile.MinX - eye[0]), std::fabs(tile.MaxX - eye[0]));
+		const float fz = std::max(std::fabs(tile.MinZ - eye[2]), std::fabs(tile.MaxZ - eye[2]));
+		mNear[i] = std::sqrt(dx * dx + dz * dz);
+		mFar[i] = std::sqrt(fx * fx + fz * fz);
+		if (tile.Occludee)
+		{
+			mOrder.push_back({ mNear[i], (uint32_t)i });
+			lastNear = std::max(lastNear, mNear[i]);
+		}
+		visible[i] = 1;
+	}
+	// Entries reaching past the farthest occludee's near side never join the horizon
+	for (size_t i = 0; i < count; ++i)
+		if (mFar[i] <= lastNear)
+			mOccluders.push_back({ mFar[i], (uint32_t)i });
+	std::sort(mOrder.begin(), mOrder.end());
+	std::sort(mOccluders.begin(), mOccluders.end());
+
+	uint32_t hidden = 0;
+	size_t added = 0;
+	const float* horizon = mHorizon.data();
+	const uint8_t* inView = mInView.data();
+	for (const std::pair<float, uint32_t>& entry : mOrder)
+	{
+		const float nearDistance = entry.first;
+		for (; added < mOccluders.size() && mOccluders[added].first <= nearDistance; ++added)
+		{
+			const uint32_t occluder = mOccluders[added].second;
+			AddOccluder(eye, tiles[occluder], mNear[occluder], mFar[occluder]);
+		}
+
+		const TerrainOcclusionTile& tile = tiles[entry.second];
+		int first, last;
+		if (added == 0 || nearDistance <= 0.f || !AzimuthBins(eye, tile, false, first, last))
+			continue;
+		// Steepest slope from the eye to any point of the box
+		const float rise = tile.TopY - eye[1];
+		const float slope = rise / (rise < 0.f ? mFar[entry.second] : nearDistance);
+		const float limit = slope + 1e-5f * (1.f + std::fabs(slope));
+		bool covered = true;
+		for (int b = first; covered; b = (b + 1) % kTerrainHorizonBins)
+		{
+			covered = !inView[b] || limit < horizon[b];
+			if (b == last)
+				break;
+		}
+		if (covered)
+		{
+			visible[entry.second] = 0;
+			++hidden;
+		}
+	}
+	return hidden;
+}
+
+TerrainOcclusionBenchmark BenchmarkTerrainOcclusion(TerrainOcclusionScene scene, int size, int frames)
+{
+	TerrainOcclusionBenchmark result;
+	Terrain terrain;
+	SetupTerrain(terrain, SyntheticHeightfield(scene, std::max(size, 17)), 7);
+	std::vector<TerrainView> views;
+	std::vector<XMFLOAT3> eyes;
+	BuildTerrainCameraPath(TerrainCameraPath::Walk, terrain.GetWorldSizeXZ(), XM_PIDIV4, 16.f / 9.f, frames,
+		[&terrain](float x, float z) { return terrain.SampleHeight(x, z); }, views, eyes);
+
+	result.Frames = (int)views.size();
+	for (int occlusion = 0; occlusion < 2; ++occlusion)
+	{
+		terrain.SetOcclusionCulling(occlusion != 0);
+		double tiles = 0.0, updateMs = 0.0, occlusionMs = 0.0;
+		for (size_t f = 0; f < views.size(); ++f)
+		{
+			terrain.UpdateViews(&views[f], 1, eyes[f]);
+			tiles += (double)terrain.GetVisibleTiles().size();
+			updateMs += terrain.GetStats().UpdateMs;
+			occlusionMs += terrain.GetStats().OcclusionMs;
+		}
+		if (occlusion)
+		{
+			result.TilesAfter = tiles / result.Frames;
+			result.OcclusionMs = occlusionMs / result.Frames;
+		}
+		else
+		{
+			result.TilesBefore = tiles / result.Frames;
+			result.UpdateMs = updateMs / result.Frames;
+		}
+	}
+	return result;
+}
+
+bool ValidateTerrainOcclusion(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	// Rays straight at a ridge: the nearer tile hides the farther one only once it is wholly nearer
+	{
+		TerrainHorizonCuller culler;
+		const float eye[3] = { 0.f, 10.f, 0.f };
+		const TerrainOcclusionTile wall[3] = {
+			{ 10.f, -10.f, 20.f, 10.f, 20.f, 30.f },  // ridge
+			{ 30.f, -5.f, 40.f, 5.f, 0.f, 15.f },     // low ground behind it
+			{ 15.f, 12.f, 25.f, 22.f, 0.f, 15.f },    // beside it, partly outside its shadow
+		};
+		uint8_t visible[3];
+		if (culler.Cull(eye, wall, 3, visible) != 1 || !visible[0] || visible[1] || !visible[2])
+			return fail("horizon culler misjudges tiles behind a wall");
+		const float above[3] = { 0.f, 200.f, 0.f };
+		if (culler.Cull(above, wall, 3, visible) != 0)
+			return fail("horizon culler hides tiles seen from above the wall");
+	}
+
+	// Blocky heightfields, where nothing is slack: columns of one or 2x2 cells as tiles of mixed
+	// sizes, each box from its top up to its highest neighbour's so that it holds the walls rising
+	// from it. Every point of a culled box that the view can see must have a column top in front of it.
+	{
+		BlockyField field;
+		field.Cells = 32;
+		field.CellSize = 2.f;
+		field.Origin = -32.f;
+		TerrainHorizonCuller culler;
+		OcclusionRandom random;
+		std::vector<TerrainOcclusionTile> columns;
+		std::vector<uint8_t> visible;
+		uint32_t blockyCulled = 0;
+		for (int trial = 0; trial < 60; ++trial)
+		{
+			// Low ground crossed by a few ridges, blocks of 2x2 cells split in a third of the places
+			const int n = field.Cells;
+			const int ridgeSpacing = 16 >> (trial % 3);
+			field.Heights.assign((size_t)n * n, 0.f);
+			std::vector<int> span((size_t)n * n, 0);
+			for (int z = 0; z < n; z += 2)
+				for (int x = 0; x < n; x += 2)
+				{
+					const bool split = random.Next() < 0.35f;
+					for (int c = 0; c < 4; ++c)
+					{
+						const int cx = x + (c & 1), cz = z + (c >> 1);
+						const bool ridge = (cx / 2) % (ridgeSpacing / 2) == 1 || (cz / 2) % 7 == 3;
+						if (split || c == 0)
+							field.Heights[(size_t)cz * n + cx] = ridge ? random.Range(4.f, 14.f) : random.Range(0.f, 2.f);
+						else
+							field.Heights[(size_t)cz * n + cx] = field.Heights[(size_t)z * n + x];
+					}
+					span[(size_t)z * n + x] = split ? 1 : 2;
+					if (split)
+						span[(size_t)z * n + x + 1] = span[(size_t)(z + 1) * n + x] = span[(size_t)(z + 1) * n + x + 1] = 1;
+				}
+			columns.clear();
+			for (int z = 0; z < n; ++z)
+				for (int x = 0; x < n; ++x)
+				{
+					const int size = span[(size_t)z * n + x];
+					if (size == 0)
+						continue;
+					TerrainOcclusionTile column;
+					column.MinX = field.Origin + x * field.CellSize;
+					column.MinZ = field.Origin + z * field.CellSize;
+					column.MaxX = column.MinX + size * field.CellSize;
+					column.MaxZ = column.MinZ + size * field.CellSize;
+					column.GroundY = field.Heights[(size_t)z * n + x];
+					column.TopY = column.GroundY;
+					for (int nz = std::max(z - 1, 0); nz <= std::min(z + size, n - 1); ++nz)
+						for (int nx = std::max(x - 1, 0); nx <= std::min(x + size, n - 1); ++nx)
+							column.TopY = std::max(column.TopY, field.Heights[(size_t)nz * n + nx]);
+					columns.push_back(column);
+				}
+			visible.resize(columns.size());
+
+			const float eyeX = random.Range(-30.f, 30.f), eyeZ = random.Range(-30.f, 30.f);
+			const int cellX = (int)((eyeX - field.Origin) / field.CellSize), cellZ = (int)((eyeZ - field.Origin) / field.CellSize);
+			const float eye[3] = { eyeX, field.Heights[(size_t)cellZ * n + cellX] + random.Range(0.5f, 8.f), eyeZ };
+
+			// Every other trial looks along a 90 degree wedge
+			const bool wedge = trial % 2 == 1;
+			const float yaw = random.Range(0.f, XM_2PI);
+			float corners[4][3];
+			for (int c = 0; c < 4; ++c)
+			{
+				const float a = yaw + ((c & 1) ? XM_PIDIV4 : -XM_PIDIV4);
+				corners[c][0] = eye[0] + 200.f * std::cos(a);
+				corners[c][1] = eye[1] + ((c & 2) ? 200.f : -200.f);
+				corners[c][2] = eye[2] + 200.f * std::sin(a);
+			}
+			blockyCulled += culler.Cull(eye, columns.data(), columns.size(), visible.data(), wedge ? corners : nullptr, wedge ? 4 : 0);
+
+			for (size_t i = 0; i < columns.size(); ++i)
+			{
+				if (visible[i])
+					continue;
+				const TerrainOcclusionTile& column = columns[i];
+				for (int sample = 0; sample < 27; ++sample)
+				{
+					const float fx = (float)(sample % 3) * 0.5f, fy = (float)(sample / 3 % 3) * 0.5f, fz = (float)(sample / 9) * 0.5f;
+					const float p[3] = { column.MinX + (column.MaxX - column.MinX) * fx, column.GroundY + (column.TopY - column.GroundY) * fy,
+						column.MinZ + (column.MaxZ - column.MinZ) * fz };
+					if (wedge && std::fabs(std::remainder(std::atan2(p[2] - eye[2], p[0] - eye[0]) - yaw, XM_2PI)) > XM_PIDIV4 + 1e-4f)
+						continue;
+					if (!field.Hidden(eye, p))
+						return fail("a culled column can be seen from the eye (trial " + std::to_string(trial) + ")");
+				}
+			}
+		}
+		if (blockyCulled == 0)
+			return fail("no column was culled behind the ridges");
+	}
+
+	Terrain culled, reference;
+	SetupTerrain(culled, SyntheticHeightfield(TerrainOcclusionScene::Ridges, 1025), 6);
+	SetupTerrain(reference, SyntheticHeightfield(TerrainOcclusionScene::Ridges, 1025), 6);
+	culled.SetOcclusionCulling(true);
+	const TerrainHeightQuery& query = culled.GetHeightQuery();
+	const float worldSize = culled.GetWorldSizeXZ();
+
+	uint32_t totalCulled = 0;
+	const TerrainCameraPath paths[2] = { TerrainCameraPath::Walk, TerrainCameraPath::Orbit };
+	for (TerrainCameraPath path : paths)
+	{
+		std::vector<TerrainView> views;
+		std::vector<XMFLOAT3> eyes;
+		BuildTerrainCameraPath(path, worldSize, XM_PIDIV4, 16.f / 9.f, 12,
+			[&query](float x, float z) { return query.SampleHeight(x, z); }, views, eyes);
+		for (size_t f = 0; f < views.size(); ++f)
+		{
+			const std::string at = " (frame " + std::to_string(f) + ")";
+			culled.UpdateViews(&views[f], 1, eyes[f]);
+			reference.UpdateViews(&views[f], 1, eyes[f]);
+			const XMMATRIX viewProj = XMMatrixTranspose(XMLoadFloat4x4(&views[f].ViewProj));
+			const std::vector<TerrainTile>& kept = culled.GetVisibleTiles();
+			const std::vector<TerrainTile>& all = reference.GetVisibleTiles();
+			if (culled.GetStats().TilesOccluded != all.size() - kept.size())
+				return fail("occluded tile count does not match the tiles removed" + at);
+			totalCulled += culled.GetStats().TilesOccluded;
+
+			// Kept tiles are the unculled ones in order; every removed one is behind the ground
+			size_t k = 0;
+			for (const TerrainTile& tile : all)
+			{
+				if (k < kept.size() && kept[k].NodeIndex == tile.NodeIndex)
+				{
+					if (kept[k].NeighborMask != tile.NeighborMask || kept[k].MorphFactor != tile.MorphFactor)
+						return fail("a kept tile changed" + at);
+					++k;
+					continue;
+				}
+				const XMFLOAT3& c = tile.AABB.Center;
+				const XMFLOAT3& e = tile.AABB.Extents;
+				for (int sample = 0; sample < 125; ++sample)
+				{
+					const float p[3] = { c.x + e.x * (float)(sample % 5 - 2) * 0.5f, c.y + e.y * (float)(sample / 5 % 5 - 2) * 0.5f,
+						c.z + e.z * (float)(sample / 25 - 2) * 0.5f };
+					// Points outside the frustum need not be hidden
+					XMFLOAT4 h;
+					XMStoreFloat4(&h, XMVector4Transform(XMVectorSet(p[0], p[1], p[2], 1.f), viewProj));
+					const float w = h.w * 1.001f;
+					if (h.x < -w || h.x > w || h.y < -w || h.y > w || h.z < -0.001f * h.w || h.z > w)
+						continue;
+					TerrainRay ray;
+					for (int a = 0; a < 3; ++a)
+					{
+						ray.Origin[a] = (&eyes[f].x)[a];
+						ray.Direction[a] = p[a] - ray.Origin[a];
+					}
+					ray.MaxT = 1.f;
+					TerrainRayHit hit;
+					if (!query.Raycast(ray, hit) || hit.T >= 0.999f)
+						return fail("a culled tile can be seen from the eye" + at);
+				}
+			}
+			if (k != kept.size())
+				return fail("kept tiles are not a subsequence of the unculled tiles" + at);
+		}
+	}
+	if (totalCulled == 0)
+		return fail("no tile was culled behind the ridges");
+
+	// Nothing is culled with the eye outside the square or under the ground
+	TerrainView view;
+	const XMFLOAT3 outside = { 0.7f * worldSize, culled.GetOriginY() + 10.f, 0.f };
+	const XMFLOAT3 under = { 0.f, culled.SampleHeight(0.f, 0.f) - 5.f, 0.f };
+	for (const XMFLOAT3& eye : { outside, under })
+	{
+		const XMMATRIX lookAt = XMMatrixLookToLH(XMLoadFloat3(&eye), XMVectorSet(-1.f, 0.f, 0.1f, 0.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+		XMStoreFloat4x4(&view.ViewProj, XMMatrixTranspose(lookAt * XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.f / 9.f, 0.5f, 4000.f)));
+		culled.UpdateViews(&view, 1, eye);
+		if (culled.GetStats().TilesOccluded != 0)
+			return fail("tiles culled with the eye outside the terrain or under the ground");
+	}
+	return true;
+}
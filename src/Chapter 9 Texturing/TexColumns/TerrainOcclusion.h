@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Azimuth bins of the horizon around the eye (0.13 to 0.25 degrees each)
+constexpr int kTerrainHorizonBins = 2048;
+
+// A candidate tile for TerrainHorizonCuller: its XZ footprint, a height its drawn surface stays
+// above everywhere over the footprint and the top of everything it draws
+struct TerrainOcclusionTile
+{
+	float MinX, MinZ, MaxX, MaxZ;
+	float GroundY;
+	float TopY;
+	bool Occludee = true; // false = only hides others (a piece of a tile with a tighter GroundY)
+};
+
+// Occlusion of terrain tiles by nearer terrain. Tiles are visited front to back by their distance
+// from the eye in XZ, and a horizon keeps, per azimuth bin, the steepest slope (height over XZ
+// distance from the eye) below which every ray reaches under some tile's GroundY before going
+// farther. A tile whose whole box stays under the horizon of every bin it spans is hidden. The
+// horizon is in azimuth rather than screen columns, so a pitched camera needs no care, and each
+// tile only joins it once the tiles it is tested against lie entirely beyond it, so the test is
+// conservative rather than approximate.
+//
+// Bins outside the view's azimuths are left out of the test, since no tile beside the frustum is
+// there to fill them: a tile is hidden once the part of it the view can see is.
+//
+// It relies on the tiles forming a heightfield surface around an eye above it: the eye must be
+// above the ground and inside the area the tiles cover, and the candidates must include every tile
+// in the view (a frustum-culled cut); the caller checks the first two.
+class TerrainHorizonCuller
+{
+public:
+	// visible[i] = 0 for the hidden tiles, 1 for the others and the occluder-only entries; returns the
+	// number hidden. The view is given by points whose convex hull holds it (the frustum's corners);
+	// nullptr = all around.
+	uint32_t Cull(const float eye[3], const TerrainOcclusionTile* tiles, size_t count, uint8_t* visible,
+		const float (*viewCorners)[3] = nullptr, int cornerCount = 0);
+
+private:
+	std::vector<float> mHorizon; // slope per bin, -inf where nothing occludes yet
+	std::vector<uint8_t> mInView; // bins the view reaches
+	std::vector<std::pair<float, uint32_t>> mOrder;     // occludees by their near XZ distance from the eye
+	std::vector<std::pair<float, uint32_t>> mOccluders; // every entry by its far XZ distance
+	std::vector<float> mNear; // XZ distance range from the eye per entry
+	std::vector<float> mFar;
+
+	// Bins [first, last] of the tile's azimuth range (last < first wraps); false with the eye over it
+	bool AzimuthBins(const float eye[3], const TerrainOcclusionTile& tile, bool inner, int& first, int& last) const;
+	void AddOccluder(const float eye[3], const TerrainOcclusionTile& tile, float nearDistance, float farDistance);
+};
+
+struct TerrainOcclusionBenchmark
+{
+	int Frames = 0;
+	double TilesBefore = 0.0;  // average camera tiles after frustum culling
+	double TilesAfter = 0.0;   // ... and horizon culling
+	double UpdateMs = 0.0;     // average Terrain::Update without horizon culling
+	double OcclusionMs = 0.0;  // average cost of the horizon pass on top of it
+};
+
+// Synthetic terrains for the benchmark: gentle hills, or ridges cut by valleys
+enum class TerrainOcclusionScene
+{
+	Hills,
+	Ridges,
+};
+
+// Walk a ground-level camera path over a synthetic heightfield of size x size texels and compare
+// the camera's tiles with and without horizon culling
+TerrainOcclusionBenchmark BenchmarkTerrainOcclusion(TerrainOcclusionScene scene, int size, int frames);
+
+// CPU check of the culler on random blocky heightfields, where every culled box must be hidden from
+// the eye by an exact grid walk, and along camera paths over a ridged heightfield: every culled tile
+// is hidden (rays from the eye to points all over its box enter the ground first, found by
+// TerrainHeightQuery::Raycast), the remaining tiles are the unculled list in order, something is
+// culled, and nothing is culled with the eye outside the square or under the ground. Returns false
+// with a reason on failure.
+bool ValidateTerrainOcclusion(std::string* error = nullptr);
@@ -0,0 +1,602 @@
+#include "TerrainQuery.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <emmintrin.h>
+#include <limits>
+
+namespace
+{
+	// Everything the SSE sampler needs, unpacked once per batch
+	struct TexelSampler
+	{
+		const float* Heights = nullptr;
+		int Width = 0;
+		__m128 MaxX, MaxZ;   // last texel centre
+		__m128 LastX0, LastZ0; // last cell start, so x0 + 1 stays inside
+		int StepX = 0;       // offset of the +X / +Z corner (0 on a 1-texel axis)
+		size_t StepZ = 0;
+	};
+
+	TexelSampler MakeSampler(const TerrainHeightfield& hf)
+	{
+		TexelSampler s;
+		s.Heights = hf.Heights.data();
+		s.Width = hf.Width;
+		s.MaxX = _mm_set1_ps((float)(hf.Width - 1));
+		s.MaxZ = _mm_set1_ps((float)(hf.Height - 1));
+		s.LastX0 = _mm_set1_ps((float)std::max(hf.Width - 2, 0));
+		s.LastZ0 = _mm_set1_ps((float)std::max(hf.Height - 2, 0));
+		s.StepX = hf.Width > 1 ? 1 : 0;
+		s.StepZ = hf.Height > 1 ? (size_t)hf.Width : 0;
+		return s;
+	}
+
+	// Same operations in the same order as TerrainHeightQuery::SampleTexel, 4 lanes at a time
+	__m128 SampleTexel4(const TexelSampler& s, __m128 fx, __m128 fz)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		fx = _mm_min_ps(_mm_max_ps(fx, zero), s.MaxX);
+		fz = _mm_min_ps(_mm_max_ps(fz, zero), s.MaxZ);
+		const __m128 x0 = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(fx)), s.LastX0);
+		const __m128 z0 = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(fz)), s.LastZ0);
+		const __m128 tx = _mm_sub_ps(fx, x0);
+		const __m128 tz = _mm_sub_ps(fz, z0);
+
+		alignas(16) int xi[4], zi[4];
+		_mm_store_si128((__m128i*)xi, _mm_cvttps_epi32(x0));
+		_mm_store_si128((__m128i*)zi, _mm_cvttps_epi32(z0));
+		const float* p[4];
+		for (int k = 0; k < 4; ++k)
+			p[k] = s.Heights + (size_t)zi[k] * s.Width + xi[k];
+		const __m128 h00 = _mm_setr_ps(p[0][0], p[1][0], p[2][0], p[3][0]);
+		const __m128 h10 = _mm_setr_ps(p[0][s.StepX], p[1][s.StepX], p[2][s.StepX], p[3][s.StepX]);
+		const __m128 h01 = _mm_setr_ps(p[0][s.StepZ], p[1][s.StepZ], p[2][s.StepZ], p[3][s.StepZ]);
+		const __m128 h11 = _mm_setr_ps(p[0][s.StepZ + s.StepX], p[1][s.StepZ + s.StepX],
+			p[2][s.StepZ + s.StepX], p[3][s.StepZ + s.StepX]);
+
+		const __m128 h0 = _mm_add_ps(h00, _mm_mul_ps(_mm_sub_ps(h10, h00), tx));
+		const __m128 h1 = _mm_add_ps(h01, _mm_mul_ps(_mm_sub_ps(h11, h01), tx));
+		return _mm_add_ps(h0, _mm_mul_ps(_mm_sub_ps(h1, h0), tz));
+	}
+}
+
+void TerrainHeightQuery::Build(const TerrainHeightfield* heightfield)
+{
+	mHeightfield = heightfield;
+	mLevels.clear();
+	UpdateMapping();
+	if (Empty()) return;
+
+	// Level 1: 2x2 cells = texels [2x - 1, 2x + 1] on each axis (clamped)
+	const TerrainHeightfield& hf = *mHeightfield;
+	Level first;
+	first.Width = (hf.Width + 2) / 2;
+	first.Height = (hf.Height + 2) / 2;
+	first.MinMax.resize(2 * (size_t)first.Width * first.Height);
+	for (int z = 0; z < first.Height; ++z)
+	{
+		const int tz0 = std::max(2 * z - 1, 0), tz1 = std::min(2 * z + 1, hf.Height - 1);
+		for (int x = 0; x < first.Width; ++x)
+		{
+			const int tx0 = std::max(2 * x - 1, 0), tx1 = std::min(2 * x + 1, hf.Width - 1);
+			float minH = hf.At(tx0, tz0), maxH = minH;
+			for (int tz = tz0; tz <= tz1; ++tz)
+				for (int tx = tx0; tx <= tx1; ++tx)
+				{
+					minH = std::min(minH, hf.At(tx, tz));
+					maxH = std::max(maxH, hf.At(tx, tz));
+				}
+			first.MinMax[2 * ((size_t)z * first.Width + x)] = minH;
+			first.MinMax[2 * ((size_t)z * first.Width + x) + 1] = maxH;
+		}
+	}
+	mLevels.push_back(std::move(first));
+
+	while (mLevels.back().Width > 1 || mLevels.back().Height > 1)
+	{
+		const Level& src = mLevels.back();
+		Level dst;
+		dst.Width = (src.Width + 1) / 2;
+		dst.Height = (src.Height + 1) / 2;
+		dst.MinMax.resize(2 * (size_t)dst.Width * dst.Height);
+		for (int z = 0; z < dst.Height; ++z)
+		{
+			const int z0 = 2 * z, z1 = std::min(2 * z + 1, src.Height - 1);
+			for (int x = 0; x < dst.Width; ++x)
+			{
+				const int x0 = 2 * x, x1 = std::min(2 * x + 1, src.Width - 1);
+				const float* a = &src.MinMax[2 * ((size_t)z0 * src.Width + x0)];
+				const float* b = &src.MinMax[2 * ((size_t)z0 * src.Width + x1)];
+				const float* c = &src.MinMax[2 * ((size_t)z1 * src.Width + x0)];
+				const float* d = &src.MinMax[2 * ((size_t)z1 * src.Width + x1)];
+				float* out = &dst.MinMax[2 * ((size_t)z * dst.Width + x)];
+				out[0] = std::min(std::min(a[0], b[0]), std::min(c[0], d[0]));
+				out[1] = std::max(std::max(a[1], b[1]), std::max(c[1], d[1]));
+			}
+		}
+		mLevels.push_back(std::move(dst));
+	}
+}
+
+void TerrainHeightQuery::SetPlacement(float worldSize, float originY, float heightScale)
+{
+	mWorldSize = worldSize;
+	mOriginY = originY;
+	mHeightScale = heightScale;
+	UpdateMapping();
+}
+
+void TerrainHeightQuery::UpdateMapping()
+{
+	// u = (x + S/2) / S, v = (S/2 - z) / S, texel coordinate = uv * size - 0.5
+	const int width = Empty() ? 1 : mHeightfield->Width;
+	const int height = Empty() ? 1 : mHeightfield->Height;
+	const float size = mWorldSize > 0.f ? mWorldSize : 1.f;
+	mScaleX = (float)width / size;
+	mOffsetX = 0.5f * (float)width - 0.5f;
+	mScaleZ = -(float)height / size;
+	mOffsetZ = 0.5f * (float)height - 0.5f;
+}
+
+float TerrainHeightQuery::SampleTexel(float fx, float fz) const
+{
+	const TerrainHeightfield& hf = *mHeightfield;
+	fx = std::min(std::max(fx, 0.f), (float)(hf.Width - 1));
+	fz = std::min(std::max(fz, 0.f), (float)(hf.Height - 1));
+	const float x0 = std::min((float)(int)fx, (float)std::max(hf.Width - 2, 0));
+	const float z0 = std::min((float)(int)fz, (float)std::max(hf.Height - 2, 0));
+	const float tx = fx - x0, tz = fz - z0;
+	const float* p = hf.Heights.data() + (size_t)z0 * hf.Width + (size_t)x0;
+	const int sx = hf.Width > 1 ? 1 : 0;
+	const size_t sz = hf.Height > 1 ? (size_t)hf.Width : 0;
+	const float h0 = p[0] + (p[sx] - p[0]) * tx;
+	const float h1 = p[sz] + (p[sz + sx] - p[sz]) * tx;
+	return h0 + (h1 - h0) * tz;
+}
+
+float TerrainHeightQuery::SampleHeight(float x, float z) const
+{
+	if (Empty()) return mOriginY;
+	return mOriginY + mHeightScale * SampleTexel(x * mScaleX + mOffsetX, z * mScaleZ + mOffsetZ);
+}
+
+void TerrainHeightQuery::SampleNormal(float x, float z, float normal[3]) const
+{
+	normal[0] = 0.f; normal[1] = 1.f; normal[2] = 0.f;
+	if (Empty()) return;
+	const float fx = x * mScaleX + mOffsetX, fz = z * mScaleZ + mOffsetZ;
+	// World slopes: texel differences times texels per world unit
+	const float gx = (SampleTexel(fx + 1.f, fz) - SampleTexel(fx - 1.f, fz)) * (0.5f * mScaleX * mHeightScale);
+	const float gz = (SampleTexel(fx, fz + 1.f) - SampleTexel(fx, fz - 1.f)) * (0.5f * mScaleZ * mHeightScale);
+	const float invLength = 1.f / std::sqrt(gx * gx + 1.f + gz * gz);
+	normal[0] = -gx * invLength;
+	normal[1] = invLength;
+	normal[2] = -gz * invLength;
+}
+
+void TerrainHeightQuery::SampleHeights(const float* x, const float* z, float* y, size_t count) const
+{
+	if (Empty())
+	{
+		std::fill(y, y + count, mOriginY);
+		return;
+	}
+	const TexelSampler s = MakeSampler(*mHeightfield);
+	const __m128 scaleX = _mm_set1_ps(mScaleX), offsetX = _mm_set1_ps(mOffsetX);
+	const __m128 scaleZ = _mm_set1_ps(mScaleZ), offsetZ = _mm_set1_ps(mOffsetZ);
+	const __m128 originY = _mm_set1_ps(mOriginY), heightScale = _mm_set1_ps(mHeightScale);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 fx = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(x + i), scaleX), offsetX);
+		const __m128 fz = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(z + i), scaleZ), offsetZ);
+		_mm_storeu_ps(y + i, _mm_add_ps(originY, _mm_mul_ps(heightScale, SampleTexel4(s, fx, fz))));
+	}
+	for (; i < count; ++i)
+		y[i] = SampleHeight(x[i], z[i]);
+}
+
+void TerrainHeightQuery::SampleNormals(const float* x, const float* z, float* nx, float* ny, float* nz, size_t count) const
+{
+	if (Empty())
+	{
+		std::fill(nx, nx + count, 0.f);
+		std::fill(ny, ny + count, 1.f);
+		std::fill(nz, nz + count, 0.f);
+		return;
+	}
+	const TexelSampler s = MakeSampler(*mHeightfield);
+	const __m128 scaleX = _mm_set1_ps(mScaleX), offsetX = _mm_set1_ps(mOffsetX);
+	const __m128 scaleZ = _mm_set1_ps(mScaleZ), offsetZ = _mm_set1_ps(mOffsetZ);
+	const __m128 slopeX = _mm_set1_ps(0.5f * mScaleX * mHeightScale), slopeZ = _mm_set1_ps(0.5f * mScaleZ * mHeightScale);
+	const __m128 one = _mm_set1_ps(1.f), zero = _mm_setzero_ps();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 fx = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(x + i), scaleX), offsetX);
+		const __m128 fz = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(z + i), scaleZ), offsetZ);
+		const __m128 gx = _mm_mul_ps(_mm_sub_ps(SampleTexel4(s, _mm_add_ps(fx, one), fz), SampleTexel4(s, _mm_sub_ps(fx, one), fz)), slopeX);
+		const __m128 gz = _mm_mul_ps(_mm_sub_ps(SampleTexel4(s, fx, _mm_add_ps(fz, one)), SampleTexel4(s, fx, _mm_sub_ps(fz, one))), slopeZ);
+		const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, gx), one), _mm_mul_ps(gz, gz))));
+		_mm_storeu_ps(nx + i, _mm_mul_ps(_mm_sub_ps(zero, gx), invLength));
+		_mm_storeu_ps(ny + i, invLength);
+		_mm_storeu_ps(nz + i, _mm_mul_ps(_mm_sub_ps(zero, gz), invLength));
+	}
+	for (; i < count; ++i)
+	{
+		float n[3];
+		SampleNormal(x[i], z[i], n);
+		nx[i] = n[0]; ny[i] = n[1]; nz[i] = n[2];
+	}
+}
+
+void TerrainHeightQuery::CellRange(int level, int cx, int cz, float& minH, float& maxH) const
+{
+	if (level > 0)
+	{
+		const Level& l = mLevels[level - 1];
+		const float* range = &l.MinMax[2 * ((size_t)(cz >> level) * l.Width + (cx >> level))];
+		minH = range[0];
+		maxH = range[1];
+		return;
+	}
+	const TerrainHeightfield& hf = *mHeightfield;
+	const int x0 = std::max(cx - 1, 0), x1 = std::min(cx, hf.Width - 1);
+	const int z0 = std::max(cz - 1, 0), z1 = std::min(cz, hf.Height - 1);
+	minH = std::min(std::min(hf.At(x0, z0), hf.At(x1, z0)), std::min(hf.At(x0, z1), hf.At(x1, z1)));
+	maxH = std::max(std::max(hf.At(x0, z0), hf.At(x1, z0)), std::max(hf.At(x0, z1), hf.At(x1, z1)));
+}
+
+bool TerrainHeightQuery::IntersectCell(int cx, int cz, const float o[3], const float d[3], float t0, float t1, float& t) const
+{
+	const TerrainHeightfield& hf = *mHeightfield;
+	const int x0 = std::max(cx - 1, 0), x1 = std::min(cx, hf.Width - 1);
+	const int z0 = std::max(cz - 1, 0), z1 = std::min(cz, hf.Height - 1);
+	const float h00 = hf.At(x0, z0), h10 = hf.At(x1, z0), h01 = hf.At(x0, z1), h11 = hf.At(x1, z1);
+
+	// h(s, r) = h00 + a s + b r + c s r with s, r in [0, 1] across the cell; along the ray
+	// s, r and y are linear in tau = t - t0, so y - h is the quadratic A tau^2 + B tau + C
+	const float s0 = o[0] + d[0] * t0 - (float)cx;
+	const float r0 = o[2] + d[2] * t0 - (float)cz;
+	const float y0 = o[1] + d[1] * t0;
+	const float a = h10 - h00, b = h01 - h00, c = h00 - h10 - h01 + h11;
+	const float C = y0 - (h00 + a * s0 + b * r0 + c * s0 * r0);
+	const float B = d[1] - (a * d[0] + b * d[2] + c * (s0 * d[2] + r0 * d[0]));
+	const float A = -c * d[0] * d[2];
+
+	const float span = std::max(t1 - t0, 0.f);
+	const float eps = 1e-4f * span;
+	float best = std::numeric_limits<float>::infinity();
+	auto consider = [&](float tau) {
+		if (tau >= -eps && tau <= span + eps)
+			best = std::min(best, std::clamp(tau, 0.f, span));
+	};
+	if (C == 0.f)
+		consider(0.f);
+	else if (A == 0.f)
+	{
+		if (B != 0.f) consider(-C / B);
+	}
+	else
+	{
+		const float disc = B * B - 4.f * A * C;
+		if (disc >= 0.f)
+		{
+			// Stable form: no cancellation when A is tiny
+			const float q = -0.5f * (B + std::copysign(std::sqrt(disc), B));
+			consider(q / A);
+			consider(C / q);
+		}
+	}
+	if (best == std::numeric_limits<float>::infinity())
+		return false;
+	t = t0 + best;
+	return true;
+}
+
+void TerrainHeightQuery::FillHit(const TerrainRay& ray, float t, TerrainRayHit& hit) const
+{
+	hit.Hit = true;
+	hit.T = t;
+	for (int k = 0; k < 3; ++k)
+		hit.Position[k] = ray.Origin[k] + ray.Direction[k] * t;
+	SampleNormal(hit.Position[0], hit.Position[2], hit.Normal);
+}
+
+bool TerrainHeightQuery::Raycast(const TerrainRay& ray, TerrainRayHit& hit) const
+{
+	hit = TerrainRayHit();
+	if (Empty()) return false;
+	const int width = mHeightfield->Width, height = mHeightfield->Height;
+
+	// Cell space: cell c spans [c, c + 1] in x (texels c - 1 and c), the square is
+	// [0.5, width + 0.5] x [0.5, height + 0.5]; y in normalized heights
+	const float heightScale = mHeightScale != 0.f ? mHeightScale : 1e-6f;
+	const float o[3] = { ray.Origin[0] * mScaleX + mOffsetX + 1.f, (ray.Origin[1] - mOriginY) / heightScale,
+		ray.Origin[2] * mScaleZ + mOffsetZ + 1.f };
+	const float d[3] = { ray.Direction[0] * mScaleX, ray.Direction[1] / heightScale, ray.Direction[2] * mScaleZ };
+
+	float tEnter = 0.f, tLeave = ray.MaxT;
+	auto clip = [&](float origin, float dir, float lo, float hi) {
+		if (dir == 0.f) return origin >= lo && origin <= hi;
+		float ta = (lo - origin) / dir, tb = (hi - origin) / dir;
+		if (ta > tb) std::swap(ta, tb);
+		tEnter = std::max(tEnter, ta);
+		tLeave = std::min(tLeave, tb);
+		return tEnter <= tLeave;
+	};
+	if (!clip(o[0], d[0], 0.5f, (float)width + 0.5f) || !clip(o[2], d[2], 0.5f, (float)height + 0.5f))
+		return false;
+
+	const float inf = std::numeric_limits<float>::infinity();
+	const float invDx = d[0] != 0.f ? 1.f / d[0] : inf;
+	const float invDz = d[2] != 0.f ? 1.f / d[2] : inf;
+	const int top = (int)mLevels.size();
+	int level = top;
+	int cx = std::clamp((int)std::floor(o[0] + d[0] * tEnter), 0, width);
+	int cz = std::clamp((int)std::floor(o[2] + d[2] * tEnter), 0, height);
+	float t = tEnter;
+
+	// Every step crosses a node boundary or descends; the cap only guards against float stalls
+	const int maxSteps = 4 * (width + height + 2) * (top + 1) + 64;
+	for (int step = 0; step < maxSteps; ++step)
+	{
+		const int size = 1 << level;
+		const int nx = cx >> level, nz = cz >> level;
+		const int x0 = nx << level, z0 = nz << level;
+		const float txExit = d[0] > 0.f ? ((float)(x0 + size) - o[0]) * invDx : d[0] < 0.f ? ((float)x0 - o[0]) * invDx : inf;
+		const float tzExit = d[2] > 0.f ? ((float)(z0 + size) - o[2]) * invDz : d[2] < 0.f ? ((float)z0 - o[2]) * invDz : inf;
+		const float tExit = std::min(std::min(txExit, tzExit), tLeave);
+
+		// The segment's height range against the node's: skip the node unless they overlap
+		const float ya = o[1] + d[1] * t, yb = o[1] + d[1] * tExit;
+		float minH, maxH;
+		CellRange(level, cx, cz, minH, maxH);
+		if (std::min(ya, yb) <= maxH && std::max(ya, yb) >= minH)
+		{
+			if (level > 0)
+			{
+				--level;
+				continue;
+			}
+			float tHit;
+			if (IntersectCell(cx, cz, o, d, t, tExit, tHit))
+			{
+				FillHit(ray, tHit, hit);
+				return true;
+			}
+		}
+
+		if (tExit >= tLeave)
+			return false;
+		t = std::max(t, tExit);
+		// Step exactly across the boundary hit; the other axis stays inside the node's span
+		const bool stepX = txExit <= tzExit, stepZ = tzExit <= txExit;
+		cx = stepX ? (d[0] > 0.f ? x0 + size : x0 - 1) : std::clamp((int)std::floor(o[0] + d[0] * t), x0, x0 + size - 1);
+		cz = stepZ ? (d[2] > 0.f ? z0 + size : z0 - 1) : std::clamp((int)std::floor(o[2] + d[2] * t), z0, z0 + size - 1);
+		if (cx < 0 || cx > width || cz < 0 || cz > height)
+			return false;
+		// Left the parent: try skipping at the coarser level again
+		if (level < top && ((cx >> (level + 1)) != (nx >> 1) || (cz >> (level + 1)) != (nz >> 1)))
+			++level;
+	}
+	return false;
+}
+
+size_t TerrainHeightQuery::Raycasts(const TerrainRay* rays, TerrainRayHit* hits, size_t count) const
+{
+	size_t hitCount = 0;
+	for (size_t i = 0; i < count; ++i)
+		hitCount += Raycast(rays[i], hits[i]) ? 1 : 0;
+	return hitCount;
+}
+
+namespace
+{
+	struct QueryRandom
+	{
+		uint32_t State = 12345u;
+		float Next() // [0, 1)
+		{
+			State = State * 1664525u + 1013904223u;
+			return (float)(State >> 8) * (1.f / 16777216.f);
+		}
+		float Range(float lo, float hi) { return lo + (hi - lo) * Next(); }
+	};
+
+	TerrainRay MakeRandomRay(QueryRandom& random, float worldSize, float originY, float heightScale, bool fromAbove)
+	{
+		TerrainRay ray;
+		const float half = 0.5f * worldSize;
+		ray.Origin[0] = random.Range(-half, half);
+		ray.Origin[2] = random.Range(-half, half);
+		if (fromAbove)
+		{
+			// Picking-like: from above the terrain, looking down at an angle
+			ray.Origin[1] = originY + heightScale * random.Range(1.05f, 2.f);
+			ray.Direction[0] = random.Range(-1.f, 1.f);
+			ray.Direction[1] = -random.Range(0.2f, 1.f);
+			ray.Direction[2] = random.Range(-1.f, 1.f);
+		}
+		else
+		{
+			ray.Origin[0] = random.Range(-0.7f * worldSize, 0.7f * worldSize);
+			ray.Origin[1] = originY + heightScale * random.Range(-0.3f, 1.3f);
+			ray.Origin[2] = random.Range(-0.7f * worldSize, 0.7f * worldSize);
+			for (int k = 0; k < 3; ++k)
+				ray.Direction[k] = random.Range(-1.f, 1.f);
+		}
+		const float length = std::sqrt(ray.Direction[0] * ray.Direction[0] + ray.Direction[1] * ray.Direction[1] +
+			ray.Direction[2] * ray.Direction[2]);
+		for (int k = 0; k < 3; ++k)
+			ray.Direction[k] /= length;
+		ray.MaxT = 2.f * worldSize + 4.f * std::abs(heightScale);
+		return ray;
+	}
+
+	double MillionsPerSecond(size_t count, std::chrono::steady_clock::time_point start)
+	{
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return seconds > 0.0 ? (double)count / seconds * 1e-6 : 0.0;
+	}
+}
+
+TerrainQueryBenchmark BenchmarkTerrainQueries(const TerrainHeightQuery& query, float worldSize, float originY,
+	float heightScale, size_t count)
+{
+	TerrainQueryBenchmark result;
+	count = std::max<size_t>(count, 4);
+	QueryRandom random;
+	const float half = 0.5f * worldSize;
+	std::vector<float> x(count), z(count), y(count), nx(count), ny(count), nz(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		x[i] = random.Range(-half, half);
+		z[i] = random.Range(-half, half);
+	}
+
+	volatile float sink = 0.f;
+	float sum = 0.f;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count; ++i)
+		sum += query.SampleHeight(x[i], z[i]);
+	result.HeightsScalar = MillionsPerSecond(count, start);
+	sink = sum;
+
+	start = std::chrono::steady_clock::now();
+	query.SampleHeights(x.data(), z.data(), y.data(), count);
+	result.HeightsBatched = MillionsPerSecond(count, start);
+	sink = y[count / 2];
+
+	start = std::chrono::steady_clock::now();
+	query.SampleNormals(x.data(), z.data(), nx.data(), ny.data(), nz.data(), count);
+	result.NormalsBatched = MillionsPerSecond(count, start);
+	sink = ny[count / 2];
+
+	const size_t rayCount = std::max<size_t>(count / 16, 1);
+	std::vector<TerrainRay> rays(rayCount);
+	std::vector<TerrainRayHit> hits(rayCount);
+	for (TerrainRay& ray : rays)
+		ray = MakeRandomRay(random, worldSize, originY, heightScale, true);
+	start = std::chrono::steady_clock::now();
+	const size_t hitCount = query.Raycasts(rays.data(), hits.data(), rayCount);
+	result.Raycasts = MillionsPerSecond(rayCount, start);
+	result.RaycastHitRate = (double)hitCount / (double)rayCount;
+	(void)sink;
+	return result;
+}
+
+bool ValidateTerrainQueries(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	// Rolling hills plus a ridge and some high-frequency noise, odd sizes on purpose
+	TerrainHeightfield hf;
+	hf.Width = 97;
+	hf.Height = 61;
+	hf.Heights.resize((size_t)hf.Width * hf.Height);
+	QueryRandom noise;
+	for (int z = 0; z < hf.Height; ++z)
+		for (int x = 0; x < hf.Width; ++x)
+			hf.Heights[(size_t)z * hf.Width + x] = std::clamp(0.45f + 0.25f * std::sin(0.21f * x) * std::cos(0.17f * z) +
+				0.2f * std::exp(-0.02f * (float)((x - 60) * (x - 60))) + 0.05f * noise.Next(), 0.f, 1.f);
+
+	const float worldSize = 80.f, originY = -3.f, heightScale = 12.f;
+	TerrainHeightQuery query;
+	query.Build(&hf);
+	query.SetPlacement(worldSize, originY, heightScale);
+
+	QueryRandom random;
+	const size_t count = 1003; // not a multiple of 4: exercises the scalar tail
+	std::vector<float> x(count), z(count), y(count), nx(count), ny(count), nz(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		x[i] = random.Range(-0.6f * worldSize, 0.6f * worldSize);
+		z[i] = random.Range(-0.6f * worldSize, 0.6f * worldSize);
+	}
+	query.SampleHeights(x.data(), z.data(), y.data(), count);
+	query.SampleNormals(x.data(), z.data(), nx.data(), ny.data(), nz.data(), count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float h = query.SampleHeight(x[i], z[i]);
+		const float u = (x[i] + 0.5f * worldSize) / worldSize, v = (0.5f * worldSize - z[i]) / worldSize;
+		if (std::abs(h - (originY + heightScale * hf.Sample(u, v))) > 1e-4f * heightScale)
+			return fail("SampleHeight differs from TerrainHeightfield::Sample");
+		if (std::abs(y[i] - h) > 1e-5f * heightScale)
+			return fail("SampleHeights differs from SampleHeight");
+		float n[3];
+		query.SampleNormal(x[i], z[i], n);
+		if (std::abs(nx[i] - n[0]) > 1e-5f || std::abs(ny[i] - n[1]) > 1e-5f || std::abs(nz[i] - n[2]) > 1e-5f)
+			return fail("SampleNormals differs from SampleNormal");
+		if (std::abs(n[0] * n[0] + n[1] * n[1] + n[2] * n[2] - 1.f) > 1e-4f || n[1] <= 0.f)
+			return fail("normal is not a unit vector facing up");
+	}
+
+	// Raycasts against dense marching (steps of 1/16 texel) restricted to the square
+	const float half = 0.5f * worldSize;
+	const float texel = worldSize / (float)std::max(hf.Width, hf.Height);
+	for (int i = 0; i < 600; ++i)
+	{
+		TerrainRay ray = MakeRandomRay(random, worldSize, originY, heightScale, i % 2 == 0);
+		if (i % 50 == 1)
+		{
+			ray.Direction[0] = 0.f; ray.Direction[1] = (i % 100 == 1) ? -1.f : 1.f; ray.Direction[2] = 0.f;
+		}
+		TerrainRayHit hit;
+		query.Raycast(ray, hit);
+
+		const float dt = texel / 16.f;
+		float marchedT = -1.f;
+		float prev = 0.f;
+		bool hasPrev = false;
+		for (float t = 0.f; t <= ray.MaxT; t += dt)
+		{
+			const float px = ray.Origin[0] + ray.Direction[0] * t, pz = ray.Origin[2] + ray.Direction[2] * t;
+			if (std::abs(px) > half || std::abs(pz) > half)
+			{
+				hasPrev = false;
+				continue;
+			}
+			const float f = ray.Origin[1] + ray.Direction[1] * t - query.SampleHeight(px, pz);
+			if (hasPrev && (f == 0.f || (f < 0.f) != (prev < 0.f)))
+			{
+				marchedT = t;
+				break;
+			}
+			prev = f;
+			hasPrev = true;
+		}
+
+		const float tolerance = 2.f * dt + 1e-3f;
+		if (hit.Hit)
+		{
+			const float residual = hit.Position[1] - query.SampleHeight(hit.Position[0], hit.Position[2]);
+			if (std::abs(residual) > 2e-3f * heightScale)
+				return fail("raycast hit is not on the surface");
+			if (std::abs(hit.Position[0]) > half + 1e-3f || std::abs(hit.Position[2]) > half + 1e-3f || hit.T < 0.f || hit.T > ray.MaxT)
+				return fail("raycast hit outside the square or the ray");
+			if (marchedT >= 0.f && marchedT < hit.T - tolerance)
+				return fail("raycast missed an earlier crossing (ray " + std::to_string(i) + ")");
+		}
+		if (marchedT >= 0.f && (!hit.Hit || hit.T > marchedT + tolerance))
+			return fail("raycast missed a crossing found by marching (ray " + std::to_string(i) + ")");
+	}
+
+	TerrainRay outside;
+	outside.Origin[0] = 2.f * worldSize; outside.Origin[1] = originY + 0.5f * heightScale;
+	outside.Direction[0] = 0.f; outside.Direction[1] = -1.f; outside.Direction[2] = 0.f;
+	TerrainRayHit hit;
+	if (query.Raycast(outside, hit) || hit.Hit)
+		return fail("ray outside the square hit");
+
+	TerrainHeightQuery empty;
+	empty.SetPlacement(worldSize, originY, heightScale);
+	if (empty.SampleHeight(1.f, 2.f) != originY || empty.Raycast(outside, hit))
+		return fail("query without a heightfield is not flat and unhittable");
+	return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "TerrainHeightmap.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct TerrainRay
+{
+	float Origin[3] = { 0.f, 0.f, 0.f };
+	float Direction[3] = { 0.f, -1.f, 0.f }; // need not be normalized, T is in units of its length
+	float MaxT = 1e30f;
+};
+
+struct TerrainRayHit
+{
+	bool Hit = false;
+	float T = 0.f;
+	float Position[3] = { 0.f, 0.f, 0.f };
+	float Normal[3] = { 0.f, 1.f, 0.f };
+};
+
+// CPU queries against the surface the quadtree terrain draws: the heightfield's bilinear surface over
+// [-worldSize/2, worldSize/2]^2 (row 0 at +Z), world height originY + height * heightScale.
+// Outside the square heights clamp to the edge, as TerrainHeightfield::Sample does.
+// The heightfield is referenced, not copied: it must outlive the query and Build runs again if it changes.
+class TerrainHeightQuery
+{
+public:
+	// Builds the min/max quadtree over the heightfield's bilinear cells
+	void Build(const TerrainHeightfield* heightfield);
+	void SetPlacement(float worldSize, float originY, float heightScale);
+	bool Empty() const { return mHeightfield == nullptr || mHeightfield->Empty(); }
+
+	float SampleHeight(float x, float z) const;
+	// Unit normal from central differences one texel apart
+	void SampleNormal(float x, float z, float normal[3]) const;
+	// First crossing of the surface along the ray within [0, MaxT] and the square, from either side.
+	// Hierarchical DDA over the min/max quadtree; each leaf cell is solved exactly (the bilinear
+	// patch along a ray is a quadratic in T).
+	bool Raycast(const TerrainRay& ray, TerrainRayHit& hit) const;
+
+	// Batched forms over SoA arrays, 4 queries per SSE step. Empty queries give originY and +Y.
+	void SampleHeights(const float* x, const float* z, float* y, size_t count) const;
+	void SampleNormals(const float* x, const float* z, float* nx, float* ny, float* nz, size_t count) const;
+	// Returns the number of rays that hit
+	size_t Raycasts(const TerrainRay* rays, TerrainRayHit* hits, size_t count) const;
+
+private:
+	struct Level
+	{
+		int Width = 0;
+		int Height = 0;
+		std::vector<float> MinMax; // interleaved: one cache line fetch per node
+	};
+
+	const TerrainHeightfield* mHeightfield = nullptr;
+	// Cell c in [0, Width] lies between texels c - 1 and c (clamped); level k of the tree covers
+	// 2^k x 2^k cells, mLevels[k - 1] holds levels 1.. (leaf ranges come from the 4 corners)
+	std::vector<Level> mLevels;
+	float mWorldSize = 100.f;
+	float mOriginY = 0.f;
+	float mHeightScale = 1.f;
+	// Texel coordinate fx = x * mScaleX + mOffsetX (texel centres at integers), fz likewise
+	float mScaleX = 1.f, mOffsetX = 0.f;
+	float mScaleZ = 1.f, mOffsetZ = 0.f;
+
+	void UpdateMapping();
+	// Normalized bilinear height at texel coordinates, clamped to the texel centres
+	float SampleTexel(float fx, float fz) const;
+	void CellRange(int level, int cx, int cz, float& minH, float& maxH) const;
+	// Smallest t in [t0, t1] where the ray (cell space, normalized height) crosses cell (cx, cz)
+	bool IntersectCell(int cx, int cz, const float o[3], const float d[3], float t0, float t1, float& t) const;
+	void FillHit(const TerrainRay& ray, float t, TerrainRayHit& hit) const;
+};
+
+struct TerrainQueryBenchmark
+{
+	double HeightsScalar = 0.0;  // millions of queries per second on the calling thread
+	double HeightsBatched = 0.0;
+	double NormalsBatched = 0.0;
+	double Raycasts = 0.0;       // picking-like rays from above the terrain
+	double RaycastHitRate = 0.0;
+};
+
+// Time `count` random queries of each kind inside the square
+TerrainQueryBenchmark BenchmarkTerrainQueries(const TerrainHeightQuery& query, float worldSize, float originY,
+	float heightScale, size_t count);
+
+// CPU check on a generated non-power-of-two heightfield: SampleHeight matches TerrainHeightfield::Sample,
+// the batched forms match the scalar ones, and Raycast finds the same first crossing as dense ray
+// marching (including rays from below, vertical rays and rays missing the square).
+// Returns false with a reason on failure.
+bool ValidateTerrainQueries(std::string* error = nullptr);
@@ -0,0 +1,431 @@
+#include "TerrainRtin.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <thread>
+#include <utility>
+
+namespace
+{
+	// Doubled signed area in the XZ plane (x = column, z = -row); the tile grid winds negative
+	int SignedArea2(int ax, int az, int bx, int bz, int cx, int cz)
+	{
+		return -(bx - ax) * (cz - az) + (bz - az) * (cx - ax);
+	}
+
+	bool OnSameBorder(int res, int px, int pz, int qx, int qz)
+	{
+		return (px == qx && (px == 0 || px == res)) || (pz == qz && (pz == 0 || pz == res));
+	}
+}
+
+TerrainRtin::TerrainRtin(int resolution)
+	: mResolution(resolution)
+{
+	// Implicit binary tree of every triangle whose hypotenuse midpoint is a grid vertex: the lowest
+	// bit of id picks one of the two halves of the tile, each further bit the left or right child
+	const int triangles = resolution * resolution * 2 - 2;
+	mParentTriangles = triangles - resolution * resolution;
+	mCoords.resize((size_t)triangles * 4);
+	for (int i = 0; i < triangles; ++i)
+	{
+		int id = i + 2;
+		int ax = 0, az = 0, bx = 0, bz = 0, cx = 0, cz = 0;
+		if (id & 1)
+			bx = bz = cx = resolution;
+		else
+			ax = az = cz = resolution;
+		while ((id >>= 1) > 1)
+		{
+			const int mx = (ax + bx) >> 1, mz = (az + bz) >> 1;
+			if (id & 1)
+			{
+				bx = ax; bz = az;
+				ax = cx; az = cz;
+			}
+			else
+			{
+				ax = bx; az = bz;
+				bx = cx; bz = cz;
+			}
+			cx = mx; cz = mz;
+		}
+		mCoords[(size_t)i * 4 + 0] = (uint16_t)ax;
+		mCoords[(size_t)i * 4 + 1] = (uint16_t)az;
+		mCoords[(size_t)i * 4 + 2] = (uint16_t)bx;
+		mCoords[(size_t)i * 4 + 3] = (uint16_t)bz;
+	}
+}
+
+void TerrainRtin::ComputeErrors(const float* heights, float* errors) const
+{
+	const int n = mResolution + 1;
+	std::fill(errors, errors + (size_t)n * n, 0.f);
+	auto height = [heights, n](int x, int z) { return heights[(size_t)z * n + x]; };
+
+	// Finest triangles first, so children are final when their parent reads them
+	for (int i = (int)(mCoords.size() / 4) - 1; i >= 0; --i)
+	{
+		const int ax = mCoords[(size_t)i * 4 + 0], az = mCoords[(size_t)i * 4 + 1];
+		const int bx = mCoords[(size_t)i * 4 + 2], bz = mCoords[(size_t)i * 4 + 3];
+		const int mx = (ax + bx) >> 1, mz = (az + bz) >> 1;
+		const int cx = mx + mz - az, cz = mz + ax - mx;
+		float error;
+		if (i >= mParentTriangles)
+			// Hypotenuse of length 2: the midpoint is the only vertex off the triangle's corners
+			error = std::abs(height(mx, mz) - (height(ax, az) + height(bx, bz)) * 0.5f);
+		else
+		{
+			// Every vertex in the triangle against its plane, one row span at a time
+			const float ha = height(ax, az), hb = height(bx, bz), hc = height(cx, cz);
+			const float invDet = 1.f / (float)((bx - ax) * (cz - az) - (cx - ax) * (bz - az));
+			const float slopeX = ((hb - ha) * (float)(cz - az) - (hc - ha) * (float)(bz - az)) * invDet;
+			const float slopeZ = ((hc - ha) * (float)(bx - ax) - (hb - ha) * (float)(cx - ax)) * invDet;
+			// Edges are axis-aligned or diagonal, so each crosses a row at an integer x = u.x + (z - u.z) * step;
+			// the triangle lies right of the edge (side > 0) or left of it. Horizontal edges only bound z.
+			int edgeX[3], edgeZ[3], edgeStep[3], edgeSide[3];
+			const int corners[3][2] = { { ax, az }, { bx, bz }, { cx, cz } };
+			for (int e = 0; e < 3; ++e)
+			{
+				const int* u = corners[e];
+				const int* v = corners[(e + 1) % 3];
+				const int* w = corners[(e + 2) % 3];
+				edgeX[e] = u[0];
+				edgeZ[e] = u[1];
+				const int dx = v[0] - u[0], dz = v[1] - u[1];
+				edgeStep[e] = (dx == 0 || dz == 0) ? 0 : ((dx > 0) == (dz > 0) ? 1 : -1);
+				edgeSide[e] = v[1] == u[1] ? 0 : (w[0] - u[0]) - (w[1] - u[1]) * edgeStep[e];
+			}
+			const int minX = std::min(std::min(ax, bx), cx), maxX = std::max(std::max(ax, bx), cx);
+			const int minZ = std::min(std::min(az, bz), cz), maxZ = std::max(std::max(az, bz), cz);
+			error = 0.f;
+			for (int z = minZ; z <= maxZ; ++z)
+			{
+				int x0 = minX, x1 = maxX;
+				for (int e = 0; e < 3; ++e)
+				{
+					const int crossing = edgeX[e] + (z - edgeZ[e]) * edgeStep[e];
+					if (edgeSide[e] > 0)
+						x0 = std::max(x0, crossing);
+					else if (edgeSide[e] < 0)
+						x1 = std::min(x1, crossing);
+				}
+				const float plane = ha + slopeX * (float)(x0 - ax) + slopeZ * (float)(z - az);
+				const float* row = &heights[(size_t)z * n];
+				for (int x = x0; x <= x1; ++x)
+					error = std::max(error, std::abs(row[x] - (plane + slopeX * (float)(x - x0))));
+			}
+			// A split child forces its parent to split
+			const int leftIndex = ((az + cz) >> 1) * n + ((ax + cx) >> 1);
+			const int rightIndex = ((bz + cz) >> 1) * n + ((bx + cx) >> 1);
+			error = std::max({ error, errors[leftIndex], errors[rightIndex] });
+		}
+		// Both triangles sharing the hypotenuse split at this vertex: keep the larger error
+		float& middle = errors[(size_t)mz * n + mx];
+		middle = std::max(middle, error);
+	}
+}
+
+float TerrainRtin::Triangulate(const float* errors, float maxError, std::vector<uint16_t>& triangles) const
+{
+	const int n = mResolution + 1;
+	float errorLeft = 0.f;
+	auto process = [&](auto& self, int ax, int az, int bx, int bz, int cx, int cz) -> void {
+		const int mx = (ax + bx) >> 1, mz = (az + bz) >> 1;
+		if (std::abs(ax - cx) + std::abs(az - cz) > 1)
+		{
+			const float error = errors[(size_t)mz * n + mx];
+			if (maxError < 0.f || error > maxError)
+			{
+				self(self, cx, cz, ax, az, mx, mz);
+				self(self, bx, bz, cx, cz, mx, mz);
+				return;
+			}
+			errorLeft = std::max(errorLeft, error);
+		}
+		if (SignedArea2(ax, az, bx, bz, cx, cz) > 0)
+		{
+			std::swap(bx, cx);
+			std::swap(bz, cz);
+		}
+		triangles.push_back((uint16_t)(az * n + ax));
+		triangles.push_back((uint16_t)(bz * n + bx));
+		triangles.push_back((uint16_t)(cz * n + cx));
+	};
+	process(process, 0, 0, mResolution, mResolution, mResolution, 0);
+	process(process, mResolution, mResolution, 0, 0, 0, mResolution);
+	return errorLeft;
+}
+
+TerrainRtinStats BuildTerrainRtinMeshes(const TerrainHeightfield& heightfield, const std::vector<TerrainRtinTileDesc>& tiles,
+	int resolution, int threadCount, TerrainMeshSet& out)
+{
+	TerrainRtinStats stats;
+	const auto start = std::chrono::steady_clock::now();
+	const TerrainRtin rtin(resolution);
+	const int n = resolution + 1;
+
+	struct TileMesh
+	{
+		std::vector<TerrainMeshVertex> Vertices;
+		std::vector<uint16_t> Indices;
+		uint32_t SurfaceTriangles = 0;
+		float MaxError = 0.f;
+	};
+	std::vector<TileMesh> meshes(tiles.size());
+
+	const unsigned hardware = std::max(std::thread::hardware_concurrency(), 1u);
+	const int threads = std::clamp(threadCount > 0 ? threadCount : (int)hardware, 1, std::max((int)tiles.size(), 1));
+	std::atomic<size_t> next{ 0 };
+	auto work = [&]() {
+		std::vector<float> heights((size_t)n * n), errors((size_t)n * n);
+		std::vector<uint16_t> triangles;
+		std::vector<int> surfaceSlot((size_t)n * n, -1), skirtSlot((size_t)n * n, -1);
+		for (size_t t = next++; t < tiles.size(); t = next++)
+		{
+			const TerrainRtinTileDesc& desc = tiles[t];
+			for (int z = 0; z < n; ++z)
+			{
+				const float v = desc.V0 + (desc.V1 - desc.V0) * (float)z / (float)resolution;
+				for (int x = 0; x < n; ++x)
+				{
+					const float u = desc.U0 + (desc.U1 - desc.U0) * (float)x / (float)resolution;
+					heights[(size_t)z * n + x] = heightfield.Sample(u, v);
+				}
+			}
+			rtin.ComputeErrors(heights.data(), errors.data());
+			triangles.clear();
+			TileMesh& mesh = meshes[t];
+			mesh.MaxError = rtin.Triangulate(errors.data(), desc.MaxError, triangles);
+			mesh.SurfaceTriangles = (uint32_t)(triangles.size() / 3);
+
+			// Compact to the vertices used, in first-use order
+			auto surfaceVertex = [&](uint16_t grid) {
+				if (surfaceSlot[grid] < 0)
+				{
+					surfaceSlot[grid] = (int)mesh.Vertices.size();
+					mesh.Vertices.push_back({ (uint16_t)(grid % n), (uint16_t)(grid / n), 0.f });
+				}
+				return (uint16_t)surfaceSlot[grid];
+			};
+			auto skirtVertex = [&](uint16_t grid) {
+				if (skirtSlot[grid] < 0)
+				{
+					skirtSlot[grid] = (int)mesh.Vertices.size();
+					mesh.Vertices.push_back({ (uint16_t)(grid % n), (uint16_t)(grid / n), desc.SkirtDepth });
+				}
+				return (uint16_t)skirtSlot[grid];
+			};
+			for (uint16_t grid : triangles)
+				mesh.Indices.push_back(surfaceVertex(grid));
+			// Skirt: a wall below each border edge, wound against the edge so the surface folds over it
+			for (size_t i = 0; i < triangles.size(); i += 3)
+				for (int e = 0; e < 3; ++e)
+				{
+					const uint16_t p = triangles[i + e], q = triangles[i + (e + 1) % 3];
+					if (!OnSameBorder(resolution, p % n, p / n, q % n, q / n))
+						continue;
+					const uint16_t sp = surfaceVertex(p), sq = surfaceVertex(q);
+					const uint16_t dp = skirtVertex(p), dq = skirtVertex(q);
+					mesh.Indices.insert(mesh.Indices.end(), { sq, sp, dp, dq, sq, dp });
+				}
+			for (const TerrainMeshVertex& vertex : mesh.Vertices)
+			{
+				surfaceSlot[(size_t)vertex.Z * n + vertex.X] = -1;
+				skirtSlot[(size_t)vertex.Z * n + vertex.X] = -1;
+			}
+		}
+	};
+	std::vector<std::thread> workers;
+	for (int t = 1; t < threads; ++t)
+		workers.emplace_back(work);
+	work();
+	for (std::thread& worker : workers)
+		worker.join();
+
+	out.Resolution = resolution;
+	out.Vertices.clear();
+	out.Indices.clear();
+	out.Ranges.resize(tiles.size());
+	for (size_t t = 0; t < meshes.size(); ++t)
+	{
+		TerrainMeshRange& range = out.Ranges[t];
+		range.BaseVertex = (uint32_t)out.Vertices.size();
+		range.VertexCount = (uint32_t)meshes[t].Vertices.size();
+		range.StartIndex = (uint32_t)out.Indices.size();
+		range.IndexCount = (uint32_t)meshes[t].Indices.size();
+		range.SurfaceTriangles = meshes[t].SurfaceTriangles;
+		range.MaxError = meshes[t].MaxError;
+		out.Vertices.insert(out.Vertices.end(), meshes[t].Vertices.begin(), meshes[t].Vertices.end());
+		out.Indices.insert(out.Indices.end(), meshes[t].Indices.begin(), meshes[t].Indices.end());
+		stats.SurfaceTriangles += range.SurfaceTriangles;
+		stats.SkirtTriangles += range.IndexCount / 3 - range.SurfaceTriangles;
+	}
+
+	stats.Tiles = (int)tiles.size();
+	stats.Threads = threads;
+	stats.Vertices = out.Vertices.size();
+	stats.UniformTriangles = (uint64_t)tiles.size() * resolution * resolution * 2;
+	stats.Reduction = stats.SurfaceTriangles > 0 ? (double)stats.UniformTriangles / (double)stats.SurfaceTriangles : 0.0;
+	stats.BuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+namespace
+{
+	// Surface triangles over grid vertices: grid winding, exact cover, edges shared by two triangles
+	// in opposite directions except on the border (a T-junction leaves an unmatched interior edge)
+	bool CheckTriangulation(int res, const std::vector<uint16_t>& triangles, std::string& reason)
+	{
+		const int n = res + 1;
+		long long area = 0;
+		std::map<std::pair<int, int>, int> edges; // directed edge -> uses
+		for (size_t i = 0; i < triangles.size(); i += 3)
+		{
+			const int a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+			const int doubled = SignedArea2(a % n, a / n, b % n, b / n, c % n, c / n);
+			if (doubled >= 0)
+			{
+				reason = "triangle not wound like the tile grid";
+				return false;
+			}
+			area -= doubled;
+			++edges[{ a, b }];
+			++edges[{ b, c }];
+			++edges[{ c, a }];
+		}
+		if (area != 2LL * res * res)
+		{
+			reason = "triangles do not cover the tile exactly once";
+			return false;
+		}
+		for (const auto& edge : edges)
+		{
+			const int p = edge.first.first, q = edge.first.second;
+			const bool reverse = edges.count({ q, p }) > 0;
+			if (edge.second != 1 || reverse == OnSameBorder(res, p % n, p / n, q % n, q / n))
+			{
+				reason = "unmatched interior edge (T-junction) or shared border edge";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Largest distance between the grid heights and the mesh's piecewise-linear surface
+	float MeshError(int res, const float* heights, const std::vector<uint16_t>& triangles)
+	{
+		const int n = res + 1;
+		float worst = 0.f;
+		for (int z = 0; z < n; ++z)
+			for (int x = 0; x < n; ++x)
+				for (size_t i = 0; i < triangles.size(); i += 3)
+				{
+					const int a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+					const int area = SignedArea2(a % n, a / n, b % n, b / n, c % n, c / n);
+					const int wa = SignedArea2(b % n, b / n, c % n, c / n, x, z);
+					const int wb = SignedArea2(c % n, c / n, a % n, a / n, x, z);
+					const int wc = area - wa - wb;
+					if (wa > 0 || wb > 0 || wc > 0)
+						continue;
+					const float plane = ((float)wa * heights[a] + (float)wb * heights[b] + (float)wc * heights[c]) / (float)area;
+					worst = std::max(worst, std::abs(heights[(size_t)z * n + x] - plane));
+					break;
+				}
+		return worst;
+	}
+}
+
+bool ValidateTerrainRtin(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	const int res = 16, n = res + 1;
+	const TerrainRtin rtin(res);
+	std::vector<float> heights((size_t)n * n), errors((size_t)n * n);
+	for (int z = 0; z < n; ++z)
+		for (int x = 0; x < n; ++x)
+		{
+			// Smooth hill, a ridge along one diagonal and a flat corner
+			const float hill = 0.3f * std::exp(-((x - 5.f) * (x - 5.f) + (z - 9.f) * (z - 9.f)) / 18.f);
+			const float ridge = 0.1f * std::max(0.f, 1.f - std::abs((float)(x - z)) / 3.f);
+			heights[(size_t)z * n + x] = (x > 12 && z > 12) ? 0.2f : 0.2f + hill + ridge;
+		}
+	rtin.ComputeErrors(heights.data(), errors.data());
+
+	std::string reason;
+	size_t previous = 0;
+	for (float bound : { 1e9f, 0.05f, 0.01f, 0.001f, 0.f, -1.f })
+	{
+		std::vector<uint16_t> triangles;
+		const float left = rtin.Triangulate(errors.data(), bound, triangles);
+		if (!CheckTriangulation(res, triangles, reason))
+			return fail(reason + " (bound " + std::to_string(bound) + ")");
+		if (bound >= 0.f && (left > bound || MeshError(res, heights.data(), triangles) > bound + 1e-6f))
+			return fail("mesh exceeds its error bound " + std::to_string(bound));
+		if (triangles.size() < previous)
+			return fail("a tighter bound gave fewer triangles");
+		previous = triangles.size();
+		if (bound == 1e9f && triangles.size() != 6)
+			return fail("an unbounded error does not give two triangles");
+		if (bound < 0.f && triangles.size() != (size_t)res * res * 6)
+			return fail("a negative bound does not give the full grid");
+	}
+
+	// Skirted meshes through the builder: flat tile collapses, sloped tiles get closed walls
+	TerrainHeightfield field;
+	field.Width = 37;
+	field.Height = 29;
+	for (int z = 0; z < field.Height; ++z)
+		for (int x = 0; x < field.Width; ++x)
+			field.Heights.push_back(x < 10 ? 0.5f : 0.5f + 0.3f * std::sin(x * 0.4f) * std::cos(z * 0.3f));
+	std::vector<TerrainRtinTileDesc> tiles = {
+		{ 0.f, 0.f, 0.2f, 0.2f, 0.f, 0.01f },   // flat strip
+		{ 0.f, 0.f, 1.f, 1.f, 0.02f, 0.05f },
+		{ 0.5f, 0.25f, 0.75f, 0.5f, 0.005f, 0.02f },
+		{ 0.5f, 0.5f, 1.f, 1.f, -1.f, 0.1f },
+	};
+	TerrainMeshSet single, parallel;
+	const TerrainRtinStats stats = BuildTerrainRtinMeshes(field, tiles, res, 1, single);
+	BuildTerrainRtinMeshes(field, tiles, res, 3, parallel);
+	if (single.Indices != parallel.Indices || single.Vertices.size() != parallel.Vertices.size())
+		return fail("meshes depend on the thread count");
+	if (single.Ranges[0].SurfaceTriangles != 2 || single.Ranges[3].SurfaceTriangles != (uint32_t)res * res * 2)
+		return fail("flat tile or full-grid tile has the wrong triangle count");
+	if (stats.UniformTriangles != (uint64_t)tiles.size() * res * res * 2 || stats.Reduction <= 1.0)
+		return fail("stats do not report a reduction");
+
+	for (size_t t = 0; t < tiles.size(); ++t)
+	{
+		const TerrainMeshRange& range = single.Ranges[t];
+		const TerrainMeshVertex* vertices = &single.Vertices[range.BaseVertex];
+		std::map<std::pair<int, int>, int> edges;
+		for (uint32_t i = 0; i < range.IndexCount; i += 3)
+		{
+			const uint16_t* tri = &single.Indices[range.StartIndex + i];
+			if (tri[0] >= range.VertexCount || tri[1] >= range.VertexCount || tri[2] >= range.VertexCount)
+				return fail("mesh index outside its tile's vertex range");
+			for (int e = 0; e < 3; ++e)
+				++edges[{ tri[e], tri[(e + 1) % 3] }];
+		}
+		// Surface + skirt is a consistently wound sheet whose only open edges are the skirt's bottom
+		for (const auto& edge : edges)
+		{
+			const int p = edge.first.first, q = edge.first.second;
+			const bool reverse = edges.count({ q, p }) > 0;
+			const bool bottom = vertices[p].Drop > 0.f && vertices[q].Drop > 0.f && (vertices[p].X == vertices[q].X ||
+				vertices[p].Z == vertices[q].Z);
+			if (edge.second != 1 || reverse == bottom)
+				return fail("skirt leaves an open edge or breaks the winding");
+		}
+		for (uint32_t v = 0; v < range.VertexCount; ++v)
+			if (vertices[v].Drop != 0.f && vertices[v].Drop != tiles[t].SkirtDepth)
+				return fail("skirt vertex at the wrong depth");
+	}
+	return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "TerrainHeightmap.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Right-triangulated irregular network over a tile grid of resolution^2 quads (resolution a power of
+// two, vertices laid out like the shared tile grid: row 0 = v = 0, column 0 = u = 0). Triangles are
+// right isosceles and split at the midpoint of their hypotenuse. A vertex's error is the largest
+// vertical distance between the heights and the plane of any triangle split at it, including every
+// triangle below, so the kept triangles stay within the bound and the mesh has no T-junctions.
+class TerrainRtin
+{
+public:
+	explicit TerrainRtin(int resolution);
+	int GetResolution() const { return mResolution; }
+
+	// heights and errors hold (resolution + 1)^2 values
+	void ComputeErrors(const float* heights, float* errors) const;
+	// Grid-vertex triangles (3 indices each, the tile grid's winding) of the mesh within maxError;
+	// a negative maxError gives the full grid. Returns the largest error left in the kept triangles.
+	float Triangulate(const float* errors, float maxError, std::vector<uint16_t>& triangles) const;
+
+private:
+	int mResolution;
+	int mParentTriangles;        // triangles with children that split again
+	std::vector<uint16_t> mCoords; // a.x, a.z, b.x, b.z of every triangle whose hypotenuse midpoint is a vertex
+};
+
+// One vertex of an adaptive tile mesh: grid position and how far below the surface it sits
+// (0 on the surface, the tile's skirt depth on the skirt, in normalized height units)
+struct TerrainMeshVertex
+{
+	uint16_t X = 0;
+	uint16_t Z = 0;
+	float Drop = 0.f;
+};
+
+struct TerrainMeshRange
+{
+	uint32_t BaseVertex = 0;
+	uint32_t VertexCount = 0;
+	uint32_t StartIndex = 0;  // 16-bit indices relative to BaseVertex
+	uint32_t IndexCount = 0;  // surface and skirt
+	uint32_t SurfaceTriangles = 0;
+	float MaxError = 0.f;     // largest vertex error left in the mesh, normalized height
+};
+
+// All tiles' meshes in one vertex and index array, one range per tile
+struct TerrainMeshSet
+{
+	int Resolution = 0;
+	std::vector<TerrainMeshVertex> Vertices;
+	std::vector<uint16_t> Indices;
+	std::vector<TerrainMeshRange> Ranges;
+};
+
+struct TerrainRtinTileDesc
+{
+	float U0 = 0.f, V0 = 0.f, U1 = 1.f, V1 = 1.f; // heightfield UV rectangle of the tile
+	float MaxError = 0.f;  // normalized height; negative = full grid
+	float SkirtDepth = 0.f; // normalized height the border skirt hangs below the edge
+};
+
+struct TerrainRtinStats
+{
+	int Tiles = 0;
+	int Threads = 0;
+	uint64_t Vertices = 0;
+	uint64_t SurfaceTriangles = 0;
+	uint64_t SkirtTriangles = 0;
+	uint64_t UniformTriangles = 0; // the same tiles drawn with the uniform resolution^2 grid
+	double Reduction = 0.0;        // UniformTriangles / SurfaceTriangles
+	double BuildMs = 0.0;
+};
+
+// Sample each tile's heights from the heightfield, triangulate within its bound and add a skirt
+// below every border edge (so neighbours with different meshes or LODs leave no visible cracks).
+// Tiles are spread over worker threads and concatenated in order.
+TerrainRtinStats BuildTerrainRtinMeshes(const TerrainHeightfield& heightfield, const std::vector<TerrainRtinTileDesc>& tiles,
+	int resolution, int threadCount, TerrainMeshSet& out);
+
+// CPU check on generated heights: meshes cover the tile exactly once with the grid's winding and
+// no T-junctions, every grid height is within the bound of the mesh, flat tiles reduce to two
+// triangles, a negative bound gives the full grid and skirts close every border edge with
+// consistently wound walls. Returns false with a reason on failure.
+bool ValidateTerrainRtin(std::string* error = nullptr);
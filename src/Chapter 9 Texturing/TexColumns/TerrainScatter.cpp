@@ -0,0 +1,559 @@
+#include "TerrainScatter.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+using namespace DirectX;
+
+namespace
+{
+	// Side of the periodic Poisson tile in units of the spacing: big enough that its repetition
+	// does not read as a pattern (~2500 points, built in ~15 ms)
+	constexpr float kScatterTileRadii = 64.f;
+	// Trees per spacing^2 a Bridson tile ends up with (measured over seeds: 0.61)
+	constexpr float kPoissonDensity = 0.61f;
+	// Candidates tried around an active point before it is retired (Bridson's k)
+	constexpr int kPoissonAttempts = 30;
+	// Culling cells per side at most; the spacing is clamped so a square holds at most ~16M candidates
+	constexpr int kScatterMaxCellsPerSide = 1024;
+	constexpr float kScatterMaxRadiiPerSide = 4096.f;
+
+	struct ScatterRandom
+	{
+		uint32_t State = 12345u;
+		float Next() // [0, 1)
+		{
+			State = State * 1664525u + 1013904223u;
+			return (float)(State >> 8) * (1.f / 16777216.f);
+		}
+		float Range(float lo, float hi) { return lo + (hi - lo) * Next(); }
+	};
+
+	uint32_t ScatterHash(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	float HashUnit(uint32_t h) { return (float)(h >> 8) * (1.f / 16777216.f); }
+
+	// Bridson's algorithm on a torus of side kScatterTileRadii with unit spacing: distances wrap
+	// around, so copies of the tile placed side by side keep the spacing across their seams.
+	// Returns interleaved (u, v) in [0, side).
+	std::vector<float> BuildPoissonTile(uint32_t seed)
+	{
+		const float side = kScatterTileRadii;
+		// Cells no wider than 1/sqrt(2) hold at most one point; a point's neighbours within 1 lie
+		// at most 2 cells away
+		const int cells = (int)std::ceil(side * std::sqrt(2.f));
+		const float cellSize = side / (float)cells;
+		std::vector<int> grid((size_t)cells * cells, -1);
+		std::vector<float> points;
+		std::vector<int> active;
+		ScatterRandom random;
+		random.State = ScatterHash(seed) | 1u;
+
+		auto wrap = [side](float a) {
+			a = std::fmod(a, side);
+			if (a < 0.f) a += side;
+			return a >= side ? 0.f : a;
+		};
+		auto cellOf = [cells, cellSize](float a) { return std::min((int)(a / cellSize), cells - 1); };
+		auto fits = [&](float u, float v) {
+			const int cx = cellOf(u), cz = cellOf(v);
+			for (int dz = -2; dz <= 2; ++dz)
+				for (int dx = -2; dx <= 2; ++dx)
+				{
+					const int gx = (cx + dx + cells) % cells, gz = (cz + dz + cells) % cells;
+					const int other = grid[(size_t)gz * cells + gx];
+					if (other < 0)
+						continue;
+					float du = std::abs(points[2 * other] - u), dv = std::abs(points[2 * other + 1] - v);
+					du = std::min(du, side - du);
+					dv = std::min(dv, side - dv);
+					if (du * du + dv * dv < 1.f)
+						return false;
+				}
+			return true;
+		};
+		auto add = [&](float u, float v) {
+			const int index = (int)(points.size() / 2);
+			points.push_back(u);
+			points.push_back(v);
+			grid[(size_t)cellOf(v) * cells + cellOf(u)] = index;
+			active.push_back(index);
+		};
+
+		add(random.Range(0.f, side), random.Range(0.f, side));
+		while (!active.empty())
+		{
+			const size_t slot = std::min((size_t)(random.Next() * active.size()), active.size() - 1);
+			const float u0 = points[2 * active[slot]], v0 = points[2 * active[slot] + 1];
+			bool placed = false;
+			for (int attempt = 0; attempt < kPoissonAttempts && !placed; ++attempt)
+			{
+				// Uniform over the annulus [1, 2) around the active point
+				const float angle = random.Range(0.f, XM_2PI);
+				const float radius = std::sqrt(random.Range(1.f, 4.f));
+				const float u = wrap(u0 + radius * std::cos(angle)), v = wrap(v0 + radius * std::sin(angle));
+				if (fits(u, v))
+				{
+					add(u, v);
+					placed = true;
+				}
+			}
+			if (!placed)
+			{
+				active[slot] = active.back();
+				active.pop_back();
+			}
+		}
+		return points;
+	}
+
+	uint32_t Part1By1(uint32_t x)
+	{
+		x &= 0x0000ffffu;
+		x = (x | (x << 8)) & 0x00ff00ffu;
+		x = (x | (x << 4)) & 0x0f0f0f0fu;
+		x = (x | (x << 2)) & 0x33333333u;
+		x = (x | (x << 1)) & 0x55555555u;
+		return x;
+	}
+
+	bool CellInFrustum(const TerrainFrustum& frustum, const TerrainVegetationCell& cell)
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			if (!(frustum.PlaneMask & (1u << i)))
+				continue;
+			const float d = frustum.Nx[i] * cell.Center[0] + frustum.Ny[i] * cell.Center[1] + frustum.Nz[i] * cell.Center[2] + frustum.D[i];
+			const float r = frustum.AbsNx[i] * cell.Extent[0] + frustum.AbsNy[i] * cell.Extent[1] + frustum.AbsNz[i] * cell.Extent[2];
+			if (d + r < 0.f)
+				return false;
+		}
+		return true;
+	}
+
+	double MsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+float TerrainScatterSpacingForCount(float worldSize, size_t count)
+{
+	return worldSize * std::sqrt(kPoissonDensity / (float)std::max<size_t>(count, 1));
+}
+
+void TerrainVegetation::Clear()
+{
+	mInstances.clear();
+	mCells.clear();
+	mCandidates = 0;
+	++mVersion;
+}
+
+void TerrainVegetation::Scatter(const TerrainHeightQuery& query, float worldSize, float originY, float heightScale,
+	const TerrainScatterSettings& settings)
+{
+	const auto start = std::chrono::steady_clock::now();
+	Clear();
+	mSettings = settings;
+	if (worldSize <= 0.f)
+		return;
+	const float spacing = std::max(settings.Spacing, worldSize / kScatterMaxRadiiPerSide);
+	const float half = 0.5f * worldSize;
+
+	// Stamp the tile across the square from its -X/-Z corner; each copy's points get their own hash.
+	// The tile only depends on the seed, so rescattering at another spacing reuses it.
+	if (mTile.empty() || mTileSeed != settings.Seed)
+	{
+		mTile = BuildPoissonTile(settings.Seed);
+		mTileSeed = settings.Seed;
+	}
+	const std::vector<float>& tile = mTile;
+	const size_t tilePoints = tile.size() / 2;
+	const float tileSize = kScatterTileRadii * spacing;
+	const int tiles = std::max(1, (int)std::ceil(worldSize / tileSize));
+	std::vector<float> x, z;
+	std::vector<uint32_t> hashes;
+	const size_t expected = (size_t)((double)kPoissonDensity * (worldSize / spacing) * (worldSize / spacing) * 1.05) + 16;
+	x.reserve(expected);
+	z.reserve(expected);
+	hashes.reserve(expected);
+	const uint32_t seedHash = ScatterHash(settings.Seed * 0x9e3779b9u + 1u);
+	for (int tz = 0; tz < tiles; ++tz)
+		for (int tx = 0; tx < tiles; ++tx)
+		{
+			const uint32_t tileHash = ScatterHash(seedHash ^ ScatterHash((uint32_t)tz * (uint32_t)tiles + (uint32_t)tx));
+			for (size_t i = 0; i < tilePoints; ++i)
+			{
+				const float px = -half + ((float)tx * kScatterTileRadii + tile[2 * i]) * spacing;
+				const float pz = -half + ((float)tz * kScatterTileRadii + tile[2 * i + 1]) * spacing;
+				if (px >= half || pz >= half)
+					continue;
+				x.push_back(px);
+				z.push_back(pz);
+				hashes.push_back(ScatterHash(tileHash + (uint32_t)i));
+			}
+		}
+	mCandidates = x.size();
+
+	// Ground under every candidate through the batched queries
+	const size_t count = x.size();
+	std::vector<float> y(count), nx(count), ny(count), nz(count);
+	query.SampleHeights(x.data(), z.data(), y.data(), count);
+	query.SampleNormals(x.data(), z.data(), nx.data(), ny.data(), nz.data(), count);
+
+	const float minNormalY = std::cos(std::clamp(settings.MaxSlopeDegrees, 0.f, 90.f) * (XM_PI / 180.f));
+	const float invHeightScale = heightScale != 0.f ? 1.f / heightScale : 0.f;
+	std::vector<TerrainVegetationInstance> placed;
+	placed.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float band = (y[i] - originY) * invHeightScale;
+		if (ny[i] < minNormalY || band < settings.MinHeight || band > settings.MaxHeight)
+			continue;
+		const uint32_t h = hashes[i];
+		TerrainVegetationInstance inst;
+		inst.Position[0] = x[i];
+		inst.Position[1] = y[i];
+		inst.Position[2] = z[i];
+		inst.Variant = h % kTerrainVegetationVariants;
+		inst.Height = settings.MinSize + (settings.MaxSize - settings.MinSize) * HashUnit(ScatterHash(h));
+		inst.Width = inst.Height * kTerrainVegetationAspect[inst.Variant];
+		placed.push_back(inst);
+	}
+
+	// Counting sort into the cells, cells ranked in Morton order
+	const int cellsPerSide = std::clamp((int)std::ceil(worldSize / std::max(settings.CellSize, 1e-3f)), 1, kScatterMaxCellsPerSide);
+	const size_t cellCount = (size_t)cellsPerSide * cellsPerSide;
+	std::vector<uint32_t> order(cellCount);
+	for (uint32_t c = 0; c < (uint32_t)cellCount; ++c)
+		order[c] = c;
+	auto morton = [cellsPerSide](uint32_t c) { return Part1By1(c % (uint32_t)cellsPerSide) | (Part1By1(c / (uint32_t)cellsPerSide) << 1); };
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return morton(a) < morton(b); });
+	std::vector<uint32_t> rank(cellCount);
+	for (uint32_t r = 0; r < (uint32_t)cellCount; ++r)
+		rank[order[r]] = r;
+
+	const float toCell = (float)cellsPerSide / worldSize;
+	auto cellOf = [&](const TerrainVegetationInstance& inst) {
+		const int cx = std::clamp((int)((inst.Position[0] + half) * toCell), 0, cellsPerSide - 1);
+		const int cz = std::clamp((int)((inst.Position[2] + half) * toCell), 0, cellsPerSide - 1);
+		return rank[(size_t)cz * cellsPerSide + cx];
+	};
+	std::vector<uint32_t> first(cellCount + 1, 0);
+	for (const TerrainVegetationInstance& inst : placed)
+		++first[cellOf(inst) + 1];
+	for (size_t c = 0; c < cellCount; ++c)
+		first[c + 1] += first[c];
+	mInstances.resize(placed.size());
+	{
+		std::vector<uint32_t> next(first.begin(), first.end() - 1);
+		for (const TerrainVegetationInstance& inst : placed)
+			mInstances[next[cellOf(inst)]++] = inst;
+	}
+
+	// Only cells with trees are kept; a billboard turns about its base, so it spans Width / 2 around it
+	for (size_t c = 0; c < cellCount; ++c)
+	{
+		if (first[c + 1] == first[c])
+			continue;
+		float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (uint32_t i = first[c]; i < first[c + 1]; ++i)
+		{
+			const TerrainVegetationInstance& inst = mInstances[i];
+			const float r = 0.5f * inst.Width;
+			lo[0] = std::min(lo[0], inst.Position[0] - r);
+			hi[0] = std::max(hi[0], inst.Position[0] + r);
+			lo[1] = std::min(lo[1], inst.Position[1]);
+			hi[1] = std::max(hi[1], inst.Position[1] + inst.Height);
+			lo[2] = std::min(lo[2], inst.Position[2] - r);
+			hi[2] = std::max(hi[2], inst.Position[2] + r);
+		}
+		TerrainVegetationCell cell;
+		for (int k = 0; k < 3; ++k)
+		{
+			cell.Center[k] = 0.5f * (lo[k] + hi[k]);
+			cell.Extent[k] = 0.5f * (hi[k] - lo[k]);
+		}
+		cell.First = first[c];
+		cell.Count = first[c + 1] - first[c];
+		mCells.push_back(cell);
+	}
+	mScatterMs = MsSince(start);
+}
+
+uint32_t TerrainVegetation::Cull(const TerrainFrustum& frustum, const XMFLOAT3& eyePos, float maxDistance,
+	std::vector<TerrainVegetationRange>& draws, TerrainVegetationCullStats* stats) const
+{
+	const auto start = std::chrono::steady_clock::now();
+	draws.clear();
+	const float maxDistanceSq = maxDistance > 0.f ? maxDistance * maxDistance : std::numeric_limits<float>::infinity();
+	const float eye[3] = { eyePos.x, eyePos.y, eyePos.z };
+	uint32_t instances = 0, cellsVisible = 0;
+	for (const TerrainVegetationCell& cell : mCells)
+	{
+		float distanceSq = 0.f;
+		for (int k = 0; k < 3; ++k)
+		{
+			const float d = std::max(std::abs(eye[k] - cell.Center[k]) - cell.Extent[k], 0.f);
+			distanceSq += d * d;
+		}
+		if (distanceSq > maxDistanceSq || !CellInFrustum(frustum, cell))
+			continue;
+		// Cells are stored back to back, so a range ending where this cell starts was the previous cell
+		if (!draws.empty() && draws.back().First + draws.back().Count == cell.First)
+			draws.back().Count += cell.Count;
+		else
+			draws.push_back({ cell.First, cell.Count });
+		instances += cell.Count;
+		++cellsVisible;
+	}
+	if (stats)
+	{
+		stats->CellsVisible = cellsVisible;
+		stats->Instances = instances;
+		stats->Draws = (uint32_t)draws.size();
+		stats->CullMs = MsSince(start);
+	}
+	return instances;
+}
+
+void BenchmarkTerrainScatter(const TerrainHeightQuery& query, float worldSize, float originY, float heightScale,
+	const XMFLOAT4X4& viewProj, const XMFLOAT3& eyePos, float maxDistance, const size_t* targets,
+	int count, int repeats, TerrainScatterBenchmark* results)
+{
+	TerrainFrustum frustum;
+	frustum.Extract(viewProj);
+	repeats = std::max(repeats, 1);
+	TerrainVegetation vegetation;
+	std::vector<TerrainVegetationRange> draws;
+	for (int t = 0; t < count; ++t)
+	{
+		TerrainScatterSettings settings;
+		settings.Spacing = TerrainScatterSpacingForCount(worldSize, targets[t]);
+		settings.MaxSlopeDegrees = 90.f;
+		settings.MinHeight = -std::numeric_limits<float>::infinity();
+		settings.MaxHeight = std::numeric_limits<float>::infinity();
+		vegetation.Scatter(query, worldSize, originY, heightScale, settings);
+
+		TerrainScatterBenchmark& result = results[t];
+		result = TerrainScatterBenchmark{};
+		result.Target = targets[t];
+		result.Instances = vegetation.GetInstances().size();
+		result.Cells = vegetation.GetCells().size();
+		result.ScatterMs = vegetation.GetScatterMs();
+		TerrainVegetationCullStats stats;
+		const auto start = std::chrono::steady_clock::now();
+		for (int r = 0; r < repeats; ++r)
+			vegetation.Cull(frustum, eyePos, maxDistance, draws, &stats);
+		result.CullMs = MsSince(start) / repeats;
+		result.VisibleInstances = stats.Instances;
+		result.Draws = stats.Draws;
+	}
+}
+
+bool ValidateTerrainScatter(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	// Hills with steep flanks, odd sizes on purpose; the square spans several Poisson tiles
+	TerrainHeightfield hf;
+	hf.Width = 97;
+	hf.Height = 61;
+	hf.Heights.resize((size_t)hf.Width * hf.Height);
+	for (int z = 0; z < hf.Height; ++z)
+		for (int x = 0; x < hf.Width; ++x)
+			hf.Heights[(size_t)z * hf.Width + x] = std::clamp(0.45f + 0.3f * std::sin(0.23f * x) * std::cos(0.19f * z) +
+				0.2f * std::exp(-0.02f * (float)((x - 60) * (x - 60))), 0.f, 1.f);
+	const float worldSize = 80.f, originY = -3.f, heightScale = 12.f;
+	TerrainHeightQuery query;
+	query.Build(&hf);
+	query.SetPlacement(worldSize, originY, heightScale);
+	const float half = 0.5f * worldSize;
+
+	// Closest pair by a sweep along x
+	auto checkSpacing = [](const std::vector<TerrainVegetationInstance>& instances, float spacing) {
+		std::vector<const TerrainVegetationInstance*> sorted;
+		for (const TerrainVegetationInstance& inst : instances)
+			sorted.push_back(&inst);
+		std::sort(sorted.begin(), sorted.end(), [](auto* a, auto* b) { return a->Position[0] < b->Position[0]; });
+		const float minSq = spacing * spacing * (1.f - 1e-4f);
+		for (size_t i = 0; i < sorted.size(); ++i)
+			for (size_t j = i + 1; j < sorted.size() && sorted[j]->Position[0] - sorted[i]->Position[0] < spacing; ++j)
+			{
+				const float dx = sorted[j]->Position[0] - sorted[i]->Position[0];
+				const float dz = sorted[j]->Position[2] - sorted[i]->Position[2];
+				if (dx * dx + dz * dz < minSq)
+					return false;
+			}
+		return true;
+	};
+
+	// Every filter open: the whole Poisson set, at its full density
+	TerrainScatterSettings settings;
+	settings.Spacing = 0.5f; // tile side 32 < 80: seams inside the square
+	settings.Seed = 7;
+	settings.MaxSlopeDegrees = 90.f;
+	settings.MinHeight = -1e30f;
+	settings.MaxHeight = 1e30f;
+	settings.CellSize = 6.f;
+	TerrainVegetation vegetation;
+	vegetation.Scatter(query, worldSize, originY, heightScale, settings);
+	const std::vector<TerrainVegetationInstance>& all = vegetation.GetInstances();
+	if (all.size() != vegetation.GetCandidates())
+		return fail("open filters dropped trees");
+	const float expected = worldSize * worldSize / (settings.Spacing * settings.Spacing) * kPoissonDensity;
+	if ((float)all.size() < 0.9f * expected || (float)all.size() > 1.1f * expected)
+		return fail("tree count far from the Poisson density");
+	if (!checkSpacing(all, settings.Spacing))
+		return fail("two trees closer than the spacing");
+
+	TerrainVegetation again;
+	again.Scatter(query, worldSize, originY, heightScale, settings);
+	if (again.GetInstances().size() != all.size() ||
+		!std::equal(all.begin(), all.end(), again.GetInstances().begin(), [](const auto& a, const auto& b) {
+			return a.Position[0] == b.Position[0] && a.Position[2] == b.Position[2] && a.Variant == b.Variant && a.Height == b.Height; }))
+		return fail("same seed scattered differently");
+
+	// Filtered: every tree on allowed ground, sized and shaped as its variant says
+	settings.Spacing = 0.9f;
+	settings.MaxSlopeDegrees = 35.f;
+	settings.MinHeight = 0.2f;
+	settings.MaxHeight = 0.8f;
+	vegetation.Scatter(query, worldSize, originY, heightScale, settings);
+	const std::vector<TerrainVegetationInstance>& trees = vegetation.GetInstances();
+	if (trees.empty() || trees.size() >= vegetation.GetCandidates())
+		return fail("filters kept all or none of the candidates");
+	if (!checkSpacing(trees, settings.Spacing))
+		return fail("two filtered trees closer than the spacing");
+	const float minNormalY = std::cos(settings.MaxSlopeDegrees * (XM_PI / 180.f));
+	for (const TerrainVegetationInstance& inst : trees)
+	{
+		if (inst.Position[0] < -half || inst.Position[0] >= half || inst.Position[2] < -half || inst.Position[2] >= half)
+			return fail("tree outside the square");
+		if (std::abs(inst.Position[1] - query.SampleHeight(inst.Position[0], inst.Position[2])) > 1e-4f * heightScale)
+			return fail("tree not on the ground");
+		float normal[3];
+		query.SampleNormal(inst.Position[0], inst.Position[2], normal);
+		const float band = (inst.Position[1] - originY) / heightScale;
+		if (normal[1] < minNormalY - 1e-4f || band < settings.MinHeight - 1e-4f || band > settings.MaxHeight + 1e-4f)
+			return fail("tree on too steep ground or outside the height band");
+		if (inst.Variant >= (uint32_t)kTerrainVegetationVariants || inst.Height < settings.MinSize || inst.Height > settings.MaxSize ||
+			std::abs(inst.Width - inst.Height * kTerrainVegetationAspect[inst.Variant]) > 1e-5f)
+			return fail("tree variant or size out of range");
+	}
+
+	// Cells partition the trees in order, each a cell-sized patch its bounds hold
+	const std::vector<TerrainVegetationCell>& cells = vegetation.GetCells();
+	uint32_t next = 0;
+	for (const TerrainVegetationCell& cell : cells)
+	{
+		if (cell.Count == 0 || cell.First != next)
+			return fail("cells do not cover the trees back to back");
+		next += cell.Count;
+		float lo[2] = { FLT_MAX, FLT_MAX }, hi[2] = { -FLT_MAX, -FLT_MAX };
+		for (uint32_t i = cell.First; i < cell.First + cell.Count; ++i)
+		{
+			const TerrainVegetationInstance& inst = trees[i];
+			const float r = 0.5f * inst.Width;
+			const float boxLo[3] = { inst.Position[0] - r, inst.Position[1], inst.Position[2] - r };
+			const float boxHi[3] = { inst.Position[0] + r, inst.Position[1] + inst.Height, inst.Position[2] + r };
+			for (int k = 0; k < 3; ++k)
+				if (boxLo[k] < cell.Center[k] - cell.Extent[k] - 1e-4f || boxHi[k] > cell.Center[k] + cell.Extent[k] + 1e-4f)
+					return fail("tree outside its cell's bounds");
+			lo[0] = std::min(lo[0], inst.Position[0]); hi[0] = std::max(hi[0], inst.Position[0]);
+			lo[1] = std::min(lo[1], inst.Position[2]); hi[1] = std::max(hi[1], inst.Position[2]);
+		}
+		if (hi[0] - lo[0] > settings.CellSize + 1e-3f || hi[1] - lo[1] > settings.CellSize + 1e-3f)
+			return fail("cell holds trees from more than one grid cell");
+	}
+	if (next != trees.size())
+		return fail("cells do not cover the trees back to back");
+
+	// Culling keeps exactly the cells no clip plane separates from the camera (all 8 corners outside
+	// it in clip space) within range, as ascending, disjoint and merged ranges
+	const XMFLOAT3 eye = { -30.f, 14.f, -25.f };
+	const float range = 40.f;
+	XMMATRIX view = XMMatrixLookAtLH(XMLoadFloat3(&eye), XMVectorSet(5.f, 0.f, 10.f, 1.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+	XMMATRIX viewProj = view * XMMatrixPerspectiveFovLH(0.9f, 1.6f, 0.5f, 300.f);
+	XMFLOAT4X4 viewProjT;
+	XMStoreFloat4x4(&viewProjT, XMMatrixTranspose(viewProj));
+	TerrainFrustum frustum;
+	frustum.Extract(viewProjT);
+	std::vector<TerrainVegetationRange> draws;
+	TerrainVegetationCullStats stats;
+	const uint32_t drawn = vegetation.Cull(frustum, eye, range, draws, &stats);
+	if (drawn == 0 || drawn == trees.size())
+		return fail("test view sees all or none of the trees");
+	std::vector<bool> inDraw(cells.size(), false);
+	uint32_t drawnTotal = 0;
+	for (size_t d = 0; d < draws.size(); ++d)
+	{
+		if (draws[d].Count == 0 || (d > 0 && draws[d - 1].First + draws[d - 1].Count >= draws[d].First))
+			return fail("draws empty, overlapping, out of order or left unmerged");
+		drawnTotal += draws[d].Count;
+		for (size_t c = 0; c < cells.size(); ++c)
+			if (cells[c].First >= draws[d].First && cells[c].First < draws[d].First + draws[d].Count)
+				inDraw[c] = true;
+	}
+	if (drawnTotal != drawn || stats.Instances != drawn || stats.Draws != draws.size())
+		return fail("cull stats do not match its draws");
+	for (size_t c = 0; c < cells.size(); ++c)
+	{
+		const TerrainVegetationCell& cell = cells[c];
+		float distanceSq = 0.f;
+		const float e[3] = { eye.x, eye.y, eye.z };
+		for (int k = 0; k < 3; ++k)
+		{
+			const float closest = std::clamp(e[k], cell.Center[k] - cell.Extent[k], cell.Center[k] + cell.Extent[k]);
+			distanceSq += (closest - e[k]) * (closest - e[k]);
+		}
+		int outside[6] = {};
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			const XMVECTOR p = XMVectorSet(cell.Center[0] + ((corner & 1) ? cell.Extent[0] : -cell.Extent[0]),
+				cell.Center[1] + ((corner & 2) ? cell.Extent[1] : -cell.Extent[1]),
+				cell.Center[2] + ((corner & 4) ? cell.Extent[2] : -cell.Extent[2]), 1.f);
+			XMFLOAT4 clip;
+			XMStoreFloat4(&clip, XMVector4Transform(p, viewProj));
+			outside[0] += clip.x < -clip.w;
+			outside[1] += clip.x > clip.w;
+			outside[2] += clip.y < -clip.w;
+			outside[3] += clip.y > clip.w;
+			outside[4] += clip.z < 0.f;
+			outside[5] += clip.z > clip.w;
+		}
+		// Leave cells within rounding of a plane or the range to either answer
+		bool separated = false, marginal = false;
+		for (int i = 0; i < 6; ++i)
+			separated |= outside[i] == 8;
+		const float distance = std::sqrt(distanceSq);
+		marginal = std::abs(distance - range) < 1e-3f;
+		const bool expected = !separated && distance <= range;
+		if (!marginal && inDraw[c] != expected)
+			return fail(expected ? "a visible cell was culled" : "a culled cell was drawn");
+	}
+
+	// From high above, looking down on the whole square, every tree is one draw
+	const XMFLOAT3 top = { 0.f, 400.f, 0.f };
+	view = XMMatrixLookAtLH(XMLoadFloat3(&top), XMVectorSet(0.f, 0.f, 0.f, 1.f), XMVectorSet(0.f, 0.f, 1.f, 0.f));
+	XMStoreFloat4x4(&viewProjT, XMMatrixTranspose(view * XMMatrixPerspectiveFovLH(0.9f, 1.f, 1.f, 1000.f)));
+	frustum.Extract(viewProjT);
+	if (vegetation.Cull(frustum, top, 0.f, draws) != trees.size() || draws.size() != 1)
+		return fail("a view of the whole square did not draw every tree in one range");
+	return true;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "Terrain.h"
+#include "TerrainQuery.h"
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Tree species: slices 0-2 of treeArray2, then the single tree01S, tree02S and tree35S textures
+constexpr int kTerrainVegetationVariants = 6;
+constexpr int kTerrainVegetationArraySlices = 3;
+// Billboard width over height of each variant (its texture's aspect)
+constexpr float kTerrainVegetationAspect[kTerrainVegetationVariants] = { 0.8125f, 0.8125f, 0.8125f, 0.8125f, 1.1343f, 0.6786f };
+
+struct TerrainScatterSettings
+{
+	float Spacing = 1.5f;          // smallest distance between two trees (world units)
+	uint32_t Seed = 1;
+	float MaxSlopeDegrees = 30.f;  // steeper ground stays bare
+	float MinHeight = 0.05f;       // band trees grow in, as a fraction of heightScale above originY
+	float MaxHeight = 0.7f;
+	float MinSize = 2.f;           // tree height range (world units)
+	float MaxSize = 4.f;
+	float CellSize = 8.f;          // side of a culling cell (world units)
+};
+
+// One tree (VegetationInstance in Vegetation.hlsl): a camera-facing billboard standing on Position
+struct TerrainVegetationInstance
+{
+	float Position[3];
+	float Width;
+	float Height;
+	uint32_t Variant;
+};
+static_assert(sizeof(TerrainVegetationInstance) == 24, "Must match VegetationInstance in Vegetation.hlsl");
+
+// Trees are stored cell by cell, cells in Morton order, so neighbouring visible cells merge into one draw
+struct TerrainVegetationCell
+{
+	float Center[3];
+	float Extent[3]; // bounds of its billboards whichever way they face
+	uint32_t First;
+	uint32_t Count;
+};
+
+struct TerrainVegetationRange
+{
+	uint32_t First;
+	uint32_t Count;
+};
+
+struct TerrainVegetationCullStats
+{
+	uint32_t CellsVisible = 0;
+	uint32_t Instances = 0;
+	uint32_t Draws = 0;
+	double CullMs = 0.0;
+};
+
+// Trees scattered over the quadtree terrain's [-worldSize/2, worldSize/2] square. Positions come from
+// a periodic Poisson-disk tile (Bridson's algorithm on a torus) stamped across the square, so the
+// spacing holds across tile seams and the cost is linear in the trees placed; species and size are
+// hashed per placed tree so the repetition does not show in them. Points on ground too steep or
+// outside the height band are dropped.
+class TerrainVegetation
+{
+public:
+	// Heights and normals from query, whose placement must match worldSize, originY and heightScale
+	void Scatter(const TerrainHeightQuery& query, float worldSize, float originY, float heightScale,
+		const TerrainScatterSettings& settings);
+	void Clear();
+
+	// Instance ranges of the cells in the frustum and within maxDistance of eyePos (<= 0 = no limit),
+	// neighbouring cells merged. Returns the instances drawn.
+	uint32_t Cull(const TerrainFrustum& frustum, const DirectX::XMFLOAT3& eyePos, float maxDistance,
+		std::vector<TerrainVegetationRange>& draws, TerrainVegetationCullStats* stats = nullptr) const;
+
+	const std::vector<TerrainVegetationInstance>& GetInstances() const { return mInstances; }
+	const std::vector<TerrainVegetationCell>& GetCells() const { return mCells; }
+	const TerrainScatterSettings& GetSettings() const { return mSettings; }
+	// Changes with every Scatter and Clear, for the app to know when to upload
+	uint32_t GetVersion() const { return mVersion; }
+	size_t GetCandidates() const { return mCandidates; } // Poisson points before the slope and height filters
+	double GetScatterMs() const { return mScatterMs; }
+
+private:
+	TerrainScatterSettings mSettings;
+	std::vector<TerrainVegetationInstance> mInstances;
+	std::vector<TerrainVegetationCell> mCells;
+	std::vector<float> mTile; // periodic Poisson tile of mTileSeed, unit spacing, (u, v) interleaved
+	uint32_t mTileSeed = 0;
+	uint32_t mVersion = 0;
+	size_t mCandidates = 0;
+	double mScatterMs = 0.0;
+};
+
+// Spacing that fills a worldSize square with about `count` trees before filtering
+float TerrainScatterSpacingForCount(float worldSize, size_t count);
+
+struct TerrainScatterBenchmark
+{
+	size_t Target = 0;
+	size_t Instances = 0;
+	size_t Cells = 0;
+	double ScatterMs = 0.0;
+	double CullMs = 0.0;         // average over the repeats
+	uint32_t VisibleInstances = 0;
+	uint32_t Draws = 0;
+};
+
+// For each of `count` target tree counts: scatter with every filter open (so the target is what
+// gets placed) and time `repeats` culls for the view
+void BenchmarkTerrainScatter(const TerrainHeightQuery& query, float worldSize, float originY, float heightScale,
+	const DirectX::XMFLOAT4X4& viewProj, const DirectX::XMFLOAT3& eyePos, float maxDistance, const size_t* targets,
+	int count, int repeats, TerrainScatterBenchmark* results);
+
+// CPU check on a synthetic heightfield: no two trees closer than the spacing (across tile seams too),
+// every tree inside the square, on allowed ground and in exactly one cell whose bounds hold it, and
+// culling keeps exactly the non-empty cells in the frustum and range with merged, disjoint draws.
+// Returns false with a reason on failure.
+bool ValidateTerrainScatter(std::string* error = nullptr);
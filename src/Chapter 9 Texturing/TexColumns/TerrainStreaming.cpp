@@ -0,0 +1,377 @@
+#include "TerrainStreaming.h"
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+	bool ReadWholeFile(const std::filesystem::path& path, std::vector<uint8_t>& data)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return false;
+		const std::streamsize size = file.tellg();
+		if (size <= 0)
+			return false;
+		data.resize((size_t)size);
+		file.seekg(0);
+		return (bool)file.read(reinterpret_cast<char*>(data.data()), size);
+	}
+}
+
+bool TerrainFileTileLoader::Load(const TerrainTileId& id, std::vector<uint8_t>& data)
+{
+	return ReadWholeFile(mPath(id), data);
+}
+
+bool TerrainFileTileLoader::LoadCompanion(const TerrainTileId& id, std::vector<uint8_t>& data)
+{
+	return mCompanionPath && ReadWholeFile(mCompanionPath(id), data);
+}
+
+void TerrainFakeTileLoader::SetMissing(uint32_t nodeIndex)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMissing.insert(nodeIndex);
+}
+
+bool TerrainFakeTileLoader::Load(const TerrainTileId& id, std::vector<uint8_t>& data)
+{
+	++mLoadCount;
+	if (mDelay.count() > 0)
+		std::this_thread::sleep_for(mDelay);
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mMissing.count(id.NodeIndex))
+			return false;
+	}
+	data.assign(mTileBytes, (uint8_t)(id.NodeIndex & 0xff));
+	return true;
+}
+
+TerrainTileCache::~TerrainTileCache()
+{
+	Stop();
+}
+
+void TerrainTileCache::Start(std::shared_ptr<TerrainTileLoader> loader, int threadCount)
+{
+	if (!mWorkers.empty())
+		Stop();
+	std::lock_guard<std::mutex> lock(mMutex);
+	mLoader = std::move(loader);
+	mStopping = false;
+	for (int i = 0; i < std::max(threadCount, 1); ++i)
+		mWorkers.emplace_back(&TerrainTileCache::WorkerMain, this);
+}
+
+void TerrainTileCache::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWorkCv.notify_all();
+	for (std::thread& worker : mWorkers)
+		worker.join();
+	mWorkers.clear();
+
+	// Requests that never reached a worker are dropped; resident tiles stay tracked
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (uint32_t node : mQueue)
+		mEntries.erase(node);
+	mQueue.clear();
+}
+
+void TerrainTileCache::SetBudgetBytes(size_t bytes)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mBudgetBytes = bytes;
+	}
+	mWorkCv.notify_all();
+	mIdleCv.notify_all();
+}
+
+size_t TerrainTileCache::GetBudgetBytes() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mBudgetBytes;
+}
+
+void TerrainTileCache::BeginFrame()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	++mFrame;
+	// Drop queued requests nobody asked for last frame (camera moved on)
+	auto stale = [this](uint32_t node) {
+		auto it = mEntries.find(node);
+		if (it->second.LastRequested + 1 >= mFrame)
+			return false;
+		mEntries.erase(it);
+		++mStats.Cancelled;
+		return true;
+	};
+	mQueue.erase(std::remove_if(mQueue.begin(), mQueue.end(), stale), mQueue.end());
+}
+
+void TerrainTileCache::SubmitRequests(const TerrainTileRequest* requests, size_t count)
+{
+	bool queued = false;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const TerrainTileRequest& request = requests[i];
+			auto inserted = mEntries.try_emplace(request.Id.NodeIndex);
+			Entry& entry = inserted.first->second;
+			if (inserted.second)
+			{
+				entry.Id = request.Id;
+				entry.State = TileState::Queued;
+				entry.Priority = request.Priority;
+				mQueue.push_back(request.Id.NodeIndex);
+				queued = true;
+			}
+			else if (entry.LastRequested != mFrame)
+				entry.Priority = request.Priority; // priorities are per frame
+			else
+				entry.Priority = std::max(entry.Priority, request.Priority);
+			entry.LastRequested = mFrame;
+			entry.LastUsed = mFrame;
+		}
+	}
+	if (queued)
+		mWorkCv.notify_all();
+}
+
+bool TerrainTileCache::IsResident(uint32_t nodeIndex) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto it = mEntries.find(nodeIndex);
+	return it != mEntries.end() && it->second.State == TileState::Resident;
+}
+
+void TerrainTileCache::CollectLoaded(std::vector<TerrainLoadedTile>& out, size_t maxCount)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mLoaded.size() > maxCount)
+		std::partial_sort(mLoaded.begin(), mLoaded.begin() + maxCount, mLoaded.end(),
+			[this](uint32_t a, uint32_t b) { return mEntries[a].Priority > mEntries[b].Priority; });
+	const size_t n = std::min(maxCount, mLoaded.size());
+	for (size_t i = 0; i < n; ++i)
+	{
+		Entry& entry = mEntries[mLoaded[i]];
+		mPendingBytes -= entry.Data.size() + entry.Companion.size();
+		out.push_back({ entry.Id, std::move(entry.Data), std::move(entry.Companion) });
+		entry.Data = {};
+		entry.Companion = {};
+	}
+	mLoaded.erase(mLoaded.begin(), mLoaded.begin() + n);
+	if (n > 0)
+		mWorkCv.notify_all();
+}
+
+void TerrainTileCache::MarkResident(uint32_t nodeIndex, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto it = mEntries.find(nodeIndex);
+	if (it == mEntries.end())
+		return;
+	it->second.State = TileState::Resident;
+	it->second.Bytes = bytes;
+	it->second.LastUsed = mFrame;
+	mStats.ResidentBytes += bytes;
+}
+
+void TerrainTileCache::MarkFailed(uint32_t nodeIndex)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto it = mEntries.find(nodeIndex);
+	if (it != mEntries.end())
+		it->second.State = TileState::Failed;
+}
+
+void TerrainTileCache::EvictToBudget(std::vector<TerrainTileId>& evicted)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	if (mStats.ResidentBytes <= mBudgetBytes)
+		return;
+	std::vector<std::pair<uint64_t, uint32_t>> candidates; // (last used, node)
+	for (const auto& kv : mEntries)
+		if (kv.second.State == TileState::Resident && kv.second.LastUsed < mFrame)
+			candidates.emplace_back(kv.second.LastUsed, kv.first);
+	std::sort(candidates.begin(), candidates.end());
+	for (const auto& candidate : candidates)
+	{
+		if (mStats.ResidentBytes <= mBudgetBytes)
+			break;
+		auto it = mEntries.find(candidate.second);
+		mStats.ResidentBytes -= it->second.Bytes;
+		evicted.push_back(it->second.Id);
+		mEntries.erase(it);
+		++mStats.Evictions;
+	}
+	lock.unlock();
+	mWorkCv.notify_all();
+}
+
+TerrainTileCacheStats TerrainTileCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	TerrainTileCacheStats stats = mStats;
+	for (const auto& kv : mEntries)
+	{
+		switch (kv.second.State)
+		{
+		case TileState::Queued: ++stats.Queued; break;
+		case TileState::Loading:
+		case TileState::Loaded: ++stats.Loading; break;
+		case TileState::Resident: ++stats.Resident; break;
+		case TileState::Failed: ++stats.Failed; break;
+		}
+	}
+	return stats;
+}
+
+void TerrainTileCache::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mIdleCv.wait(lock, [this] { return mLoadsInFlight == 0 && (mQueue.empty() || mWorkers.empty() || !HasBudgetHeadroom()); });
+}
+
+bool TerrainTileCache::HasBudgetHeadroom() const
+{
+	return mStats.ResidentBytes + mPendingBytes < mBudgetBytes;
+}
+
+void TerrainTileCache::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	for (;;)
+	{
+		// Loads pause while the budget is used up; eviction or a larger budget resumes them
+		mWorkCv.wait(lock, [this] { return mStopping || (!mQueue.empty() && HasBudgetHeadroom()); });
+		if (mStopping)
+			return;
+
+		// Highest priority first; the queue is small enough for a linear scan
+		size_t best = 0;
+		for (size_t i = 1; i < mQueue.size(); ++i)
+			if (mEntries[mQueue[i]].Priority > mEntries[mQueue[best]].Priority)
+				best = i;
+		const uint32_t node = mQueue[best];
+		mQueue[best] = mQueue.back();
+		mQueue.pop_back();
+		Entry& entry = mEntries[node];
+		entry.State = TileState::Loading;
+		const TerrainTileId id = entry.Id;
+		++mLoadsInFlight;
+
+		lock.unlock();
+		std::vector<uint8_t> data, companion;
+		const bool ok = mLoader->Load(id, data);
+		if (ok && !mLoader->LoadCompanion(id, companion))
+			companion.clear();
+		lock.lock();
+
+		// Loading entries are never erased, so the entry is still there
+		--mLoadsInFlight;
+		Entry& done = mEntries[node];
+		++mStats.Loads;
+		if (ok)
+		{
+			done.State = TileState::Loaded;
+			mPendingBytes += data.size() + companion.size();
+			done.Data = std::move(data);
+			done.Companion = std::move(companion);
+			mLoaded.push_back(node);
+		}
+		else
+			done.State = TileState::Failed;
+		mIdleCv.notify_all();
+	}
+}
+
+bool RunTerrainTileCacheSelfTest(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+	const size_t tileBytes = 1000;
+	auto loader = std::make_shared<TerrainFakeTileLoader>(tileBytes);
+	loader->SetMissing(99);
+	TerrainTileCache cache;
+	cache.SetBudgetBytes(3 * tileBytes);
+	auto request = [](uint32_t node, float priority) {
+		return TerrainTileRequest{ { node, 1, (int)node & 1, (int)node >> 1 }, priority };
+	};
+	auto makeResident = [&cache](size_t maxCount) {
+		std::vector<TerrainLoadedTile> loaded;
+		cache.CollectLoaded(loaded, maxCount);
+		for (const TerrainLoadedTile& tile : loaded)
+			cache.MarkResident(tile.Id.NodeIndex, tile.Data.size());
+		return loaded;
+	};
+
+	// Requests made before the workers start load highest priority first
+	cache.BeginFrame();
+	cache.SubmitRequests({ request(1, 1.f), request(2, 3.f), request(3, 2.f), request(99, 5.f) });
+	cache.Start(loader, 1);
+	cache.WaitIdle();
+	std::vector<TerrainLoadedTile> loaded = makeResident(1);
+	if (loaded.size() != 1 || loaded[0].Id.NodeIndex != 2)
+		return fail("loaded tiles not collected in priority order");
+	makeResident(8);
+	if (!cache.IsResident(1) || !cache.IsResident(3) || cache.IsResident(99))
+		return fail("residency after loading is wrong");
+	if (cache.GetStats().Failed != 1)
+		return fail("failed load not recorded");
+
+	// Frame 2: only tile 1 and the failed tile are requested; failed tiles are not retried
+	const int loadsBefore = loader->GetLoadCount();
+	cache.BeginFrame();
+	cache.SubmitRequests({ request(1, 1.f), request(99, 1.f) });
+	cache.WaitIdle();
+	if (loader->GetLoadCount() != loadsBefore)
+		return fail("failed tile was retried");
+
+	// Frame 3: the budget is full, so tile 4 waits in the queue until there is room
+	cache.BeginFrame();
+	cache.SubmitRequests({ request(1, 1.f), request(4, 1.f) });
+	cache.WaitIdle();
+	if (cache.GetStats().Queued != 1 || cache.IsResident(4))
+		return fail("loaded past the budget");
+	cache.SetBudgetBytes(4 * tileBytes);
+	cache.WaitIdle();
+	makeResident(8);
+	if (!cache.IsResident(4))
+		return fail("load did not resume after the budget grew");
+
+	// Shrinking the budget evicts 2 and 3 (last used in frame 1), never tile 1 or 4,
+	// which were used this frame
+	cache.SetBudgetBytes(2 * tileBytes);
+	std::vector<TerrainTileId> evicted;
+	cache.EvictToBudget(evicted);
+	if (evicted.size() != 2 || cache.IsResident(2) || cache.IsResident(3) || !cache.IsResident(1) || !cache.IsResident(4))
+		return fail("LRU eviction picked the wrong tiles");
+	if (cache.GetStats().ResidentBytes != 2 * tileBytes)
+		return fail("resident bytes out of sync after eviction");
+
+	// Everything in use this frame: over budget, but nothing may be evicted
+	cache.SetBudgetBytes(0);
+	evicted.clear();
+	cache.EvictToBudget(evicted);
+	if (!evicted.empty())
+		return fail("evicted a tile used this frame");
+
+	// A queued request nobody repeats is cancelled at the next frame
+	cache.Stop();
+	cache.BeginFrame();
+	cache.SubmitRequests({ request(5, 1.f) });
+	cache.BeginFrame();
+	cache.BeginFrame();
+	if (cache.GetStats().Queued != 0 || cache.GetStats().Cancelled != 1)
+		return fail("stale request was not cancelled");
+	return true;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// A streamable terrain tile; NodeIndex is the tile's index in Terrain's flat node array
+struct TerrainTileId
+{
+	uint32_t NodeIndex = 0;
+	int LOD = 0;
+	int TileX = 0;
+	int TileZ = 0;
+};
+
+struct TerrainTileRequest
+{
+	TerrainTileId Id;
+	float Priority = 0.f; // higher loads first
+};
+
+struct TerrainLoadedTile
+{
+	TerrainTileId Id;
+	std::vector<uint8_t> Data;
+	std::vector<uint8_t> Companion; // optional data loaded with the tile (e.g. its normal map), may be empty
+};
+
+// Reads one tile's data on a worker thread; implementations must be thread-safe
+class TerrainTileLoader
+{
+public:
+	virtual ~TerrainTileLoader() = default;
+	virtual bool Load(const TerrainTileId& id, std::vector<uint8_t>& data) = 0;
+	// Called after a successful Load; a missing companion does not fail the tile
+	virtual bool LoadCompanion(const TerrainTileId& /*id*/, std::vector<uint8_t>& /*data*/) { return false; }
+};
+
+// Reads whole tile files (e.g. DDS) from disk, and a companion file per tile when companionPath is set
+class TerrainFileTileLoader : public TerrainTileLoader
+{
+public:
+	using PathFunc = std::function<std::filesystem::path(const TerrainTileId&)>;
+	explicit TerrainFileTileLoader(PathFunc path, PathFunc companionPath = nullptr)
+		: mPath(std::move(path)), mCompanionPath(std::move(companionPath)) {}
+	bool Load(const TerrainTileId& id, std::vector<uint8_t>& data) override;
+	bool LoadCompanion(const TerrainTileId& id, std::vector<uint8_t>& data) override;
+
+private:
+	PathFunc mPath;
+	PathFunc mCompanionPath;
+};
+
+// Headless stand-in for tests: returns tileBytes of data after an optional delay,
+// fails tiles marked missing and counts loads
+class TerrainFakeTileLoader : public TerrainTileLoader
+{
+public:
+	explicit TerrainFakeTileLoader(size_t tileBytes, std::chrono::milliseconds delay = std::chrono::milliseconds(0))
+		: mTileBytes(tileBytes), mDelay(delay) {}
+	void SetMissing(uint32_t nodeIndex);
+	int GetLoadCount() const { return mLoadCount.load(); }
+	bool Load(const TerrainTileId& id, std::vector<uint8_t>& data) override;
+
+private:
+	size_t mTileBytes;
+	std::chrono::milliseconds mDelay;
+	std::mutex mMutex;
+	std::set<uint32_t> mMissing;
+	std::atomic<int> mLoadCount{ 0 };
+};
+
+struct TerrainTileCacheStats
+{
+	uint32_t Resident = 0;
+	uint32_t Queued = 0;
+	uint32_t Loading = 0;     // on a worker or waiting for CollectLoaded/MarkResident
+	uint32_t Failed = 0;
+	size_t ResidentBytes = 0;
+	uint64_t Loads = 0;
+	uint64_t Evictions = 0;
+	uint64_t Cancelled = 0;   // queued requests dropped after going unrequested for a frame
+};
+
+// Tile residency cache: requests are loaded by a pool of worker threads in priority order,
+// resident tiles are kept under a byte budget and evicted least recently used first. Workers
+// stop starting loads while resident + not yet collected bytes fill the budget.
+// The cache only tracks residency; the owner uploads loaded data and reports its size.
+//
+// Per frame (main thread): BeginFrame, SubmitRequests (requesting a resident tile touches it),
+// CollectLoaded -> upload -> MarkResident/MarkFailed, EvictToBudget -> release evicted tiles.
+class TerrainTileCache
+{
+public:
+	TerrainTileCache() = default;
+	~TerrainTileCache();
+	TerrainTileCache(const TerrainTileCache&) = delete;
+	TerrainTileCache& operator=(const TerrainTileCache&) = delete;
+
+	void Start(std::shared_ptr<TerrainTileLoader> loader, int threadCount);
+	void Stop();
+
+	void SetBudgetBytes(size_t bytes);
+	size_t GetBudgetBytes() const;
+
+	void BeginFrame();
+	void SubmitRequests(const TerrainTileRequest* requests, size_t count);
+	void SubmitRequests(const std::vector<TerrainTileRequest>& requests) { SubmitRequests(requests.data(), requests.size()); }
+	bool IsResident(uint32_t nodeIndex) const;
+
+	// Move up to maxCount loaded tiles (highest priority first) to out
+	void CollectLoaded(std::vector<TerrainLoadedTile>& out, size_t maxCount);
+	void MarkResident(uint32_t nodeIndex, size_t bytes);
+	void MarkFailed(uint32_t nodeIndex);
+	// Evict resident tiles not used this frame, oldest first, until within budget
+	void EvictToBudget(std::vector<TerrainTileId>& evicted);
+
+	TerrainTileCacheStats GetStats() const;
+	// Block until nothing is loading and the queue is empty or held back by the budget (headless tests)
+	void WaitIdle();
+
+private:
+	enum class TileState : uint8_t { Queued, Loading, Loaded, Resident, Failed };
+	struct Entry
+	{
+		TerrainTileId Id;
+		TileState State = TileState::Queued;
+		float Priority = 0.f;
+		uint64_t LastRequested = 0;
+		uint64_t LastUsed = 0;
+		size_t Bytes = 0;
+		std::vector<uint8_t> Data; // Loaded only
+		std::vector<uint8_t> Companion;
+	};
+
+	mutable std::mutex mMutex;
+	std::condition_variable mWorkCv;
+	std::condition_variable mIdleCv;
+	std::vector<std::thread> mWorkers;
+	std::shared_ptr<TerrainTileLoader> mLoader;
+	std::unordered_map<uint32_t, Entry> mEntries;
+	std::vector<uint32_t> mQueue;  // Queued entries
+	std::vector<uint32_t> mLoaded; // Loaded entries awaiting CollectLoaded
+	uint64_t mFrame = 1;
+	size_t mBudgetBytes = 64ull << 20;
+	size_t mPendingBytes = 0; // loaded, not yet collected
+	uint32_t mLoadsInFlight = 0;
+	bool mStopping = false;
+	TerrainTileCacheStats mStats;
+
+	bool HasBudgetHeadroom() const;
+	void WorkerMain();
+};
+
+// Headless check of the cache policy with TerrainFakeTileLoader: priority order, loads held
+// back by a full budget, LRU eviction, tiles touched this frame never evicted, stale requests
+// cancelled and failed tiles not retried. Returns false with a reason on failure.
+bool RunTerrainTileCacheSelfTest(std::string* error = nullptr);
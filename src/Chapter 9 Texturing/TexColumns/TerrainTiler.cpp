@@ -0,0 +1,558 @@
+#include "TerrainTiler.h"
+#include "TerrainGenerator.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// Read-only file mapping with one movable view, so only the band being filtered is resident
+	class MappedFile
+	{
+	public:
+		~MappedFile() { Close(); }
+
+		bool Open(const std::filesystem::path& path)
+		{
+			Close();
+#ifdef _WIN32
+			mFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+				FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (mFile == INVALID_HANDLE_VALUE) return false;
+			mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mMapping == nullptr) { Close(); return false; }
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			mGranularity = info.dwAllocationGranularity;
+#else
+			mFd = open(path.c_str(), O_RDONLY);
+			if (mFd < 0) return false;
+			mGranularity = (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+			return true;
+		}
+
+		// View of [offset, offset + bytes), replacing the previous one
+		const uint8_t* Map(uint64_t offset, size_t bytes)
+		{
+			Unmap();
+			const uint64_t base = offset / mGranularity * mGranularity;
+			const size_t viewBytes = (size_t)(offset - base) + bytes;
+#ifdef _WIN32
+			mView = MapViewOfFile(mMapping, FILE_MAP_READ, (DWORD)(base >> 32), (DWORD)base, viewBytes);
+			if (mView == nullptr) return nullptr;
+#else
+			void* view = mmap(nullptr, viewBytes, PROT_READ, MAP_PRIVATE, mFd, (off_t)base);
+			if (view == MAP_FAILED) return nullptr;
+			madvise(view, viewBytes, MADV_SEQUENTIAL);
+			mView = view;
+#endif
+			mViewBytes = viewBytes;
+			return (const uint8_t*)mView + (offset - base);
+		}
+
+		void Unmap()
+		{
+			if (mView == nullptr) return;
+#ifdef _WIN32
+			UnmapViewOfFile(mView);
+#else
+			munmap(mView, mViewBytes);
+#endif
+			mView = nullptr;
+			mViewBytes = 0;
+		}
+
+		void Close()
+		{
+			Unmap();
+#ifdef _WIN32
+			if (mMapping != nullptr) CloseHandle(mMapping);
+			if (mFile != INVALID_HANDLE_VALUE) CloseHandle(mFile);
+			mMapping = nullptr;
+			mFile = INVALID_HANDLE_VALUE;
+#else
+			if (mFd >= 0) close(mFd);
+			mFd = -1;
+#endif
+		}
+
+	private:
+#ifdef _WIN32
+		HANDLE mFile = INVALID_HANDLE_VALUE;
+		HANDLE mMapping = nullptr;
+#else
+		int mFd = -1;
+#endif
+		void* mView = nullptr;
+		size_t mViewBytes = 0;
+		uint64_t mGranularity = 65536;
+	};
+
+	uint64_t QueryPeakResidentBytes()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters = {};
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+			return (uint64_t)counters.PeakWorkingSetSize;
+#else
+		rusage usage = {};
+		if (getrusage(RUSAGE_SELF, &usage) == 0)
+			return (uint64_t)usage.ru_maxrss * 1024; // kilobytes on Linux
+#endif
+		return 0;
+	}
+
+	// Area filter from `inputs` texels (centres at integers, texel k covering [k - 0.5, k + 0.5]) to
+	// `outputs` corner-aligned samples: sample i sits at i * (inputs - 1) / (outputs - 1) and averages a
+	// box one output spacing wide (at least one input texel, so upsampling degenerates to linear).
+	struct BoxFilter
+	{
+		std::vector<int> First;    // first input texel of each output
+		std::vector<int> Offset;   // outputs + 1 entries into Weights
+		std::vector<float> Weights; // normalized
+
+		int Count(int i) const { return Offset[i + 1] - Offset[i]; }
+		int Last(int i) const { return First[i] + Count(i) - 1; }
+		size_t Bytes() const { return (First.size() + Offset.size()) * sizeof(int) + Weights.size() * sizeof(float); }
+	};
+
+	BoxFilter BuildBoxFilter(int outputs, int inputs)
+	{
+		BoxFilter filter;
+		filter.First.resize(outputs);
+		filter.Offset.resize((size_t)outputs + 1);
+		const double scale = outputs > 1 ? (double)(inputs - 1) / (outputs - 1) : 0.0;
+		const double half = std::max(scale, 1.0) * 0.5;
+		for (int i = 0; i < outputs; ++i)
+		{
+			const double c = i * scale;
+			const double a = std::max(c - half, -0.5), b = std::min(c + half, inputs - 0.5);
+			const int k0 = std::clamp((int)std::floor(a + 0.5), 0, inputs - 1);
+			const int k1 = std::clamp((int)std::ceil(b - 0.5), k0, inputs - 1);
+			filter.First[i] = k0;
+			filter.Offset[i] = (int)filter.Weights.size();
+			double total = 0.0;
+			for (int k = k0; k <= k1; ++k)
+				total += std::max(std::min(b, k + 0.5) - std::max(a, k - 0.5), 0.0);
+			for (int k = k0; k <= k1; ++k)
+				filter.Weights.push_back((float)(std::max(std::min(b, k + 0.5) - std::max(a, k - 0.5), 0.0) / total));
+		}
+		filter.Offset[outputs] = (int)filter.Weights.size();
+		return filter;
+	}
+
+	// fn(i) for i in [0, count) over up to `threads` threads
+	template <class Fn>
+	void ParallelFor(int threads, int count, const Fn& fn)
+	{
+		std::atomic<int> next{ 0 };
+		auto work = [&]() {
+			for (int i = next++; i < count; i = next++)
+				fn(i);
+		};
+		std::vector<std::thread> workers;
+		for (int t = 1; t < std::min(threads, count); ++t)
+			workers.emplace_back(work);
+		work();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	float QuantizeR16(float h)
+	{
+		return (float)std::lround(std::clamp(h, 0.f, 1.f) * 65535.f) / 65535.f;
+	}
+}
+
+std::filesystem::path TerrainTileBoundsPath(const std::filesystem::path& root)
+{
+	return root / "TerrainTileBounds.txt";
+}
+
+TerrainTilerStats BakeTerrainTiles(const std::filesystem::path& source, const TerrainTilerSettings& settings,
+	const std::filesystem::path& root)
+{
+	TerrainTilerStats stats;
+	const auto start = std::chrono::steady_clock::now();
+	const int tileSize = settings.TileSize;
+	const int step = tileSize - 1;
+	TerrainR16Layout layout;
+	MappedFile file;
+	if (tileSize < 2)
+	{
+		stats.Error = "tile size below 2";
+		return stats;
+	}
+	if (!FindTerrainHeightmapR16(source, layout))
+	{
+		stats.Error = "not an R16 DDS or square headerless R16 heightmap: " + source.string();
+		return stats;
+	}
+	if (!file.Open(source))
+	{
+		stats.Error = "cannot map " + source.string();
+		return stats;
+	}
+	stats.SourceWidth = layout.Width;
+	stats.SourceHeight = layout.Height;
+
+	int levels = settings.Levels;
+	if (levels <= 0)
+	{
+		const int side = std::max(layout.Width, layout.Height);
+		levels = 1;
+		while (levels < 12 && (int64_t)step * (1 << levels) + 1 <= side)
+			++levels;
+	}
+	stats.Levels = levels;
+
+	std::error_code ec;
+	for (int lod = 0; lod < levels; ++lod)
+		std::filesystem::create_directories(TerrainTilePath(root, lod, 0, 0).parent_path(), ec);
+
+	const unsigned hardware = std::max(std::thread::hardware_concurrency(), 1u);
+	const int threads = std::max(settings.ThreadCount > 0 ? settings.ThreadCount : (int)hardware, 1);
+	const int bandRows = std::max(settings.BandRows, 1);
+	const size_t rowBytes = (size_t)layout.Width * sizeof(uint16_t);
+	stats.Threads = threads;
+
+	std::vector<TerrainTileBounds> bounds;
+	std::vector<float> acc;
+	std::atomic<int> failed{ 0 };
+	for (int lod = 0; lod < levels; ++lod)
+	{
+		const int tiles = 1 << lod;
+		const int globalSize = step * tiles + 1;
+		const BoxFilter filterX = BuildBoxFilter(globalSize, layout.Width);
+		const BoxFilter filterZ = BuildBoxFilter(globalSize, layout.Height);
+		acc.assign((size_t)tileSize * globalSize, 0.f);
+		// Columns split into one slice per thread: slices accumulate into disjoint columns of the band
+		const int slices = std::clamp(globalSize / 64, 1, threads);
+		const size_t tileBytes = (size_t)tileSize * tileSize * (sizeof(float) * 4 / 3 + sizeof(uint16_t));
+
+		for (int band = 0; band < tiles; ++band)
+		{
+			// Global rows [g0, g0 + tileSize): row 0 is the +Z edge, so band 0 is the last TileZ
+			const int g0 = band * step;
+			const int k0 = filterZ.First[g0], k1 = filterZ.Last(g0 + step);
+			// Band rows each source row contributes to (footprints are monotonic in both ends)
+			std::vector<std::pair<int, int>> targets((size_t)(k1 - k0 + 1));
+			for (int k = k0, gBegin = 0, gEnd = 0; k <= k1; ++k)
+			{
+				while (gBegin < tileSize && filterZ.Last(g0 + gBegin) < k) ++gBegin;
+				while (gEnd < tileSize && filterZ.First[g0 + gEnd] <= k) ++gEnd;
+				targets[k - k0] = { gBegin, gEnd };
+			}
+			std::fill(acc.begin(), acc.end(), 0.f);
+
+			const auto filterStart = std::chrono::steady_clock::now();
+			for (int chunk = k0; chunk <= k1; chunk += bandRows)
+			{
+				const int rows = std::min(bandRows, k1 - chunk + 1);
+				const uint8_t* view = file.Map(layout.DataOffset + (uint64_t)chunk * rowBytes, (size_t)rows * rowBytes);
+				if (view == nullptr)
+				{
+					stats.Error = "cannot map source rows";
+					return stats;
+				}
+				stats.PeakBufferBytes = std::max<uint64_t>(stats.PeakBufferBytes, acc.size() * sizeof(float) +
+					filterX.Bytes() + filterZ.Bytes() + targets.size() * sizeof(targets[0]) + (size_t)rows * rowBytes +
+					(size_t)globalSize * sizeof(float));
+				ParallelFor(threads, slices, [&](int slice) {
+					const int x0 = (int)((int64_t)globalSize * slice / slices);
+					const int x1 = (int)((int64_t)globalSize * (slice + 1) / slices);
+					std::vector<float> filtered((size_t)(x1 - x0));
+					for (int r = 0; r < rows; ++r)
+					{
+						// Rows start at even offsets: read the little-endian texels in place
+						const uint16_t* row = (const uint16_t*)(view + (size_t)r * rowBytes);
+						for (int x = x0; x < x1; ++x)
+						{
+							const uint16_t* src = row + filterX.First[x];
+							const float* w = &filterX.Weights[filterX.Offset[x]];
+							const int count = filterX.Count(x);
+							float sum = 0.f;
+							for (int j = 0; j < count; ++j)
+								sum += w[j] * (float)src[j];
+							filtered[x - x0] = sum;
+						}
+						const int k = chunk + r;
+						const std::pair<int, int> target = targets[k - k0];
+						for (int g = target.first; g < target.second; ++g)
+						{
+							const float w = filterZ.Weights[filterZ.Offset[g0 + g] + (k - filterZ.First[g0 + g])] * (1.f / 65535.f);
+							float* dst = &acc[(size_t)g * globalSize + x0];
+							for (int x = 0; x < x1 - x0; ++x)
+								dst[x] += w * filtered[x];
+						}
+					}
+				});
+			}
+			file.Unmap();
+			stats.SourceTexelsRead += (uint64_t)(k1 - k0 + 1) * layout.Width;
+			const auto writeStart = std::chrono::steady_clock::now();
+			stats.FilterSeconds += std::chrono::duration<double>(writeStart - filterStart).count();
+
+			// Tiles of the band share the accumulated rows: extract, bound and write them in parallel
+			const int tileZ = tiles - 1 - band;
+			const size_t firstBound = bounds.size();
+			bounds.resize(firstBound + tiles);
+			stats.PeakBufferBytes = std::max<uint64_t>(stats.PeakBufferBytes, acc.size() * sizeof(float) +
+				(uint64_t)std::min(threads, tiles) * tileBytes);
+			ParallelFor(threads, tiles, [&](int tileX) {
+				TerrainHeightfield tile;
+				tile.Width = tileSize;
+				tile.Height = tileSize;
+				tile.Heights.resize((size_t)tileSize * tileSize);
+				float minH = 1.f, maxH = 0.f;
+				for (int z = 0; z < tileSize; ++z)
+				{
+					const float* src = &acc[(size_t)z * globalSize + (size_t)tileX * step];
+					float* dst = &tile.Heights[(size_t)z * tileSize];
+					for (int x = 0; x < tileSize; ++x)
+					{
+						dst[x] = src[x];
+						minH = std::min(minH, src[x]);
+						maxH = std::max(maxH, src[x]);
+					}
+				}
+				bounds[firstBound + tileX] = { lod, tileX, tileZ, QuantizeR16(minH), QuantizeR16(maxH) };
+				if (!SaveTerrainHeightfieldDDS(TerrainTilePath(root, lod, tileX, tileZ), tile, settings.Mips))
+					++failed;
+			});
+			stats.WriteSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - writeStart).count();
+		}
+	}
+	file.Close();
+
+	std::ofstream boundsFile(TerrainTileBoundsPath(root));
+	boundsFile << "# lod x z min max (normalized heights of " << tileSize << "^2 tiles baked from " << layout.Width
+		<< "x" << layout.Height << " " << source.filename().string() << ")\n";
+	boundsFile.precision(9);
+	for (const TerrainTileBounds& b : bounds)
+		boundsFile << b.LOD << ' ' << b.TileX << ' ' << b.TileZ << ' ' << b.MinHeight << ' ' << b.MaxHeight << '\n';
+	if (!boundsFile)
+		++failed;
+
+	stats.Tiles = (int)bounds.size();
+	stats.Failed = failed.load();
+	stats.TotalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.SourceMTexelsPerSecond = stats.FilterSeconds > 0.0 ? (double)stats.SourceTexelsRead / stats.FilterSeconds * 1e-6 : 0.0;
+	stats.PeakResidentBytes = QueryPeakResidentBytes();
+	return stats;
+}
+
+void PrintTerrainTilerStats(std::ostream& out, const TerrainTilerStats& stats)
+{
+	if (!stats.Error.empty())
+	{
+		out << "[BakeTerrainTiles] " << stats.Error << "\n";
+		return;
+	}
+	out << "[BakeTerrainTiles] " << stats.SourceWidth << "x" << stats.SourceHeight << " source, " << stats.Levels
+		<< " levels, " << stats.Tiles << " tiles (" << stats.Failed << " failed) on " << stats.Threads << " threads in "
+		<< stats.TotalSeconds << " s (filter " << stats.FilterSeconds << " s at " << stats.SourceMTexelsPerSecond
+		<< " Mtexels/s, write " << stats.WriteSeconds << " s), buffers " << stats.PeakBufferBytes / (1024 * 1024)
+		<< " MB, peak RSS " << stats.PeakResidentBytes / (1024 * 1024) << " MB\n";
+}
+
+bool LoadTerrainTileBounds(const std::filesystem::path& root, std::vector<TerrainTileBounds>& bounds)
+{
+	std::ifstream file(TerrainTileBoundsPath(root));
+	if (!file) return false;
+	bounds.clear();
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#') continue;
+		TerrainTileBounds b;
+		if (std::sscanf(line.c_str(), "%d %d %d %f %f", &b.LOD, &b.TileX, &b.TileZ, &b.MinHeight, &b.MaxHeight) != 5)
+			return false;
+		bounds.push_back(b);
+	}
+	return true;
+}
+
+namespace
+{
+	// Exact box filter of one output texel in double, written without the weight tables
+	double ReferenceBoxSample(const std::vector<uint16_t>& source, int width, int height, int globalSize, int gx, int gz)
+	{
+		auto footprint = [globalSize](int i, int inputs, double& a, double& b) {
+			const double scale = (double)(inputs - 1) / (globalSize - 1);
+			const double half = std::max(scale, 1.0) * 0.5;
+			a = std::max(i * scale - half, -0.5);
+			b = std::min(i * scale + half, inputs - 0.5);
+		};
+		double ax, bx, az, bz;
+		footprint(gx, width, ax, bx);
+		footprint(gz, height, az, bz);
+		double sum = 0.0, area = 0.0;
+		for (int z = 0; z < height; ++z)
+		{
+			const double wz = std::min(bz, z + 0.5) - std::max(az, z - 0.5);
+			if (wz <= 0.0) continue;
+			for (int x = 0; x < width; ++x)
+			{
+				const double wx = std::min(bx, x + 0.5) - std::max(ax, x - 0.5);
+				if (wx <= 0.0) continue;
+				sum += wx * wz * source[(size_t)z * width + x];
+				area += wx * wz;
+			}
+		}
+		return sum / area / 65535.0;
+	}
+}
+
+bool ValidateTerrainTiler(std::string* error)
+{
+	const std::filesystem::path dir = std::filesystem::temp_directory_path() / "TerrainTilerCheck";
+	std::error_code ec;
+	auto fail = [error, &dir, &ec](const std::string& reason) {
+		std::filesystem::remove_all(dir, ec);
+		if (error) *error = reason;
+		return false;
+	};
+	std::filesystem::remove_all(dir, ec);
+	std::filesystem::create_directories(dir, ec);
+
+	// 201^2 source: levels 0..3 of 33^2 tiles (33 .. 257 texels per side) cover down- and upsampling
+	const int side = 201, tileSize = 33, levels = 4;
+	std::vector<uint16_t> source((size_t)side * side);
+	for (int z = 0; z < side; ++z)
+		for (int x = 0; x < side; ++x)
+		{
+			uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)z * 19349663u;
+			h = (h ^ (h >> 13)) * 0x5bd1e995u;
+			const double smooth = 0.5 + 0.3 * std::sin(x * 0.05) * std::cos(z * 0.07);
+			source[(size_t)z * side + x] = (uint16_t)std::clamp(smooth * 65535.0 + (double)(h >> 22) - 512.0, 0.0, 65535.0);
+		}
+	{
+		std::ofstream raw(dir / "source.r16", std::ios::binary);
+		raw.write((const char*)source.data(), (std::streamsize)(source.size() * sizeof(uint16_t)));
+		std::ofstream odd(dir / "odd.r16", std::ios::binary);
+		odd.write((const char*)source.data(), (std::streamsize)(side * 3 * sizeof(uint16_t)));
+	}
+	TerrainR16Layout layout;
+	if (FindTerrainHeightmapR16(dir / "odd.r16", layout))
+		return fail("a non-square headerless file was accepted");
+
+	TerrainTilerSettings settings;
+	settings.Levels = levels;
+	settings.TileSize = tileSize;
+	settings.ThreadCount = 3;
+	settings.BandRows = 7; // many views per band, chunk edges inside filter footprints
+	const TerrainTilerStats stats = BakeTerrainTiles(dir / "source.r16", settings, dir / "raw");
+	if (!stats.Error.empty())
+		return fail("bake failed: " + stats.Error);
+	if (stats.Failed != 0 || stats.Tiles != 1 + 4 + 16 + 64)
+		return fail("bake wrote " + std::to_string(stats.Tiles) + " tiles, " + std::to_string(stats.Failed) + " failed");
+
+	std::vector<TerrainTileBounds> bounds;
+	if (!LoadTerrainTileBounds(dir / "raw", bounds) || (int)bounds.size() != stats.Tiles)
+		return fail("bounds file missing or incomplete");
+
+	const int step = tileSize - 1;
+	// Mip 0 .. 1x1 of 33^2 R16 after the DDS + DX10 headers
+	uintmax_t expectedBytes = 4 + 124 + 20;
+	for (int s = tileSize; ; s = std::max(s / 2, 1))
+	{
+		expectedBytes += (uintmax_t)s * s * 2;
+		if (s == 1) break;
+	}
+	std::vector<std::vector<TerrainHeightfield>> pyramid(levels);
+	for (int lod = 0; lod < levels; ++lod)
+	{
+		const int tiles = 1 << lod;
+		pyramid[lod].resize((size_t)tiles * tiles);
+		for (int z = 0; z < tiles; ++z)
+			for (int x = 0; x < tiles; ++x)
+			{
+				const std::filesystem::path path = TerrainTilePath(dir / "raw", lod, x, z);
+				TerrainHeightfield& tile = pyramid[lod][(size_t)z * tiles + x];
+				if (!LoadTerrainHeightfieldDDS(path, tile) || tile.Width != tileSize || tile.Height != tileSize)
+					return fail("tile " + path.string() + " missing or wrong size");
+				if (std::filesystem::file_size(path, ec) != expectedBytes)
+					return fail("tile " + path.string() + " has an incomplete mip chain");
+				const float minH = *std::min_element(tile.Heights.begin(), tile.Heights.end());
+				const float maxH = *std::max_element(tile.Heights.begin(), tile.Heights.end());
+				const auto entry = std::find_if(bounds.begin(), bounds.end(), [&](const TerrainTileBounds& b) {
+					return b.LOD == lod && b.TileX == x && b.TileZ == z;
+				});
+				if (entry == bounds.end() || entry->MinHeight != minH || entry->MaxHeight != maxH)
+					return fail("bounds of " + path.string() + " do not match its texels");
+			}
+
+		const int globalSize = step * tiles + 1;
+		for (int z = 0; z < tiles; ++z)
+			for (int x = 0; x < tiles; ++x)
+			{
+				const TerrainHeightfield& tile = pyramid[lod][(size_t)z * tiles + x];
+				for (int k = 0; k < tileSize; ++k)
+				{
+					// Shared columns, and rows (TileZ + 1 is above: its last row is this tile's first)
+					if (x + 1 < tiles && tile.At(tileSize - 1, k) != pyramid[lod][(size_t)z * tiles + x + 1].At(0, k))
+						return fail("level " + std::to_string(lod) + " tiles do not share their x border");
+					if (z + 1 < tiles && tile.At(k, 0) != pyramid[lod][(size_t)(z + 1) * tiles + x].At(k, tileSize - 1))
+						return fail("level " + std::to_string(lod) + " tiles do not share their z border");
+				}
+				for (int tz = 0; tz < tileSize; tz += 4)
+					for (int tx = 0; tx < tileSize; tx += 4)
+					{
+						const int gx = x * step + tx, gz = (tiles - 1 - z) * step + tz;
+						const double expected = ReferenceBoxSample(source, side, side, globalSize, gx, gz);
+						if (std::abs(tile.At(tx, tz) - expected) > 1.5 / 65535.0)
+							return fail("level " + std::to_string(lod) + " texel differs from the box-filtered source");
+					}
+			}
+	}
+
+	// Same texels from a DDS source
+	TerrainHeightfield sourceField;
+	sourceField.Width = side;
+	sourceField.Height = side;
+	for (uint16_t texel : source)
+		sourceField.Heights.push_back((float)texel / 65535.f);
+	if (!SaveTerrainHeightfieldDDS(dir / "source.dds", sourceField))
+		return fail("cannot write the DDS source");
+	settings.Levels = 2;
+	settings.BandRows = 64;
+	if (!BakeTerrainTiles(dir / "source.dds", settings, dir / "dds").Error.empty())
+		return fail("DDS source was rejected");
+	for (int lod = 0; lod < 2; ++lod)
+		for (int z = 0; z < (1 << lod); ++z)
+			for (int x = 0; x < (1 << lod); ++x)
+			{
+				TerrainHeightfield tile;
+				if (!LoadTerrainHeightfieldDDS(TerrainTilePath(dir / "dds", lod, x, z), tile) ||
+					tile.Heights != pyramid[lod][(size_t)z * (1 << lod) + x].Heights)
+					return fail("DDS and raw sources bake different tiles");
+			}
+
+	std::filesystem::remove_all(dir, ec);
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "TerrainHeightmap.h"
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Offline baker: one large 16-bit source heightmap (FindTerrainHeightmapR16: R16 DDS or square .r16/.raw)
+// to the tile pyramid the app streams (TerrainTilePath). Tiles use the generator's layout: corner-aligned,
+// neighbours share their border texels, TileZ = 0 at the -Z edge. Every level is box filtered straight
+// from the source; the source is memory-mapped a band of rows at a time and the tiles of a band are
+// written in parallel, so memory stays at about TileSize x source width whatever the source size.
+struct TerrainTilerSettings
+{
+	int Levels = 0;        // LOD levels 0 .. Levels-1; 0 = as many as the source fills without upsampling
+	int TileSize = 512;
+	int ThreadCount = 0;   // 0 = one per hardware thread
+	int BandRows = 256;    // source rows mapped at a time
+	bool Mips = true;      // full mip chain in every tile
+};
+
+struct TerrainTileBounds
+{
+	int LOD = 0;
+	int TileX = 0;
+	int TileZ = 0;
+	float MinHeight = 0.f; // normalized, exactly as stored in the tile (after R16 quantization)
+	float MaxHeight = 0.f;
+};
+
+struct TerrainTilerStats
+{
+	int SourceWidth = 0;
+	int SourceHeight = 0;
+	int Levels = 0;
+	int Tiles = 0;
+	int Failed = 0;                 // tiles that could not be written
+	int Threads = 0;
+	uint64_t SourceTexelsRead = 0;  // summed over the level passes
+	double TotalSeconds = 0.0;      // wall time, including the bounds file
+	double FilterSeconds = 0.0;     // wall time mapping and filtering source bands
+	double WriteSeconds = 0.0;      // wall time building mips and writing tiles
+	double SourceMTexelsPerSecond = 0.0; // SourceTexelsRead / FilterSeconds
+	uint64_t PeakBufferBytes = 0;   // largest band buffers + mapped view held at once
+	uint64_t PeakResidentBytes = 0; // process peak working set (max RSS) after the bake, 0 if unavailable
+	std::string Error;              // set when the bake could not start
+};
+
+// Bake every tile of every level under root plus the bounds file (TerrainTileBoundsPath)
+TerrainTilerStats BakeTerrainTiles(const std::filesystem::path& source, const TerrainTilerSettings& settings,
+	const std::filesystem::path& root);
+
+// One line: source, tiles, failures, timings and peak memory (or the error)
+void PrintTerrainTilerStats(std::ostream& out, const TerrainTilerStats& stats);
+
+// Text file with one "lod x z min max" line per tile
+std::filesystem::path TerrainTileBoundsPath(const std::filesystem::path& root);
+bool LoadTerrainTileBounds(const std::filesystem::path& root, std::vector<TerrainTileBounds>& bounds);
+
+// CPU check on a small non-power-of-two source baked in narrow bands: tiles share bit-identical borders,
+// texels match a direct double-precision box filter of the source, the bounds file matches the tiles,
+// the mip chains are complete and a DDS source bakes the same tiles as the raw one.
+// Returns false with a reason on failure.
+bool ValidateTerrainTiler(std::string* error = nullptr);
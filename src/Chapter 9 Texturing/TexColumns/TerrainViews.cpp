@@ -0,0 +1,344 @@
+#include "TerrainViews.h"
+#include "Terrain.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+void TerrainJobPool::SetThreadCount(int threads)
+{
+	const int hardware = (int)std::max(1u, std::thread::hardware_concurrency());
+	threads = std::max(threads > 0 ? threads : std::min(hardware, 4), 1);
+	if (threads == mThreads)
+		return;
+	StopWorkers();
+	mThreads = threads;
+	// A worker starts at the current generation, so it only joins runs started after it exists
+	for (int t = 1; t < threads; ++t)
+		mWorkers.emplace_back(&TerrainJobPool::WorkerLoop, this, mGeneration);
+}
+
+void TerrainJobPool::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mWake.notify_all();
+	for (std::thread& worker : mWorkers)
+		worker.join();
+	mWorkers.clear();
+	mStop = false;
+}
+
+void TerrainJobPool::Drain(const std::function<void(int)>& fn, int count)
+{
+	for (int i = mNext++; i < count; i = mNext++)
+		fn(i);
+}
+
+void TerrainJobPool::Run(int count, const std::function<void(int)>& fn)
+{
+	if (count <= 0)
+		return;
+	if (mWorkers.empty() || count == 1)
+	{
+		for (int i = 0; i < count; ++i)
+			fn(i);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJob = &fn;
+		mJobCount = count;
+		mNext = 0;
+		mBusy = (int)mWorkers.size();
+		++mGeneration;
+	}
+	mWake.notify_all();
+	Drain(fn, count);
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDone.wait(lock, [this] { return mBusy == 0; });
+	mJob = nullptr;
+}
+
+void TerrainJobPool::WorkerLoop(uint64_t generation)
+{
+	for (;;)
+	{
+		const std::function<void(int)>* job;
+		int count;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [this, generation] { return mStop || mGeneration != generation; });
+			if (mStop)
+				return;
+			generation = mGeneration;
+			job = mJob;
+			count = mJobCount;
+		}
+		Drain(*job, count);
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (--mBusy == 0)
+			mDone.notify_one();
+	}
+}
+
+void BuildTerrainCameraPath(TerrainCameraPath path, float worldSize, float fovY, float aspect, int frames,
+	const std::function<float(float, float)>& heightAt, std::vector<TerrainView>& views, std::vector<XMFLOAT3>& eyes)
+{
+	frames = std::max(frames, 1);
+	views.resize(frames);
+	eyes.resize(frames);
+	const XMMATRIX proj = XMMatrixPerspectiveFovLH(fovY, aspect, 0.5f, 4.f * worldSize);
+	for (int f = 0; f < frames; ++f)
+	{
+		const float t = (float)f / (float)frames;
+		float x, z, yaw, above, pitch;
+		switch (path)
+		{
+		case TerrainCameraPath::Walk: // a fifth of the terrain along a gently winding line
+			x = worldSize * (-0.1f + 0.2f * t);
+			z = worldSize * (-0.05f + 0.02f * std::sin(t * XM_2PI));
+			yaw = 0.3f * std::cos(t * XM_2PI);
+			above = 0.02f * worldSize;
+			pitch = -0.1f;
+			break;
+		case TerrainCameraPath::Flyover: // one lap around the terrain, looking ahead and down
+			x = worldSize * 0.3f * std::cos(t * XM_2PI);
+			z = worldSize * 0.3f * std::sin(t * XM_2PI);
+			yaw = t * XM_2PI + XM_PI;
+			above = 0.1f * worldSize;
+			pitch = -0.35f;
+			break;
+		default: // a full turn in the middle
+			x = z = 0.f;
+			yaw = t * XM_2PI;
+			above = 0.03f * worldSize;
+			pitch = -0.15f;
+			break;
+		}
+		eyes[f] = { x, heightAt(x, z) + above, z };
+		const XMVECTOR eye = XMLoadFloat3(&eyes[f]);
+		const XMVECTOR forward = XMVectorSet(std::cos(yaw) * std::cos(pitch), std::sin(pitch), std::sin(yaw) * std::cos(pitch), 0.f);
+		const XMMATRIX view = XMMatrixLookToLH(eye, forward, XMVectorSet(0.f, 1.f, 0.f, 0.f));
+		XMStoreFloat4x4(&views[f].ViewProj, XMMatrixTranspose(view * proj));
+		views[f].ErrorScale = 1.f;
+	}
+}
+
+namespace
+{
+	// Tiles as comparable keys: node, neighbour mask and morph
+	struct TileKey
+	{
+		uint32_t Node;
+		uint32_t Mask;
+		float Morph;
+		bool operator==(const TileKey& o) const { return Node == o.Node && Mask == o.Mask && Morph == o.Morph; }
+		bool operator<(const TileKey& o) const { return Node < o.Node; }
+	};
+
+	std::vector<TileKey> TileKeys(const std::vector<TerrainTile>& tiles, bool sorted)
+	{
+		std::vector<TileKey> keys;
+		for (const TerrainTile& tile : tiles)
+			keys.push_back({ tile.NodeIndex, tile.NeighborMask, tile.MorphFactor });
+		if (sorted)
+			std::sort(keys.begin(), keys.end());
+		return keys;
+	}
+
+	XMFLOAT4X4 StoreViewProj(FXMMATRIX viewProj)
+	{
+		XMFLOAT4X4 m;
+		XMStoreFloat4x4(&m, XMMatrixTranspose(viewProj));
+		return m;
+	}
+
+	void SetupTerrain(Terrain& terrain, int threads, int levels = 6)
+	{
+		TerrainHeightfield field;
+		field.Width = field.Height = 257;
+		for (int z = 0; z < field.Height; ++z)
+			for (int x = 0; x < field.Width; ++x)
+				field.Heights.push_back(0.5f + 0.3f * std::sin(x * 0.071f) * std::cos(z * 0.053f) +
+					0.1f * std::sin((x + 2 * z) * 0.23f));
+		terrain.SetWorldSize(100.f);
+		terrain.SetHeightScale(20.f);
+		terrain.SetLODLevels(levels);
+		terrain.SetViewport(XM_PIDIV4, 720.f);
+		terrain.SetMaxPixelError(2.f);
+		terrain.SetHeightfield(std::move(field));
+		terrain.BuildQuadtree();
+		terrain.SetUpdateThreads(threads);
+	}
+}
+
+bool ValidateTerrainMultiView(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	Terrain single, multi, serial, lightOnly;
+	SetupTerrain(single, 1);
+	SetupTerrain(multi, 4);
+	SetupTerrain(serial, 1);
+	SetupTerrain(lightOnly, 1);
+
+	// A directional light's box around the whole terrain and a spot light on one corner
+	const XMMATRIX sunView = XMMatrixLookAtLH(XMVectorSet(40.f, 80.f, -30.f, 1.f), XMVectorZero(), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+	const XMMATRIX spotView = XMMatrixLookAtLH(XMVectorSet(-30.f, 40.f, -30.f, 1.f), XMVectorSet(-30.f, 10.f, -30.f, 1.f),
+		XMVectorSet(0.f, 0.f, 1.f, 0.f));
+	TerrainView views[3];
+	views[1].ViewProj = StoreViewProj(sunView * XMMatrixOrthographicLH(200.f, 200.f, 1.f, 300.f));
+	views[2].ViewProj = StoreViewProj(spotView * XMMatrixPerspectiveFovLH(XM_PIDIV4, 1.f, 1.f, 100.f));
+	views[2].ErrorScale = 0.5f;
+
+	// The camera flies across, so refinement, hysteresis and morphing all change between frames
+	for (int frame = 0; frame < 12; ++frame)
+	{
+		const XMFLOAT3 eye = { -40.f + 7.f * frame, 15.f + 2.f * frame, -20.f + 3.f * frame };
+		const XMMATRIX cameraView = XMMatrixLookAtLH(XMLoadFloat3(&eye), XMVectorSet(eye.x + 30.f, 5.f, eye.z + 20.f, 1.f),
+			XMVectorSet(0.f, 1.f, 0.f, 0.f));
+		views[0].ViewProj = StoreViewProj(cameraView * XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.f / 9.f, 0.5f, 500.f));
+		single.Update(views[0].ViewProj, eye);
+		multi.UpdateViews(views, 3, eye);
+		serial.UpdateViews(views, 3, eye);
+		lightOnly.UpdateViews(views + 2, 1, eye);
+		const std::string at = " (frame " + std::to_string(frame) + ")";
+
+		if (multi.GetVisibleTiles(0).empty() || multi.GetVisibleTiles(2).empty())
+			return fail("a view sees no tiles" + at);
+		if (TileKeys(multi.GetVisibleTiles(0), true) != TileKeys(single.GetVisibleTiles(), true))
+			return fail("camera tiles differ from a single-view update" + at);
+		if (TileKeys(multi.GetVisibleTiles(2), true) != TileKeys(lightOnly.GetVisibleTiles(), true))
+			return fail("spot light tiles differ from selecting the view alone" + at);
+		for (int v = 0; v < 3; ++v)
+			if (TileKeys(multi.GetVisibleTiles(v), false) != TileKeys(serial.GetVisibleTiles(v), false))
+				return fail("tiles depend on the thread count" + at);
+
+		// The sun sees everything: its tiles cover the terrain exactly once, neighbours within one LOD
+		const std::vector<TerrainTile>& sunTiles = multi.GetVisibleTiles(1);
+		const int finest = 1 << (multi.GetLODLevels() - 1);
+		std::vector<int> cover((size_t)finest * finest, -1);
+		for (const TerrainTile& tile : sunTiles)
+		{
+			const int span = finest >> tile.LOD;
+			for (int z = tile.TileZ * span; z < (tile.TileZ + 1) * span; ++z)
+				for (int x = tile.TileX * span; x < (tile.TileX + 1) * span; ++x)
+				{
+					if (cover[(size_t)z * finest + x] >= 0)
+						return fail("sun tiles overlap" + at);
+					cover[(size_t)z * finest + x] = tile.LOD;
+				}
+		}
+		for (int z = 0; z < finest; ++z)
+			for (int x = 0; x < finest; ++x)
+			{
+				const int lod = cover[(size_t)z * finest + x];
+				if (lod < 0)
+					return fail("sun tiles leave a hole" + at);
+				if ((x + 1 < finest && std::abs(lod - cover[(size_t)z * finest + x + 1]) > 1) ||
+					(z + 1 < finest && std::abs(lod - cover[(size_t)(z + 1) * finest + x]) > 1))
+					return fail("sun tiles differ by more than one LOD across an edge" + at);
+			}
+
+		// Spot light tiles touch its frustum (tested with the exact box corners, not the node planes)
+		const XMMATRIX spotViewProj = XMMatrixTranspose(XMLoadFloat4x4(&views[2].ViewProj));
+		for (const TerrainTile& tile : multi.GetVisibleTiles(2))
+		{
+			bool outside[6] = { true, true, true, true, true, true };
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				const XMFLOAT3& c = tile.AABB.Center;
+				const XMFLOAT3& e = tile.AABB.Extents;
+				const XMVECTOR p = XMVector4Transform(XMVectorSet(c.x + ((corner & 1) ? e.x : -e.x),
+					c.y + ((corner & 2) ? e.y : -e.y), c.z + ((corner & 4) ? e.z : -e.z), 1.f), spotViewProj);
+				XMFLOAT4 h;
+				XMStoreFloat4(&h, p);
+				outside[0] = outside[0] && h.x < -h.w;
+				outside[1] = outside[1] && h.x > h.w;
+				outside[2] = outside[2] && h.y < -h.w;
+				outside[3] = outside[3] && h.y > h.w;
+				outside[4] = outside[4] && h.z < 0.f;
+				outside[5] = outside[5] && h.z > h.w;
+			}
+			if (std::any_of(outside, outside + 6, [](bool o) { return o; }))
+				return fail("spot light tile outside its frustum" + at);
+		}
+	}
+
+	// Fewer views later drop the others' tiles
+	const XMFLOAT3 eye = { 0.f, 30.f, 0.f };
+	multi.UpdateViews(views, 1, eye);
+	if (multi.GetViewCount() != 1 || !multi.GetVisibleTiles(1).empty() || multi.GetStats().ShadowTiles != 0)
+		return fail("tiles of a dropped view remain");
+	return true;
+}
+
+bool ValidateTerrainTemporalCoherence(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	const XMMATRIX sunView = XMMatrixLookAtLH(XMVectorSet(40.f, 80.f, -30.f, 1.f), XMVectorZero(), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+	const XMMATRIX spotView = XMMatrixLookAtLH(XMVectorSet(-30.f, 40.f, -30.f, 1.f), XMVectorSet(-20.f, 10.f, -25.f, 1.f),
+		XMVectorSet(0.f, 0.f, 1.f, 0.f));
+	const char* pathNames[3] = { "walk", "flyover", "orbit" };
+	// A tree deep enough to be split into jobs, on several threads, and one traversed in one piece
+	const int configs[2][2] = { { 7, 3 }, { 4, 1 } };
+	for (const int* config : configs)
+		for (int path = 0; path < 3; ++path)
+		{
+			Terrain coherent, full;
+			SetupTerrain(coherent, config[1], config[0]);
+			SetupTerrain(full, config[1], config[0]);
+			full.SetTemporalCoherence(false);
+			std::vector<TerrainView> cameras;
+			std::vector<XMFLOAT3> eyes;
+			const int frames = 90;
+			BuildTerrainCameraPath((TerrainCameraPath)path, 100.f, XM_PIDIV4, 16.f / 9.f, frames,
+				[&full](float x, float z) { return full.SampleHeight(x, z); }, cameras, eyes);
+
+			TerrainView views[3];
+			views[1].ViewProj = StoreViewProj(sunView * XMMatrixOrthographicLH(200.f, 200.f, 1.f, 300.f));
+			views[2].ViewProj = StoreViewProj(spotView * XMMatrixPerspectiveFovLH(XM_PIDIV4, 1.f, 1.f, 100.f));
+			views[2].ErrorScale = 0.5f;
+			uint64_t coherentVisited = 0, fullVisited = 0, reused = 0;
+			for (int frame = 0; frame < frames; ++frame)
+			{
+				// Settings changes, a frame standing still and a teleport along the way
+				if (frame == 30)
+					for (Terrain* t : { &coherent, &full })
+						t->SetMaxPixelError(3.f);
+				if (frame == 45)
+					for (Terrain* t : { &coherent, &full })
+						t->SetLODHysteresis(0.4f);
+				if (frame == 60)
+					views[2].ErrorScale = 0.7f;
+				const int at = frame == 50 ? 49 : frame == 70 ? frames - 1 - frame : frame;
+				views[0] = cameras[at];
+				const int viewCount = frame < 80 ? 3 : 1;
+				coherent.UpdateViews(views, viewCount, eyes[at]);
+				full.UpdateViews(views, viewCount, eyes[at]);
+				const std::string where = std::string(" (") + pathNames[path] + ", " + std::to_string(config[0]) +
+					" levels, frame " + std::to_string(frame) + ")";
+				for (int v = 0; v < viewCount; ++v)
+					if (TileKeys(coherent.GetVisibleTiles(v), true) != TileKeys(full.GetVisibleTiles(v), true))
+						return fail("reused cut differs from a full traversal in view " + std::to_string(v) + where);
+				coherentVisited += coherent.GetStats().NodesVisited;
+				fullVisited += full.GetStats().NodesVisited;
+				reused += coherent.GetStats().NodesReused;
+			}
+			if (full.GetStats().NodesReused != 0)
+				return fail("a full traversal reused nodes");
+			if (path != (int)TerrainCameraPath::Orbit && (reused == 0 || coherentVisited >= fullVisited))
+				return fail(std::string("temporal coherence saved no work on the ") + pathNames[path] + " path");
+		}
+	return true;
+}
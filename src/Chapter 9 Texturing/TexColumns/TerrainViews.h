@@ -0,0 +1,92 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Views Terrain::UpdateViews selects tiles for in one traversal: the camera first, then e.g. one
+// per shadow-casting light
+constexpr int kTerrainMaxViews = 8;
+
+struct TerrainView
+{
+	DirectX::XMFLOAT4X4 ViewProj; // stored transposed (as in PassConstants)
+	// Multiplies the camera's projected error for this view's refinement: 1 = the camera's tiles
+	// wherever both see the terrain, < 1 = coarser
+	float ErrorScale = 1.f;
+};
+
+// Camera paths for Terrain::BenchmarkCameraPath, each over the whole [-worldSize/2, worldSize/2] square:
+// Walk = eye height above the ground at walking speed, Flyover = fast and high, Orbit = turning on the spot
+enum class TerrainCameraPath
+{
+	Walk,
+	Flyover,
+	Orbit,
+};
+
+struct TerrainCameraPathBenchmark
+{
+	int Frames = 0;
+	double FullMs = 0.0;        // average update, every node evaluated
+	double CoherentMs = 0.0;    // average update with temporal coherence
+	double FullNodesVisited = 0.0;     // average per update
+	double CoherentNodesVisited = 0.0;
+	double CoherentNodesReused = 0.0;
+};
+
+// Camera views (one per frame) and eyes along a path; heights follow heightAt(x, z) (world units)
+void BuildTerrainCameraPath(TerrainCameraPath path, float worldSize, float fovY, float aspect, int frames,
+	const std::function<float(float, float)>& heightAt, std::vector<TerrainView>& views, std::vector<DirectX::XMFLOAT3>& eyes);
+
+// Fork-join pool for the terrain update: Run(count, fn) calls fn(0 .. count-1) on the workers and
+// the calling thread and returns once all calls are done. Unlike the bakes' ParallelFor the workers
+// are kept between runs, since a whole update is shorter than starting a thread.
+class TerrainJobPool
+{
+public:
+	TerrainJobPool() = default;
+	~TerrainJobPool() { StopWorkers(); }
+	TerrainJobPool(const TerrainJobPool&) = delete;
+	TerrainJobPool& operator=(const TerrainJobPool&) = delete;
+
+	// Threads including the caller (0 = one per hardware thread, at most 4); not during Run
+	void SetThreadCount(int threads);
+	// 0 until SetThreadCount
+	int GetThreadCount() const { return mThreads; }
+	void Run(int count, const std::function<void(int)>& fn);
+
+private:
+	std::vector<std::thread> mWorkers;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mDone;
+	const std::function<void(int)>* mJob = nullptr;
+	int mJobCount = 0;
+	std::atomic<int> mNext{ 0 }; // next job index of the current run
+	int mBusy = 0;     // workers still in the current run
+	uint64_t mGeneration = 0;
+	bool mStop = false;
+	int mThreads = 0;
+
+	void StopWorkers();
+	void WorkerLoop(uint64_t generation);
+	void Drain(const std::function<void(int)>& fn, int count);
+};
+
+// CPU check of Terrain::UpdateViews on a synthetic heightfield: the camera view matches a
+// single-view Update frame for frame (hysteresis included), every view matches selecting it alone,
+// a light view covering the terrain gets a crack-free cover of it, shadow tiles lie in their
+// frustum, and the result does not depend on the thread count. Returns false with a reason on failure.
+bool ValidateTerrainMultiView(std::string* error = nullptr);
+
+// CPU check of temporal coherence along camera paths: every frame the reused cuts give exactly the
+// tiles (morph and neighbour masks included) of a terrain that evaluates every node, for several views
+// and across settings changes, while evaluating fewer nodes. Returns false with a reason on failure.
+bool ValidateTerrainTemporalCoherence(std::string* error = nullptr);
@@ -0,0 +1,430 @@
+#include "TerrainVirtualTexture.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	// Pinned pages outrank any feedback count; within a class coarser mips load first
+	const float kPinnedPriority = 1e9f;
+	const float kMipPriority = 65536.f;
+
+	float Smoothstep(float e0, float e1, float x)
+	{
+		const float t = std::clamp((x - e0) / (e1 - e0), 0.f, 1.f);
+		return t * t * (3.f - 2.f * t);
+	}
+
+	float Lerp(float a, float b, float t) { return a + (b - a) * t; }
+
+	float HashLattice(int x, int y, int octave)
+	{
+		uint32_t h = (uint32_t)x * 0x8da6b343u ^ (uint32_t)y * 0xd8163841u ^ (uint32_t)octave * 0xcb1ab31fu;
+		h ^= h >> 13;
+		h *= 0x5bd1e995u;
+		h ^= h >> 15;
+		return (float)(h & 0xffffffu) / 16777215.f;
+	}
+
+	// Value noise with lattice period `period` (in mip-0 texels), in [0, 1]
+	float ValueNoise(double px, double py, int period, int octave)
+	{
+		const double sx = px / period, sy = py / period;
+		const int cx = (int)std::floor(sx), cy = (int)std::floor(sy);
+		const float fx = (float)(sx - cx), fy = (float)(sy - cy);
+		const float wx = fx * fx * (3.f - 2.f * fx), wy = fy * fy * (3.f - 2.f * fy);
+		const float a = Lerp(HashLattice(cx, cy, octave), HashLattice(cx + 1, cy, octave), wx);
+		const float b = Lerp(HashLattice(cx, cy + 1, octave), HashLattice(cx + 1, cy + 1, octave), wx);
+		return Lerp(a, b, wy);
+	}
+}
+
+void TerrainVirtualTexture::Start(const TerrainVTSettings& settings, std::shared_ptr<TerrainTileLoader> producer)
+{
+	Stop();
+	mSettings = settings;
+	int pagesPerSide = 1;
+	while (pagesPerSide < std::min(settings.PagesPerSide, kTerrainVTMaxPagesPerSide))
+		pagesPerSide <<= 1;
+	mSettings.PagesPerSide = pagesPerSide;
+	mSettings.PageSize = std::max(settings.PageSize, 1);
+	mSettings.PageBorder = std::max(settings.PageBorder, 0);
+	mSettings.PhysicalPagesPerSide = std::clamp(settings.PhysicalPagesPerSide, 2, kTerrainVTMaxPhysicalPagesPerSide);
+	mSettings.WorkerThreads = std::max(settings.WorkerThreads, 1);
+	mMipCount = 1;
+	while ((pagesPerSide >> (mMipCount - 1)) > 1)
+		++mMipCount;
+	mSettings.PinnedMips = std::clamp(settings.PinnedMips, 1, mMipCount);
+
+	mMipOffset.resize(mMipCount + 1);
+	mMipOffset[0] = 0;
+	for (int mip = 0; mip < mMipCount; ++mip)
+		mMipOffset[mip + 1] = mMipOffset[mip] + (size_t)(pagesPerSide >> mip) * (pagesPerSide >> mip);
+	const size_t pageCount = mMipOffset[mMipCount];
+	mPageSlot.assign(pageCount, -1);
+	mPageTable.assign(pageCount, 0u);
+	mRequestCount.assign(pageCount, 0u);
+	const int slots = mSettings.PhysicalPagesPerSide * mSettings.PhysicalPagesPerSide;
+	mFreeSlots.clear();
+	for (int slot = slots - 1; slot >= 0; --slot)
+		mFreeSlots.push_back(slot);
+	mPageTableDirty = true;
+	mFeedbackTexels = 0;
+	mUploads = 0;
+	SubmitFeedback(nullptr, 0, 0); // pinned pages only
+
+	// The cache evicts only above its budget, so the budget sits one byte under a whole number of
+	// pages to let a full cache go one page over. Workers check it before loading and may each add a
+	// page at once, so keep one slot per extra worker spare.
+	mCache = std::make_unique<TerrainTileCache>();
+	const int budgetPages = std::max(slots - (mSettings.WorkerThreads - 1), 1);
+	mCache->SetBudgetBytes((size_t)budgetPages * GetPageBytes() - 1);
+	mCache->Start(std::move(producer), mSettings.WorkerThreads);
+}
+
+void TerrainVirtualTexture::Stop()
+{
+	if (mCache)
+		mCache->Stop();
+	mCache.reset();
+	mPageSlot.clear();
+	mPageTable.clear();
+	mRequests.clear();
+}
+
+TerrainTileRequest TerrainVirtualTexture::MakeRequest(int mip, int x, int y, float priority) const
+{
+	return TerrainTileRequest{ { PageKey(mip, x, y), mip, x, y }, priority };
+}
+
+void TerrainVirtualTexture::SubmitFeedback(const uint32_t* feedback, size_t count, uint32_t tag)
+{
+	if (mPageSlot.empty())
+		return;
+	struct Touched { uint32_t Key; int Mip, X, Y; };
+	std::vector<Touched> touched;
+	const int firstPinned = mMipCount - mSettings.PinnedMips;
+	mFeedbackTexels = 0;
+	for (size_t i = 0; i < count && tag != 0; ++i)
+	{
+		const uint32_t value = feedback[i];
+		if ((value >> 24) != tag)
+			continue;
+		const int mip = (int)((value >> 20) & 15u);
+		int x = (int)(value & 1023u), y = (int)((value >> 10) & 1023u);
+		if (mip >= mMipCount || x >= (mSettings.PagesPerSide >> mip) || y >= (mSettings.PagesPerSide >> mip))
+			continue;
+		++mFeedbackTexels;
+		// The page and its ancestors up to the pinned mips, so its fallbacks sharpen on the way
+		for (int m = mip; m < firstPinned; ++m, x >>= 1, y >>= 1)
+		{
+			const uint32_t key = PageKey(m, x, y);
+			if (mRequestCount[key]++ == 0)
+				touched.push_back({ key, m, x, y });
+		}
+	}
+
+	mRequests.clear();
+	for (int mip = firstPinned; mip < mMipCount; ++mip)
+		for (int y = 0; y < (mSettings.PagesPerSide >> mip); ++y)
+			for (int x = 0; x < (mSettings.PagesPerSide >> mip); ++x)
+				mRequests.push_back(MakeRequest(mip, x, y, kPinnedPriority + kMipPriority * mip));
+	for (const Touched& page : touched)
+	{
+		const float pixels = (float)std::min(mRequestCount[page.Key], 65535u);
+		mRequests.push_back(MakeRequest(page.Mip, page.X, page.Y, kMipPriority * page.Mip + pixels));
+		mRequestCount[page.Key] = 0;
+	}
+}
+
+void TerrainVirtualTexture::Update(std::vector<TerrainVTPageUpload>& uploads, size_t maxUploads)
+{
+	if (!mCache)
+		return;
+	// Requests are repeated every frame: the cache drops queued pages nobody asked for last frame
+	// and never evicts pages asked for this frame
+	mCache->BeginFrame();
+	mCache->SubmitRequests(mRequests);
+
+	std::vector<TerrainLoadedTile> loaded;
+	mCache->CollectLoaded(loaded, std::min(maxUploads, mFreeSlots.size()));
+	for (TerrainLoadedTile& page : loaded)
+	{
+		if (page.Data.size() != GetPageBytes())
+		{
+			mCache->MarkFailed(page.Id.NodeIndex);
+			continue;
+		}
+		const int slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+		mPageSlot[page.Id.NodeIndex] = slot;
+		mCache->MarkResident(page.Id.NodeIndex, page.Data.size());
+		ResolvePageTable(page.Id.LOD, page.Id.TileX, page.Id.TileZ);
+		TerrainVTPageUpload upload;
+		upload.Page = page.Id;
+		upload.SlotX = slot % mSettings.PhysicalPagesPerSide;
+		upload.SlotY = slot / mSettings.PhysicalPagesPerSide;
+		upload.Texels = std::move(page.Data);
+		uploads.push_back(std::move(upload));
+		++mUploads;
+	}
+
+	// A freed slot is only overwritten by a later upload, which the atlas barrier orders after
+	// every draw already submitted, so no fence is needed here
+	std::vector<TerrainTileId> evicted;
+	mCache->EvictToBudget(evicted);
+	for (const TerrainTileId& page : evicted)
+	{
+		const int slot = mPageSlot[page.NodeIndex];
+		if (slot < 0)
+			continue;
+		mFreeSlots.push_back(slot);
+		mPageSlot[page.NodeIndex] = -1;
+		ResolvePageTable(page.LOD, page.TileX, page.TileZ);
+	}
+}
+
+void TerrainVirtualTexture::ResolvePageTable(int mip, int x, int y)
+{
+	// Parents first: each finer mip copies the entry above it unless its own page is resident
+	for (int m = mip, span = 1; m >= 0; --m, span <<= 1)
+		for (int py = y * span; py < (y + 1) * span; ++py)
+			for (int px = x * span; px < (x + 1) * span; ++px)
+			{
+				const uint32_t key = PageKey(m, px, py);
+				const int slot = mPageSlot[key];
+				if (slot >= 0)
+					mPageTable[key] = PackTerrainVTPageEntry(slot % mSettings.PhysicalPagesPerSide, slot / mSettings.PhysicalPagesPerSide, m);
+				else
+					mPageTable[key] = m + 1 < mMipCount ? mPageTable[PageKey(m + 1, px >> 1, py >> 1)] : 0u;
+			}
+	mPageTableDirty = true;
+}
+
+TerrainVTStats TerrainVirtualTexture::GetStats() const
+{
+	TerrainVTStats stats;
+	stats.FeedbackTexels = mFeedbackTexels;
+	stats.PagesRequested = (uint32_t)mRequests.size();
+	stats.FreeSlots = (uint32_t)mFreeSlots.size();
+	stats.Uploads = mUploads;
+	if (mCache)
+	{
+		const TerrainTileCacheStats cache = mCache->GetStats();
+		stats.Resident = cache.Resident;
+		stats.Queued = cache.Queued;
+		stats.Loading = cache.Loading;
+		stats.Evictions = cache.Evictions;
+	}
+	return stats;
+}
+
+TerrainPageComposer::TerrainPageComposer(const TerrainHeightfield& heightfield, const TerrainVTSettings& settings, float slopeScale)
+	: mSettings(settings), mSlopeScale(slopeScale)
+{
+	mHeightfield.Encode(heightfield);
+}
+
+bool TerrainPageComposer::Load(const TerrainTileId& page, std::vector<uint8_t>& texels)
+{
+	const auto start = std::chrono::steady_clock::now();
+	const int size = mSettings.PageSize + 2 * mSettings.PageBorder;
+	const int mip = page.LOD;
+	const int scale = 1 << mip; // mip-0 texels per texel of this page
+	const double texelUV = (double)scale / ((double)mSettings.PagesPerSide * mSettings.PageSize);
+	const float gradientStep = (float)std::max(texelUV, 1.0 / std::max(mHeightfield.GetWidth() - 1, 1));
+	const int kOctaves = 8; // lattice periods 2 .. 256 mip-0 texels
+	float weights[kOctaves + 1] = {}, weightSum = 0.f;
+	for (int octave = 1; octave <= kOctaves; ++octave)
+		weightSum += weights[octave] = std::pow(0.55f, (float)(kOctaves - octave));
+
+	struct Color { float R, G, B; };
+	auto mix = [](Color a, Color b, float t) { return Color{ Lerp(a.R, b.R, t), Lerp(a.G, b.G, t), Lerp(a.B, b.B, t) }; };
+	const Color grass = { 0.25f, 0.36f, 0.13f }, dirt = { 0.37f, 0.30f, 0.20f }, sand = { 0.62f, 0.56f, 0.42f };
+	const Color rock = { 0.45f, 0.42f, 0.38f }, snow = { 0.90f, 0.92f, 0.95f };
+
+	texels.resize((size_t)size * size * 4);
+	for (int j = 0; j < size; ++j)
+		for (int i = 0; i < size; ++i)
+		{
+			// Global texel of this mip; the border reaches into the neighbouring pages
+			const int64_t gx = (int64_t)page.TileX * mSettings.PageSize + i - mSettings.PageBorder;
+			const int64_t gy = (int64_t)page.TileZ * mSettings.PageSize + j - mSettings.PageBorder;
+			const float u = (float)((gx + 0.5) * texelUV), v = (float)((gy + 0.5) * texelUV);
+
+			// Detail octaves finer than two texels of this mip would alias, so they are left out
+			const double px = (gx + 0.5) * scale, py = (gy + 0.5) * scale;
+			float detail = 0.f;
+			for (int octave = 1; octave <= kOctaves; ++octave)
+				if ((1 << octave) >= 2 * scale)
+					detail += weights[octave] * (ValueNoise(px, py, 1 << octave, octave) - 0.5f);
+			detail /= weightSum;
+
+			float h = 0.3f, slope = 0.f;
+			if (!mHeightfield.Empty())
+			{
+				h = mHeightfield.Sample(u, v);
+				const float gu = (mHeightfield.Sample(u + gradientStep, v) - mHeightfield.Sample(u - gradientStep, v)) / (2.f * gradientStep);
+				const float gv = (mHeightfield.Sample(u, v + gradientStep) - mHeightfield.Sample(u, v - gradientStep)) / (2.f * gradientStep);
+				slope = std::sqrt(gu * gu + gv * gv) * mSlopeScale;
+			}
+			const float rockWeight = Smoothstep(0.55f, 1.0f, slope + 0.3f * detail);
+			const float snowWeight = Smoothstep(0.68f, 0.78f, h + 0.1f * detail) * (1.f - rockWeight);
+			const float sandWeight = (1.f - Smoothstep(0.06f, 0.12f, h + 0.05f * detail)) * (1.f - rockWeight);
+			Color c = mix(grass, dirt, Smoothstep(-0.1f, 0.1f, detail + 0.4f * (h - 0.45f)));
+			c = mix(c, sand, sandWeight);
+			c = mix(c, snow, snowWeight);
+			c = mix(c, rock, rockWeight);
+			const float shade = 1.f + 0.6f * detail;
+
+			uint8_t* texel = texels.data() + ((size_t)j * size + i) * 4;
+			texel[0] = (uint8_t)std::lround(std::clamp(c.R * shade, 0.f, 1.f) * 255.f);
+			texel[1] = (uint8_t)std::lround(std::clamp(c.G * shade, 0.f, 1.f) * 255.f);
+			texel[2] = (uint8_t)std::lround(std::clamp(c.B * shade, 0.f, 1.f) * 255.f);
+			texel[3] = 255;
+		}
+	++mComposed;
+	mComposeMicroseconds += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
+
+double TerrainPageComposer::GetAverageComposeMs() const
+{
+	const uint64_t composed = mComposed.load();
+	return composed > 0 ? (double)mComposeMicroseconds.load() / 1000.0 / (double)composed : 0.0;
+}
+
+bool RunTerrainVirtualTextureSelfTest(std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error) *error = reason;
+		return false;
+	};
+
+	// 8x8 pages at mip 0 (4 mips, 85 pages), 4x4 physical slots, top two mips pinned
+	TerrainVTSettings settings;
+	settings.PageSize = 6;
+	settings.PageBorder = 1;
+	settings.PagesPerSide = 8;
+	settings.PhysicalPagesPerSide = 4;
+	settings.WorkerThreads = 1;
+	settings.PinnedMips = 2;
+	TerrainVirtualTexture vt;
+	auto loader = std::make_shared<TerrainFakeTileLoader>((size_t)8 * 8 * 4);
+	vt.Start(settings, loader);
+	const int mips = vt.GetMipCount();
+	if (mips != 4)
+		return fail("wrong mip count");
+
+	std::vector<int> slotOwner;
+	std::vector<TerrainVTPageUpload> uploads;
+	// Every entry resolves to the finest resident page covering it, and no slot holds two pages
+	auto checkTable = [&]() -> std::string {
+		slotOwner.assign(16, -1);
+		for (int mip = mips - 1; mip >= 0; --mip)
+			for (int y = 0; y < (8 >> mip); ++y)
+				for (int x = 0; x < (8 >> mip); ++x)
+				{
+					uint32_t expected = 0;
+					for (int m = mip; m < mips && expected == 0; ++m)
+					{
+						const int slot = vt.GetPageSlot(m, x >> (m - mip), y >> (m - mip));
+						if (slot >= 0)
+							expected = PackTerrainVTPageEntry(slot % 4, slot / 4, m);
+					}
+					const size_t index = vt.GetPageTableOffset(mip) + (size_t)y * (8 >> mip) + x;
+					if (vt.GetPageTable()[index] != expected)
+						return "page table entry of mip " + std::to_string(mip) + " is not the finest resident ancestor";
+					const int slot = vt.GetPageSlot(mip, x, y);
+					if (slot >= 0 && slotOwner[slot]++ >= 0)
+						return "two pages share a physical slot";
+				}
+		return {};
+	};
+	auto settle = [&](size_t maxUploads) {
+		for (int i = 0; i < 40; ++i)
+		{
+			vt.Update(uploads, maxUploads);
+			vt.WaitIdle();
+		}
+	};
+
+	// Stale texels (other tags, out of range) are ignored; one page per upload shows the load order
+	const uint32_t feedback[] = {
+		PackTerrainVTFeedback(0, 5, 2, 9), PackTerrainVTFeedback(0, 5, 2, 9), PackTerrainVTFeedback(0, 5, 2, 9),
+		PackTerrainVTFeedback(0, 0, 0, 8), PackTerrainVTFeedback(0, 9, 0, 9), 0u,
+	};
+	vt.SubmitFeedback(feedback, sizeof(feedback) / sizeof(feedback[0]), 9);
+	vt.Update(uploads, 0);
+	vt.WaitIdle();
+	settle(1);
+	if (uploads.size() != 7)
+		return fail("expected 5 pinned pages, the requested page and its parent, got " + std::to_string(uploads.size()));
+	for (size_t i = 0; i < uploads.size(); ++i)
+	{
+		if (i > 0 && uploads[i].Page.LOD > uploads[i - 1].Page.LOD)
+			return fail("a finer page was uploaded before a coarser one");
+		if (uploads[i].Texels.size() != vt.GetPageBytes() || uploads[i].Texels[0] != (uint8_t)(uploads[i].Page.NodeIndex & 0xff))
+			return fail("upload does not carry its page's texels");
+	}
+	if (vt.GetPageSlot(0, 5, 2) < 0 || vt.GetPageSlot(1, 2, 1) < 0 || vt.GetPageSlot(0, 0, 0) >= 0)
+		return fail("residency after feedback is wrong");
+	std::string tableError = checkTable();
+	if (!tableError.empty())
+		return fail(tableError);
+
+	// Walk the feedback across the pyramid: the cache fills, pages of the current feedback stay,
+	// older ones are evicted least recently requested first and their entries fall back
+	for (int frame = 0; frame < 12; ++frame)
+	{
+		std::vector<uint32_t> walk;
+		const uint32_t tag = 10u + (uint32_t)frame;
+		for (int k = 0; k < 4; ++k)
+			walk.push_back(PackTerrainVTFeedback(0, (frame * 3 + k) % 8, (frame + k / 2) % 8, tag));
+		walk.push_back(PackTerrainVTFeedback(0, 1, 1, tag - 1)); // last frame's tag
+		vt.SubmitFeedback(walk.data(), walk.size(), tag);
+		uploads.clear();
+		settle(4);
+		for (int k = 0; k < 4; ++k)
+			if (vt.GetPageSlot(0, (frame * 3 + k) % 8, (frame + k / 2) % 8) < 0)
+				return fail("requested page not resident in frame " + std::to_string(frame));
+		for (int y = 0; y < 2; ++y)
+			for (int x = 0; x < 2; ++x)
+				if (vt.GetPageSlot(mips - 2, x, y) < 0 || vt.GetPageSlot(mips - 1, 0, 0) < 0)
+					return fail("pinned page evicted");
+		tableError = checkTable();
+		if (!tableError.empty())
+			return fail(tableError + " in frame " + std::to_string(frame));
+		const TerrainVTStats stats = vt.GetStats();
+		if (stats.Resident + stats.FreeSlots != 16)
+			return fail("resident pages and free slots do not add up to the atlas");
+	}
+	if (vt.GetStats().Evictions == 0)
+		return fail("walking feedback never evicted a page");
+	vt.Stop();
+
+	// Composed pages are deterministic and their borders repeat the neighbouring pages
+	TerrainHeightfield field;
+	field.Width = field.Height = 33;
+	for (int z = 0; z < 33; ++z)
+		for (int x = 0; x < 33; ++x)
+			field.Heights.push_back(0.5f + 0.4f * std::sin(x * 0.3f) * std::cos(z * 0.2f));
+	TerrainVTSettings composeSettings;
+	composeSettings.PageSize = 6;
+	composeSettings.PageBorder = 2;
+	composeSettings.PagesPerSide = 4;
+	TerrainPageComposer composer(field, composeSettings, 0.5f);
+	std::vector<uint8_t> a, b, again;
+	composer.Load({ 0, 0, 1, 1 }, a);
+	composer.Load({ 0, 0, 2, 1 }, b);
+	composer.Load({ 0, 0, 1, 1 }, again);
+	if (a != again)
+		return fail("composed page is not deterministic");
+	const int size = 6 + 2 * 2;
+	for (int j = 0; j < size; ++j)
+		for (int i = 0; i < 2 * 2; ++i)
+			for (int c = 0; c < 4; ++c)
+				if (a[((size_t)j * size + 6 + i) * 4 + c] != b[((size_t)j * size + i) * 4 + c])
+					return fail("page border does not match the neighbouring page");
+	return true;
+}
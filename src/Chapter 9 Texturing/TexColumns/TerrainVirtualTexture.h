@@ -0,0 +1,152 @@
+#pragma once
+
+#include "TerrainCompression.h"
+#include "TerrainHeightmap.h"
+#include "TerrainStreaming.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Virtual texture over the terrain's surface (UV [0,1] across the whole terrain, v towards -Z):
+// a mip pyramid of pages, PagesPerSide^2 at mip 0 halving to one page at the top. Only the pages
+// the GPU reports in its feedback buffer are composed (on TerrainTileCache's worker threads) and
+// kept in a fixed atlas of physical pages; every other page falls back to its nearest resident
+// ancestor through the page table, so the surface is never missing, only blurrier.
+constexpr int kTerrainVTMaxPagesPerSide = 1024; // feedback packs 10-bit page coordinates
+constexpr int kTerrainVTMaxMips = 11;
+constexpr int kTerrainVTMaxPhysicalPagesPerSide = 256; // page table packs 8-bit slot coordinates
+
+struct TerrainVTSettings
+{
+	int PageSize = 128;            // texels per page side, without the border
+	int PageBorder = 4;            // texels of the neighbouring pages around each page, for filtering
+	int PagesPerSide = 64;         // at mip 0, a power of two
+	int PhysicalPagesPerSide = 16; // the atlas holds this squared pages
+	int WorkerThreads = 2;
+	int PinnedMips = 2;            // coarsest mips always resident, the fallback of every page
+};
+
+// One feedback texel written by Terrain.hlsl: page x, y (10 bits each) and mip (4 bits) the pixel
+// wanted, and the frame's tag (8 bits, never 0) so texels not written this frame are skipped
+inline uint32_t PackTerrainVTFeedback(int mip, int x, int y, uint32_t tag)
+{
+	return (uint32_t)x | ((uint32_t)y << 10) | ((uint32_t)mip << 20) | (tag << 24);
+}
+
+// Page table entry (R32_UINT, one mip per page mip): physical slot x, y (8 bits each), the mip of
+// the page actually resident (4 bits; coarser than the entry's own mip when it falls back) and a valid bit
+constexpr uint32_t kTerrainVTPageValid = 1u << 31;
+inline uint32_t PackTerrainVTPageEntry(int slotX, int slotY, int mip)
+{
+	return (uint32_t)slotX | ((uint32_t)slotY << 8) | ((uint32_t)mip << 16) | kTerrainVTPageValid;
+}
+
+// A composed page for the owner to copy into the atlas; Page.LOD is the page's mip, TileX/TileZ its x, y
+struct TerrainVTPageUpload
+{
+	TerrainTileId Page;
+	int SlotX = 0;
+	int SlotY = 0;
+	std::vector<uint8_t> Texels; // RGBA8, (PageSize + 2 * PageBorder)^2, row 0 = low v
+};
+
+struct TerrainVTStats
+{
+	uint32_t FeedbackTexels = 0;  // texels of the last feedback with the frame's tag
+	uint32_t PagesRequested = 0;  // distinct pages wanted, ancestors and pinned pages included
+	uint32_t Resident = 0;
+	uint32_t Queued = 0;
+	uint32_t Loading = 0;
+	uint32_t FreeSlots = 0;
+	uint64_t Uploads = 0;
+	uint64_t Evictions = 0;
+};
+
+// Page residency for the virtual texture. TerrainTileCache does the priority queue, worker threads
+// and LRU bookkeeping (a page is a tile keyed by its index in the mip pyramid); this class turns
+// feedback into requests, assigns physical slots and keeps the page table resolved. Its budget
+// keeps resident pages and pages being composed within the atlas, so a finished page always finds
+// a free slot.
+//
+// Per frame (main thread): SubmitFeedback with the newest readback (optional), then Update, which
+// resubmits the last feedback's requests, hands out finished pages and evicts pages over budget.
+class TerrainVirtualTexture
+{
+public:
+	TerrainVirtualTexture() = default;
+	~TerrainVirtualTexture() { Stop(); }
+	TerrainVirtualTexture(const TerrainVirtualTexture&) = delete;
+	TerrainVirtualTexture& operator=(const TerrainVirtualTexture&) = delete;
+
+	void Start(const TerrainVTSettings& settings, std::shared_ptr<TerrainTileLoader> producer);
+	void Stop();
+	bool IsStarted() const { return !mPageSlot.empty(); }
+
+	const TerrainVTSettings& GetSettings() const { return mSettings; }
+	int GetMipCount() const { return mMipCount; }
+	int GetPhysicalPageSize() const { return mSettings.PageSize + 2 * mSettings.PageBorder; }
+	size_t GetPageBytes() const { return (size_t)GetPhysicalPageSize() * GetPhysicalPageSize() * 4; }
+
+	// Count the pages feedback texels with this tag ask for; coarser pages and more pixels load first
+	void SubmitFeedback(const uint32_t* feedback, size_t count, uint32_t tag);
+	// Move up to maxUploads composed pages into free slots (appended to uploads) and evict least
+	// recently requested pages beyond the budget; their entries fall back to resident ancestors
+	void Update(std::vector<TerrainVTPageUpload>& uploads, size_t maxUploads);
+
+	// Resolved page table, all mips back to back (mip 0 first, row-major, row 0 = low v)
+	const std::vector<uint32_t>& GetPageTable() const { return mPageTable; }
+	size_t GetPageTableOffset(int mip) const { return mMipOffset[mip]; }
+	bool ConsumePageTableDirty() { const bool dirty = mPageTableDirty; mPageTableDirty = false; return dirty; }
+	int GetPageSlot(int mip, int x, int y) const { return mPageSlot[PageKey(mip, x, y)]; }
+
+	TerrainVTStats GetStats() const;
+	// Block until the workers are idle (headless tests)
+	void WaitIdle() { if (mCache) mCache->WaitIdle(); }
+
+private:
+	TerrainVTSettings mSettings;
+	int mMipCount = 0;
+	std::vector<size_t> mMipOffset;  // first page key of each mip
+	std::vector<int> mPageSlot;      // per page key: physical slot, -1 = not resident
+	std::vector<uint32_t> mPageTable;
+	std::vector<int> mFreeSlots;
+	std::vector<uint32_t> mRequestCount; // per page key, scratch for SubmitFeedback
+	std::vector<TerrainTileRequest> mRequests;
+	std::unique_ptr<TerrainTileCache> mCache; // new per Start, so a restart forgets old pages
+	bool mPageTableDirty = true;
+	uint32_t mFeedbackTexels = 0;
+	uint64_t mUploads = 0;
+
+	uint32_t PageKey(int mip, int x, int y) const { return (uint32_t)(mMipOffset[mip] + (size_t)y * (mSettings.PagesPerSide >> mip) + x); }
+	TerrainTileRequest MakeRequest(int mip, int x, int y, float priority) const;
+	// Re-resolve the entries of a page and every finer page below it
+	void ResolvePageTable(int mip, int x, int y);
+};
+
+// Composes pages from the terrain heightfield on the cache's workers: ground layers blended by
+// height and slope, with value-noise detail down to the page's texel size. Every texel is a
+// function of its global texel position, so page borders repeat the neighbouring pages exactly.
+// The heightfield is kept block-compressed (R16-exact), at under half the size of a float copy.
+class TerrainPageComposer : public TerrainTileLoader
+{
+public:
+	// slopeScale = heightScale / worldSizeXZ turns heightfield gradients into world slopes
+	TerrainPageComposer(const TerrainHeightfield& heightfield, const TerrainVTSettings& settings, float slopeScale);
+	bool Load(const TerrainTileId& page, std::vector<uint8_t>& texels) override;
+	double GetAverageComposeMs() const;
+
+private:
+	TerrainCompressedHeightfield mHeightfield;
+	TerrainVTSettings mSettings;
+	float mSlopeScale;
+	std::atomic<uint64_t> mComposed{ 0 };
+	std::atomic<uint64_t> mComposeMicroseconds{ 0 };
+};
+
+// Headless check with synthetic feedback and TerrainFakeTileLoader: pages load coarse first, the
+// page table always resolves to the finest resident ancestor, slots are never shared, pages still
+// in the feedback are not evicted, stale feedback is ignored, and composed pages are deterministic
+// with borders matching their neighbours. Returns false with a reason on failure.
+bool RunTerrainVirtualTextureSelfTest(std::string* error = nullptr);
@@ -7,11 +7,23 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/model.h"
 #include <filesystem>
 #include "FrameResource.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
 #include "Terrain.h"
+#include "TerrainBenchmark.h"
+#include "TerrainCompression.h"
+#include "TerrainGenerator.h"
+#include "TerrainHorizon.h"
+#include "TerrainNormals.h"
+#include "TerrainScatter.h"
+#include "TerrainTiler.h"
+#include "TerrainVirtualTexture.h"
 #include <iostream>
 #include <algorithm> 
+#include <chrono>
 #include <cmath>
 #include <cctype>
 #include <dxcapi.h>
@@ -176,6 +188,63 @@ struct TAAConstants
 };
 static_assert(sizeof(TAAConstants) == 32);
 
+// Root constants b0 of the terrain root signature (cbTerrainDraw in Terrain.hlsl)
+struct TerrainDrawConstants
+{
+	uint32_t InstanceBase = 0; // quadtree: first instance of the draw
+	uint32_t ClipLevel = 0;    // clipmap: ring drawn and its lattice window
+	int32_t ClipOriginX = 0;
+	int32_t ClipOriginZ = 0;
+	float ClipSpacing = 1.0f;
+	int32_t ClipQuads = 0;
+	float ClipHeightScale = 1.0f;
+	float ClipOriginY = 0.0f;
+};
+static_assert(sizeof(TerrainDrawConstants) == 32);
+
+// The same b0 root constants as seen by the vegetation draw (cbVegetationDraw in Vegetation.hlsl)
+struct VegetationDrawConstants
+{
+	uint32_t InstanceBase = 0;    // first tree of the draw
+	uint32_t TreeTextures[3] = {}; // SRV heap indices of tree01S, tree02S, tree35S (UINT32_MAX = not loaded)
+};
+static_assert(sizeof(VegetationDrawConstants) <= sizeof(TerrainDrawConstants));
+
+// Tree count presets of the vegetation UI, before the slope and height filters
+static const size_t kTerrainVegetationCounts[] = { 10000, 100000, 300000, 1000000 };
+static const int kTerrainVegetationPresets = (int)(sizeof(kTerrainVegetationCounts) / sizeof(kTerrainVegetationCounts[0]));
+
+// OBJ files in Common the model benchmarks run over
+static const char* kModelBenchmarkFiles[] = { "sponza_ornament.OBJ", "arch_stones_01_Internal.OBJ",
+	"sponza_ornament_Internal.OBJ", "negr.obj", "plane2.obj" };
+static const int kModelBenchmarkFileCount = (int)(sizeof(kModelBenchmarkFiles) / sizeof(kModelBenchmarkFiles[0]));
+
+// Root constants b3 of the terrain root signature, pixel shader (cbTerrainShade in Terrain.hlsl)
+struct TerrainShadeConstants
+{
+	DirectX::XMFLOAT3 ToSun = { 0.0f, 1.0f, 0.0f };
+	float HorizonScale = 0.0f;    // heightScale / worldSizeXZ; 0 = no horizon shadows
+	float InvWorldSize = 0.01f;
+	float HorizonSoftness = 0.03f;
+	float NormalScale = 2.0f;     // (heightScale / worldSizeXZ) / kTerrainNormalReferenceScale
+	float _pad = 0.0f;
+};
+static_assert(sizeof(TerrainShadeConstants) == 32);
+
+// Root constants b4 of the terrain root signature, pixel shader (cbTerrainVT in Terrain.hlsl)
+struct TerrainVTConstants
+{
+	uint32_t PagesPerSide = 1;
+	uint32_t PageSize = 1;
+	uint32_t PageBorder = 0;
+	uint32_t PhysicalPagesPerSide = 1;
+	uint32_t MipCount = 1;
+	uint32_t FeedbackTag = 0;     // 1..255, written into this frame's feedback texels
+	uint32_t FeedbackOffset = 0;  // pixel of each 8x8 block that writes feedback: x = & 7, y = >> 3
+	uint32_t Enabled = 0;         // 0 = diffuse map as before, no feedback
+};
+static_assert(sizeof(TerrainVTConstants) == 32);
+
 
 
 struct TAAReprojectConstants
@@ -221,6 +290,7 @@ private:
 	void LoadAllTextures();
 	void LoadTexture(const std::string& name);
 	void BuildRootSignature();
+	void BuildTerrainRootSignature();
 	void BuildLightingRootSignature();
 	void BuildShadowPassRootSignature();
 	void BuildPostProcessRootSignature();
@@ -232,10 +302,13 @@ private:
 	void BuildPSOs();
 	void BuildFrameResources();
 	void RotateSpotlightTowardCursor(int x, int y);
+	void PickTerrain(int x, int y);
+	void ClampCameraToTerrain();
 	void CreateMaterial(std::string _name, int _CBIndex, int _SRVDiffIndex, int _SRVNMapIndex, XMFLOAT4 _DiffuseAlbedo, XMFLOAT3 _FresnelR0, float _Roughness, float _Metallic);
 	void BuildMaterials();
 	void RenderCustomMesh(std::string unique_name, std::string meshname, std::string materialName, XMFLOAT3 Scale, XMFLOAT3 Rotation, XMFLOAT3 Position);
-	void BuildCustomMeshGeometry(std::string name, UINT& meshVertexOffset, UINT& meshIndexOffset, UINT& prevVertSize, UINT& prevIndSize, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo);
+	// Appends the model's vertices and indices; true when they came from its MeshCache file
+	bool BuildCustomMeshGeometry(std::string name, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo);
 	void BuildRenderItems();
 	void DrawSceneToShadowMap();
 	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
@@ -250,8 +323,27 @@ private:
 	void CreatePointLight(XMFLOAT3 pos, XMFLOAT3 color, float faloff_start, float faloff_end, float strength);
 
 	void LoadTerrainTextures();
+	void GenerateMissingTerrainHeightmaps();
+	void BakeMissingTerrainNormalMaps();
+	TerrainHeightfield LoadTerrainHeightfield() const;
+	void StartTerrainStreaming();
+	void UpdateTerrainStreaming(ID3D12GraphicsCommandList* cmdList);
 	void BuildTerrainGeometry();
+	void PackTerrainViewInstances();
 	void DrawTerrain(ID3D12GraphicsCommandList* cmdList);
+	void DrawTerrainShadow(ID3D12GraphicsCommandList* cmdList, int lightCBIndex, D3D12_GPU_VIRTUAL_ADDRESS shadowCBAddress);
+	void DrawTerrainClipmap(ID3D12GraphicsCommandList* cmdList);
+	void UploadTerrainClipmap(ID3D12GraphicsCommandList* cmdList);
+	void UploadTerrainAdaptiveMeshes(ID3D12GraphicsCommandList* cmdList);
+	void BuildTerrainHorizonMap();
+	void SetTerrainShadeRoot(ID3D12GraphicsCommandList* cmdList, bool horizon);
+	void StartTerrainVirtualTexture();
+	void UpdateTerrainVirtualTexture(ID3D12GraphicsCommandList* cmdList);
+	void SetTerrainVirtualTextureRoot(ID3D12GraphicsCommandList* cmdList, bool enabled);
+	void CopyTerrainVTFeedback(ID3D12GraphicsCommandList* cmdList);
+	void UpdateTerrainVegetation();
+	void UploadTerrainVegetation(ID3D12GraphicsCommandList* cmdList);
+	void DrawTerrainVegetation(ID3D12GraphicsCommandList* cmdList);
 	void BuildDxrShadowRootSignature();
 	void BuildDxrShadowPSO();
 	void BuildDxrAccelerationStructures();
@@ -272,6 +364,7 @@ private:
 	ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
 	ComPtr<ID3D12RootSignature> mLightingRootSignature = nullptr;
 	ComPtr<ID3D12RootSignature> mShadowPassRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mTerrainRootSignature = nullptr;
 
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 	ComPtr<ID3D12DescriptorHeap> m_ImGuiSrvDescriptorHeap; // Member variable
@@ -376,19 +469,124 @@ private:
 	AtmosphereConstants mAtmosphereParams;
 
 	std::unique_ptr<Terrain> mTerrain;
-	std::vector<int> mTerrainHeightmapIndicesLOD0;
-	std::vector<int> mTerrainHeightmapIndicesLOD1;
-	std::vector<int> mTerrainHeightmapIndicesLOD2;
+	std::vector<TerrainInstanceRange> mTerrainInstanceRanges; // this frame's instanced draws, one per stitch variant
+	// Shadow-casting lights get their own terrain view: LightCBIndex of views 1, 2, ... and the
+	// ranges of their instances, packed after the camera's
+	std::vector<int> mTerrainShadowViewLights;
+	std::vector<std::vector<TerrainInstanceRange>> mTerrainShadowInstanceRanges;
+	bool mTerrainCastsShadows = true;
+	float mTerrainShadowErrorScale = 1.0f; // < 1 = coarser shadow casters than the camera's tiles
+	std::vector<std::vector<int>> mTerrainHeightmapIndices; // per LOD level, row-major tiles (-1 = not loaded)
+	std::vector<std::vector<int>> mTerrainNormalMapIndices; // the heightmaps' baked normal maps, same layout
 	int mTerrainMaterialIndex = -1;
 	float mTerrainHeightScale = 50.0f;
 	float mTerrainWorldSize = 100.0f;
-	float mTerrainLOD1Factor = 0.6f;
-	float mTerrainLOD2Factor = 0.3f;
+	float mTerrainMaxPixelError = 4.0f;
+	float mTerrainLODHysteresis = 0.2f;
+	int mTerrainLODLevels = kTerrainDefaultLODLevels;
+	TerrainUpdateBenchmark mTerrainUpdateBenchmark;
+	bool mTerrainTemporalLOD = true;
+	TerrainCameraPathBenchmark mTerrainPathBenchmarks[3]; // by TerrainCameraPath
+	bool mTerrainOcclusionCulling = false;
+	TerrainOcclusionBenchmark mTerrainOcclusionBenchmarks[2]; // by TerrainOcclusionScene
 	int mTerrainFallbackHeightmapIndex = -1;
+	SubmeshGeometry mTerrainStitchSubmeshes[kTerrainStitchVariants]; // index buffer ranges by TerrainTile::NeighborMask
+	SubmeshGeometry mTerrainClipmapSubmeshes[kTerrainClipmapRingVariants]; // by TerrainClipmap::GetRingVariant, last = full grid
+	int mTerrainMode = (int)TerrainMode::Quadtree;
+	int mTerrainClipmapLevels = 8;
+	ComPtr<ID3D12Resource> mTerrainClipmapTexture; // R32_FLOAT array, one slice per ring
+	D3D12_RESOURCE_STATES mTerrainClipmapState = D3D12_RESOURCE_STATE_COPY_DEST;
+	int mTerrainClipmapSrvIndex = -1;
+	TerrainClipmapBenchmark mTerrainClipmapBenchmark;
+	bool mTerrainClampCamera = false;
+	float mTerrainCameraClearance = 2.0f; // eye height kept above the ground
+	bool mTerrainPickValid = false;
+	XMFLOAT3 mTerrainPick = { 0.0f, 0.0f, 0.0f };
+	XMFLOAT3 mTerrainPickNormal = { 0.0f, 1.0f, 0.0f };
+	TerrainQueryBenchmark mTerrainQueryBenchmark;
+	TerrainHeightCompressionBenchmark mTerrainCompressionBenchmark;
+	TerrainGeneratorStats mTerrainGeneratorStats; // Tiles == 0 when the heightmaps were on disk
+	TerrainTilerStats mTerrainTilerStats;         // Tiles == 0 unless baked from a source heightmap at startup
 	bool mTerrainEnabled = true;
 	bool mTerrainWireframe = false;
+	bool mTerrainTightBounds = true;
+	TerrainHorizonStats mTerrainHorizonStats;
+	TerrainNormalBakeStats mTerrainNormalStats; // Tiles == 0 when the normal maps were up to date
+	ComPtr<ID3D12Resource> mTerrainHorizonTexture;  // RGBA8 array, kTerrainHorizonSlices slices
+	ComPtr<ID3D12Resource> mTerrainHorizonUpload;
+	int mTerrainHorizonSrvIndex = -1;
+	bool mTerrainHorizonShadows = true;
+	float mTerrainHorizonSoftness = 0.03f;
+	bool mTerrainAdaptive = false;
+	float mTerrainAdaptiveError = 0.1f;      // world units between a tile's RTIN mesh and its grid heights
+	uint32_t mTerrainAdaptiveVersion = 0;    // Terrain::GetAdaptiveMeshVersion of the uploaded "terrainAdaptive"
+	uint64_t mTerrainAdaptiveDrawnTriangles = 0;  // surface triangles drawn last frame
+	uint64_t mTerrainAdaptiveUniformTriangles = 0; // the same tiles as uniform grids
 	float mTerrainOriginY = 125.0f;  // above PBR spheres (y=120)
 
+	// Trees scattered over the quadtree square (TerrainScatter.h), billboards drawn after the terrain
+	TerrainVegetation mTerrainVegetation;
+	TerrainScatterSettings mTerrainVegetationSettings;
+	bool mTerrainVegetationEnabled = true;
+	int mTerrainVegetationPreset = 0;               // into kTerrainVegetationCounts
+	float mTerrainVegetationDistance = 150.0f;      // cells farther from the eye are not drawn (0 = no limit)
+	float mTerrainVegetationPlacement[3] = {};      // world size, origin Y and height scale scattered for
+	uint32_t mTerrainVegetationVersion = 0;         // TerrainVegetation::GetVersion of mTerrainVegetationBuffer
+	ComPtr<ID3D12Resource> mTerrainVegetationBuffer; // every tree, in cell order
+	ComPtr<ID3D12Resource> mTerrainVegetationUpload;
+	std::vector<TerrainVegetationRange> mTerrainVegetationDraws; // this frame's runs of visible cells
+	TerrainVegetationCullStats mTerrainVegetationCullStats;
+	TerrainScatterBenchmark mTerrainVegetationBenchmarks[kTerrainVegetationPresets];
+	int mVegetationMaterialIndex = -1;
+
+	ModelParseBenchmark mModelParseBenchmarks[kModelBenchmarkFileCount]; // by kModelBenchmarkFiles
+	ModelMeshStats mModelMeshStats[kModelBenchmarkFileCount];
+	ModelImportStats mModelImportStats[kModelBenchmarkFileCount];
+	MeshCacheBenchmark mMeshCacheBenchmarks[kModelBenchmarkFileCount];
+	double mModelLoadMs = 0.0; // BuildCustomMeshGeometry for every model at startup
+	int mModelsFromCache = 0;
+
+	// Heightmap streaming: 002/003 tiles (LOD 1..2) load on worker threads; 001 stays resident
+	static const int kTerrainStreamFirstLevel = 1;
+	static const int kTerrainStreamLevels = 2;
+	static const int kTerrainStreamSrvSlots = 2 * (4 + 16); // heightmap + normal map per tile
+	static const int kTerrainStreamUploadsPerFrame = 2;
+	struct TerrainStreamedTile
+	{
+		ComPtr<ID3D12Resource> Resource;
+		ComPtr<ID3D12Resource> NormalResource; // null when the tile has no baked normal map
+		int SrvIndex = -1;
+		int NormalSrvIndex = -1;
+		UINT64 Fence = 0; // retired tiles: released once the GPU has passed this fence
+	};
+	TerrainTileCache mTerrainTileCache;
+	std::unordered_map<uint32_t, TerrainStreamedTile> mTerrainStreamedTiles; // by node index
+	std::vector<TerrainStreamedTile> mTerrainRetiredTiles;
+	std::vector<ComPtr<ID3D12Resource>> mTerrainUploadHeaps[gNumFrameResources];
+	std::vector<int> mTerrainFreeSrvSlots;
+	int mTerrainStreamBudgetMB = 16;
+	bool mTerrainStreamingEnabled = true;
+
+	// Virtual texture over the quadtree terrain's surface: pages composed from the heightfield on
+	// worker threads, chosen by the terrain PS's feedback (one pixel of each 8x8 block per frame)
+	static const UINT kTerrainVTFeedbackWidth = 320; // feedback texels, enough for 2560x1440
+	static const UINT kTerrainVTFeedbackHeight = 180;
+	static const int kTerrainVTUploadsPerFrame = 4;
+	TerrainVirtualTexture mTerrainVirtualTexture;
+	std::shared_ptr<TerrainPageComposer> mTerrainPageComposer;
+	ComPtr<ID3D12Resource> mTerrainVTPageTable; // R32_UINT, one mip per page mip
+	ComPtr<ID3D12Resource> mTerrainVTAtlas;     // RGBA8 physical pages with their borders
+	ComPtr<ID3D12Resource> mTerrainVTFeedback;  // R32_UINT UAV, PackTerrainVTFeedback texels
+	D3D12_RESOURCE_STATES mTerrainVTPageTableState = D3D12_RESOURCE_STATE_COPY_DEST;
+	D3D12_RESOURCE_STATES mTerrainVTAtlasState = D3D12_RESOURCE_STATE_COPY_DEST;
+	D3D12_RESOURCE_STATES mTerrainVTFeedbackState = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+	int mTerrainVTSrvIndex = -1; // page table, then the atlas
+	int mTerrainVTUavIndex = -1;
+	UINT mTerrainVTFrame = 0;
+	TerrainVTConstants mTerrainVTConstants;
+	bool mTerrainVTFeedbackWritten = false; // a draw this frame wrote feedback
+	bool mTerrainVTEnabled = true;
+
 	// ---------------- DXR (RayQuery) shadows ----------------
 	bool mEnableDxrShadows = true;
 	bool mVisualizeDxrShadowMask = false;
@@ -498,6 +696,143 @@ static const XMFLOAT2 gHalton23_8[8] =
 	{0.0625f,8.0f / 9.0f},
 };
 
+// TexColumns.exe -bake <source.r16|.dds> [output root]: bake the terrain tile pyramid offline and exit.
+// Returns false when the command line asks for something else.
+static bool RunTerrainBakeCommand(int argc, char** argv, int& exitCode)
+{
+	if (argc < 3 || std::string(argv[1]) != "-bake")
+		return false;
+
+	if (!AttachConsole(ATTACH_PARENT_PROCESS))
+		AllocConsole();
+	freopen("CONOUT$", "w", stdout);
+	freopen("CONOUT$", "w", stderr);
+
+	TerrainTilerSettings settings; // all levels the source supports
+	const TerrainTilerStats stats = BakeTerrainTiles(argv[2], settings, argc > 3 ? argv[3] : "../../Textures");
+	PrintTerrainTilerStats(std::cout, stats);
+	exitCode = (stats.Error.empty() && stats.Failed == 0) ? 0 : 1;
+	return true;
+}
+
+// TexColumns.exe -meshstats [model ...]: ACMR, ATVR and overdraw of every submesh of ../../Common/<model>.obj
+// (sponza and negr by default) before and after OptimizeMesh, then exit. Returns false when the command
+// line asks for something else.
+static bool RunMeshStatsCommand(int argc, char** argv, int& exitCode)
+{
+	if (argc < 2 || std::string(argv[1]) != "-meshstats")
+		return false;
+
+	if (!AttachConsole(ATTACH_PARENT_PROCESS))
+		AllocConsole();
+	freopen("CONOUT$", "w", stdout);
+	freopen("CONOUT$", "w", stderr);
+
+	std::vector<std::string> models(argv + 2, argv + argc);
+	if (models.empty())
+		models = { "sponza", "negr" };
+	exitCode = 0;
+	for (const std::string& model : models)
+	{
+		const std::vector<MeshOptimizerReport> reports = ReportMeshOptimizer("../../Common/" + model + ".obj");
+		PrintMeshOptimizerReport(std::cout, model, reports);
+		if (reports.empty())
+			exitCode = 1;
+	}
+	return true;
+}
+
+// TexColumns.exe -terrainbench [levels] [frames]: time the pointer quadtree Terrain replaced against
+// Terrain::Update along each camera path, with the Terrain at its 3 levels and at `levels` (8 by default),
+// then the frustum tests alone, and exit. Returns false when the command line asks for something else.
+static bool RunTerrainBenchCommand(int argc, char** argv, int& exitCode)
+{
+	if (argc < 2 || std::string(argv[1]) != "-terrainbench")
+		return false;
+
+	if (!AttachConsole(ATTACH_PARENT_PROCESS))
+		AllocConsole();
+	freopen("CONOUT$", "w", stdout);
+	freopen("CONOUT$", "w", stderr);
+
+	const int levels = argc > 2 ? std::clamp(atoi(argv[2]), 1, kTerrainMaxLODLevels) : 8;
+	const int frames = argc > 3 ? std::max(atoi(argv[3]), 1) : 600;
+	static const char* kPathNames[3] = { "Walk", "Flyover", "Orbit" };
+	for (int path = 0; path < 3; ++path)
+	{
+		PrintTerrainUpdateBenchmark(std::cout, kPathNames[path],
+			BenchmarkTerrainUpdate((TerrainCameraPath)path, TerrainPointerQuadtree::kLevels, frames));
+		if (levels != TerrainPointerQuadtree::kLevels)
+			PrintTerrainUpdateBenchmark(std::cout, kPathNames[path], BenchmarkTerrainUpdate((TerrainCameraPath)path, levels, frames));
+	}
+	PrintTerrainFrustumBenchmark(std::cout, BenchmarkTerrainFrustum(levels, 200));
+	exitCode = 0;
+	return true;
+}
+
+// TexColumns.exe -selftest: run every CPU self-check (OBJ import, mesh cache and optimizer, terrain modules),
+// print each result and exit with 1 if any failed. Some write temporary files (mesh cache, tiler); the OBJ
+// checks read ../../Common/negr.obj. Returns false when the command line asks for something else.
+static bool RunSelfTestCommand(int argc, char** argv, int& exitCode)
+{
+	if (argc < 2 || std::string(argv[1]) != "-selftest")
+		return false;
+
+	if (!AttachConsole(ATTACH_PARENT_PROCESS))
+		AllocConsole();
+	freopen("CONOUT$", "w", stdout);
+	freopen("CONOUT$", "w", stderr);
+
+	struct SelfTest
+	{
+		const char* Name;
+		bool (*Run)(std::string* error);
+	};
+	static const SelfTest kSelfTests[] = {
+		{ "OBJ parser", [](std::string* error) { return ValidateModelParse("../../Common/negr.obj", error); } },
+		{ "OBJ welded mesh", [](std::string* error) { return ValidateModelMesh("../../Common/negr.obj", error); } },
+		{ "OBJ import", ValidateModelImport },
+		{ "Mesh cache", ValidateMeshCache },
+		{ "Mesh optimizer", ValidateMeshOptimizer },
+		{ "Terrain tiler", ValidateTerrainTiler },
+		{ "Terrain generator", ValidateTerrainGenerator },
+		{ "Terrain normals", ValidateTerrainNormals },
+		{ "Terrain tile cache", RunTerrainTileCacheSelfTest },
+		{ "Terrain grid stitching", [](std::string* error) { return ValidateTerrainGridStitching(kTerrainGridResolution, error); } },
+		{ "Terrain instance packing", ValidateTerrainInstancePacking },
+		{ "Terrain frustum culling", ValidateTerrainFrustum },
+		{ "Terrain clipmap", ValidateTerrainClipmap },
+		{ "Terrain queries", ValidateTerrainQueries },
+		{ "Terrain horizon map", ValidateTerrainHorizon },
+		{ "Terrain RTIN meshes", ValidateTerrainRtin },
+		{ "Terrain multi-view update", ValidateTerrainMultiView },
+		{ "Terrain temporal coherence", ValidateTerrainTemporalCoherence },
+		{ "Terrain height compression", ValidateTerrainHeightCompression },
+		{ "Terrain vegetation scatter", ValidateTerrainScatter },
+		{ "Terrain horizon occlusion", ValidateTerrainOcclusion },
+		{ "Terrain virtual texture", RunTerrainVirtualTextureSelfTest },
+	};
+	int failed = 0;
+	for (const SelfTest& test : kSelfTests)
+	{
+		std::string error;
+		const auto start = std::chrono::steady_clock::now();
+		const bool passed = test.Run(&error);
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "[SelfTest] " << test.Name << ": " << (passed ? "ok" : "FAILED") << " (" << ms << " ms)";
+		if (!passed)
+		{
+			std::cout << " - " << (error.empty() ? "no reason given" : error);
+			++failed;
+		}
+		std::cout << "\n";
+	}
+	const int total = (int)(sizeof(kSelfTests) / sizeof(kSelfTests[0]));
+	std::cout << "[SelfTest] " << total - failed << " of " << total << " passed\n";
+	exitCode = failed ? 1 : 0;
+	return true;
+}
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 	PSTR cmdLine, int showCmd)
 {
@@ -506,6 +841,16 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+	int bakeExitCode = 0;
+	if (RunTerrainBakeCommand(__argc, __argv, bakeExitCode))
+		return bakeExitCode;
+	if (RunMeshStatsCommand(__argc, __argv, bakeExitCode))
+		return bakeExitCode;
+	if (RunTerrainBenchCommand(__argc, __argv, bakeExitCode))
+		return bakeExitCode;
+	if (RunSelfTestCommand(__argc, __argv, bakeExitCode))
+		return bakeExitCode;
+
 	try
 	{
 		TexColumnsApp theApp(hInstance);
@@ -576,8 +921,11 @@ bool TexColumnsApp::Initialize()
 	mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
 
+	GenerateMissingTerrainHeightmaps();
+	BakeMissingTerrainNormalMaps();
 	LoadAllTextures();
 	BuildRootSignature();
+	BuildTerrainRootSignature();
 	BuildLightingRootSignature();
 	BuildShadowPassRootSignature();
 	BuildPostProcessRootSignature();
@@ -601,10 +949,16 @@ bool TexColumnsApp::Initialize()
 	mTerrain->SetWorldSize(mTerrainWorldSize);
 	mTerrain->SetHeightScale(mTerrainHeightScale);
 	mTerrain->SetOriginY(mTerrainOriginY);
-	mTerrain->SetLODDistances(mTerrainWorldSize * mTerrainLOD1Factor, mTerrainWorldSize * mTerrainLOD2Factor);
+	mTerrain->SetMaxPixelError(mTerrainMaxPixelError);
+	mTerrain->SetLODHysteresis(mTerrainLODHysteresis);
+	mTerrain->SetLODLevels(mTerrainLODLevels);
+	mTerrain->SetHeightfield(LoadTerrainHeightfield());
 	mTerrain->BuildQuadtree();
-	mTerrain->AssignHeightmapIndices(mTerrainHeightmapIndicesLOD0, mTerrainHeightmapIndicesLOD1, mTerrainHeightmapIndicesLOD2);
+	BuildTerrainHorizonMap();
+	mTerrain->AssignHeightmapIndices(mTerrainHeightmapIndices, mTerrainNormalMapIndices);
+	StartTerrainStreaming();
 	BuildFrameResources();
+	StartTerrainVirtualTexture();
 
 	D3D12_DESCRIPTOR_HEAP_DESC imGuiHeapDesc = {};
 	imGuiHeapDesc.NumDescriptors = 1;
@@ -731,6 +1085,7 @@ void TexColumnsApp::Update(const GameTimer& gt)
 		WaitForSingleObject(eventHandle, INFINITE);
 		CloseHandle(eventHandle);
 	}
+	ClampCameraToTerrain();
 	UpdateCamera(gt);
 	// ImGui Setup
 	ImGui_ImplDX12_NewFrame();
@@ -870,13 +1225,240 @@ void TexColumnsApp::Update(const GameTimer& gt)
 	ImGui::Begin("Terrain");
 	ImGui::Checkbox("Enable terrain", &mTerrainEnabled);
 	ImGui::Checkbox("Wireframe (debug)", &mTerrainWireframe);
+	ImGui::Checkbox("Tight height bounds", &mTerrainTightBounds);
 	ImGui::DragFloat("Origin Y (above spheres)", &mTerrainOriginY, 1.0f, -100.0f, 300.0f);
 	ImGui::DragFloat("World size (XZ)", &mTerrainWorldSize, 1.0f, 10.0f, 500.0f);
 	ImGui::DragFloat("Height scale", &mTerrainHeightScale, 0.5f, 1.0f, 200.0f);
-	ImGui::DragFloat("LOD1 distance factor", &mTerrainLOD1Factor, 0.05f, 0.1f, 2.0f, "%.2f");
-	ImGui::DragFloat("LOD2 distance factor", &mTerrainLOD2Factor, 0.05f, 0.05f, 1.0f, "%.2f");
+	ImGui::DragFloat("Max pixel error", &mTerrainMaxPixelError, 0.1f, 0.5f, 32.0f, "%.1f");
+	ImGui::DragFloat("LOD hysteresis", &mTerrainLODHysteresis, 0.01f, 0.0f, 0.9f, "%.2f");
+	ImGui::Checkbox("Temporal LOD coherence", &mTerrainTemporalLOD);
+	ImGui::Checkbox("Occlusion culling", &mTerrainOcclusionCulling);
+	ImGui::SliderInt("LOD levels", &mTerrainLODLevels, 1, kTerrainMaxLODLevels);
+	ImGui::Checkbox("Horizon shadows", &mTerrainHorizonShadows);
+	if (mTerrainHorizonShadows)
+	{
+		ImGui::SameLine();
+		ImGui::DragFloat("Softness (rad)", &mTerrainHorizonSoftness, 0.002f, 0.001f, 0.3f, "%.3f");
+	}
+	ImGui::Checkbox("Adaptive meshes (RTIN)", &mTerrainAdaptive);
+	if (mTerrainAdaptive)
+	{
+		ImGui::SameLine();
+		ImGui::DragFloat("Mesh error", &mTerrainAdaptiveError, 0.005f, 0.0f, 5.0f, "%.3f");
+	}
+	ImGui::Checkbox("Virtual texture", &mTerrainVTEnabled);
+	ImGui::Checkbox("Casts shadows", &mTerrainCastsShadows);
+	if (mTerrainCastsShadows)
+	{
+		ImGui::SameLine();
+		ImGui::DragFloat("Shadow error scale", &mTerrainShadowErrorScale, 0.01f, 0.05f, 1.0f, "%.2f");
+	}
+	ImGui::Combo("Mode", &mTerrainMode, "Quadtree\0Clipmap\0");
+	if (mTerrainMode == (int)TerrainMode::Clipmap)
+		ImGui::SliderInt("Clipmap levels", &mTerrainClipmapLevels, 1, kTerrainClipmapMaxLevels);
 	if (mTerrain)
+	{
 		ImGui::Text("Visible tiles: %zu", mTerrain->GetVisibleTiles().size());
+		ImGui::Text("Update: %.4f ms  nodes visited: %u  reused: %u  culled: %u", mTerrain->GetStats().UpdateMs,
+			mTerrain->GetStats().NodesVisited, mTerrain->GetStats().NodesReused, mTerrain->GetStats().NodesCulled);
+		ImGui::Text("Forced splits (LOD balance): %u", mTerrain->GetStats().ForcedSplits);
+		if (mTerrainOcclusionCulling)
+			ImGui::Text("Occluded tiles: %u in %.4f ms", mTerrain->GetStats().TilesOccluded, mTerrain->GetStats().OcclusionMs);
+		ImGui::Text("Views: %u (camera + shadow lights), shadow tiles: %u", mTerrain->GetStats().Views,
+			mTerrain->GetStats().ShadowTiles);
+		ImGui::Text("CPU heightfield: %dx%d", mTerrain->GetHeightfield().Width, mTerrain->GetHeightfield().Height);
+		if (mTerrainGeneratorStats.Tiles > 0)
+			ImGui::Text("Generated heightmaps: %d tiles in %.2f s, %.1f Mtexels/s (%.1f per thread)", mTerrainGeneratorStats.Tiles,
+				mTerrainGeneratorStats.TotalSeconds, mTerrainGeneratorStats.MTexelsPerSecond, mTerrainGeneratorStats.KernelMTexelsPerThread);
+		if (mTerrainTilerStats.Tiles > 0)
+			ImGui::Text("Baked heightmaps: %dx%d source, %d tiles in %.2f s, peak RSS %.0f MB", mTerrainTilerStats.SourceWidth,
+				mTerrainTilerStats.SourceHeight, mTerrainTilerStats.Tiles, mTerrainTilerStats.TotalSeconds,
+				(double)mTerrainTilerStats.PeakResidentBytes / (1024.0 * 1024.0));
+		if (mTerrainHorizonStats.Width > 0)
+			ImGui::Text("Horizon map: %dx%d x %d directions in %.1f ms (%.2f ms per 512^2 tile, %d threads)",
+				mTerrainHorizonStats.Width, mTerrainHorizonStats.Height, kTerrainHorizonDirections, mTerrainHorizonStats.TotalMs,
+				mTerrainHorizonStats.MsPerTile, mTerrainHorizonStats.Threads);
+		if (mTerrainNormalStats.Tiles > 0)
+			ImGui::Text("Baked normal maps: %d tiles in %.2f s (%.1f ms per tile, %d threads)", mTerrainNormalStats.Tiles,
+				mTerrainNormalStats.TotalSeconds, mTerrainNormalStats.MsPerTile, mTerrainNormalStats.Threads);
+		if (mTerrainVTEnabled && mTerrainVirtualTexture.IsStarted())
+		{
+			const TerrainVTStats vt = mTerrainVirtualTexture.GetStats();
+			const int slots = mTerrainVirtualTexture.GetSettings().PhysicalPagesPerSide * mTerrainVirtualTexture.GetSettings().PhysicalPagesPerSide;
+			ImGui::Text("Virtual texture: %u/%d pages resident, %u wanted, %u queued, %u composing", vt.Resident, slots,
+				vt.PagesRequested, vt.Queued, vt.Loading);
+			ImGui::Text("Feedback: %u texels  uploads: %llu  evictions: %llu  compose: %.2f ms/page", vt.FeedbackTexels,
+				(unsigned long long)vt.Uploads, (unsigned long long)vt.Evictions, mTerrainPageComposer->GetAverageComposeMs());
+		}
+		if (mTerrainAdaptive && mTerrain->GetMode() == TerrainMode::Quadtree)
+		{
+			const TerrainRtinStats& rtin = mTerrain->GetAdaptiveMeshStats();
+			ImGui::Text("Adaptive meshes: %d tiles, %.2fx fewer triangles, %llu skirt, built in %.1f ms on %d threads",
+				rtin.Tiles, rtin.Reduction, (unsigned long long)rtin.SkirtTriangles, rtin.BuildMs, rtin.Threads);
+			if (mTerrainAdaptiveDrawnTriangles > 0)
+				ImGui::Text("Drawn: %llu triangles (uniform grid: %llu, %.2fx)", (unsigned long long)mTerrainAdaptiveDrawnTriangles,
+					(unsigned long long)mTerrainAdaptiveUniformTriangles,
+					(double)mTerrainAdaptiveUniformTriangles / (double)mTerrainAdaptiveDrawnTriangles);
+		}
+		if (mTerrain->GetMode() == TerrainMode::Clipmap)
+		{
+			const int quads = mTerrain->GetClipmap().GetQuadsPerSide();
+			ImGui::Text("Clipmap: %d rings x %d verts, heights updated: %u", mTerrain->GetClipmap().GetLevelCount(),
+				(quads + 1) * (quads + 1), mTerrain->GetStats().ClipmapSamplesUpdated);
+			if (ImGui::Button("Benchmark clipmap moves (1000x)"))
+				mTerrainClipmapBenchmark = mTerrain->BenchmarkClipmap(1000, mTerrain->GetClipmap().GetFinestSpacing() * 4.0f);
+			if (mTerrainClipmapBenchmark.SamplesPerMove > 0.0)
+				ImGui::Text("Per move: update %.2f us, fill %.2f us (%.0f heights)", mTerrainClipmapBenchmark.UpdateUs,
+					mTerrainClipmapBenchmark.FillUs, mTerrainClipmapBenchmark.SamplesPerMove);
+		}
+		if (mTerrainStreamingEnabled)
+		{
+			const TerrainTileCacheStats streamStats = mTerrainTileCache.GetStats();
+			ImGui::SliderInt("Stream budget (MB)", &mTerrainStreamBudgetMB, 1, 256);
+			ImGui::Text("Tiles resident: %u (%.1f MB)  loading: %u  queued: %u  failed: %u", streamStats.Resident,
+				streamStats.ResidentBytes / (1024.0 * 1024.0), streamStats.Loading, streamStats.Queued, streamStats.Failed);
+			ImGui::Text("Requests: %u  loads: %llu  evictions: %llu", mTerrain->GetStats().TileRequests,
+				(unsigned long long)streamStats.Loads, (unsigned long long)streamStats.Evictions);
+		}
+		ImGui::Checkbox("Clamp camera to ground", &mTerrainClampCamera);
+		ImGui::SameLine();
+		ImGui::DragFloat("Clearance", &mTerrainCameraClearance, 0.1f, 0.1f, 50.0f, "%.1f");
+		if (mTerrainPickValid)
+			ImGui::Text("Picked (RMB): %.2f, %.2f, %.2f  normal %.2f, %.2f, %.2f", mTerrainPick.x, mTerrainPick.y, mTerrainPick.z,
+				mTerrainPickNormal.x, mTerrainPickNormal.y, mTerrainPickNormal.z);
+		else
+			ImGui::Text("Picked (RMB): none");
+		if (ImGui::Button("Benchmark queries (1M)"))
+			mTerrainQueryBenchmark = mTerrain->BenchmarkQueries(1 << 20);
+		if (mTerrainQueryBenchmark.HeightsScalar > 0.0)
+			ImGui::Text("Mq/s: height %.1f, batched %.1f, normals %.1f, rays %.2f (%.0f%% hit)",
+				mTerrainQueryBenchmark.HeightsScalar, mTerrainQueryBenchmark.HeightsBatched, mTerrainQueryBenchmark.NormalsBatched,
+				mTerrainQueryBenchmark.Raycasts, 100.0 * mTerrainQueryBenchmark.RaycastHitRate);
+		if (ImGui::Button("Benchmark compressed heightfield (1M)"))
+		{
+			TerrainCompressedHeightfield compressed;
+			mTerrainCompressionBenchmark = BenchmarkTerrainHeightCompression(mTerrain->GetHeightfield(), {}, 1 << 20, compressed);
+		}
+		if (mTerrainCompressionBenchmark.CompressedBytes > 0)
+		{
+			const TerrainHeightCompressionBenchmark& b = mTerrainCompressionBenchmark;
+			ImGui::Text("Heights MB: float %.2f, R16 %.2f, compressed %.2f (%.2f bits/texel, max error %.1e)",
+				b.FloatBytes / 1048576.0, b.R16Bytes / 1048576.0, b.CompressedBytes / 1048576.0, b.BitsPerTexel, b.MaxError);
+			ImGui::Text("ns/query: texel %.1f -> %.1f, bilinear %.1f -> %.1f; rows %.0f Mtexel/s", b.FloatAtNs, b.CompressedAtNs,
+				b.FloatSampleNs, b.CompressedSampleNs, b.RowDecodeMTexelsPerSecond);
+		}
+		if (ImGui::Button("Benchmark Update vs pointer tree (600 frames)"))
+			mTerrainUpdateBenchmark = BenchmarkTerrainUpdate(TerrainCameraPath::Flyover, mTerrainLODLevels, 600);
+		if (mTerrainUpdateBenchmark.Frames > 0)
+		{
+			const TerrainUpdateBenchmark& b = mTerrainUpdateBenchmark;
+			ImGui::Text("Pointer tree: %.4f ms, %.1f nodes; Update (%d levels): %.4f ms, %.1f nodes (coherent %.4f ms)",
+				b.PointerTreeMs, b.PointerTreeNodesVisited, b.Levels, b.UpdateMs, b.UpdateNodesVisited, b.CoherentMs);
+		}
+		if (ImGui::Button("Benchmark camera paths (600 frames)"))
+		{
+			std::vector<TerrainView> pathViews;
+			std::vector<XMFLOAT3> pathEyes;
+			const Terrain* terrain = mTerrain.get();
+			for (int path = 0; path < 3; ++path)
+			{
+				BuildTerrainCameraPath((TerrainCameraPath)path, mTerrain->GetWorldSizeXZ(), 2.0f * atanf(1.0f / mBaseProj._22),
+					AspectRatio(), 600, [terrain](float x, float z) { return terrain->SampleHeight(x, z); }, pathViews, pathEyes);
+				mTerrainPathBenchmarks[path] = mTerrain->BenchmarkCameraPath(pathViews, pathEyes);
+			}
+		}
+		static const char* kPathNames[3] = { "Walk", "Flyover", "Orbit" };
+		for (int path = 0; path < 3; ++path)
+		{
+			const TerrainCameraPathBenchmark& b = mTerrainPathBenchmarks[path];
+			if (b.Frames > 0)
+				ImGui::Text("%s: %.4f -> %.4f ms, nodes visited %.0f -> %.0f (%.0f reused)", kPathNames[path], b.FullMs,
+					b.CoherentMs, b.FullNodesVisited, b.CoherentNodesVisited, b.CoherentNodesReused);
+		}
+		if (ImGui::Button("Benchmark occlusion culling (1025^2, 300 frames)"))
+			for (int scene = 0; scene < 2; ++scene)
+				mTerrainOcclusionBenchmarks[scene] = BenchmarkTerrainOcclusion((TerrainOcclusionScene)scene, 1025, 300);
+		static const char* kOcclusionSceneNames[2] = { "Hills", "Ridges" };
+		for (int scene = 0; scene < 2; ++scene)
+		{
+			const TerrainOcclusionBenchmark& b = mTerrainOcclusionBenchmarks[scene];
+			if (b.Frames > 0)
+				ImGui::Text("%s: tiles %.1f -> %.1f, update %.4f ms + occlusion %.4f ms", kOcclusionSceneNames[scene],
+					b.TilesBefore, b.TilesAfter, b.UpdateMs, b.OcclusionMs);
+		}
+
+		ImGui::Checkbox("Trees", &mTerrainVegetationEnabled);
+		if (mTerrainVegetationEnabled)
+		{
+			ImGui::SameLine();
+			ImGui::Combo("Count", &mTerrainVegetationPreset, "10k\0" "100k\0" "300k\0" "1M\0");
+			ImGui::DragFloat("Max slope (deg)", &mTerrainVegetationSettings.MaxSlopeDegrees, 0.5f, 0.0f, 90.0f, "%.1f");
+			ImGui::DragFloatRange2("Height band", &mTerrainVegetationSettings.MinHeight, &mTerrainVegetationSettings.MaxHeight,
+				0.005f, 0.0f, 1.0f, "%.3f");
+			ImGui::DragFloatRange2("Tree size", &mTerrainVegetationSettings.MinSize, &mTerrainVegetationSettings.MaxSize,
+				0.05f, 0.1f, 20.0f, "%.2f");
+			ImGui::DragFloat("Draw distance", &mTerrainVegetationDistance, 1.0f, 0.0f, 2000.0f, "%.0f");
+			const TerrainVegetationCullStats& cull = mTerrainVegetationCullStats;
+			ImGui::Text("Trees: %zu of %zu candidates, scattered in %.1f ms in %zu cells", mTerrainVegetation.GetInstances().size(),
+				mTerrainVegetation.GetCandidates(), mTerrainVegetation.GetScatterMs(), mTerrainVegetation.GetCells().size());
+			ImGui::Text("Cull: %.4f ms, %u cells, %u trees in %u draws; frame %.2f ms", cull.CullMs, cull.CellsVisible,
+				cull.Instances, cull.Draws, 1000.0f / std::max(ImGui::GetIO().Framerate, 1e-3f));
+		}
+		if (ImGui::Button("Benchmark tree scatter + cull (10k-1M)"))
+			BenchmarkTerrainScatter(mTerrain->GetHeightQuery(), mTerrain->GetWorldSizeXZ(), mTerrainOriginY, mTerrainHeightScale,
+				mMainPassCB.ViewProj, mMainPassCB.EyePosW, mTerrainVegetationDistance, kTerrainVegetationCounts,
+				kTerrainVegetationPresets, 100, mTerrainVegetationBenchmarks);
+		for (const TerrainScatterBenchmark& b : mTerrainVegetationBenchmarks)
+			if (b.Target > 0)
+				ImGui::Text("%zu trees: scatter %.1f ms, cull %.4f ms (%zu cells) -> %u trees in %u draws", b.Instances,
+					b.ScatterMs, b.CullMs, b.Cells, b.VisibleInstances, b.Draws);
+	}
+	ImGui::End();
+
+	ImGui::Begin("Models");
+	if (ImGui::Button("Benchmark OBJ parse (20x)"))
+		for (int i = 0; i < kModelBenchmarkFileCount; ++i)
+			mModelParseBenchmarks[i] = BenchmarkModelParse(std::string("../../Common/") + kModelBenchmarkFiles[i], 20);
+	for (int i = 0; i < kModelBenchmarkFileCount; ++i)
+	{
+		const ModelParseBenchmark& b = mModelParseBenchmarks[i];
+		if (b.Bytes > 0)
+			ImGui::Text("%s (%.0f KB): %.1f -> %.1f MB/s (%.2f -> %.2f ms, %d threads)", kModelBenchmarkFiles[i],
+				b.Bytes / 1024.0, b.LegacyMBps, b.MappedMBps, b.LegacyMs, b.MappedMs, b.Threads);
+	}
+	if (ImGui::Button("Weld OBJ meshes"))
+		for (int i = 0; i < kModelBenchmarkFileCount; ++i)
+			mModelMeshStats[i] = MeasureModelMesh(std::string("../../Common/") + kModelBenchmarkFiles[i]);
+	for (int i = 0; i < kModelBenchmarkFileCount; ++i)
+	{
+		const ModelMeshStats& m = mModelMeshStats[i];
+		if (m.Triangles > 0)
+			ImGui::Text("%s: %zu triangles, %zu -> %zu vertices; KB memory %.0f -> %.0f, upload %.0f -> %.0f (%.2f ms)",
+				kModelBenchmarkFiles[i], m.Triangles, m.Corners, m.Vertices, m.FaceBytes / 1024.0, m.MeshBytes / 1024.0,
+				m.UnindexedUploadBytes / 1024.0, m.IndexedUploadBytes / 1024.0, m.WeldMs);
+	}
+	if (ImGui::Button("Benchmark OBJ import (20x)"))
+		for (int i = 0; i < kModelBenchmarkFileCount; ++i)
+			mModelImportStats[i] = BenchmarkModelImport(std::string("../../Common/") + kModelBenchmarkFiles[i], 20);
+	for (int i = 0; i < kModelBenchmarkFileCount; ++i)
+	{
+		const ModelImportStats& m = mModelImportStats[i];
+		if (m.FileBytes > 0)
+			ImGui::Text("%s: %zu meshes, %zu vertices; %.2f ms (parse %.2f, MTL %.2f, meshes %.2f); KB parsed %.0f, meshes %.0f",
+				kModelBenchmarkFiles[i], m.Meshes, m.Vertices, m.TotalMs, m.ParseMs, m.MaterialMs, m.MeshMs,
+				m.ModelBytes / 1024.0, m.MeshBytes / 1024.0);
+	}
+	ImGui::Text("Startup models: %.1f ms, %d of 5 from MeshCache", mModelLoadMs, mModelsFromCache);
+	if (ImGui::Button("Benchmark mesh cache (20x)"))
+		for (int i = 0; i < kModelBenchmarkFileCount; ++i)
+			mMeshCacheBenchmarks[i] = BenchmarkMeshCache(std::string("../../Common/") + kModelBenchmarkFiles[i], 20);
+	for (int i = 0; i < kModelBenchmarkFileCount; ++i)
+	{
+		const MeshCacheBenchmark& b = mMeshCacheBenchmarks[i];
+		if (b.FileBytes > 0)
+			ImGui::Text("%s (%.0f KB cached): cold %.2f ms + %.2f ms write, warm %.3f ms", kModelBenchmarkFiles[i],
+				b.FileBytes / 1024.0, b.ImportMs, b.WriteMs, b.LoadMs);
+	}
 	ImGui::End();
 
 	TAAConstants c = {};
@@ -895,14 +1477,43 @@ void TexColumnsApp::Update(const GameTimer& gt)
 	{
 		mTerrain->SetHeightScale(mTerrainHeightScale);
 		mTerrain->SetOriginY(mTerrainOriginY);
-		mTerrain->SetLODDistances(mTerrainWorldSize * mTerrainLOD1Factor, mTerrainWorldSize * mTerrainLOD2Factor);
-		if (mTerrain->GetWorldSizeXZ() != mTerrainWorldSize)
+		mTerrain->SetTightHeightBounds(mTerrainTightBounds);
+		mTerrain->SetMaxPixelError(mTerrainMaxPixelError);
+		mTerrain->SetLODHysteresis(mTerrainLODHysteresis);
+		mTerrain->SetTemporalCoherence(mTerrainTemporalLOD);
+		mTerrain->SetOcclusionCulling(mTerrainOcclusionCulling);
+		mTerrain->SetMode((TerrainMode)mTerrainMode);
+		mTerrain->SetClipmapLevels(mTerrainClipmapLevels);
+		mTerrain->SetAdaptiveMeshes(mTerrainAdaptive, mTerrainAdaptiveError);
+		// Projection scale for screen-space error: _22 = 1 / tan(fovY / 2)
+		mTerrain->SetViewport(2.0f * atanf(1.0f / mBaseProj._22), (float)mClientHeight);
+		if (mTerrain->GetWorldSizeXZ() != mTerrainWorldSize || mTerrain->GetLODLevels() != mTerrainLODLevels)
 		{
 			mTerrain->SetWorldSize(mTerrainWorldSize);
+			mTerrain->SetLODLevels(mTerrainLODLevels);
 			mTerrain->BuildQuadtree();
-			mTerrain->AssignHeightmapIndices(mTerrainHeightmapIndicesLOD0, mTerrainHeightmapIndicesLOD1, mTerrainHeightmapIndicesLOD2);
 		}
-		mTerrain->Update(mMainPassCB.ViewProj, mMainPassCB.EyePosW);
+		mTerrainTileCache.SetBudgetBytes((size_t)mTerrainStreamBudgetMB << 20);
+		mTerrainTileCache.BeginFrame();
+		// The camera and every shadow-casting light in one traversal (UpdateLightCBs set LightViewProj)
+		TerrainView views[kTerrainMaxViews];
+		views[0].ViewProj = mMainPassCB.ViewProj;
+		int viewCount = 1;
+		mTerrainShadowViewLights.clear();
+		for (const auto& l : mLights)
+		{
+			if (!mTerrainCastsShadows || viewCount == kTerrainMaxViews)
+				break;
+			if ((l.type == 2 || l.type == 3) && l.CastsShadows)
+			{
+				views[viewCount].ViewProj = l.LightViewProj;
+				views[viewCount].ErrorScale = mTerrainShadowErrorScale;
+				mTerrainShadowViewLights.push_back(l.LightCBIndex);
+				++viewCount;
+			}
+		}
+		mTerrain->UpdateViews(views, viewCount, mMainPassCB.EyePosW);
+		UpdateTerrainVegetation();
 	}
 
 	// DXR shadow constants (updated every frame; TAA will filter noise)
@@ -991,12 +1602,50 @@ void TexColumnsApp::RotateSpotlightTowardCursor(int x, int y)
 }
 
 
+// Ray through the cursor (unjittered projection) against the CPU terrain surface
+void TexColumnsApp::PickTerrain(int x, int y)
+{
+	mTerrainPickValid = false;
+	if (!mTerrainEnabled || !mTerrain) return;
+	const float px = (2.0f * x) / mClientWidth - 1.0f;
+	const float py = 1.0f - (2.0f * y) / mClientHeight;
+	XMMATRIX invView = XMMatrixInverse(nullptr, XMLoadFloat4x4(&mView));
+	XMMATRIX invProj = XMMatrixInverse(nullptr, XMLoadFloat4x4(&mBaseProj));
+	XMVECTOR rayView = XMVectorSetW(XMVector3TransformCoord(XMVectorSet(px, py, 1.0f, 1.0f), invProj), 0.0f);
+	XMFLOAT3 origin, direction;
+	XMStoreFloat3(&origin, cam.GetPosition());
+	XMStoreFloat3(&direction, XMVector3Normalize(XMVector3TransformNormal(rayView, invView)));
+
+	TerrainRayHit hit;
+	if (mTerrain->Raycast(origin, direction, 10.0f * mTerrainWorldSize + mTerrainHeightScale, hit))
+	{
+		mTerrainPickValid = true;
+		mTerrainPick = { hit.Position[0], hit.Position[1], hit.Position[2] };
+		mTerrainPickNormal = { hit.Normal[0], hit.Normal[1], hit.Normal[2] };
+	}
+}
+
+// Keep the eye at least mTerrainCameraClearance above the terrain under it
+void TexColumnsApp::ClampCameraToTerrain()
+{
+	if (!mTerrainClampCamera || !mTerrainEnabled || !mTerrain || mTerrain->GetHeightfield().Empty()) return;
+	XMFLOAT3 pos;
+	XMStoreFloat3(&pos, cam.GetPosition());
+	const float minY = mTerrain->SampleHeight(pos.x, pos.z) + mTerrainCameraClearance;
+	if (pos.y >= minY) return;
+	pos.y = minY;
+	cam.SetPosition(pos);
+	cam.UpdateViewMatrix();
+}
+
 void TexColumnsApp::OnMouseDown(WPARAM btnState, int x, int y)
 {
 	mLastMousePos.x = x;
 	mLastMousePos.y = y;
 
 	SetCapture(mhMainWnd);
+	if ((btnState & MK_RBUTTON) != 0 && !ImGui::GetIO().WantCaptureMouse)
+		PickTerrain(x, y);
 	//if ((btnState & MK_LBUTTON) != 0 && !ImGui::GetIO().WantCaptureMouse)
 	//{
 	//	RotateSpotlightTowardCursor(x, y);
@@ -1611,14 +2260,183 @@ void TexColumnsApp::LoadTerrainTextures()
 		if (mTextures.find(name) == mTextures.end())
 			LoadTexture(name);
 	};
+	// Only the root heightmap and its normal map are loaded up front; 002/003 tiles are streamed
+	// (StartTerrainStreaming)
 	tryLoad("001/Height_Out");
-	tryLoad("002/Height/Height_Out_y0_x0");
-	tryLoad("002/Height/Height_Out_y0_x1");
-	tryLoad("002/Height/Height_Out_y1_x0");
-	tryLoad("002/Height/Height_Out_y1_x1");
-	for (int z = 0; z < 4; ++z)
-		for (int x = 0; x < 4; ++x)
-			tryLoad("003/Height/Height_Out_y" + std::to_string(z) + "_x" + std::to_string(x));
+	tryLoad("001/Normal_Out");
+	// Vegetation billboards: an array of species and three single ones
+	tryLoad("treeArray2");
+	tryLoad("tree01S");
+	tryLoad("tree02S");
+	tryLoad("tree35S");
+}
+
+// The 001/002/003 heightmaps are not shipped with the sources: on first run bake them from
+// Textures/TerrainSource.r16 (or .dds) when there is one, else write procedural ones
+void TexColumnsApp::GenerateMissingTerrainHeightmaps()
+{
+	const std::filesystem::path root = L"../../Textures";
+	const int levels = kTerrainStreamFirstLevel + kTerrainStreamLevels;
+	bool complete = true;
+	for (int lod = 0; lod < levels && complete; ++lod)
+		for (int z = 0; z < (1 << lod) && complete; ++z)
+			for (int x = 0; x < (1 << lod) && complete; ++x)
+				complete = std::filesystem::exists(TerrainTilePath(root, lod, x, z));
+	if (complete)
+		return;
+
+	for (const wchar_t* sourceName : { L"TerrainSource.r16", L"TerrainSource.dds" })
+	{
+		if (!std::filesystem::exists(root / sourceName))
+			continue;
+		TerrainTilerSettings settings;
+		settings.Levels = levels;
+		mTerrainTilerStats = BakeTerrainTiles(root / sourceName, settings, root);
+		PrintTerrainTilerStats(std::cout, mTerrainTilerStats);
+		if (mTerrainTilerStats.Error.empty() && mTerrainTilerStats.Failed == 0)
+			return;
+	}
+
+	TerrainGeneratorSettings settings;
+	settings.Levels = levels;
+	mTerrainGeneratorStats = GenerateTerrainTiles(settings, root);
+	std::cout << "[GenerateMissingTerrainHeightmaps] " << mTerrainGeneratorStats.Tiles << " tiles ("
+		<< mTerrainGeneratorStats.Failed << " failed) on " << mTerrainGeneratorStats.Threads << " threads in "
+		<< mTerrainGeneratorStats.TotalSeconds << " s: " << mTerrainGeneratorStats.MTexelsPerSecond << " Mtexels/s, kernels "
+		<< mTerrainGeneratorStats.KernelMTexelsPerThread << " Mtexels/s per thread\n";
+}
+
+// Normal maps next to every heightmap tile, rebaked when missing or older than the heights they
+// are derived from (including the neighbours read across tile borders)
+void TexColumnsApp::BakeMissingTerrainNormalMaps()
+{
+	TerrainNormalBakeSettings settings;
+	settings.Levels = kTerrainStreamFirstLevel + kTerrainStreamLevels;
+	mTerrainNormalStats = BakeTerrainNormalMaps(L"../../Textures", settings);
+	if (mTerrainNormalStats.Tiles > 0 || mTerrainNormalStats.Failed > 0)
+		std::cout << "[BakeMissingTerrainNormalMaps] " << mTerrainNormalStats.Tiles << " tiles (" << mTerrainNormalStats.Failed
+			<< " failed, " << mTerrainNormalStats.Skipped << " up to date) on " << mTerrainNormalStats.Threads << " threads in "
+			<< mTerrainNormalStats.TotalSeconds << " s: " << mTerrainNormalStats.MsPerTile << " ms per tile\n";
+}
+
+void TexColumnsApp::StartTerrainStreaming()
+{
+	if (!mTerrainStreamingEnabled)
+		return;
+	// Each tile's normal map travels with its heightmap as the companion file
+	auto loader = std::make_shared<TerrainFileTileLoader>([](const TerrainTileId& id) {
+		return TerrainTilePath(L"../../Textures", id.LOD, id.TileX, id.TileZ);
+	}, [](const TerrainTileId& id) {
+		return TerrainNormalTilePath(L"../../Textures", id.LOD, id.TileX, id.TileZ);
+	});
+	mTerrainTileCache.SetBudgetBytes((size_t)mTerrainStreamBudgetMB << 20);
+	mTerrainTileCache.Start(loader, 2);
+	mTerrain->SetTileStreaming(&mTerrainTileCache, kTerrainStreamFirstLevel, kTerrainStreamLevels);
+}
+
+// Runs on the frame's command list before any terrain draw: uploads tiles the workers finished,
+// evicts tiles over the budget and frees GPU memory/SRV slots the GPU no longer references.
+void TexColumnsApp::UpdateTerrainStreaming(ID3D12GraphicsCommandList* cmdList)
+{
+	if (!mTerrainStreamingEnabled || !mTerrain)
+		return;
+	// This frame resource's previous upload has completed (Update waited on its fence)
+	mTerrainUploadHeaps[mCurrFrameResourceIndex].clear();
+	const UINT64 completed = mFence->GetCompletedValue();
+	for (size_t i = 0; i < mTerrainRetiredTiles.size();)
+	{
+		if (mTerrainRetiredTiles[i].Fence > completed) { ++i; continue; }
+		mTerrainFreeSrvSlots.push_back(mTerrainRetiredTiles[i].SrvIndex);
+		if (mTerrainRetiredTiles[i].NormalSrvIndex >= 0)
+			mTerrainFreeSrvSlots.push_back(mTerrainRetiredTiles[i].NormalSrvIndex);
+		mTerrainRetiredTiles[i] = std::move(mTerrainRetiredTiles.back());
+		mTerrainRetiredTiles.pop_back();
+	}
+
+	// Upload a DDS into a free terrain slot; returns the slot and adds the texture's size to bytes
+	auto upload = [&](const std::vector<uint8_t>& dds, ComPtr<ID3D12Resource>& resource, size_t& bytes) {
+		ComPtr<ID3D12Resource> uploadHeap;
+		if (FAILED(DirectX::CreateDDSTextureFromMemory12(md3dDevice.Get(), cmdList, dds.data(), dds.size(), resource, uploadHeap)))
+			return -1;
+		mTerrainUploadHeaps[mCurrFrameResourceIndex].push_back(uploadHeap);
+
+		const D3D12_RESOURCE_DESC texDesc = resource->GetDesc();
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.Format = texDesc.Format;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MipLevels = texDesc.MipLevels;
+		const int slot = mTerrainFreeSrvSlots.back();
+		mTerrainFreeSrvSlots.pop_back();
+		CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+		srvHandle.Offset(slot, mCbvSrvDescriptorSize);
+		md3dDevice->CreateShaderResourceView(resource.Get(), &srvDesc, srvHandle);
+		bytes += (size_t)md3dDevice->GetResourceAllocationInfo(0, 1, &texDesc).SizeInBytes;
+		return slot;
+	};
+
+	// Each tile may need two slots (heightmap and normal map)
+	std::vector<TerrainLoadedTile> loaded;
+	mTerrainTileCache.CollectLoaded(loaded, std::min<size_t>(kTerrainStreamUploadsPerFrame, mTerrainFreeSrvSlots.size() / 2));
+	for (TerrainLoadedTile& tile : loaded)
+	{
+		TerrainStreamedTile streamed;
+		size_t bytes = 0;
+		streamed.SrvIndex = upload(tile.Data, streamed.Resource, bytes);
+		if (streamed.SrvIndex < 0)
+		{
+			std::cout << "[UpdateTerrainStreaming] Bad DDS for tile LOD " << tile.Id.LOD << " (" << tile.Id.TileX << ", " << tile.Id.TileZ << ")\n";
+			mTerrainTileCache.MarkFailed(tile.Id.NodeIndex);
+			continue;
+		}
+		// Without a usable normal map the tile derives its normals from the heights
+		if (!tile.Companion.empty())
+			streamed.NormalSrvIndex = upload(tile.Companion, streamed.NormalResource, bytes);
+
+		mTerrain->SetTileHeightmapIndex(tile.Id.LOD, tile.Id.TileX, tile.Id.TileZ, streamed.SrvIndex, streamed.NormalSrvIndex);
+		mTerrainTileCache.MarkResident(tile.Id.NodeIndex, bytes);
+		mTerrainStreamedTiles[tile.Id.NodeIndex] = std::move(streamed);
+	}
+
+	// Evicted tiles fall back to their ancestor at once, but in-flight frames may still sample them
+	std::vector<TerrainTileId> evicted;
+	mTerrainTileCache.EvictToBudget(evicted);
+	for (const TerrainTileId& id : evicted)
+	{
+		auto it = mTerrainStreamedTiles.find(id.NodeIndex);
+		if (it == mTerrainStreamedTiles.end())
+			continue;
+		mTerrain->SetTileHeightmapIndex(id.LOD, id.TileX, id.TileZ, -1);
+		it->second.Fence = mCurrentFence + 1;
+		mTerrainRetiredTiles.push_back(std::move(it->second));
+		mTerrainStreamedTiles.erase(it);
+	}
+}
+
+// CPU copy of the heightmaps LoadTerrainTextures loads: the finest complete 001/002/003 set
+// stitched into one field, else the same fallback heightmap the renderer uses.
+TerrainHeightfield TexColumnsApp::LoadTerrainHeightfield() const
+{
+	auto path = [](const std::string& name) {
+		return std::filesystem::path(L"../../Textures/" + std::wstring(name.begin(), name.end()) + L".dds");
+	};
+	TerrainHeightfield heightfield;
+	for (int lod = 2; lod >= 1; --lod)
+	{
+		const int n = 1 << lod;
+		std::vector<TerrainHeightfield> tiles(n * n);
+		bool complete = true;
+		for (int z = 0; z < n && complete; ++z)
+			for (int x = 0; x < n && complete; ++x)
+				complete = LoadTerrainHeightfieldDDS(TerrainTilePath(L"../../Textures", lod, x, z), tiles[z * n + x]);
+		if (complete && StitchTerrainHeightfields(tiles, n, heightfield))
+			return heightfield;
+	}
+	for (const char* name : { "001/Height_Out", "textures/HeightMap2", "textures/HeightMap" })
+		if (LoadTerrainHeightfieldDDS(path(name), heightfield))
+			return heightfield;
+	std::cout << "[LoadTerrainHeightfield] No CPU heightmap, terrain bounds use the full height range\n";
+	return {};
 }
 
 void TexColumnsApp::LoadTexture(const std::string& name)
@@ -1688,6 +2506,63 @@ void TexColumnsApp::BuildRootSignature()
 		IID_PPV_ARGS(mRootSignature.GetAddressOf())));
 }
 
+void TexColumnsApp::BuildTerrainRootSignature()
+{
+	// Heightmaps and normal maps are indexed per instance, so the table spans the whole SRV heap
+	// (t0+, space1); the VS samples heights and the PS normals
+	CD3DX12_DESCRIPTOR_RANGE heightmapRange;
+	heightmapRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 0, 1);
+
+	CD3DX12_DESCRIPTOR_RANGE diffuseRange;
+	diffuseRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1); // t1
+
+	CD3DX12_DESCRIPTOR_RANGE clipmapRange;
+	clipmapRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 3); // t3
+
+	CD3DX12_DESCRIPTOR_RANGE horizonRange;
+	horizonRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 4); // t4
+
+	CD3DX12_DESCRIPTOR_RANGE virtualTextureRange;
+	virtualTextureRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 5); // t5 page table, t6 atlas
+
+	CD3DX12_DESCRIPTOR_RANGE feedbackRange;
+	feedbackRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0); // u0
+
+	CD3DX12_ROOT_PARAMETER slotRootParameter[13];
+	slotRootParameter[0].InitAsDescriptorTable(1, &heightmapRange, D3D12_SHADER_VISIBILITY_ALL);
+	slotRootParameter[1].InitAsDescriptorTable(1, &diffuseRange, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[2].InitAsShaderResourceView(2, 0, D3D12_SHADER_VISIBILITY_VERTEX); // t2: tile instances
+	slotRootParameter[3].InitAsConstantBufferView(1); // b1: pass
+	slotRootParameter[4].InitAsConstantBufferView(2); // b2: material
+	slotRootParameter[5].InitAsConstants(sizeof(TerrainDrawConstants) / 4, 0, 0, D3D12_SHADER_VISIBILITY_VERTEX); // b0
+	slotRootParameter[6].InitAsDescriptorTable(1, &clipmapRange, D3D12_SHADER_VISIBILITY_VERTEX);
+	slotRootParameter[7].InitAsConstants(sizeof(TerrainShadeConstants) / 4, 3, 0, D3D12_SHADER_VISIBILITY_PIXEL); // b3
+	slotRootParameter[8].InitAsDescriptorTable(1, &horizonRange, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[9].InitAsDescriptorTable(1, &virtualTextureRange, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[10].InitAsDescriptorTable(1, &feedbackRange, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[11].InitAsConstants(sizeof(TerrainVTConstants) / 4, 4, 0, D3D12_SHADER_VISIBILITY_PIXEL); // b4
+	slotRootParameter[12].InitAsConstantBufferView(5, 0, D3D12_SHADER_VISIBILITY_VERTEX); // b5: shadow pass (light viewProj)
+
+	auto staticSamplers = GetStaticSamplers();
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(_countof(slotRootParameter), slotRootParameter,
+		(UINT)staticSamplers.size(), staticSamplers.data(),
+		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+	if (errorBlob != nullptr)
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	ThrowIfFailed(hr);
+
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mTerrainRootSignature.GetAddressOf())));
+}
+
 
 void TexColumnsApp::BuildLightingRootSignature()
 {
@@ -2128,6 +3003,10 @@ void TexColumnsApp::BuildDescriptorHeaps()
 	// [TAA table 0: 4 SRVs contiguous]             : [Scene][Hist0][DepthCur][PrevDepth0]
 	// [TAA table 1: 4 SRVs contiguous]             : [Scene][Hist1][DepthCur][PrevDepth1]
 	// [DXR (3 descriptors)]                        : [TLAS SRV][ShadowMask UAV][ShadowMask SRV]
+	// [terrain stream slots]                       : streamed 002/003 heightmap tiles
+	// [terrain clipmap (1 descriptor)]             : clipmap height array
+	// [terrain horizon (1 descriptor)]             : horizon map
+	// [terrain virtual texture (3 descriptors)]    : [page table SRV][atlas SRV][feedback UAV]
 	// =========================================================
 
 	// 0) Count shadow SRVs
@@ -2140,6 +3019,10 @@ void TexColumnsApp::BuildDescriptorHeaps()
 	const int kGbufferCount = 4; // Albedo, Normal, Position, Velocity
 	const int kTaaCount = 10; // 2 tables * 5 SRVs
 	const int kDxrCount = 3; // TLAS SRV + ShadowMask UAV + ShadowMask SRV
+	const int kTerrainStreamCount = kTerrainStreamSrvSlots;
+	const int kTerrainClipmapCount = 1;
+	const int kTerrainHorizonCount = 1;
+	const int kTerrainVTCount = 3;
 
 
 	const int baseTextures = 0;
@@ -2169,13 +3052,27 @@ void TexColumnsApp::BuildDescriptorHeaps()
 	const int taa1_prevDepth = baseTaa + 8;
 	const int taa1_velocity = baseTaa + 9;
 
-	const int totalSrvCount = texturesCount + kGbufferCount + shadowCount + kTaaCount + kDxrCount;
+	const int baseTerrainStream = baseDxr + kDxrCount;
+	const int totalSrvCount = texturesCount + kGbufferCount + shadowCount + kTaaCount + kDxrCount + kTerrainStreamCount + kTerrainClipmapCount + kTerrainHorizonCount + kTerrainVTCount;
+	mTerrainClipmapSrvIndex = baseTerrainStream + kTerrainStreamCount; // view written with the texture
+	mTerrainHorizonSrvIndex = mTerrainClipmapSrvIndex + kTerrainClipmapCount; // likewise
+	mTerrainVTSrvIndex = mTerrainHorizonSrvIndex + kTerrainHorizonCount;     // likewise
+	mTerrainVTUavIndex = mTerrainVTSrvIndex + 2;
 
 	// DXR descriptor indices (filled later when resources exist)
 	mDxrTlasSrvIndex = baseDxr + 0;
 	mDxrShadowMaskUavIndex = baseDxr + 1;
 	mDxrShadowMaskSrvIndex = baseDxr + 2;
 
+	// Streamed terrain heightmaps (views written when a tile becomes resident). The heap is kept on
+	// resize, so slots only move while no tile holds one.
+	if (mTerrainStreamedTiles.empty() && mTerrainRetiredTiles.empty())
+	{
+		mTerrainFreeSrvSlots.clear();
+		for (int i = kTerrainStreamCount - 1; i >= 0; --i)
+			mTerrainFreeSrvSlots.push_back(baseTerrainStream + i);
+	}
+
 	// 1) Create SRV heap (only if needed). Recreating it after ImGui init can break ImGui.
 	bool needCreate = true;
 	if (mSrvDescriptorHeap)
@@ -2315,32 +3212,24 @@ void TexColumnsApp::BuildDescriptorHeaps()
 	}
 
 	// Terrain heightmap indices for quadtree LOD
-	mTerrainHeightmapIndicesLOD0.clear();
-	mTerrainHeightmapIndicesLOD1.clear();
-	mTerrainHeightmapIndicesLOD2.clear();
 	auto texIdx = [&](const std::string& name) -> int {
 		auto it = TexOffsets.find(name);
 		return (it != TexOffsets.end()) ? it->second : -1;
 	};
-	if (texIdx("001/Height_Out") >= 0)
-		mTerrainHeightmapIndicesLOD0.push_back(texIdx("001/Height_Out"));
-	for (int z = 0; z < 2; ++z)
-		for (int x = 0; x < 2; ++x) {
-			std::string n = "002/Height/Height_Out_y" + std::to_string(z) + "_x" + std::to_string(x);
-			if (texIdx(n) >= 0) mTerrainHeightmapIndicesLOD1.push_back(texIdx(n));
-		}
-	for (int z = 0; z < 4; ++z)
-		for (int x = 0; x < 4; ++x) {
-			std::string n = "003/Height/Height_Out_y" + std::to_string(z) + "_x" + std::to_string(x);
-			if (texIdx(n) >= 0) mTerrainHeightmapIndicesLOD2.push_back(texIdx(n));
-		}
+	// 001 = 1 tile, resident; 002 (2x2) and 003 (4x4) are streamed into the terrain SRV slots at
+	// runtime. Until a tile is resident it samples its nearest resident ancestor's heightmap.
+	mTerrainHeightmapIndices.assign(1, { texIdx("001/Height_Out") });
+	mTerrainNormalMapIndices.assign(1, { texIdx("001/Normal_Out") });
 	// Fallback heightmap when 001/002/003 not loaded (so terrain still draws)
 	int fallback = texIdx("textures/HeightMap2");
 	if (fallback < 0) fallback = texIdx("textures/HeightMap");
 	if (fallback < 0 && !TexOffsets.empty()) fallback = TexOffsets.begin()->second;
 	mTerrainFallbackHeightmapIndex = (fallback >= 0) ? fallback : -1;
-	if (mTerrainHeightmapIndicesLOD0.empty() && mTerrainFallbackHeightmapIndex >= 0)
-		mTerrainHeightmapIndicesLOD0.push_back(mTerrainFallbackHeightmapIndex);
+	if (mTerrainHeightmapIndices[0][0] < 0)
+	{
+		mTerrainHeightmapIndices[0][0] = mTerrainFallbackHeightmapIndex;
+		mTerrainNormalMapIndices[0][0] = -1; // baked for a different heightmap
+	}
 
 	// 3) GBuffer SRV
 	D3D12_SHADER_RESOURCE_VIEW_DESC gbufSrvDesc = {};
@@ -2480,8 +3369,13 @@ void TexColumnsApp::BuildShadersAndInputLayout()
 	mShaders["postprocessPS"] = d3dUtil::CompileShader(L"Shaders\\PostProcess.hlsl", nullptr, "PS", "ps_5_0");
 	mShaders["taaResolveVS"] = d3dUtil::CompileShader(L"Shaders\\TAAResolve.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["taaResolvePS"] = d3dUtil::CompileShader(L"Shaders\\TAAResolve.hlsl", nullptr, "PS", "ps_5_1");
-	mShaders["terrainVS"] = d3dUtil::CompileShader(L"Shaders\\Terrain.hlsl", nullptr, "VS", "vs_5_0");
-	mShaders["terrainPS"] = d3dUtil::CompileShader(L"Shaders\\Terrain.hlsl", nullptr, "PS", "ps_5_0");
+	// 5.1: per-instance heightmap index into an unbounded texture array
+	mShaders["terrainVS"] = d3dUtil::CompileShader(L"Shaders\\Terrain.hlsl", nullptr, "VS", "vs_5_1");
+	mShaders["terrainPS"] = d3dUtil::CompileShader(L"Shaders\\Terrain.hlsl", nullptr, "PS", "ps_5_1");
+	mShaders["terrainClipmapVS"] = d3dUtil::CompileShader(L"Shaders\\Terrain.hlsl", nullptr, "ClipmapVS", "vs_5_1");
+	mShaders["terrainShadowVS"] = d3dUtil::CompileShader(L"Shaders\\Terrain.hlsl", nullptr, "ShadowVS", "vs_5_1");
+	mShaders["vegetationVS"] = d3dUtil::CompileShader(L"Shaders\\Vegetation.hlsl", nullptr, "VS", "vs_5_1");
+	mShaders["vegetationPS"] = d3dUtil::CompileShader(L"Shaders\\Vegetation.hlsl", nullptr, "PS", "ps_5_1");
 
 	mInputLayout =
 	{
@@ -2491,152 +3385,93 @@ void TexColumnsApp::BuildShadersAndInputLayout()
 		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
 }
-void TexColumnsApp::BuildCustomMeshGeometry(std::string name, UINT& meshVertexOffset, UINT& meshIndexOffset, UINT& prevVertSize, UINT& prevIndSize, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo)
+bool TexColumnsApp::BuildCustomMeshGeometry(std::string name, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo)
 {
-	std::vector<GeometryGenerator::MeshData> meshDatas; // Это твоя структура для хранения вершин и индексов
-
-	// Создаем инстанс импортера.
-	Assimp::Importer importer;
-
-	// Читаем файл с постпроцессингом: триангуляция, флип UV (если нужно) и генерация нормалей.
-	const aiScene* scene = importer.ReadFile("../../Common/" + name + ".obj",
-		aiProcess_Triangulate |
-		aiProcess_ConvertToLeftHanded |
-		aiProcess_FlipUVs |
-		aiProcess_GenNormals |
-		aiProcess_CalcTangentSpace);
-	if (!scene || !scene->mRootNode)
+	// The buffers exactly as uploaded, baked on the first run and mapped on the next ones
+	const MeshCacheLayout layout = { kModelImportDefault, (uint32_t)sizeof(Vertex), (uint32_t)sizeof(std::uint16_t) };
+	const std::filesystem::path cachePath = MeshCachePath(name);
+	MeshCache cache;
+	std::vector<Vertex> importedVertices;
+	std::vector<std::uint16_t> importedIndices;
+	MeshCacheContents imported;
+	const bool cached = cache.Open(cachePath, layout);
+	if (!cached)
 	{
-		std::cerr << "Assimp error: " << importer.GetErrorString() << std::endl;
-	}
-	unsigned int nMeshes = scene->mNumMeshes;
-	ObjectsMeshCount[name] = nMeshes;
-
-	for (int i = 0; i < scene->mNumMeshes; i++)
-	{
-		GeometryGenerator::MeshData meshData;
-		aiMesh* mesh = scene->mMeshes[i];
-
-		// Подготовка контейнеров для вершин и индексов.
-		std::vector<GeometryGenerator::Vertex> vertices;
-		std::vector<std::uint16_t> indices;
-
-		// Проходим по всем вершинам и копируем данные.
-		for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
+		// Triangulated, left-handed, v flipped, with generated normals and tangents where the file has
+		// none: what the Assimp importer was asked for (aiProcess_Triangulate | ConvertToLeftHanded |
+		// FlipUVs | GenNormals | CalcTangentSpace)
+		ModelImport import;
+		if (!ImportModel("../../Common/" + name + ".obj", kModelImportDefault, import))
+			std::cerr << "OBJ import failed: " << name << std::endl;
+		imported.Sources = import.Sources;
+		imported.Materials = import.Materials;
+		for (GeometryGenerator::MeshData& mesh : import.Meshes)
 		{
-			GeometryGenerator::Vertex v;
-
-			v.Position.x = mesh->mVertices[i].x;
-			v.Position.y = mesh->mVertices[i].y;
-			v.Position.z = mesh->mVertices[i].z;
-
-			if (mesh->HasNormals())
-			{
-				v.Normal.x = mesh->mNormals[i].x;
-				v.Normal.y = mesh->mNormals[i].y;
-				v.Normal.z = mesh->mNormals[i].z;
-			}
-
-			if (mesh->HasTextureCoords(0))
-			{
-				v.TexC.x = mesh->mTextureCoords[0][i].x;
-				v.TexC.y = mesh->mTextureCoords[0][i].y;
-			}
-			else
-			{
-				v.TexC = XMFLOAT2(0.0f, 0.0f);
-			}
-			if (mesh->HasTangentsAndBitangents())
-			{
-				v.TangentU.x = mesh->mTangents[i].x;
-				v.TangentU.y = mesh->mTangents[i].y;
-				v.TangentU.z = mesh->mTangents[i].z;
-
-			}
-
-			// Если необходимо, можно обработать тангенты и другие атрибуты.
-			vertices.push_back(v);
-		}
-		// Проходим по всем граням для формирования индексов.
-		for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
-		{
-			aiFace face = mesh->mFaces[i];
-			// Убедимся, что грань треугольная.
-			if (face.mNumIndices != 3) continue;
-			indices.push_back(static_cast<std::uint16_t>(face.mIndices[0]));
-			indices.push_back(static_cast<std::uint16_t>(face.mIndices[1]));
-			indices.push_back(static_cast<std::uint16_t>(face.mIndices[2]));
+			OptimizeMesh(mesh);
+			MeshCacheSubmesh submesh;
+			submesh.Material = mesh.matName;
+			submesh.IndexCount = (uint32_t)mesh.Indices32.size();
+			submesh.StartIndex = (uint32_t)importedIndices.size();
+			submesh.BaseVertex = (int32_t)importedVertices.size();
+			imported.Submeshes.push_back(submesh);
+			for (const GeometryGenerator::Vertex& v : mesh.Vertices)
+				importedVertices.push_back(Vertex(v.Position, v.Normal, v.TexC, v.TangentU));
+			for (std::uint32_t index : mesh.Indices32)
+				importedIndices.push_back((std::uint16_t)index);
 		}
-
-		meshData.Vertices = vertices;
-		meshData.Indices32.resize(indices.size());
-		for (size_t j = 0; j < indices.size(); ++j)
-			meshData.Indices32[j] = indices[j];
-
-		aiMaterial* mat = scene->mMaterials[mesh->mMaterialIndex];
-		aiString texturePath;
-
-		aiString texPath;
-
-		meshData.matName = scene->mMaterials[mesh->mMaterialIndex]->GetName().C_Str();
-		meshDatas.push_back(meshData);
+		imported.Vertices = importedVertices.data();
+		imported.VertexCount = importedVertices.size();
+		imported.Indices = importedIndices.data();
+		imported.IndexCount = importedIndices.size();
+		if (!WriteMeshCache(cachePath, layout, imported))
+			std::cerr << "Mesh cache not written: " << cachePath.string() << std::endl;
 	}
-	for (int k = 0; k < scene->mNumMaterials; k++)
+	const std::vector<MeshCacheSubmesh>& submeshes = cached ? cache.Submeshes() : imported.Submeshes;
+	const std::vector<GeometryGenerator::Material>& materials = cached ? cache.Materials() : imported.Materials;
+	ObjectsMeshCount[name] = (unsigned int)submeshes.size();
+
+	for (int k = 0; k < (int)materials.size(); k++)
 	{
-		aiString texPath;
-		scene->mMaterials[k]->GetTexture(aiTextureType_DIFFUSE, 0, &texPath);
-		std::string a = std::string(texPath.C_Str());
+		const GeometryGenerator::Material& material = materials[k];
+		std::string a = material.diffFile;
 		a = a.substr(0, a.length() - 4);
 		std::cout << "DIFFUSE: " << a << "\n";
-		scene->mMaterials[k]->GetTexture(aiTextureType_DISPLACEMENT, 0, &texPath);
-		std::string b = std::string(texPath.C_Str());
+		// Without a normal map the diffuse one stands in, as the Assimp path left it
+		std::string b = material.normFile.empty() ? material.diffFile : material.normFile;
 		b = b.substr(0, b.length() - 4);
 		std::cout << "NORMAL: " << b << "\n";
 
 		// Sponza/mesh materials: high roughness (matte), no metallic to avoid wet look
-		CreateMaterial(scene->mMaterials[k]->GetName().C_Str(), k, TexOffsets[a], TexOffsets[b],
+		CreateMaterial(material.name, k, TexOffsets[a], TexOffsets[b],
 			XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f),
 			XMFLOAT3(0.04f, 0.04f, 0.04f),
 			0.82f,
 			0.0f);
 	}
 
-	UINT totalMeshSize = 0;
-	UINT k = vertices.size();
-	std::vector<std::pair<GeometryGenerator::MeshData, SubmeshGeometry>>meshSubmeshes;
-	for (auto mesh : meshDatas)
+	// Only matName of the MeshData is read back (BuildRenderItems), so it carries no vertices
+	const UINT baseVertex = (UINT)vertices.size();
+	const UINT baseIndex = (UINT)indices.size();
+	std::vector<std::pair<GeometryGenerator::MeshData, SubmeshGeometry>> meshSubmeshes;
+	for (const MeshCacheSubmesh& submesh : submeshes)
 	{
-		meshVertexOffset = meshVertexOffset + prevVertSize;
-		prevVertSize = mesh.Vertices.size();
-		totalMeshSize += mesh.Vertices.size();
-
-		meshIndexOffset = meshIndexOffset + prevIndSize;
-		prevIndSize = mesh.Indices32.size();
+		GeometryGenerator::MeshData m;
+		m.matName = submesh.Material;
 		SubmeshGeometry meshSubmesh;
-		meshSubmesh.IndexCount = (UINT)mesh.Indices32.size();
-		meshSubmesh.StartIndexLocation = meshIndexOffset;
-		meshSubmesh.BaseVertexLocation = meshVertexOffset;
-		GeometryGenerator::MeshData m = mesh;
+		meshSubmesh.IndexCount = submesh.IndexCount;
+		meshSubmesh.StartIndexLocation = baseIndex + submesh.StartIndex;
+		meshSubmesh.BaseVertexLocation = (INT)baseVertex + submesh.BaseVertex;
 		meshSubmeshes.push_back(std::make_pair(m, meshSubmesh));
 	}
-	/////////
-	/////
-	for (auto mesh : meshDatas)
-	{
-		for (size_t i = 0; i < mesh.Vertices.size(); ++i, ++k)
-		{
-			vertices.push_back(Vertex(mesh.Vertices[i].Position, mesh.Vertices[i].Normal, mesh.Vertices[i].TexC, mesh.Vertices[i].TangentU));
-		}
-	}
-	////////
 
-	///////
-	for (auto mesh : meshDatas)
-	{
-		indices.insert(indices.end(), std::begin(mesh.GetIndices16()), std::end(mesh.GetIndices16()));
-	}
-	///////
+	const Vertex* modelVertices = cached ? (const Vertex*)cache.Vertices() : importedVertices.data();
+	const std::uint16_t* modelIndices = cached ? (const std::uint16_t*)cache.Indices() : importedIndices.data();
+	const size_t vertexCount = cached ? cache.VertexCount() : importedVertices.size();
+	const size_t indexCount = cached ? cache.IndexCount() : importedIndices.size();
+	vertices.insert(vertices.end(), modelVertices, modelVertices + vertexCount);
+	indices.insert(indices.end(), modelIndices, modelIndices + indexCount);
 	Geo->MultiDrawArgs[name] = meshSubmeshes;
+	return cached;
 }
 void TexColumnsApp::BuildShapeGeometry()
 {
@@ -2727,18 +3562,13 @@ void TexColumnsApp::BuildShapeGeometry()
 	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
 
 
-	UINT meshVertexOffset = cylinderVertexOffset;
-	UINT meshIndexOffset = cylinderIndexOffset;
-	UINT prevIndSize = (UINT)cylinder.Indices32.size();
-	UINT prevVertSize = (UINT)cylinder.Vertices.size();
-
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "shapeGeo";
-	BuildCustomMeshGeometry("sponza", meshVertexOffset, meshIndexOffset, prevVertSize, prevIndSize, vertices, indices, geo.get());
-	BuildCustomMeshGeometry("negr", meshVertexOffset, meshIndexOffset, prevVertSize, prevIndSize, vertices, indices, geo.get());
-	BuildCustomMeshGeometry("left", meshVertexOffset, meshIndexOffset, prevVertSize, prevIndSize, vertices, indices, geo.get());
-	BuildCustomMeshGeometry("right", meshVertexOffset, meshIndexOffset, prevVertSize, prevIndSize, vertices, indices, geo.get());
-	BuildCustomMeshGeometry("plane2", meshVertexOffset, meshIndexOffset, prevVertSize, prevIndSize, vertices, indices, geo.get());
+	const auto modelStart = std::chrono::steady_clock::now();
+	mModelsFromCache = 0;
+	for (const char* model : { "sponza", "negr", "left", "right", "plane2" })
+		mModelsFromCache += BuildCustomMeshGeometry(model, vertices, indices, geo.get()) ? 1 : 0;
+	mModelLoadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - modelStart).count();
 
 
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
@@ -2773,7 +3603,8 @@ void TexColumnsApp::BuildShapeGeometry()
 void TexColumnsApp::BuildTerrainGeometry()
 {
 	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(1.0f, 1.0f, 64, 64);
+	// kTerrainGridResolution quads per side, so every other edge vertex lines up with a coarser neighbour
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid(1.0f, 1.0f, kTerrainGridResolution + 1, kTerrainGridResolution + 1);
 
 	std::vector<Vertex> vertices(grid.Vertices.size());
 	for (size_t i = 0; i < grid.Vertices.size(); ++i)
@@ -2785,12 +3616,35 @@ void TexColumnsApp::BuildTerrainGeometry()
 		vertices[i].Tangent = gv.TangentU;
 	}
 
-	std::vector<std::uint16_t> indices(grid.GetIndices16().begin(), grid.GetIndices16().end());
+	// One index range per neighbour mask; stitched edges skip the odd border vertices
+	std::vector<std::uint16_t> indices;
+	for (uint32_t mask = 0; mask < (uint32_t)kTerrainStitchVariants; ++mask)
+	{
+		SubmeshGeometry& submesh = mTerrainStitchSubmeshes[mask];
+		submesh.StartIndexLocation = (UINT)indices.size();
+		submesh.BaseVertexLocation = 0;
+		BuildTerrainGridIndices(kTerrainGridResolution, mask, indices);
+		submesh.IndexCount = (UINT)indices.size() - submesh.StartIndexLocation;
+	}
 
-	SubmeshGeometry terrainSubmesh;
-	terrainSubmesh.IndexCount = (UINT)indices.size();
-	terrainSubmesh.StartIndexLocation = 0;
-	terrainSubmesh.BaseVertexLocation = 0;
+	// Clipmap rings: (quads + 1)^2 vertices with PosL.xz = grid vertex (i, j), one index range per
+	// position of the finer ring's hole plus the full grid for the finest ring
+	const UINT clipmapBaseVertex = (UINT)vertices.size();
+	const int clipmapQuads = kTerrainClipmapQuads;
+	for (int j = 0; j <= clipmapQuads; ++j)
+		for (int i = 0; i <= clipmapQuads; ++i)
+			vertices.push_back(Vertex(XMFLOAT3((float)i, 0.0f, (float)j), XMFLOAT3(0.0f, 1.0f, 0.0f),
+				XMFLOAT2((float)i / clipmapQuads, (float)j / clipmapQuads), XMFLOAT3(1.0f, 0.0f, 0.0f)));
+	for (int variant = 0; variant < kTerrainClipmapRingVariants; ++variant)
+	{
+		SubmeshGeometry& submesh = mTerrainClipmapSubmeshes[variant];
+		submesh.StartIndexLocation = (UINT)indices.size();
+		submesh.BaseVertexLocation = (INT)clipmapBaseVertex;
+		const bool fullGrid = variant == kTerrainClipmapRingVariants - 1;
+		BuildTerrainClipmapIndices(clipmapQuads, fullGrid ? -1 : clipmapQuads / 4 + (variant & 1),
+			clipmapQuads / 4 + (variant >> 1), indices);
+		submesh.IndexCount = (UINT)indices.size() - submesh.StartIndexLocation;
+	}
 
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
 	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
@@ -2809,7 +3663,7 @@ void TexColumnsApp::BuildTerrainGeometry()
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
-	geo->DrawArgs["terrain"] = terrainSubmesh;
+	geo->DrawArgs["terrain"] = mTerrainStitchSubmeshes[0];
 	mGeometries[geo->Name] = std::move(geo);
 }
 
@@ -2867,7 +3721,7 @@ void TexColumnsApp::BuildPSOs()
 	// TERRAIN (same MRT as gbuffer, heightmap in VS)
 	{
 		auto pso = DefaultPso();
-		pso.pRootSignature = mRootSignature.Get();
+		pso.pRootSignature = mTerrainRootSignature.Get();
 		pso.InputLayout = { mInputLayout.data(), (UINT)mInputLayout.size() };
 		pso.VS = { (BYTE*)mShaders["terrainVS"]->GetBufferPointer(), mShaders["terrainVS"]->GetBufferSize() };
 		pso.PS = { (BYTE*)mShaders["terrainPS"]->GetBufferPointer(), mShaders["terrainPS"]->GetBufferSize() };
@@ -2878,11 +3732,13 @@ void TexColumnsApp::BuildPSOs()
 		pso.RTVFormats[3] = DXGI_FORMAT_R16G16_FLOAT;
 		pso.DSVFormat = mDepthStencilFormat;
 		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&pso, IID_PPV_ARGS(&mPSOs["terrain"])));
+		pso.VS = { (BYTE*)mShaders["terrainClipmapVS"]->GetBufferPointer(), mShaders["terrainClipmapVS"]->GetBufferSize() };
+		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&pso, IID_PPV_ARGS(&mPSOs["terrain_clipmap"])));
 	}
 	// TERRAIN WIREFRAME (debug)
 	{
 		auto pso = DefaultPso();
-		pso.pRootSignature = mRootSignature.Get();
+		pso.pRootSignature = mTerrainRootSignature.Get();
 		pso.InputLayout = { mInputLayout.data(), (UINT)mInputLayout.size() };
 		pso.VS = { (BYTE*)mShaders["terrainVS"]->GetBufferPointer(), mShaders["terrainVS"]->GetBufferSize() };
 		pso.PS = { (BYTE*)mShaders["terrainPS"]->GetBufferPointer(), mShaders["terrainPS"]->GetBufferSize() };
@@ -2895,6 +3751,24 @@ void TexColumnsApp::BuildPSOs()
 		pso.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
 		pso.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
 		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&pso, IID_PPV_ARGS(&mPSOs["terrain_wireframe"])));
+		pso.VS = { (BYTE*)mShaders["terrainClipmapVS"]->GetBufferPointer(), mShaders["terrainClipmapVS"]->GetBufferSize() };
+		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&pso, IID_PPV_ARGS(&mPSOs["terrain_clipmap_wireframe"])));
+	}
+	// TERRAIN VEGETATION (billboards expanded from SV_VertexID, alpha-tested into the GBuffer)
+	{
+		auto pso = DefaultPso();
+		pso.pRootSignature = mTerrainRootSignature.Get();
+		pso.InputLayout = { nullptr, 0 };
+		pso.VS = { (BYTE*)mShaders["vegetationVS"]->GetBufferPointer(), mShaders["vegetationVS"]->GetBufferSize() };
+		pso.PS = { (BYTE*)mShaders["vegetationPS"]->GetBufferPointer(), mShaders["vegetationPS"]->GetBufferSize() };
+		pso.NumRenderTargets = 4;
+		pso.RTVFormats[0] = albedoFormat;
+		pso.RTVFormats[1] = normalFormat;
+		pso.RTVFormats[2] = positionFormat;
+		pso.RTVFormats[3] = DXGI_FORMAT_R16G16_FLOAT;
+		pso.DSVFormat = mDepthStencilFormat;
+		pso.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&pso, IID_PPV_ARGS(&mPSOs["terrain_vegetation"])));
 	}
 
 	// SHADOW MAP
@@ -2912,6 +3786,18 @@ void TexColumnsApp::BuildPSOs()
 
 		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&pso, IID_PPV_ARGS(&mPSOs["shadow_map"])));
 	}
+	// TERRAIN SHADOW (depth only, the light's tiles through the terrain root signature)
+	{
+		auto pso = DefaultPso();
+		pso.pRootSignature = mTerrainRootSignature.Get();
+		pso.InputLayout = { mInputLayout.data(), (UINT)mInputLayout.size() };
+		pso.VS = { (BYTE*)mShaders["terrainShadowVS"]->GetBufferPointer(), mShaders["terrainShadowVS"]->GetBufferSize() };
+		pso.NumRenderTargets = 0;
+		pso.DSVFormat = SHADOW_MAP_DSV_FORMAT;
+		pso.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+		pso.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&pso, IID_PPV_ARGS(&mPSOs["terrain_shadow"])));
+	}
 
 	// LIGHTING FULLSCREEN (additive)
 	// Renders into mSceneTexture (SceneColorFormat)
@@ -3030,9 +3916,8 @@ void TexColumnsApp::BuildFrameResources()
 	mFrameResources.clear();
 	for (int i = 0; i < gNumFrameResources; ++i)
 	{
-		// +1 object slot for terrain tiles
 		mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-			1, (UINT)mAllRitems.size() + 1, (UINT)mMaterials.size(), (UINT)mLights.size()));
+			1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), (UINT)mLights.size()));
 	}
 	mChromaticAberrationCB = std::make_unique<UploadBuffer<float>>(md3dDevice.Get(), 1, true);
 	mTaaCB = std::make_unique<UploadBuffer<TAAConstants>>(md3dDevice.Get(), 1, true);
@@ -3107,6 +3992,10 @@ void TexColumnsApp::BuildMaterials()
 	CreateMaterial("TerrainMat", 0, terrainTex, terrainTex,
 		XMFLOAT4(0.4f, 0.5f, 0.3f, 1.0f), XMFLOAT3(0.04f, 0.04f, 0.04f), 0.9f, 0.0f);
 	mTerrainMaterialIndex = mMaterials["TerrainMat"]->MatCBIndex;
+	int vegetationTex = (TexOffsets.find("treeArray2") != TexOffsets.end()) ? TexOffsets["treeArray2"] : terrainTex;
+	CreateMaterial("VegetationMat", 0, vegetationTex, vegetationTex,
+		XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), XMFLOAT3(0.04f, 0.04f, 0.04f), 0.8f, 0.0f);
+	mVegetationMaterialIndex = mMaterials["VegetationMat"]->MatCBIndex;
 }
 void TexColumnsApp::RenderCustomMesh(std::string unique_name, std::string meshname, std::string materialName, XMFLOAT3 Scale, XMFLOAT3 Rotation, XMFLOAT3 Position)
 {
@@ -3358,6 +4247,7 @@ void TexColumnsApp::DrawSceneToShadowMap()
 
 					mCommandList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
 				}
+				DrawTerrainShadow(mCommandList.Get(), light.LightCBIndex, shadowCBAddress);
 				// Transition the shadow map from depth-write to pixel shader resource for the lighting pass.
 				mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(light.ShadowMap.Get(),
 					D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
@@ -3375,6 +4265,12 @@ void TexColumnsApp::DeferredDraw(const GameTimer& gt)
 	ThrowIfFailed(cmdListAlloc->Reset());
 	ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), nullptr));
 
+	UpdateTerrainStreaming(mCommandList.Get());
+	UpdateTerrainVirtualTexture(mCommandList.Get());
+	UploadTerrainClipmap(mCommandList.Get());
+	UploadTerrainAdaptiveMeshes(mCommandList.Get());
+	UploadTerrainVegetation(mCommandList.Get());
+	PackTerrainViewInstances();
 	DrawSceneToShadowMap();
 
 	mCommandList->RSSetViewports(1, &mScreenViewport);
@@ -3420,10 +4316,12 @@ void TexColumnsApp::DeferredDraw(const GameTimer& gt)
 
 	mCommandList->OMSetRenderTargets(4, gbufferRtvs, TRUE, &DepthStencilView());
 
+	DrawTerrain(mCommandList.Get()); // binds its own root signature
+	DrawTerrainVegetation(mCommandList.Get());
+	CopyTerrainVTFeedback(mCommandList.Get());
+
 	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
 	mCommandList->SetGraphicsRootConstantBufferView(3, passCB->GetGPUVirtualAddress());
-
-	DrawTerrain(mCommandList.Get());
 	DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
 
 	// GBuffer -> SRV для lighting
@@ -3721,15 +4619,14 @@ void TexColumnsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const st
 
 void TexColumnsApp::DrawTerrain(ID3D12GraphicsCommandList* cmdList)
 {
-	if (!mTerrainEnabled || !mTerrain || mTerrain->GetVisibleTiles().empty()) return;
+	if (mTerrainEnabled && mTerrain && mTerrain->GetMode() == TerrainMode::Clipmap)
+	{
+		DrawTerrainClipmap(cmdList);
+		return;
+	}
+	if (!mTerrainEnabled || !mTerrain || mTerrainInstanceRanges.empty()) return;
 	auto* geo = mGeometries["terrainGrid"].get();
 	if (!geo) return;
-	const auto& drawArg = geo->DrawArgs["terrain"];
-	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
-	const UINT terrainObjCBIndex = (UINT)mAllRitems.size();
-	auto objectCB = mCurrFrameResource->ObjectCB.get();
-	auto matCB = mCurrFrameResource->MaterialCB->Resource();
 	Material* terrainMat = mMaterials["TerrainMat"].get();
 	if (!terrainMat || mTerrainMaterialIndex < 0) return;
 
@@ -3737,36 +4634,624 @@ void TexColumnsApp::DrawTerrain(ID3D12GraphicsCommandList* cmdList)
 	auto it = mPSOs.find(psoName);
 	if (it == mPSOs.end()) it = mPSOs.find("terrain");
 	if (it == mPSOs.end() || !it->second) return;
+
+	// PackTerrainViewInstances grouped the camera's tiles by stitch variant at the buffer's start
+	const std::vector<TerrainTile>& tiles = mTerrain->GetVisibleTiles();
+	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+	auto matCB = mCurrFrameResource->MaterialCB->Resource();
+	auto passCB = mCurrFrameResource->PassCB->Resource();
+	CD3DX12_GPU_DESCRIPTOR_HANDLE diffuseHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	diffuseHandle.Offset(terrainMat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+
+	cmdList->SetGraphicsRootSignature(mTerrainRootSignature.Get());
 	cmdList->SetPipelineState(it->second.Get());
+	cmdList->SetGraphicsRootDescriptorTable(0, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	cmdList->SetGraphicsRootDescriptorTable(1, diffuseHandle);
+	cmdList->SetGraphicsRootShaderResourceView(2, mCurrFrameResource->TerrainInstanceBuffer->GetGPUVirtualAddress());
+	cmdList->SetGraphicsRootConstantBufferView(3, passCB->GetGPUVirtualAddress());
+	cmdList->SetGraphicsRootConstantBufferView(4, matCB->GetGPUVirtualAddress() + mTerrainMaterialIndex * matCBByteSize);
+	SetTerrainShadeRoot(cmdList, mTerrainHorizonShadows && mTerrainHorizonTexture);
+	SetTerrainVirtualTextureRoot(cmdList, mTerrainVTEnabled);
 	cmdList->IASetVertexBuffers(0, 1, &geo->VertexBufferView());
 	cmdList->IASetIndexBuffer(&geo->IndexBufferView());
 	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	for (const TerrainTile& tile : mTerrain->GetVisibleTiles())
-	{
-		int srvIndex = (tile.HeightmapSrvIndex >= 0) ? tile.HeightmapSrvIndex : mTerrainFallbackHeightmapIndex;
-		if (srvIndex < 0) continue;
-		ObjectConstants objConstants;
-		objConstants.World = tile.World;
-		objConstants.PrevWorld = tile.PrevWorld;
-		objConstants.TexTransform = MathHelper::Identity4x4();
-		XMMATRIX world = XMLoadFloat4x4(&tile.World);
-		XMVECTOR det;
-		XMStoreFloat4x4(&objConstants.InvWorld, XMMatrixInverse(&det, world));
-		objectCB->CopyData(terrainObjCBIndex, objConstants);
-
-		CD3DX12_GPU_DESCRIPTOR_HANDLE heightmapHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		heightmapHandle.Offset(srvIndex, mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(0, heightmapHandle);
-		CD3DX12_GPU_DESCRIPTOR_HANDLE diffuseHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		diffuseHandle.Offset(terrainMat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(1, diffuseHandle);
+	mTerrainAdaptiveDrawnTriangles = 0;
+	mTerrainAdaptiveUniformTriangles = 0;
+	auto* adaptiveGeo = mGeometries.count("terrainAdaptive") ? mGeometries["terrainAdaptive"].get() : nullptr;
+	if (mTerrain->GetAdaptiveMeshesEnabled() && adaptiveGeo && !mTerrain->GetAdaptiveMeshes().Ranges.empty() &&
+		mTerrainAdaptiveVersion == mTerrain->GetAdaptiveMeshVersion())
+	{
+		// Every tile has its own mesh, so one draw per tile. Find each tile's instance the way the
+		// packer placed it (stable by mask); skirts replace stitching and the meshes cannot morph.
+		uint32_t next[kTerrainInstanceMaskCount] = {};
+		for (const TerrainInstanceRange& range : mTerrainInstanceRanges)
+			next[range.NeighborMask] = range.First;
+		cmdList->IASetVertexBuffers(0, 1, &adaptiveGeo->VertexBufferView());
+		cmdList->IASetIndexBuffer(&adaptiveGeo->IndexBufferView());
+		for (const TerrainTile& tile : tiles)
+		{
+			if (tile.HeightmapSrvIndex < 0 && mTerrainFallbackHeightmapIndex < 0)
+				continue;
+			const uint32_t slot = next[tile.NeighborMask & (kTerrainInstanceMaskCount - 1)]++;
+			mCurrFrameResource->TerrainInstances[slot].MorphFactor = 0.0f;
+			const TerrainMeshRange& mesh = mTerrain->GetAdaptiveMeshRange(tile.NodeIndex);
+			cmdList->SetGraphicsRoot32BitConstant(5, slot, 0); // TerrainDrawConstants::InstanceBase
+			cmdList->DrawIndexedInstanced(mesh.IndexCount, 1, mesh.StartIndex, (INT)mesh.BaseVertex, 0);
+			mTerrainAdaptiveDrawnTriangles += mesh.SurfaceTriangles;
+			mTerrainAdaptiveUniformTriangles += 2u * kTerrainGridResolution * kTerrainGridResolution;
+		}
+		return;
+	}
 
-		D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = mCurrFrameResource->ObjectCB->Resource()->GetGPUVirtualAddress() + terrainObjCBIndex * objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + mTerrainMaterialIndex * matCBByteSize;
-		cmdList->SetGraphicsRootConstantBufferView(2, objCBAddress);
-		cmdList->SetGraphicsRootConstantBufferView(4, matCBAddress);
+	for (const TerrainInstanceRange& range : mTerrainInstanceRanges)
+	{
+		const SubmeshGeometry& drawArg = mTerrainStitchSubmeshes[range.NeighborMask];
+		cmdList->SetGraphicsRoot32BitConstant(5, range.First, 0); // TerrainDrawConstants::InstanceBase
+		cmdList->DrawIndexedInstanced(drawArg.IndexCount, range.Count, drawArg.StartIndexLocation, drawArg.BaseVertexLocation, 0);
+	}
+}
+
+// Pack every terrain view's tiles into this frame's instance buffer, the camera's first, so the
+// shadow pass (drawn before the GBuffer) and DrawTerrain share one upload
+void TexColumnsApp::PackTerrainViewInstances()
+{
+	mTerrainInstanceRanges.clear();
+	mTerrainShadowInstanceRanges.resize(mTerrainShadowViewLights.size());
+	for (std::vector<TerrainInstanceRange>& ranges : mTerrainShadowInstanceRanges)
+		ranges.clear();
+	if (!mTerrainEnabled || !mTerrain || mTerrain->GetMode() != TerrainMode::Quadtree)
+		return;
+
+	const int viewCount = std::min(mTerrain->GetViewCount(), (int)mTerrainShadowViewLights.size() + 1);
+	size_t tileCount = 0;
+	for (int view = 0; view < viewCount; ++view)
+		tileCount += mTerrain->GetVisibleTiles(view).size();
+	if (tileCount == 0)
+		return;
+	mCurrFrameResource->ReserveTerrainInstances(md3dDevice.Get(), (UINT)tileCount);
+	uint32_t first = 0;
+	for (int view = 0; view < viewCount; ++view)
+	{
+		std::vector<TerrainInstanceRange>& ranges = view == 0 ? mTerrainInstanceRanges : mTerrainShadowInstanceRanges[view - 1];
+		const uint32_t count = PackTerrainInstances(mTerrain->GetVisibleTiles(view), mTerrainFallbackHeightmapIndex,
+			mCurrFrameResource->TerrainInstances + first, ranges);
+		for (TerrainInstanceRange& range : ranges)
+			range.First += first;
+		first += count;
+	}
+}
+
+// Terrain into the shadow map DrawSceneToShadowMap has bound: the light's own tiles, always as
+// stitched grids (adaptive meshes stay within their error bound of them, under the depth bias)
+void TexColumnsApp::DrawTerrainShadow(ID3D12GraphicsCommandList* cmdList, int lightCBIndex, D3D12_GPU_VIRTUAL_ADDRESS shadowCBAddress)
+{
+	auto view = std::find(mTerrainShadowViewLights.begin(), mTerrainShadowViewLights.end(), lightCBIndex);
+	if (view == mTerrainShadowViewLights.end()) return;
+	const std::vector<TerrainInstanceRange>& ranges = mTerrainShadowInstanceRanges[view - mTerrainShadowViewLights.begin()];
+	if (ranges.empty()) return;
+	auto* geo = mGeometries["terrainGrid"].get();
+	auto it = mPSOs.find("terrain_shadow");
+	if (!geo || it == mPSOs.end() || !it->second) return;
+
+	ID3D12DescriptorHeap* heaps[] = { mSrvDescriptorHeap.Get() };
+	cmdList->SetDescriptorHeaps(_countof(heaps), heaps);
+	cmdList->SetGraphicsRootSignature(mTerrainRootSignature.Get());
+	cmdList->SetPipelineState(it->second.Get());
+	cmdList->SetGraphicsRootDescriptorTable(0, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	cmdList->SetGraphicsRootShaderResourceView(2, mCurrFrameResource->TerrainInstanceBuffer->GetGPUVirtualAddress());
+	cmdList->SetGraphicsRootConstantBufferView(12, shadowCBAddress);
+	cmdList->IASetVertexBuffers(0, 1, &geo->VertexBufferView());
+	cmdList->IASetIndexBuffer(&geo->IndexBufferView());
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	for (const TerrainInstanceRange& range : ranges)
+	{
+		const SubmeshGeometry& drawArg = mTerrainStitchSubmeshes[range.NeighborMask];
+		cmdList->SetGraphicsRoot32BitConstant(5, range.First, 0); // TerrainDrawConstants::InstanceBase
+		cmdList->DrawIndexedInstanced(drawArg.IndexCount, range.Count, drawArg.StartIndexLocation, drawArg.BaseVertexLocation, 0);
+	}
+}
 
+// Rebuild the adaptive tile meshes' vertex and index buffers after Terrain regenerated them.
+// Vertices follow the tile grid's layout, with the skirt drop as a negative local height.
+void TexColumnsApp::UploadTerrainAdaptiveMeshes(ID3D12GraphicsCommandList* cmdList)
+{
+	if (!mTerrain || mTerrainAdaptiveVersion == mTerrain->GetAdaptiveMeshVersion())
+		return;
+	// The old buffers may still be read by frames in flight
+	FlushCommandQueue();
+	mGeometries.erase("terrainAdaptive");
+	mTerrainAdaptiveVersion = mTerrain->GetAdaptiveMeshVersion();
+	const TerrainMeshSet& meshes = mTerrain->GetAdaptiveMeshes();
+	if (meshes.Ranges.empty())
+		return;
+
+	const float invResolution = 1.0f / (float)meshes.Resolution;
+	std::vector<Vertex> vertices(meshes.Vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		const TerrainMeshVertex& mv = meshes.Vertices[i];
+		const float u = mv.X * invResolution;
+		const float v = mv.Z * invResolution;
+		vertices[i] = Vertex(XMFLOAT3(u, -mv.Drop, 1.0f - v), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT2(u, v), XMFLOAT3(1.0f, 0.0f, 0.0f));
+	}
+
+	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	const UINT ibByteSize = (UINT)meshes.Indices.size() * sizeof(std::uint16_t);
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "terrainAdaptive";
+	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		cmdList, vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		cmdList, meshes.Indices.data(), ibByteSize, geo->IndexBufferUploader);
+	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexBufferByteSize = ibByteSize;
+	mGeometries[geo->Name] = std::move(geo);
+}
+
+// Rescatter the trees when their count, filters or the terrain's placement changed (not while a
+// control is dragged: a million trees take ~0.1 s), then cull their cells for the camera
+void TexColumnsApp::UpdateTerrainVegetation()
+{
+	mTerrainVegetationDraws.clear();
+	mTerrainVegetationCullStats = {};
+	if (!mTerrainVegetationEnabled || !mTerrainEnabled)
+		return;
+	const float placement[3] = { mTerrain->GetWorldSizeXZ(), mTerrainOriginY, mTerrainHeightScale };
+	TerrainScatterSettings settings = mTerrainVegetationSettings;
+	settings.Spacing = TerrainScatterSpacingForCount(placement[0], kTerrainVegetationCounts[mTerrainVegetationPreset]);
+	const TerrainScatterSettings& scattered = mTerrainVegetation.GetSettings();
+	const bool changed = mTerrainVegetation.GetCandidates() == 0 ||
+		!std::equal(placement, placement + 3, mTerrainVegetationPlacement) ||
+		settings.Spacing != scattered.Spacing || settings.MaxSlopeDegrees != scattered.MaxSlopeDegrees ||
+		settings.MinHeight != scattered.MinHeight || settings.MaxHeight != scattered.MaxHeight ||
+		settings.MinSize != scattered.MinSize || settings.MaxSize != scattered.MaxSize;
+	if (changed && !ImGui::IsAnyItemActive())
+	{
+		mTerrainVegetation.Scatter(mTerrain->GetHeightQuery(), placement[0], placement[1], placement[2], settings);
+		std::copy(placement, placement + 3, mTerrainVegetationPlacement);
+	}
+
+	TerrainFrustum frustum;
+	frustum.Extract(mMainPassCB.ViewProj);
+	mTerrainVegetation.Cull(frustum, mMainPassCB.EyePosW, mTerrainVegetationDistance, mTerrainVegetationDraws,
+		&mTerrainVegetationCullStats);
+}
+
+// The trees never move, so they live in a default heap buffer replaced on every rescatter
+void TexColumnsApp::UploadTerrainVegetation(ID3D12GraphicsCommandList* cmdList)
+{
+	if (mTerrainVegetationVersion == mTerrainVegetation.GetVersion())
+		return;
+	// The old buffer may still be read by frames in flight
+	FlushCommandQueue();
+	mTerrainVegetationBuffer.Reset();
+	mTerrainVegetationUpload.Reset();
+	mTerrainVegetationVersion = mTerrainVegetation.GetVersion();
+	const std::vector<TerrainVegetationInstance>& trees = mTerrainVegetation.GetInstances();
+	if (trees.empty())
+		return;
+	mTerrainVegetationBuffer = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), cmdList, trees.data(),
+		(UINT64)trees.size() * sizeof(TerrainVegetationInstance), mTerrainVegetationUpload);
+}
+
+// Tree billboards into the GBuffer, one instanced draw per run of visible cells. They do not cast
+// shadows: the shadow maps are drawn before the GBuffer from the lights' own terrain tiles.
+void TexColumnsApp::DrawTerrainVegetation(ID3D12GraphicsCommandList* cmdList)
+{
+	if (mTerrainVegetationDraws.empty() || !mTerrainVegetationBuffer || mVegetationMaterialIndex < 0 ||
+		mTerrainVegetationVersion != mTerrainVegetation.GetVersion())
+		return;
+	auto it = mPSOs.find("terrain_vegetation");
+	auto treeArray = TexOffsets.find("treeArray2");
+	if (it == mPSOs.end() || !it->second || treeArray == TexOffsets.end())
+		return;
+
+	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+	auto matCB = mCurrFrameResource->MaterialCB->Resource();
+	auto passCB = mCurrFrameResource->PassCB->Resource();
+	CD3DX12_GPU_DESCRIPTOR_HANDLE treeArrayHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	treeArrayHandle.Offset(treeArray->second, mCbvSrvDescriptorSize);
+
+	cmdList->SetGraphicsRootSignature(mTerrainRootSignature.Get());
+	cmdList->SetPipelineState(it->second.Get());
+	cmdList->SetGraphicsRootDescriptorTable(0, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	cmdList->SetGraphicsRootDescriptorTable(1, treeArrayHandle);
+	cmdList->SetGraphicsRootShaderResourceView(2, mTerrainVegetationBuffer->GetGPUVirtualAddress());
+	cmdList->SetGraphicsRootConstantBufferView(3, passCB->GetGPUVirtualAddress());
+	cmdList->SetGraphicsRootConstantBufferView(4, matCB->GetGPUVirtualAddress() + mVegetationMaterialIndex * matCBByteSize);
+	SetTerrainShadeRoot(cmdList, mTerrainHorizonShadows && mTerrainHorizonTexture);
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	VegetationDrawConstants constants;
+	const char* singles[3] = { "tree01S", "tree02S", "tree35S" };
+	for (int i = 0; i < 3; ++i)
+	{
+		auto single = TexOffsets.find(singles[i]);
+		constants.TreeTextures[i] = single != TexOffsets.end() ? (uint32_t)single->second : UINT32_MAX;
+	}
+	for (const TerrainVegetationRange& range : mTerrainVegetationDraws)
+	{
+		constants.InstanceBase = range.First;
+		cmdList->SetGraphicsRoot32BitConstants(5, sizeof(VegetationDrawConstants) / 4, &constants, 0);
+		cmdList->DrawInstanced(6, range.Count, 0, 0);
+	}
+}
+
+// Bake the horizon map of the CPU heightfield and upload it (init command list). The map is in
+// normalized units, so height scale and world size changes only change the shading constants.
+void TexColumnsApp::BuildTerrainHorizonMap()
+{
+	TerrainHorizonMap map;
+	mTerrainHorizonStats = BakeTerrainHorizonMap(mTerrain->GetHeightfield(), 0, map);
+	if (map.Empty())
+		return;
+	std::cout << "[TerrainHorizon] " << map.Width << "x" << map.Height << " x " << kTerrainHorizonDirections
+		<< " directions in " << mTerrainHorizonStats.TotalMs << " ms (sweep " << mTerrainHorizonStats.SweepMs
+		<< " ms, encode " << mTerrainHorizonStats.EncodeMs << " ms), " << mTerrainHorizonStats.MsPerTile
+		<< " ms per 512^2 tile on " << mTerrainHorizonStats.Threads << " threads\n";
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, (UINT64)map.Width, (UINT)map.Height, kTerrainHorizonSlices, 1),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&mTerrainHorizonTexture)));
+	const UINT64 uploadSize = GetRequiredIntermediateSize(mTerrainHorizonTexture.Get(), 0, kTerrainHorizonSlices);
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(uploadSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mTerrainHorizonUpload)));
+	D3D12_SUBRESOURCE_DATA slices[kTerrainHorizonSlices];
+	for (int s = 0; s < kTerrainHorizonSlices; ++s)
+	{
+		slices[s].pData = map.Texels.data() + (size_t)s * map.Width * map.Height * 4;
+		slices[s].RowPitch = (LONG_PTR)map.Width * 4;
+		slices[s].SlicePitch = slices[s].RowPitch * map.Height;
+	}
+	UpdateSubresources(mCommandList.Get(), mTerrainHorizonTexture.Get(), mTerrainHorizonUpload.Get(), 0, 0, kTerrainHorizonSlices, slices);
+	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mTerrainHorizonTexture.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.ArraySize = kTerrainHorizonSlices;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+	srvHandle.Offset(mTerrainHorizonSrvIndex, mCbvSrvDescriptorSize);
+	md3dDevice->CreateShaderResourceView(mTerrainHorizonTexture.Get(), &srvDesc, srvHandle);
+}
+
+// Terrain PS constants and horizon map; the sun is the first directional light (as for the sky)
+void TexColumnsApp::SetTerrainShadeRoot(ID3D12GraphicsCommandList* cmdList, bool horizon)
+{
+	TerrainShadeConstants shade;
+	XMStoreFloat3(&shade.ToSun, XMVector3Normalize(-XMLoadFloat3(&mAtmosphereParams.SunDirection)));
+	shade.HorizonScale = horizon ? mTerrainHeightScale / mTerrainWorldSize : 0.0f;
+	shade.InvWorldSize = 1.0f / mTerrainWorldSize;
+	shade.HorizonSoftness = mTerrainHorizonSoftness;
+	shade.NormalScale = mTerrainHeightScale / mTerrainWorldSize / kTerrainNormalReferenceScale;
+	cmdList->SetGraphicsRoot32BitConstants(7, sizeof(TerrainShadeConstants) / 4, &shade, 0);
+	CD3DX12_GPU_DESCRIPTOR_HANDLE horizonHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	horizonHandle.Offset(mTerrainHorizonSrvIndex, mCbvSrvDescriptorSize);
+	cmdList->SetGraphicsRootDescriptorTable(8, horizonHandle);
+}
+
+// Virtual texture resources and page producer. The page table and atlas start empty and are filled
+// through UpdateTerrainVirtualTexture.
+void TexColumnsApp::StartTerrainVirtualTexture()
+{
+	TerrainVTSettings settings;
+	mTerrainPageComposer = std::make_shared<TerrainPageComposer>(mTerrain->GetHeightfield(), settings,
+		mTerrainHeightScale / mTerrainWorldSize);
+	mTerrainVirtualTexture.Start(settings, mTerrainPageComposer);
+	settings = mTerrainVirtualTexture.GetSettings();
+	const UINT16 mips = (UINT16)mTerrainVirtualTexture.GetMipCount();
+	const UINT atlasSize = (UINT)(settings.PhysicalPagesPerSide * mTerrainVirtualTexture.GetPhysicalPageSize());
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32_UINT, (UINT64)settings.PagesPerSide, (UINT)settings.PagesPerSide, 1, mips),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&mTerrainVTPageTable)));
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, (UINT64)atlasSize, atlasSize, 1, 1),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&mTerrainVTAtlas)));
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32_UINT, kTerrainVTFeedbackWidth, kTerrainVTFeedbackHeight, 1, 1, 1, 0,
+			D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		nullptr,
+		IID_PPV_ARGS(&mTerrainVTFeedback)));
+	mTerrainVTPageTableState = D3D12_RESOURCE_STATE_COPY_DEST;
+	mTerrainVTAtlasState = D3D12_RESOURCE_STATE_COPY_DEST;
+	mTerrainVTFeedbackState = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE handle(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+	handle.Offset(mTerrainVTSrvIndex, mCbvSrvDescriptorSize);
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_R32_UINT;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = mips;
+	md3dDevice->CreateShaderResourceView(mTerrainVTPageTable.Get(), &srvDesc, handle);
+	handle.Offset(1, mCbvSrvDescriptorSize);
+	srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	srvDesc.Texture2D.MipLevels = 1;
+	md3dDevice->CreateShaderResourceView(mTerrainVTAtlas.Get(), &srvDesc, handle);
+	handle.Offset(1, mCbvSrvDescriptorSize);
+	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_UINT;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+	md3dDevice->CreateUnorderedAccessView(mTerrainVTFeedback.Get(), nullptr, &uavDesc, handle);
+
+	mTerrainVTConstants.PagesPerSide = (uint32_t)settings.PagesPerSide;
+	mTerrainVTConstants.PageSize = (uint32_t)settings.PageSize;
+	mTerrainVTConstants.PageBorder = (uint32_t)settings.PageBorder;
+	mTerrainVTConstants.PhysicalPagesPerSide = (uint32_t)settings.PhysicalPagesPerSide;
+	mTerrainVTConstants.MipCount = (uint32_t)mips;
+}
+
+// Runs on the frame's command list before any terrain draw: feeds back what this frame resource's
+// last frame sampled (its fence has passed), then copies finished pages into their atlas slots and
+// re-uploads the page table when residency changed
+void TexColumnsApp::UpdateTerrainVirtualTexture(ID3D12GraphicsCommandList* cmdList)
+{
+	if (!mTerrainVirtualTexture.IsStarted())
+		return;
+	mTerrainVTFeedbackWritten = false;
+	if (mCurrFrameResource->TerrainVTFeedbackTag != 0)
+	{
+		const UINT64 bytes = (UINT64)kTerrainVTFeedbackWidth * kTerrainVTFeedbackHeight * 4;
+		const D3D12_RANGE readRange = { 0, (SIZE_T)bytes };
+		const D3D12_RANGE noWrite = { 0, 0 };
+		void* feedback = nullptr;
+		ThrowIfFailed(mCurrFrameResource->TerrainVTFeedbackReadback->Map(0, &readRange, &feedback));
+		mTerrainVirtualTexture.SubmitFeedback((const uint32_t*)feedback, (size_t)kTerrainVTFeedbackWidth * kTerrainVTFeedbackHeight,
+			mCurrFrameResource->TerrainVTFeedbackTag);
+		mCurrFrameResource->TerrainVTFeedbackReadback->Unmap(0, &noWrite);
+		mCurrFrameResource->TerrainVTFeedbackTag = 0;
+	}
+	// The tag cycles through 1..255 and the sampled pixel walks all 64 of each block (37 is odd)
+	++mTerrainVTFrame;
+	mTerrainVTConstants.FeedbackTag = mTerrainVTFrame % 255u + 1u;
+	mTerrainVTConstants.FeedbackOffset = (mTerrainVTFrame * 37u) & 63u;
+
+	std::vector<TerrainVTPageUpload> uploads;
+	mTerrainVirtualTexture.Update(uploads, kTerrainVTUploadsPerFrame);
+	const bool tableDirty = mTerrainVirtualTexture.ConsumePageTableDirty();
+	if (uploads.empty() && !tableDirty)
+		return;
+
+	auto AlignTo = [](UINT64 value, UINT64 alignment) { return (value + alignment - 1) & ~(alignment - 1); };
+	const TerrainVTSettings& settings = mTerrainVirtualTexture.GetSettings();
+	const int mips = mTerrainVirtualTexture.GetMipCount();
+	const UINT pageSize = (UINT)mTerrainVirtualTexture.GetPhysicalPageSize();
+	const UINT64 pagePitch = AlignTo((UINT64)pageSize * 4, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+	auto tablePitchOf = [&](int mip) {
+		return AlignTo((UINT64)(settings.PagesPerSide >> mip) * 4, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+	};
+	UINT64 bytes = 0;
+	if (tableDirty)
+		for (int mip = 0; mip < mips; ++mip)
+			bytes = AlignTo(bytes, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT) + tablePitchOf(mip) * (settings.PagesPerSide >> mip);
+	for (size_t i = 0; i < uploads.size(); ++i)
+		bytes = AlignTo(bytes, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT) + pagePitch * pageSize;
+	mCurrFrameResource->ReserveTerrainVTUpload(md3dDevice.Get(), bytes);
+	BYTE* staging = mCurrFrameResource->TerrainVTUploadData;
+	UINT64 offset = 0;
+
+	// Copy rows into the staging buffer and from there into the texture at (x, y) of a subresource
+	auto copy = [&](const uint8_t* rows, UINT width, UINT height, UINT64 rowPitch, DXGI_FORMAT format,
+		ID3D12Resource* texture, UINT subresource, UINT x, UINT y) {
+		offset = AlignTo(offset, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+		for (UINT row = 0; row < height; ++row)
+			memcpy(staging + offset + row * rowPitch, rows + (size_t)row * width * 4, (size_t)width * 4);
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
+		footprint.Offset = offset;
+		footprint.Footprint = { format, width, height, 1, (UINT)rowPitch };
+		CD3DX12_TEXTURE_COPY_LOCATION src(mCurrFrameResource->TerrainVTUpload.Get(), footprint);
+		CD3DX12_TEXTURE_COPY_LOCATION dst(texture, subresource);
+		cmdList->CopyTextureRegion(&dst, x, y, 0, &src, nullptr);
+		offset += rowPitch * height;
+	};
+
+	// Pages only go into slots no page table entry of an earlier frame still points at; the barrier
+	// orders the copies after those frames' draws
+	Transition(mTerrainVTPageTable.Get(), mTerrainVTPageTableState, D3D12_RESOURCE_STATE_COPY_DEST);
+	Transition(mTerrainVTAtlas.Get(), mTerrainVTAtlasState, D3D12_RESOURCE_STATE_COPY_DEST);
+	if (tableDirty)
+	{
+		const std::vector<uint32_t>& table = mTerrainVirtualTexture.GetPageTable();
+		for (int mip = 0; mip < mips; ++mip)
+		{
+			const UINT pages = (UINT)(settings.PagesPerSide >> mip);
+			copy((const uint8_t*)(table.data() + mTerrainVirtualTexture.GetPageTableOffset(mip)), pages, pages, tablePitchOf(mip),
+				DXGI_FORMAT_R32_UINT, mTerrainVTPageTable.Get(), (UINT)mip, 0, 0);
+		}
+	}
+	for (const TerrainVTPageUpload& page : uploads)
+		copy(page.Texels.data(), pageSize, pageSize, pagePitch, DXGI_FORMAT_R8G8B8A8_UNORM, mTerrainVTAtlas.Get(), 0,
+			(UINT)page.SlotX * pageSize, (UINT)page.SlotY * pageSize);
+	Transition(mTerrainVTPageTable.Get(), mTerrainVTPageTableState, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	Transition(mTerrainVTAtlas.Get(), mTerrainVTAtlasState, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+}
+
+// Terrain PS virtual texture constants, page table/atlas and feedback UAV; disabled draws keep
+// sampling the material's diffuse map and write no feedback
+void TexColumnsApp::SetTerrainVirtualTextureRoot(ID3D12GraphicsCommandList* cmdList, bool enabled)
+{
+	TerrainVTConstants constants = mTerrainVTConstants;
+	constants.Enabled = enabled && mTerrainVTAtlas && mTerrainVTAtlasState == D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE ? 1u : 0u;
+	cmdList->SetGraphicsRoot32BitConstants(11, sizeof(TerrainVTConstants) / 4, &constants, 0);
+	CD3DX12_GPU_DESCRIPTOR_HANDLE vtHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	vtHandle.Offset(mTerrainVTSrvIndex, mCbvSrvDescriptorSize);
+	cmdList->SetGraphicsRootDescriptorTable(9, vtHandle);
+	CD3DX12_GPU_DESCRIPTOR_HANDLE feedbackHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	feedbackHandle.Offset(mTerrainVTUavIndex, mCbvSrvDescriptorSize);
+	cmdList->SetGraphicsRootDescriptorTable(10, feedbackHandle);
+	mTerrainVTFeedbackWritten |= constants.Enabled != 0;
+}
+
+// After the terrain draws: copy this frame's feedback into the frame resource's readback buffer,
+// read by UpdateTerrainVirtualTexture once the GPU is done with the frame
+void TexColumnsApp::CopyTerrainVTFeedback(ID3D12GraphicsCommandList* cmdList)
+{
+	if (!mTerrainVTFeedbackWritten)
+		return;
+	// Frame resources are rebuilt with the render items, so the readback buffer is made on first use.
+	// Feedback rows are 4 * 320 bytes, already a multiple of the copy pitch alignment.
+	static_assert((kTerrainVTFeedbackWidth * 4) % D3D12_TEXTURE_DATA_PITCH_ALIGNMENT == 0);
+	if (!mCurrFrameResource->TerrainVTFeedbackReadback)
+		ThrowIfFailed(md3dDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer((UINT64)kTerrainVTFeedbackWidth * kTerrainVTFeedbackHeight * 4),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&mCurrFrameResource->TerrainVTFeedbackReadback)));
+	Transition(mTerrainVTFeedback.Get(), mTerrainVTFeedbackState, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
+	footprint.Footprint = { DXGI_FORMAT_R32_UINT, kTerrainVTFeedbackWidth, kTerrainVTFeedbackHeight, 1, kTerrainVTFeedbackWidth * 4 };
+	CD3DX12_TEXTURE_COPY_LOCATION dst(mCurrFrameResource->TerrainVTFeedbackReadback.Get(), footprint);
+	CD3DX12_TEXTURE_COPY_LOCATION src(mTerrainVTFeedback.Get(), 0);
+	cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+	Transition(mTerrainVTFeedback.Get(), mTerrainVTFeedbackState, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	mCurrFrameResource->TerrainVTFeedbackTag = mTerrainVTConstants.FeedbackTag;
+}
+
+// Copy the clipmap heights that scrolled in since the last frame into the height array. Each
+// region is a rectangle of one slice that does not cross the toroidal wrap, so it is one copy.
+void TexColumnsApp::UploadTerrainClipmap(ID3D12GraphicsCommandList* cmdList)
+{
+	if (!mTerrain || mTerrain->GetMode() != TerrainMode::Clipmap || !mTerrain->GetClipmap().IsConfigured())
+		return;
+	const TerrainClipmap& clipmap = mTerrain->GetClipmap();
+	const UINT size = (UINT)clipmap.GetTextureSize();
+	const UINT16 levels = (UINT16)clipmap.GetLevelCount();
+
+	if (!mTerrainClipmapTexture || mTerrainClipmapTexture->GetDesc().Width != size ||
+		mTerrainClipmapTexture->GetDesc().DepthOrArraySize != levels)
+	{
+		// The old array may still be read by frames in flight
+		FlushCommandQueue();
+		mTerrainClipmapTexture.Reset();
+		ThrowIfFailed(md3dDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32_FLOAT, size, size, levels, 1),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&mTerrainClipmapTexture)));
+		mTerrainClipmapState = D3D12_RESOURCE_STATE_COPY_DEST;
+
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MipLevels = 1;
+		srvDesc.Texture2DArray.ArraySize = levels;
+		CD3DX12_CPU_DESCRIPTOR_HANDLE srvHandle(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+		srvHandle.Offset(mTerrainClipmapSrvIndex, mCbvSrvDescriptorSize);
+		md3dDevice->CreateShaderResourceView(mTerrainClipmapTexture.Get(), &srvDesc, srvHandle);
+		// A new size or level count reconfigured the clipmap, which queued every ring for upload
+	}
+
+	const std::vector<TerrainClipmapRegion>& regions = mTerrain->GetClipmapRegions();
+	if (regions.empty())
+		return;
+	auto AlignTo = [](UINT64 value, UINT64 alignment) { return (value + alignment - 1) & ~(alignment - 1); };
+	auto rowPitchOf = [AlignTo](const TerrainClipmapRegion& r) {
+		return AlignTo((UINT64)r.Width * sizeof(float), D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+	};
+	UINT64 bytes = 0;
+	for (const TerrainClipmapRegion& region : regions)
+		bytes = AlignTo(bytes, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT) + rowPitchOf(region) * region.Height;
+	mCurrFrameResource->ReserveTerrainClipmapUpload(md3dDevice.Get(), bytes);
+
+	Transition(mTerrainClipmapTexture.Get(), mTerrainClipmapState, D3D12_RESOURCE_STATE_COPY_DEST);
+	UINT64 offset = 0;
+	for (const TerrainClipmapRegion& region : regions)
+	{
+		offset = AlignTo(offset, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+		const UINT64 rowPitch = rowPitchOf(region);
+		mTerrain->FillClipmapRegion(region, (float*)(mCurrFrameResource->TerrainClipmapUploadData + offset),
+			(size_t)(rowPitch / sizeof(float)));
+
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
+		footprint.Offset = offset;
+		footprint.Footprint = { DXGI_FORMAT_R32_FLOAT, (UINT)region.Width, (UINT)region.Height, 1, (UINT)rowPitch };
+		CD3DX12_TEXTURE_COPY_LOCATION src(mCurrFrameResource->TerrainClipmapUpload.Get(), footprint);
+		CD3DX12_TEXTURE_COPY_LOCATION dst(mTerrainClipmapTexture.Get(), D3D12CalcSubresource(0, region.Level, 0, 1, levels));
+		cmdList->CopyTextureRegion(&dst, (UINT)region.TexX, (UINT)region.TexZ, 0, &src, nullptr);
+		offset += rowPitch * region.Height;
+	}
+	Transition(mTerrainClipmapTexture.Get(), mTerrainClipmapState, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	mTerrain->ClearClipmapRegions();
+}
+
+// One draw per ring, finest first; each ring's hole is filled by the next finer ring
+void TexColumnsApp::DrawTerrainClipmap(ID3D12GraphicsCommandList* cmdList)
+{
+	if (!mTerrainClipmapTexture || mTerrainClipmapState != D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE) return;
+	auto* geo = mGeometries["terrainGrid"].get();
+	Material* terrainMat = mMaterials["TerrainMat"].get();
+	if (!geo || !terrainMat || mTerrainMaterialIndex < 0) return;
+	auto it = mPSOs.find(mTerrainWireframe ? "terrain_clipmap_wireframe" : "terrain_clipmap");
+	if (it == mPSOs.end() || !it->second) return;
+
+	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+	auto matCB = mCurrFrameResource->MaterialCB->Resource();
+	auto passCB = mCurrFrameResource->PassCB->Resource();
+	CD3DX12_GPU_DESCRIPTOR_HANDLE diffuseHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	diffuseHandle.Offset(terrainMat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+	CD3DX12_GPU_DESCRIPTOR_HANDLE clipmapHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	clipmapHandle.Offset(mTerrainClipmapSrvIndex, mCbvSrvDescriptorSize);
+
+	cmdList->SetGraphicsRootSignature(mTerrainRootSignature.Get());
+	cmdList->SetPipelineState(it->second.Get());
+	cmdList->SetGraphicsRootDescriptorTable(1, diffuseHandle);
+	cmdList->SetGraphicsRootConstantBufferView(3, passCB->GetGPUVirtualAddress());
+	cmdList->SetGraphicsRootConstantBufferView(4, matCB->GetGPUVirtualAddress() + mTerrainMaterialIndex * matCBByteSize);
+	cmdList->SetGraphicsRootDescriptorTable(6, clipmapHandle);
+	SetTerrainShadeRoot(cmdList, false); // the map covers the quadtree square, not the repeated clipmap plane
+	SetTerrainVirtualTextureRoot(cmdList, false); // likewise the virtual texture
+	cmdList->IASetVertexBuffers(0, 1, &geo->VertexBufferView());
+	cmdList->IASetIndexBuffer(&geo->IndexBufferView());
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	const TerrainClipmap& clipmap = mTerrain->GetClipmap();
+	for (int l = 0; l < clipmap.GetLevelCount(); ++l)
+	{
+		const TerrainClipmapLevel& level = clipmap.GetLevel(l);
+		TerrainDrawConstants constants;
+		constants.ClipLevel = (uint32_t)l;
+		constants.ClipOriginX = level.OriginX;
+		constants.ClipOriginZ = level.OriginZ;
+		constants.ClipSpacing = level.Spacing;
+		constants.ClipQuads = clipmap.GetQuadsPerSide();
+		constants.ClipHeightScale = mTerrain->GetHeightScale();
+		constants.ClipOriginY = mTerrain->GetOriginY();
+		cmdList->SetGraphicsRoot32BitConstants(5, sizeof(constants) / 4, &constants, 0);
+
+		const int variant = (l == 0) ? kTerrainClipmapRingVariants - 1 : clipmap.GetRingVariant(l);
+		const SubmeshGeometry& drawArg = mTerrainClipmapSubmeshes[variant];
 		cmdList->DrawIndexedInstanced(drawArg.IndexCount, 1, drawArg.StartIndexLocation, drawArg.BaseVertexLocation, 0);
 	}
 }
@@ -0,0 +1,98 @@
+//***************************************************************************************
+// MappedFile.cpp
+//***************************************************************************************
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return false;
+	}
+	mFile = file;
+	mSize = (size_t)size.QuadPart;
+	mOpen = true;
+	if (mSize == 0)
+		return true; // CreateFileMapping refuses empty files
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+	mMapping = mapping;
+	mData = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (mData == nullptr)
+	{
+		Close();
+		return false;
+	}
+#else
+	mFd = open(filename.c_str(), O_RDONLY);
+	if (mFd < 0)
+		return false;
+	struct stat st;
+	if (fstat(mFd, &st) != 0)
+	{
+		Close();
+		return false;
+	}
+	mSize = (size_t)st.st_size;
+	mOpen = true;
+	if (mSize == 0)
+		return true; // mmap refuses a zero length
+	void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFd, 0);
+	if (data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	madvise(data, mSize, MADV_SEQUENTIAL);
+	mData = (const char*)data;
+#endif
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (mData)
+		UnmapViewOfFile(mData);
+	if (mMapping)
+		CloseHandle((HANDLE)mMapping);
+	if (mFile)
+		CloseHandle((HANDLE)mFile);
+	mMapping = nullptr;
+	mFile = nullptr;
+#else
+	if (mData)
+		munmap((void*)mData, mSize);
+	if (mFd >= 0)
+		close(mFd);
+	mFd = -1;
+#endif
+	mData = nullptr;
+	mSize = 0;
+	mOpen = false;
+}
@@ -0,0 +1,40 @@
+//***************************************************************************************
+// MappedFile.h
+//
+// Read-only memory mapping of a whole file (MapViewOfFile on Windows, mmap elsewhere).
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::string& filename) { Open(filename); }
+	~MappedFile() { Close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// False if the file cannot be opened or mapped; an empty file opens with Data() == nullptr
+	bool Open(const std::string& filename);
+	void Close();
+
+	bool IsOpen()const { return mOpen; }
+	const char* Data()const { return mData; }
+	size_t Size()const { return mSize; }
+
+private:
+	const char* mData = nullptr;
+	size_t mSize = 0;
+	bool mOpen = false;
+#ifdef _WIN32
+	void* mFile = nullptr;    // HANDLE
+	void* mMapping = nullptr; // HANDLE
+#else
+	int mFd = -1;
+#endif
+};
@@ -2,9 +2,318 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include "MappedFile.h"
 #include "model.h"
 
-Model::Model(std::string filename) : verts_(), faces_() {
+namespace {
+
+// Index not given in a corner (v//vn, or a bare v)
+constexpr int kNoIndex = INT_MIN;
+// Chunks per thread, so a chunk dense in faces does not hold up the rest
+constexpr int kChunksPerThread = 4;
+
+// What one chunk of lines holds; indices are 0-based, relative ones counted from the chunk's start
+struct ObjChunk {
+    std::vector<XMFLOAT3> verts;
+    std::vector<XMFLOAT3> normals;
+    std::vector<XMFLOAT2> uvs;
+    std::vector<obj_corner> corners;
+    std::vector<uint32_t> face_sizes;
+    std::vector<uint32_t> relative; // corners_ slot * 3 + (0 = v, 1 = vt, 2 = vn) of relative indices
+
+    // State lines; a chunk does not know what came before it, so its faces before the first usemtl or
+    // s line get -1 and take the previous chunk's state in the merge
+    std::vector<std::string> material_names; // usemtl lines in order
+    std::vector<std::string> libraries;      // mtllib lines
+    uint32_t groups = 0;                     // o and g lines
+    int smoothing = -1;
+    std::vector<int> face_material;          // into material_names
+    std::vector<uint32_t> face_group;        // o and g lines before the face within the chunk
+    std::vector<int> face_smoothing;
+};
+
+inline bool is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Exact powers of ten a double holds
+constexpr double kPowersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+// Decimal number at c, the way fast_atof reads it (digits gathered into an integer, then scaled once)
+// without its Assimp logger and exception types. Up to 19 significant digits are kept.
+inline const char* read_real(const char* c, float& out) {
+    const bool negative = *c == '-';
+    if (*c == '-' || *c == '+') ++c;
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    for (; is_digit(*c); ++c) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*c - '0');
+            digits += mantissa != 0;
+        } else {
+            ++exponent;
+        }
+    }
+    if (*c == '.')
+        for (++c; is_digit(*c); ++c)
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*c - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+    if (*c == 'e' || *c == 'E') {
+        const char* e = c + 1;
+        const bool negative_exponent = *e == '-';
+        if (*e == '-' || *e == '+') ++e;
+        if (is_digit(*e)) {
+            int value = 0;
+            for (; is_digit(*e); ++e)
+                value = std::min(value * 10 + (*e - '0'), 9999);
+            exponent += negative_exponent ? -value : value;
+            c = e;
+        }
+    }
+    double value = (double)mantissa;
+    if (exponent > 0)
+        value *= exponent <= 22 ? kPowersOfTen[exponent] : std::pow(10.0, exponent);
+    else if (exponent < 0)
+        value /= exponent >= -22 ? kPowersOfTen[-exponent] : std::pow(10.0, -exponent);
+    out = (float)(negative ? -value : value);
+    return c;
+}
+
+// Reads the next number of the line into out; false (and out untouched) when there is none. Every
+// line ends with '\n', which stops the digits.
+inline bool parse_float(const char*& c, float& out) {
+    while (is_blank(*c)) ++c;
+    const char* p = c + (*c == '-' || *c == '+');
+    if (!is_digit(*p) && !(*p == '.' && is_digit(p[1])))
+        return false;
+    c = read_real(c, out);
+    return true;
+}
+
+inline bool parse_int(const char*& c, int& out) {
+    const bool negative = *c == '-';
+    const char* p = c + (*c == '-' || *c == '+');
+    if (!is_digit(*p))
+        return false;
+    int value = 0;
+    for (; is_digit(*p); ++p)
+        value = std::min(value * 10 + (*p - '0'), INT_MAX / 10 - 1);
+    out = negative ? -value : value;
+    c = p;
+    return true;
+}
+
+// Line starting with the word key followed by a blank
+inline bool has_key(const char* c, const char* key) {
+    for (; *key; ++c, ++key)
+        if (*c != *key)
+            return false;
+    return is_blank(*c);
+}
+
+// The rest of the line from c, without the blanks around it
+std::string line_rest(const char* c, const char* eol) {
+    while (c < eol && is_blank(*c)) ++c;
+    const char* e = eol;
+    while (e > c && (is_blank(e[-1]) || e[-1] == '\r')) --e;
+    return std::string(c, e);
+}
+
+// OBJ index (1-based, or negative from the end of what came before) to 0-based; relative ones are
+// counted within the chunk and noted for the merge to rebase
+inline int resolve_index(int index, size_t count, uint32_t slot, std::vector<uint32_t>& relative) {
+    if (index > 0)
+        return index - 1;
+    if (index < 0) {
+        relative.push_back(slot);
+        return (int)count + index;
+    }
+    return kNoIndex;
+}
+
+void parse_chunk(const char* c, const char* end, ObjChunk& out) {
+    while (c < end) {
+        const char* eol = (const char*)memchr(c, '\n', end - c);
+        if (!eol) eol = end;
+        while (is_blank(*c)) ++c;
+        if (c[0] == 'v' && is_blank(c[1])) {
+            XMFLOAT3 v(0.f, 0.f, 0.f);
+            c += 2;
+            parse_float(c, v.x) && parse_float(c, v.y) && parse_float(c, v.z);
+            out.verts.push_back(v);
+        } else if (c[0] == 'v' && c[1] == 'n' && is_blank(c[2])) {
+            XMFLOAT3 n(0.f, 0.f, 0.f);
+            c += 3;
+            parse_float(c, n.x) && parse_float(c, n.y) && parse_float(c, n.z);
+            out.normals.push_back(n);
+        } else if (c[0] == 'v' && c[1] == 't' && is_blank(c[2])) {
+            XMFLOAT2 uv(0.f, 0.f);
+            c += 3;
+            parse_float(c, uv.x) && parse_float(c, uv.y);
+            out.uvs.push_back(uv);
+        } else if (c[0] == 'f' && is_blank(c[1])) {
+            c += 2;
+            uint32_t size = 0;
+            for (;;) {
+                while (is_blank(*c)) ++c;
+                int v, vt = 0, vn = 0;
+                if (!parse_int(c, v))
+                    break;
+                if (*c == '/') {
+                    ++c;
+                    parse_int(c, vt);
+                    if (*c == '/') {
+                        ++c;
+                        parse_int(c, vn);
+                    }
+                }
+                const uint32_t slot = (uint32_t)out.corners.size() * 3;
+                obj_corner corner;
+                corner.v = resolve_index(v, out.verts.size(), slot, out.relative);
+                corner.vt = resolve_index(vt, out.uvs.size(), slot + 1, out.relative);
+                corner.vn = resolve_index(vn, out.normals.size(), slot + 2, out.relative);
+                out.corners.push_back(corner);
+                ++size;
+            }
+            out.face_sizes.push_back(size);
+            out.face_material.push_back(out.material_names.empty() ? -1 : (int)out.material_names.size() - 1);
+            out.face_group.push_back(out.groups);
+            out.face_smoothing.push_back(out.smoothing);
+        } else if (has_key(c, "usemtl")) {
+            out.material_names.push_back(line_rest(c + 6, eol));
+        } else if ((c[0] == 'o' || c[0] == 'g') && (is_blank(c[1]) || c[1] == '\r' || c[1] == '\n')) {
+            ++out.groups;
+        } else if (c[0] == 's' && is_blank(c[1])) {
+            c += 2;
+            while (is_blank(*c)) ++c;
+            int group = 0; // "off"
+            parse_int(c, group);
+            out.smoothing = std::max(group, 0);
+        } else if (has_key(c, "mtllib")) {
+            out.libraries.push_back(line_rest(c + 6, eol));
+        }
+        c = eol + 1;
+    }
+}
+
+template <typename T>
+T attribute(const std::vector<T>& values, int index) {
+    return index >= 0 && index < (int)values.size() ? values[index] : T();
+}
+
+// Bits of a corner's position, normal and uv
+struct WeldKey {
+    uint32_t bits[8];
+    bool operator==(const WeldKey& o) const { return memcmp(bits, o.bits, sizeof(bits)) == 0; }
+    size_t hash() const {
+        uint64_t h = 14695981039346656037ull;
+        for (uint32_t b : bits)
+            h = (h ^ b) * 1099511628211ull;
+        h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdull; // the multiplies only carry bits upwards
+        return (size_t)(h ^ (h >> 33));
+    }
+};
+
+// Corners [face_starts[0], face_starts[faces]) welded into mesh by value (8 floats each in corner_values,
+// from face_starts[0] on: position, normal, uv), the faces fanned from their first corner, tangents
+// from the uvs
+void weld_faces(const float* corner_values, const uint32_t* face_starts, size_t faces, GeometryGenerator::MeshData& mesh) {
+    const uint32_t first = face_starts[0];
+    const size_t corner_count = face_starts[faces] - first;
+
+    // Weld: open addressing over the corners' values, -0 folded into 0 so it matches
+    size_t table_size = 16;
+    while (table_size < corner_count * 2) table_size *= 2;
+    std::vector<uint32_t> table(table_size, UINT32_MAX);
+    std::vector<WeldKey> keys;
+    std::vector<uint32_t> corner_vertex(corner_count);
+    for (size_t i = 0; i < corner_count; ++i) {
+        const float* values = corner_values + i * 8;
+        WeldKey key;
+        for (int k = 0; k < 8; ++k) {
+            const float value = values[k] == 0.f ? 0.f : values[k];
+            memcpy(&key.bits[k], &value, sizeof(float));
+        }
+        const size_t hash = key.hash();
+        size_t slot = hash & (table_size - 1);
+        while (table[slot] != UINT32_MAX && !(keys[table[slot]] == key))
+            slot = (slot + 1) & (table_size - 1);
+        if (table[slot] == UINT32_MAX) {
+            table[slot] = (uint32_t)keys.size();
+            keys.push_back(key);
+            mesh.Vertices.push_back(GeometryGenerator::Vertex(values[0], values[1], values[2], values[3], values[4],
+                values[5], 0.f, 0.f, 0.f, values[6], values[7]));
+        }
+        corner_vertex[i] = table[slot];
+    }
+
+    for (size_t f = 0; f < faces; ++f)
+        for (uint32_t i = face_starts[f] + 2; i < face_starts[f + 1]; ++i) {
+            mesh.Indices32.push_back(corner_vertex[face_starts[f] - first]);
+            mesh.Indices32.push_back(corner_vertex[i - 1 - first]);
+            mesh.Indices32.push_back(corner_vertex[i - first]);
+        }
+
+    // Tangents: each triangle's uv-space x direction, summed per vertex and made orthogonal to the normal
+    std::vector<XMFLOAT3> tangents(mesh.Vertices.size(), XMFLOAT3(0.f, 0.f, 0.f));
+    for (size_t i = 0; i + 2 < mesh.Indices32.size(); i += 3) {
+        const GeometryGenerator::Vertex& a = mesh.Vertices[mesh.Indices32[i]];
+        const GeometryGenerator::Vertex& b = mesh.Vertices[mesh.Indices32[i + 1]];
+        const GeometryGenerator::Vertex& c = mesh.Vertices[mesh.Indices32[i + 2]];
+        const float e1[3] = { b.Position.x - a.Position.x, b.Position.y - a.Position.y, b.Position.z - a.Position.z };
+        const float e2[3] = { c.Position.x - a.Position.x, c.Position.y - a.Position.y, c.Position.z - a.Position.z };
+        const float du1 = b.TexC.x - a.TexC.x, dv1 = b.TexC.y - a.TexC.y;
+        const float du2 = c.TexC.x - a.TexC.x, dv2 = c.TexC.y - a.TexC.y;
+        const float det = du1 * dv2 - du2 * dv1;
+        if (std::fabs(det) < 1e-12f)
+            continue;
+        const float r = 1.f / det;
+        const XMFLOAT3 t((e1[0] * dv2 - e2[0] * dv1) * r, (e1[1] * dv2 - e2[1] * dv1) * r, (e1[2] * dv2 - e2[2] * dv1) * r);
+        for (int k = 0; k < 3; ++k) {
+            XMFLOAT3& sum = tangents[mesh.Indices32[i + k]];
+            sum.x += t.x;
+            sum.y += t.y;
+            sum.z += t.z;
+        }
+    }
+    for (size_t i = 0; i < mesh.Vertices.size(); ++i) {
+        GeometryGenerator::Vertex& v = mesh.Vertices[i];
+        // OBJ normals need not be unit length
+        const float n_length = std::sqrt(v.Normal.x * v.Normal.x + v.Normal.y * v.Normal.y + v.Normal.z * v.Normal.z);
+        const float n_scale = n_length > 0.f ? 1.f / n_length : 0.f;
+        const XMFLOAT3 n(v.Normal.x * n_scale, v.Normal.y * n_scale, v.Normal.z * n_scale);
+        XMFLOAT3 t = tangents[i];
+        const float d = t.x * n.x + t.y * n.y + t.z * n.z;
+        t = XMFLOAT3(t.x - n.x * d, t.y - n.y * d, t.z - n.z * d);
+        float length = std::sqrt(t.x * t.x + t.y * t.y + t.z * t.z);
+        if (length < 1e-8f) {
+            // No uv direction here: any direction across the normal
+            t = std::fabs(n.x) < 0.9f ? XMFLOAT3(1.f - n.x * n.x, -n.x * n.y, -n.x * n.z) : XMFLOAT3(-n.y * n.x, 1.f - n.y * n.y, -n.y * n.z);
+            length = std::sqrt(t.x * t.x + t.y * t.y + t.z * t.z);
+        }
+        v.TangentU = length > 1e-8f ? XMFLOAT3(t.x / length, t.y / length, t.z / length) : XMFLOAT3(1.f, 0.f, 0.f);
+    }
+}
+
+// The line-by-line parser Model used before, for the benchmark and the check. Only the corner count
+// is capped at three and the indices are checked, where it used to read and write out of bounds.
+void legacy_parse(const std::string& filename, std::vector<XMFLOAT3>& verts_, std::vector<XMFLOAT3>& normals_,
+    std::vector<XMFLOAT2>& uv_coords_, std::vector<polygon>& faces_) {
     std::ifstream in;
     in.open (filename, std::ifstream::in);
     if (in.fail()) { std::cerr << ":("; }
@@ -34,50 +343,217 @@ Model::Model(std::string filename) : verts_(), faces_() {
             polygon f;
             int v, uv, n, i = 0;
             iss >> trash;
-            while (iss >> v >> trash >> uv >> trash >> n) {
+            while (i < 3 && iss >> v >> trash >> uv >> trash >> n) {
                 Vert vt;
                 v--;
                 uv--;
                 n--;
-                vt.Position = vert(v);
-                vt.TexC = uv_coords(uv);
-                vt.Normal = normal(n);
+                vt.Position = attribute(verts_, v);
+                vt.TexC = attribute(uv_coords_, uv);
+                vt.Normal = attribute(normals_, n);
                 f.verts[i] = vt;
                 i++;
             }
             faces_.push_back(f);
-        } else if (!line.compare(0, 3, "vn ")) {
-            iss >> trash;
         }
     }
-    in.close();
+}
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+Model::Model(std::string filename) : verts_(), faces_() {
+    MappedFile file;
+    if (!file.Open(filename)) { std::cerr << ":("; return; }
+    parse(file.Data(), file.Size());
  //   load_texture(filename, "_diffuse.tga", diffuse_map_);
     std::cerr << "# v# " << verts_.size() << " f# "  << faces_.size() << std::endl;
 }
 
+void Model::parse(const char* data, size_t size, size_t chunk_bytes, int threads) {
+    verts_.clear();
+    normals_.clear();
+    uv_coords_.clear();
+    corners_.clear();
+    face_starts_.assign(1, 0);
+    faces_.clear();
+    materials_.clear();
+    material_libs_.clear();
+    face_material_.clear();
+    face_group_.clear();
+    face_smoothing_.clear();
+    loaded_ = true;
+
+    // Lines are parsed in place, each stopped by its '\n'; a last line without one is copied
+    size_t body = size;
+    std::string tail;
+    if (size > 0 && data[size - 1] != '\n') {
+        const char* last = data + size;
+        while (last > data && last[-1] != '\n') --last;
+        body = last - data;
+        tail.assign(last, data + size);
+        tail += '\n';
+    }
+
+    if (threads <= 0)
+        threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    const size_t max_chunks = (size_t)threads * kChunksPerThread;
+    const size_t chunk_count = std::max<size_t>(1, std::min(body / std::max<size_t>(chunk_bytes, 1), max_chunks));
+    std::vector<size_t> starts(chunk_count + 1, body);
+    starts[0] = 0;
+    for (size_t i = 1; i < chunk_count; ++i) {
+        size_t start = std::max(body * i / chunk_count, starts[i - 1]);
+        while (start > 0 && start < body && data[start - 1] != '\n') ++start;
+        starts[i] = start;
+    }
+
+    std::vector<ObjChunk> chunks(chunk_count + (tail.empty() ? 0 : 1));
+    const int workers = (int)std::min<size_t>(threads, chunk_count);
+    auto work = [&](int worker) {
+        for (size_t i = worker; i < chunk_count; i += workers)
+            parse_chunk(data + starts[i], data + starts[i + 1], chunks[i]);
+    };
+    std::vector<std::thread> pool;
+    for (int w = 1; w < workers; ++w)
+        pool.emplace_back(work, w);
+    work(0);
+    for (std::thread& t : pool)
+        t.join();
+    if (!tail.empty())
+        parse_chunk(tail.data(), tail.data() + tail.size(), chunks.back());
+
+    // Merge in file order
+    size_t verts = 0, normals = 0, uvs = 0, corners = 0, faces = 0;
+    for (const ObjChunk& chunk : chunks) {
+        verts += chunk.verts.size();
+        normals += chunk.normals.size();
+        uvs += chunk.uvs.size();
+        corners += chunk.corners.size();
+        faces += chunk.face_sizes.size();
+    }
+    verts_.reserve(verts);
+    normals_.reserve(normals);
+    uv_coords_.reserve(uvs);
+    corners_.reserve(corners);
+    face_starts_.reserve(faces + 1);
+    face_material_.reserve(faces);
+    face_group_.reserve(faces);
+    face_smoothing_.reserve(faces);
+    int material = -1;
+    int smoothing = 0;
+    uint32_t group_base = 0;
+    std::unordered_map<std::string, int> material_ids;
+    std::vector<int> chunk_materials;
+    for (ObjChunk& chunk : chunks) {
+        const int bases[3] = { (int)verts_.size(), (int)uv_coords_.size(), (int)normals_.size() };
+        for (uint32_t slot : chunk.relative)
+            (&chunk.corners[slot / 3].v)[slot % 3] += bases[slot % 3];
+        verts_.insert(verts_.end(), chunk.verts.begin(), chunk.verts.end());
+        normals_.insert(normals_.end(), chunk.normals.begin(), chunk.normals.end());
+        uv_coords_.insert(uv_coords_.end(), chunk.uvs.begin(), chunk.uvs.end());
+        corners_.insert(corners_.end(), chunk.corners.begin(), chunk.corners.end());
+        for (uint32_t n : chunk.face_sizes)
+            face_starts_.push_back(face_starts_.back() + n);
+
+        // State carried over from the chunks before
+        chunk_materials.clear();
+        for (const std::string& name : chunk.material_names) {
+            auto it = material_ids.emplace(name, (int)materials_.size());
+            if (it.second)
+                materials_.push_back(name);
+            chunk_materials.push_back(it.first->second);
+        }
+        for (size_t f = 0; f < chunk.face_sizes.size(); ++f) {
+            face_material_.push_back(chunk.face_material[f] >= 0 ? chunk_materials[chunk.face_material[f]] : material);
+            face_group_.push_back(group_base + chunk.face_group[f]);
+            face_smoothing_.push_back((uint32_t)(chunk.face_smoothing[f] >= 0 ? chunk.face_smoothing[f] : smoothing));
+        }
+        if (!chunk_materials.empty())
+            material = chunk_materials.back();
+        if (chunk.smoothing >= 0)
+            smoothing = chunk.smoothing;
+        group_base += chunk.groups;
+        material_libs_.insert(material_libs_.end(), chunk.libraries.begin(), chunk.libraries.end());
+    }
+    for (obj_corner& c : corners_) {
+        c.v = c.v >= 0 && c.v < (int)verts_.size() ? c.v : -1;
+        c.vt = c.vt >= 0 && c.vt < (int)uv_coords_.size() ? c.vt : -1;
+        c.vn = c.vn >= 0 && c.vn < (int)normals_.size() ? c.vn : -1;
+    }
+
+    // Triangles fanned from each face's first corner; faces of fewer than three corners draw nothing
+    size_t triangles = 0;
+    for (size_t f = 0; f < faces; ++f)
+        triangles += std::max<uint32_t>(face_starts_[f + 1] - face_starts_[f], 2) - 2;
+    faces_.resize(triangles);
+    auto corner_vert = [this](uint32_t corner) {
+        const obj_corner& c = corners_[corner];
+        return Vert(attribute(verts_, c.v), attribute(normals_, c.vn), XMFLOAT3(0.f, 0.f, 0.f), attribute(uv_coords_, c.vt));
+    };
+    size_t t = 0;
+    for (size_t f = 0; f < faces; ++f)
+        for (uint32_t i = face_starts_[f] + 2; i < face_starts_[f + 1]; ++i, ++t)
+            faces_[t] = polygon(corner_vert(face_starts_[f]), corner_vert(i - 1), corner_vert(i));
+}
+
+GeometryGenerator::MeshData Model::mesh_data() const {
+    if (face_starts_.empty())
+        return GeometryGenerator::MeshData();
+    std::vector<float> values(corners_.size() * 8);
+    for (size_t i = 0; i < corners_.size(); ++i)
+        corner_values(corners_[i], attribute(normals_, corners_[i].vn), &values[i * 8]);
+    GeometryGenerator::MeshData mesh;
+    weld_faces(values.data(), face_starts_.data(), face_starts_.size() - 1, mesh);
+    return mesh;
+}
+
+void Model::corner_values(const obj_corner& c, const XMFLOAT3& n, float* out) const {
+    const XMFLOAT3 p = attribute(verts_, c.v);
+    const XMFLOAT2 uv = attribute(uv_coords_, c.vt);
+    const float values[8] = { p.x, p.y, p.z, n.x, n.y, n.z, uv.x, uv.y };
+    std::copy(values, values + 8, out);
+}
+
+size_t Model::memory_bytes() const {
+    size_t bytes = verts_.capacity() * sizeof(XMFLOAT3) + normals_.capacity() * sizeof(XMFLOAT3) +
+        uv_coords_.capacity() * sizeof(XMFLOAT2) + faces_.capacity() * sizeof(polygon) +
+        corners_.capacity() * sizeof(obj_corner) + face_starts_.capacity() * sizeof(uint32_t) +
+        face_material_.capacity() * sizeof(int) + face_group_.capacity() * sizeof(uint32_t) +
+        face_smoothing_.capacity() * sizeof(uint32_t);
+    for (const std::string& name : materials_)
+        bytes += name.capacity();
+    return bytes;
+}
+
 Model::~Model() {
 }
+bool Model::loaded() const {
+    return loaded_;
+}
 // number of verts
-int Model::nverts() {
+int Model::nverts() const {
     return (int)verts_.size();
 }
 // number of faces
-int Model::nfaces() {
+int Model::nfaces() const {
     return (int)faces_.size();
 }
 // face
-polygon Model::face(int idx) {
+polygon Model::face(int idx) const {
     return faces_[idx];
 }
 // array of verts
-XMFLOAT3 Model::vert(int i) {
+XMFLOAT3 Model::vert(int i) const {
     return verts_[i];
 }
-XMFLOAT3 Model::normal(int i) {
+XMFLOAT3 Model::normal(int i) const {
     //XMStoreFloat3(&normals_[i], XMVector3Normalize(XMLoadFloat3(&normals_[i])))
     return normals_[i];
 }
-XMFLOAT2 Model::uv_coords(int i) {
+XMFLOAT2 Model::uv_coords(int i) const {
  //   return Vector2(uv_coords_[i].x*diffuse_map_.get_width(), uv_coords_[i].y*diffuse_map_.get_height());
     return uv_coords_[i];
 }
@@ -93,3 +569,625 @@ XMFLOAT2 Model::uv_coords(int i) {
 //        img.flip_vertically();
 //    }
 //}
+
+ModelParseBenchmark BenchmarkModelParse(const std::string& filename, int repeats) {
+    ModelParseBenchmark result;
+    repeats = std::max(repeats, 1);
+    {
+        MappedFile file(filename);
+        if (!file.IsOpen())
+            return result;
+        result.Bytes = file.Size();
+    }
+    result.Threads = (int)std::max(1u, std::thread::hardware_concurrency());
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        std::vector<XMFLOAT3> verts, normals;
+        std::vector<XMFLOAT2> uvs;
+        std::vector<polygon> faces;
+        legacy_parse(filename, verts, normals, uvs, faces);
+    }
+    result.LegacyMs = ms_since(start) / repeats;
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        MappedFile file(filename);
+        Model model;
+        model.parse(file.Data(), file.Size());
+    }
+    result.MappedMs = ms_since(start) / repeats;
+
+    const double mb = result.Bytes / (1024.0 * 1024.0);
+    result.LegacyMBps = result.LegacyMs > 0.0 ? mb / (result.LegacyMs * 1e-3) : 0.0;
+    result.MappedMBps = result.MappedMs > 0.0 ? mb / (result.MappedMs * 1e-3) : 0.0;
+    return result;
+}
+
+namespace {
+
+bool fail(std::string* error, const std::string& message) {
+    if (error)
+        *error = message;
+    return false;
+}
+
+bool near_equal(float a, float b) {
+    return std::fabs(a - b) <= 1e-5f * std::max(1.f, std::fabs(a));
+}
+
+bool same_vert(const Vert& a, const Vert& b) {
+    return near_equal(a.Position.x, b.Position.x) && near_equal(a.Position.y, b.Position.y) &&
+        near_equal(a.Position.z, b.Position.z) && near_equal(a.Normal.x, b.Normal.x) &&
+        near_equal(a.Normal.y, b.Normal.y) && near_equal(a.Normal.z, b.Normal.z) &&
+        near_equal(a.TexC.x, b.TexC.x) && near_equal(a.TexC.y, b.TexC.y);
+}
+
+} // namespace
+
+bool ValidateModelParse(const std::string& filename, std::string* error) {
+    // Two chunks' worth of lines referring back across each other, ending without a newline
+    const std::string text =
+        "# comment v 9 9 9\r\n"
+        "mtllib x.mtl\n"
+        "v 1 2 3\r\n"
+        "v\t-4.5 5e-1 +6\n"
+        "  v 7 8 9\n"
+        "vt 0.25 0.75\n"
+        "vt .5 1\n"
+        "vn 0 1 0\n"
+        "usemtl a\n"
+        "f 1/1/1 2/2/1 3/1/1\r\n"
+        "f -3/-2/-1 -2/-1/-1 -1/-2/-1 1/1/1\n"
+        "\n"
+        "v -1 -2 -3\n"
+        "f 4//1 3//1 2//1\n"
+        "f 1 2 4";
+    const int expected_faces[4][3] = { { 0, 1, 2 }, { 0, 1, 2 }, { 3, 2, 1 }, { 0, 1, 3 } };
+    const float expected_x[4] = { 1.f, -4.5f, 7.f, -1.f };
+
+    Model reference;
+    reference.parse(text.data(), text.size(), text.size() + 1, 1);
+    if (reference.nverts() != 4 || reference.nfaces() != 5 || reference.face_starts().size() != 5 ||
+        reference.corners().size() != 13)
+        return fail(error, "synthetic text: wrong element counts");
+    for (int i = 0; i < 4; ++i)
+        if (reference.vert(i).x != expected_x[i])
+            return fail(error, "synthetic text: wrong position " + std::to_string(i));
+    if (reference.vert(1).y != 0.5f || reference.vert(1).z != 6.f || reference.uv_coords(1).x != 0.5f)
+        return fail(error, "synthetic text: number forms misread");
+    for (int f = 0; f < 4; ++f)
+        for (int i = 0; i < 3; ++i)
+            if (reference.corners()[reference.face_starts()[f] + i].v != expected_faces[f][i])
+                return fail(error, "synthetic text: wrong corner in face " + std::to_string(f));
+    const obj_corner& bare = reference.corners()[reference.face_starts()[3]];
+    if (reference.corners()[reference.face_starts()[2]].vt != -1 || bare.vt != -1 || bare.vn != -1)
+        return fail(error, "synthetic text: missing indices not marked");
+    if (reference.face(1).verts[0].TexC.x != 0.25f || reference.face(1).verts[2].Normal.y != 1.f)
+        return fail(error, "synthetic text: relative indices misresolved");
+
+    for (size_t chunk_bytes = 1; chunk_bytes < text.size(); chunk_bytes += 7) {
+        Model chunked;
+        chunked.parse(text.data(), text.size(), chunk_bytes, 3);
+        if (chunked.nverts() != reference.nverts() || chunked.nfaces() != reference.nfaces() ||
+            chunked.face_starts() != reference.face_starts())
+            return fail(error, "synthetic text: counts change with " + std::to_string(chunk_bytes) + "-byte chunks");
+        for (size_t i = 0; i < chunked.corners().size(); ++i) {
+            const obj_corner& a = chunked.corners()[i];
+            const obj_corner& b = reference.corners()[i];
+            if (a.v != b.v || a.vt != b.vt || a.vn != b.vn)
+                return fail(error, "synthetic text: corners change with " + std::to_string(chunk_bytes) + "-byte chunks");
+        }
+    }
+
+    if (filename.empty())
+        return true;
+    std::vector<XMFLOAT3> verts, normals;
+    std::vector<XMFLOAT2> uvs;
+    std::vector<polygon> faces;
+    legacy_parse(filename, verts, normals, uvs, faces);
+    MappedFile file(filename);
+    if (!file.IsOpen())
+        return fail(error, "cannot open " + filename);
+    // Small chunks so even a small file is split many ways
+    Model model;
+    model.parse(file.Data(), file.Size(), 4096);
+    if (model.nverts() != (int)verts.size() || model.nfaces() != (int)faces.size())
+        return fail(error, filename + ": element counts differ from the line parser");
+    for (int i = 0; i < model.nverts(); ++i) {
+        const XMFLOAT3 v = model.vert(i);
+        if (!near_equal(v.x, verts[i].x) || !near_equal(v.y, verts[i].y) || !near_equal(v.z, verts[i].z))
+            return fail(error, filename + ": position " + std::to_string(i) + " differs from the line parser");
+    }
+    for (int f = 0; f < model.nfaces(); ++f)
+        for (int i = 0; i < 3; ++i)
+            if (!same_vert(model.face(f).verts[i], faces[f].verts[i]))
+                return fail(error, filename + ": face " + std::to_string(f) + " differs from the line parser");
+    return true;
+}
+
+ModelMeshStats MeasureModelMesh(const std::string& filename) {
+    ModelMeshStats stats;
+    Model model(filename);
+    const auto start = std::chrono::steady_clock::now();
+    const GeometryGenerator::MeshData mesh = model.mesh_data();
+    stats.WeldMs = ms_since(start);
+
+    const size_t vertex_bytes = sizeof(GeometryGenerator::Vertex);
+    stats.Triangles = mesh.Indices32.size() / 3;
+    stats.Corners = stats.Triangles * 3;
+    stats.Vertices = mesh.Vertices.size();
+    stats.FaceBytes = (size_t)model.nfaces() * sizeof(polygon);
+    stats.MeshBytes = stats.Vertices * vertex_bytes + mesh.Indices32.size() * sizeof(uint32_t);
+    stats.UnindexedUploadBytes = stats.Corners * vertex_bytes;
+    stats.IndexedUploadBytes = stats.Vertices * vertex_bytes +
+        mesh.Indices32.size() * (stats.Vertices <= 65536 ? sizeof(uint16_t) : sizeof(uint32_t));
+    return stats;
+}
+
+namespace {
+
+void vertex_values(const GeometryGenerator::Vertex& v, float out[8]) {
+    const float values[8] = { v.Position.x, v.Position.y, v.Position.z, v.Normal.x, v.Normal.y, v.Normal.z, v.TexC.x, v.TexC.y };
+    std::copy(values, values + 8, out);
+}
+
+bool check_mesh(const Model& model, const GeometryGenerator::MeshData& mesh, const std::string& name, std::string* error) {
+    const std::vector<obj_corner>& corners = model.corners();
+    const std::vector<uint32_t>& starts = model.face_starts();
+    size_t index = 0;
+    std::vector<uint8_t> used(mesh.Vertices.size(), 0);
+    for (size_t f = 0; f + 1 < starts.size(); ++f)
+        for (uint32_t i = starts[f] + 2; i < starts[f + 1]; ++i) {
+            const uint32_t fan[3] = { starts[f], i - 1, i };
+            for (int k = 0; k < 3; ++k, ++index) {
+                if (index >= mesh.Indices32.size() || mesh.Indices32[index] >= mesh.Vertices.size())
+                    return fail(error, name + ": index out of range or missing");
+                const GeometryGenerator::Vertex& v = mesh.Vertices[mesh.Indices32[index]];
+                used[mesh.Indices32[index]] = 1;
+                const obj_corner& c = corners[fan[k]];
+                const XMFLOAT3 p = c.v >= 0 ? model.vert(c.v) : XMFLOAT3(0.f, 0.f, 0.f);
+                const XMFLOAT3 n = c.vn >= 0 ? model.normal(c.vn) : XMFLOAT3(0.f, 0.f, 0.f);
+                const XMFLOAT2 uv = c.vt >= 0 ? model.uv_coords(c.vt) : XMFLOAT2(0.f, 0.f);
+                if (v.Position.x != p.x || v.Position.y != p.y || v.Position.z != p.z || v.Normal.x != n.x ||
+                    v.Normal.y != n.y || v.Normal.z != n.z || v.TexC.x != uv.x || v.TexC.y != uv.y)
+                    return fail(error, name + ": face " + std::to_string(f) + " reads back other values");
+            }
+        }
+    if (index != mesh.Indices32.size())
+        return fail(error, name + ": more indices than fanned corners");
+    if (std::find(used.begin(), used.end(), 0) != used.end())
+        return fail(error, name + ": unreferenced vertex");
+
+    std::vector<uint32_t> order(mesh.Vertices.size());
+    for (uint32_t i = 0; i < (uint32_t)order.size(); ++i) order[i] = i;
+    auto less = [&mesh](uint32_t a, uint32_t b) {
+        float va[8], vb[8];
+        vertex_values(mesh.Vertices[a], va);
+        vertex_values(mesh.Vertices[b], vb);
+        return std::lexicographical_compare(va, va + 8, vb, vb + 8);
+    };
+    std::sort(order.begin(), order.end(), less);
+    for (size_t i = 1; i < order.size(); ++i)
+        if (!less(order[i - 1], order[i]))
+            return fail(error, name + ": two vertices hold the same values");
+
+    for (const GeometryGenerator::Vertex& v : mesh.Vertices) {
+        const XMFLOAT3& t = v.TangentU;
+        const float length = std::sqrt(t.x * t.x + t.y * t.y + t.z * t.z);
+        const float n_length = std::sqrt(v.Normal.x * v.Normal.x + v.Normal.y * v.Normal.y + v.Normal.z * v.Normal.z);
+        const float across = t.x * v.Normal.x + t.y * v.Normal.y + t.z * v.Normal.z;
+        if (std::fabs(length - 1.f) > 1e-3f || std::fabs(across) > 1e-3f * std::max(n_length, 1.f))
+            return fail(error, name + ": tangent not a unit vector across the normal");
+    }
+    return true;
+}
+
+} // namespace
+
+bool ValidateModelMesh(const std::string& filename, std::string* error) {
+    const std::string text =
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 2 0.5 0\nv 1 0 0\n"
+        "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+        "vn 0 0 1\nvn -0 0 1\nvn 0 0 -1\n"
+        "f 1/1/1 2/2/1 3/3/1 4/4/1\n"
+        "f 6/2/2 5/2/1 3/3/1 4/4/2 1/1/1\n"
+        "f 1/1/3 2/2/3\n"
+        "f 1/1/3 3/3/3 2/2/3\n";
+    Model model;
+    model.parse(text.data(), text.size());
+    const GeometryGenerator::MeshData mesh = model.mesh_data();
+    // 2 + 3 + 0 + 1 triangles; 4 + 1 (2 0.5 0) + 3 (the normal flipped) distinct corners
+    if (mesh.Indices32.size() != 18 || model.nfaces() != 6)
+        return fail(error, "synthetic faces: wrong triangle count");
+    if (mesh.Vertices.size() != 8)
+        return fail(error, "synthetic faces: " + std::to_string(mesh.Vertices.size()) + " vertices, expected 8");
+    if (!check_mesh(model, mesh, "synthetic faces", error))
+        return false;
+    const XMFLOAT3& t = mesh.Vertices[0].TangentU;
+    if (std::fabs(t.x - 1.f) > 1e-4f || std::fabs(t.y) > 1e-4f)
+        return fail(error, "synthetic faces: tangent does not follow u");
+
+    if (filename.empty())
+        return true;
+    Model file_model(filename);
+    if (!file_model.loaded())
+        return fail(error, "cannot open " + filename);
+    return check_mesh(file_model, file_model.mesh_data(), filename, error);
+}
+
+namespace {
+
+// Lower-case copy of the first word of the line
+std::string line_key(const char* c, const char* eol) {
+    std::string key;
+    for (; c < eol && !is_blank(*c) && *c != '\r'; ++c)
+        key += (char)(*c >= 'A' && *c <= 'Z' ? *c - 'A' + 'a' : *c);
+    return key;
+}
+
+// File name of a texture statement, after its options (-bm 1, -o u v w, ...); may hold blanks
+std::string texture_path(const char* c, const char* eol) {
+    static const struct { const char* name; int args; } kOptions[] = { { "-blendu", 1 }, { "-blendv", 1 },
+        { "-boost", 1 }, { "-bm", 1 }, { "-cc", 1 }, { "-clamp", 1 }, { "-imfchan", 1 }, { "-mm", 2 },
+        { "-o", 3 }, { "-s", 3 }, { "-t", 3 }, { "-texres", 1 }, { "-type", 1 } };
+    for (;;) {
+        while (c < eol && is_blank(*c)) ++c;
+        if (c >= eol || *c != '-')
+            break;
+        const char* e = c;
+        while (e < eol && !is_blank(*e)) ++e;
+        const std::string option(c, e);
+        int args = 0;
+        for (const auto& o : kOptions)
+            if (option == o.name)
+                args = o.args;
+        c = e;
+        // -o, -s and -t take one to three numbers
+        for (int i = 0; i < args; ++i) {
+            while (c < eol && is_blank(*c)) ++c;
+            const char* p = c + (*c == '-' || *c == '+');
+            if (i > 0 && args == 3 && !is_digit(*p) && *p != '.')
+                break;
+            while (c < eol && !is_blank(*c)) ++c;
+        }
+    }
+    return line_rest(c, eol);
+}
+
+void convert_mesh(GeometryGenerator::MeshData& mesh, uint32_t flags) {
+    for (GeometryGenerator::Vertex& v : mesh.Vertices) {
+        if (flags & kModelImportLeftHanded) {
+            v.Position.z = -v.Position.z;
+            v.Normal.z = -v.Normal.z;
+            v.TangentU.z = -v.TangentU.z;
+        }
+        // dP/du does not change with v, so the tangents stay
+        if (flags & kModelImportFlipV)
+            v.TexC.y = 1.f - v.TexC.y;
+    }
+    if (flags & kModelImportLeftHanded)
+        for (size_t i = 0; i + 2 < mesh.Indices32.size(); i += 3)
+            std::swap(mesh.Indices32[i + 1], mesh.Indices32[i + 2]);
+}
+
+size_t mesh_bytes(const GeometryGenerator::MeshData& mesh) {
+    return mesh.Vertices.capacity() * sizeof(GeometryGenerator::Vertex) + mesh.Indices32.capacity() * sizeof(uint32_t);
+}
+
+} // namespace
+
+void ParseModelMaterials(const char* data, size_t size, std::vector<GeometryGenerator::Material>& materials) {
+    const std::string text = std::string(data, size) + '\n';
+    const char* c = text.data();
+    const char* end = c + text.size();
+    bool displacement = false; // map_Disp seen for the current material, which map_bump does not replace
+    while (c < end) {
+        const char* eol = (const char*)memchr(c, '\n', end - c);
+        while (is_blank(*c)) ++c;
+        const std::string key = line_key(c, eol);
+        const char* rest = c + key.size();
+        if (key == "newmtl") {
+            materials.push_back(GeometryGenerator::Material());
+            materials.back().name = line_rest(rest, eol);
+            displacement = false;
+        } else if (!materials.empty()) {
+            GeometryGenerator::Material& m = materials.back();
+            if (key == "map_kd") {
+                m.diffFile = texture_path(rest, eol);
+            } else if (key == "map_disp" || key == "disp") {
+                m.normFile = texture_path(rest, eol);
+                displacement = true;
+            } else if ((key == "map_bump" || key == "bump") && !displacement) {
+                m.normFile = texture_path(rest, eol);
+            }
+        }
+        c = eol + 1;
+    }
+}
+
+void ImportModel(const Model& model, const std::vector<GeometryGenerator::Material>& libraryMaterials,
+    uint32_t flags, ModelImport& out) {
+    out.Meshes.clear();
+    out.Sources.clear();
+    out.Materials.assign(1, GeometryGenerator::Material());
+    out.Materials[0].name = "DefaultMaterial";
+    out.Materials.insert(out.Materials.end(), libraryMaterials.begin(), libraryMaterials.end());
+    std::unordered_map<std::string, int> material_ids;
+    for (int i = (int)out.Materials.size() - 1; i >= 0; --i)
+        material_ids[out.Materials[i].name] = i; // the first of a repeated name
+    std::vector<int> material_index(model.materials().size(), 0);
+    for (size_t i = 0; i < material_index.size(); ++i) {
+        auto it = material_ids.find(model.materials()[i]);
+        material_index[i] = it != material_ids.end() ? it->second : 0;
+    }
+
+    const std::vector<obj_corner>& corners = model.corners();
+    const std::vector<uint32_t>& starts = model.face_starts();
+    const size_t faces = starts.empty() ? 0 : starts.size() - 1;
+
+    // Normals for the corners without one
+    std::vector<XMFLOAT3> made_normals;
+    if (std::any_of(corners.begin(), corners.end(), [](const obj_corner& c) { return c.vn < 0; })) {
+        auto position = [&model](int v) { return v >= 0 ? model.vert(v) : XMFLOAT3(0.f, 0.f, 0.f); };
+        // Newell's normal, twice the face's area long
+        std::vector<XMFLOAT3> face_normals(faces, XMFLOAT3(0.f, 0.f, 0.f));
+        for (size_t f = 0; f < faces; ++f) {
+            XMFLOAT3& n = face_normals[f];
+            for (uint32_t i = starts[f]; i < starts[f + 1]; ++i) {
+                const XMFLOAT3 p = position(corners[i].v);
+                const XMFLOAT3 q = position(corners[i + 1 < starts[f + 1] ? i + 1 : starts[f]].v);
+                n.x += (p.y - q.y) * (p.z + q.z);
+                n.y += (p.z - q.z) * (p.x + q.x);
+                n.z += (p.x - q.x) * (p.y + q.y);
+            }
+        }
+        auto smooth_key = [](uint32_t group, int v) { return ((uint64_t)group << 32) | (uint32_t)v; };
+        std::unordered_map<uint64_t, XMFLOAT3> smooth;
+        for (size_t f = 0; f < faces; ++f) {
+            const uint32_t group = model.face_smoothing()[f];
+            if (group == 0)
+                continue;
+            for (uint32_t i = starts[f]; i < starts[f + 1]; ++i)
+                if (corners[i].vn < 0) {
+                    XMFLOAT3& sum = smooth.emplace(smooth_key(group, corners[i].v), XMFLOAT3(0.f, 0.f, 0.f)).first->second;
+                    sum.x += face_normals[f].x;
+                    sum.y += face_normals[f].y;
+                    sum.z += face_normals[f].z;
+                }
+        }
+        made_normals.resize(corners.size(), XMFLOAT3(0.f, 0.f, 0.f));
+        for (size_t f = 0; f < faces; ++f) {
+            const uint32_t group = model.face_smoothing()[f];
+            for (uint32_t i = starts[f]; i < starts[f + 1]; ++i) {
+                if (corners[i].vn >= 0)
+                    continue;
+                const XMFLOAT3 n = group != 0 ? smooth[smooth_key(group, corners[i].v)] : face_normals[f];
+                const float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+                if (length > 0.f)
+                    made_normals[i] = XMFLOAT3(n.x / length, n.y / length, n.z / length);
+            }
+        }
+    }
+
+    // Runs of faces with one material in one object, as Assimp's OBJ loader makes meshes
+    struct Run {
+        int material;
+        uint32_t group;
+        std::vector<uint32_t> faces;
+    };
+    std::vector<Run> runs;
+    for (size_t f = 0; f < faces; ++f) {
+        if (starts[f + 1] - starts[f] < 3)
+            continue;
+        const int material = model.face_material()[f] >= 0 ? material_index[model.face_material()[f]] : 0;
+        const uint32_t group = model.face_group()[f];
+        if (runs.empty() || runs.back().material != material || runs.back().group != group)
+            runs.push_back(Run{ material, group, {} });
+        runs.back().faces.push_back((uint32_t)f);
+    }
+
+    std::vector<float> values;
+    std::vector<uint32_t> run_starts;
+    out.Meshes.resize(runs.size());
+    for (size_t r = 0; r < runs.size(); ++r) {
+        values.clear();
+        run_starts.assign(1, 0);
+        for (uint32_t f : runs[r].faces) {
+            for (uint32_t i = starts[f]; i < starts[f + 1]; ++i) {
+                const obj_corner& c = corners[i];
+                const XMFLOAT3 n = c.vn >= 0 ? model.normal(c.vn) : made_normals[i];
+                values.resize(values.size() + 8);
+                model.corner_values(c, n, &values[values.size() - 8]);
+            }
+            run_starts.push_back(run_starts.back() + (starts[f + 1] - starts[f]));
+        }
+        GeometryGenerator::MeshData& mesh = out.Meshes[r];
+        weld_faces(values.data(), run_starts.data(), runs[r].faces.size(), mesh);
+        convert_mesh(mesh, flags);
+        mesh.matName = out.Materials[runs[r].material].name;
+    }
+}
+
+bool ImportModel(const std::string& filename, uint32_t flags, ModelImport& out, ModelImportStats* stats) {
+    ModelImportStats local;
+    ModelImportStats& s = stats ? *stats : local;
+    s = ModelImportStats();
+    const auto start = std::chrono::steady_clock::now();
+
+    Model model;
+    {
+        MappedFile file;
+        if (!file.Open(filename))
+            return false;
+        s.FileBytes = file.Size();
+        model.parse(file.Data(), file.Size());
+    }
+    s.ModelBytes = model.memory_bytes();
+    s.ParseMs = ms_since(start);
+
+    const auto material_start = std::chrono::steady_clock::now();
+    const size_t slash = filename.find_last_of("/\\");
+    const std::string directory = slash == std::string::npos ? std::string() : filename.substr(0, slash + 1);
+    std::vector<GeometryGenerator::Material> materials;
+    for (const std::string& library : model.material_libs()) {
+        MappedFile file;
+        if (file.Open(directory + library))
+            ParseModelMaterials(file.Data(), file.Size(), materials);
+    }
+    s.MaterialMs = ms_since(material_start);
+
+    const auto mesh_start = std::chrono::steady_clock::now();
+    ImportModel(model, materials, flags, out);
+    out.Sources.push_back(filename);
+    for (const std::string& library : model.material_libs())
+        out.Sources.push_back(directory + library);
+    s.MeshMs = ms_since(mesh_start);
+    s.TotalMs = ms_since(start);
+
+    s.Meshes = out.Meshes.size();
+    for (const GeometryGenerator::MeshData& mesh : out.Meshes) {
+        s.Vertices += mesh.Vertices.size();
+        s.Triangles += mesh.Indices32.size() / 3;
+        s.MeshBytes += mesh_bytes(mesh);
+    }
+    return true;
+}
+
+ModelImportStats BenchmarkModelImport(const std::string& filename, int repeats) {
+    ModelImportStats total;
+    repeats = std::max(repeats, 1);
+    for (int r = 0; r < repeats; ++r) {
+        ModelImport import;
+        ModelImportStats s;
+        if (!ImportModel(filename, kModelImportDefault, import, &s))
+            return ModelImportStats();
+        total.ParseMs += s.ParseMs / repeats;
+        total.MaterialMs += s.MaterialMs / repeats;
+        total.MeshMs += s.MeshMs / repeats;
+        total.TotalMs += s.TotalMs / repeats;
+        if (r == 0) {
+            total.FileBytes = s.FileBytes;
+            total.ModelBytes = s.ModelBytes;
+            total.MeshBytes = s.MeshBytes;
+            total.Meshes = s.Meshes;
+            total.Vertices = s.Vertices;
+            total.Triangles = s.Triangles;
+        }
+    }
+    return total;
+}
+
+namespace {
+
+// A flat-shaded triangle faces its normal
+bool faces_normal(const GeometryGenerator::MeshData& mesh, size_t triangle) {
+    const XMFLOAT3& a = mesh.Vertices[mesh.Indices32[triangle * 3]].Position;
+    const XMFLOAT3& b = mesh.Vertices[mesh.Indices32[triangle * 3 + 1]].Position;
+    const XMFLOAT3& c = mesh.Vertices[mesh.Indices32[triangle * 3 + 2]].Position;
+    const XMFLOAT3& n = mesh.Vertices[mesh.Indices32[triangle * 3]].Normal;
+    const float e1[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+    const float e2[3] = { c.x - a.x, c.y - a.y, c.z - a.z };
+    const float cross[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+    return cross[0] * n.x + cross[1] * n.y + cross[2] * n.z > 0.f;
+}
+
+// Normal of the mesh's vertex at (x, y, z) after the import, or zeros
+XMFLOAT3 normal_at(const GeometryGenerator::MeshData& mesh, float x, float y, float z) {
+    for (const GeometryGenerator::Vertex& v : mesh.Vertices)
+        if (v.Position.x == x && v.Position.y == y && v.Position.z == z)
+            return v.Normal;
+    return XMFLOAT3(0.f, 0.f, 0.f);
+}
+
+} // namespace
+
+bool ValidateModelImport(std::string* error) {
+    const std::string mtl =
+        "# two materials\n"
+        "newmtl stone\r\n"
+        "Kd 1 1 1\n"
+        "map_Kd -bm 0.5 -o 0 0.5 textures/stone.dds\n"
+        "map_bump -bm 1 textures/stone_bump.dds\n"
+        "newmtl metal\n"
+        "map_Kd textures/metal.dds\n"
+        "map_Disp textures/metal_ddn.dds\n"
+        "bump textures/metal_bump.dds";
+    std::vector<GeometryGenerator::Material> materials;
+    ParseModelMaterials(mtl.data(), mtl.size(), materials);
+    if (materials.size() != 2 || materials[0].name != "stone" || materials[1].name != "metal")
+        return fail(error, "MTL: wrong materials");
+    if (materials[0].diffFile != "textures/stone.dds" || materials[0].normFile != "textures/stone_bump.dds" ||
+        materials[1].normFile != "textures/metal_ddn.dds")
+        return fail(error, "MTL: wrong texture paths");
+
+    // Runs: default, stone, stone (new group), default (unknown material), stone
+    const std::string obj =
+        "mtllib test.mtl\n"
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 2 0 0\nv 2 1 0\n"
+        "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+        "f 1/1 2/2 3/3 4/4\n"
+        "usemtl stone\n"
+        "f 2/1 5/2 6/3 3/4\n"
+        "g second\n"
+        "f 1/1 2/2 3/3\n"
+        "usemtl missing\n"
+        "f 1/1 3/3 4/4\n"
+        "usemtl stone\n"
+        "f 2/1 5/2 6/3\n";
+    const char* expected_materials[5] = { "DefaultMaterial", "stone", "stone", "DefaultMaterial", "stone" };
+    const size_t expected_triangles[5] = { 2, 2, 1, 1, 1 };
+    for (size_t chunk_bytes = 1; chunk_bytes <= obj.size(); chunk_bytes += 5) {
+        Model model;
+        model.parse(obj.data(), obj.size(), chunk_bytes, 3);
+        if (model.material_libs().size() != 1 || model.material_libs()[0] != "test.mtl")
+            return fail(error, "OBJ: mtllib not read");
+        ModelImport import;
+        ImportModel(model, materials, kModelImportDefault, import);
+        const std::string chunks = " with " + std::to_string(chunk_bytes) + "-byte chunks";
+        if (import.Materials.size() != 3 || import.Materials[0].name != "DefaultMaterial")
+            return fail(error, "OBJ: wrong material list");
+        if (import.Meshes.size() != 5)
+            return fail(error, "OBJ: " + std::to_string(import.Meshes.size()) + " meshes, expected 5" + chunks);
+        for (int m = 0; m < 5; ++m) {
+            const GeometryGenerator::MeshData& mesh = import.Meshes[m];
+            if (mesh.matName != expected_materials[m] || mesh.Indices32.size() != expected_triangles[m] * 3)
+                return fail(error, "OBJ: mesh " + std::to_string(m) + " has the wrong material or size" + chunks);
+            for (size_t t = 0; t < expected_triangles[m]; ++t)
+                if (!faces_normal(mesh, t))
+                    return fail(error, "OBJ: converted triangle faces away from its normal" + chunks);
+            for (const GeometryGenerator::Vertex& v : mesh.Vertices)
+                if (v.Normal.z != -1.f || v.Position.z != 0.f)
+                    return fail(error, "OBJ: flat normals wrong after the left-handed conversion");
+        }
+        // vt 0 1 at (0 1 0) flips to v = 0
+        const GeometryGenerator::MeshData& first = import.Meshes[0];
+        for (const GeometryGenerator::Vertex& v : first.Vertices)
+            if (v.Position.y == 1.f && v.Position.x == 0.f && v.TexC.y != 0.f)
+                return fail(error, "OBJ: v not flipped");
+    }
+
+    // A roof of two slopes meeting at x = 0, in one smoothing group, two groups, or flat
+    const char* roof_smoothing[3] = { "s 1\nf 4 5 2 1\nf 5 6 3 2\n", "s 1\nf 4 5 2 1\ns 2\nf 5 6 3 2\n",
+        "s off\nf 4 5 2 1\nf 5 6 3 2\n" };
+    const float ridge_y[3] = { 1.f, 0.70710678f, 0.70710678f };
+    for (int k = 0; k < 3; ++k) {
+        const std::string roof = std::string("v -1 0 0\nv 0 1 0\nv 1 0 0\nv -1 0 1\nv 0 1 1\nv 1 0 1\n") + roof_smoothing[k];
+        Model model;
+        model.parse(roof.data(), roof.size());
+        ModelImport import;
+        ImportModel(model, {}, kModelImportDefault, import);
+        if (import.Meshes.size() != 1)
+            return fail(error, "smoothing groups: wrong mesh count");
+        const GeometryGenerator::MeshData& mesh = import.Meshes[0];
+        const XMFLOAT3 ridge = normal_at(mesh, 0.f, 1.f, -1.f);
+        if (std::fabs(ridge.y - ridge_y[k]) > 1e-4f)
+            return fail(error, "smoothing groups: ridge normal wrong in case " + std::to_string(k));
+        if (mesh.Vertices.size() != (k == 0 ? 6u : 8u))
+            return fail(error, "smoothing groups: ridge vertices welded wrongly in case " + std::to_string(k));
+        for (size_t t = 0; t < 4 && k == 2; ++t)
+            if (!faces_normal(mesh, t))
+                return fail(error, "smoothing groups: flat triangle faces away from its normal");
+    }
+    return true;
+}
@@ -2,6 +2,9 @@
 #ifndef MODEL_H
 #define MODEL_H
 #include "DirectXMath.h"
+#include "GeometryGenerator.h"
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <string>
 struct mVertex
@@ -42,25 +45,154 @@ struct polygon {
     polygon() = default;
     polygon(Vert v1, Vert v2, Vert v3) : verts{ v1,v2,v3 } {}
 };
+// One face corner: 0-based position, uv and normal indices, -1 where the face gives none
+struct obj_corner {
+    int v, vt, vn;
+};
+
+// OBJ text is parsed in newline-aligned chunks of at least this many bytes, one thread per chunk
+constexpr size_t kModelParseChunkBytes = 64 * 1024;
+
 class Model {
     
 private:
     std::vector<XMFLOAT3> verts_;
-    std::vector<polygon> faces_;
+    std::vector<polygon> faces_;       // triangles, n-gons fanned from their first corner
     std::vector<XMFLOAT3> normals_;
     std::vector<XMFLOAT2> uv_coords_;
+    std::vector<obj_corner> corners_;    // every face's corners, faces one after another
+    std::vector<uint32_t> face_starts_; // first corner of each face in corners_, plus the end
+    std::vector<std::string> materials_;     // usemtl names in order of first use
+    std::vector<std::string> material_libs_; // mtllib lines
+    std::vector<int> face_material_;         // per face, into materials_; -1 before any usemtl
+    std::vector<uint32_t> face_group_;       // per face, the o and g lines before it
+    std::vector<uint32_t> face_smoothing_;   // per face, its smoothing group; 0 = off
+    bool loaded_ = false;
    // TGAImage diffuse_map_;
 public:
+    Model() = default;
+    // Memory-maps the file and parses it as parse() does
     Model(std::string filename);
     ~Model();
-    int nverts();
-    int nfaces();
-    XMFLOAT3 vert(int i);
-    XMFLOAT3 normal(int i);
-    XMFLOAT2 uv_coords(int i);
+    // Parses OBJ text (v, vt, vn, f, usemtl, mtllib, o, g and s lines; the rest is skipped) split into
+    // chunks parsed on up to `threads` threads (0 = one per core) and merged in file order, so the result
+    // does not depend on the chunking. Relative (negative) indices are resolved; indices out of range
+    // read as zeros.
+    void parse(const char* data, size_t size, size_t chunk_bytes = kModelParseChunkBytes, int threads = 0);
+    bool loaded() const;
+    int nverts() const;
+    int nfaces() const;
+    XMFLOAT3 vert(int i) const;
+    XMFLOAT3 normal(int i) const;
+    XMFLOAT2 uv_coords(int i) const;
     //void load_texture(std::string filename,std::string suffix, TGAImage& img);
     //TGAColor diffuse_color(Vector2 uv);
-    polygon face(int idx);
+    polygon face(int idx) const;
+    // Indexed triangle mesh: n-gons fanned from their first corner, corners with the same position,
+    // normal and uv welded into one vertex (by value, not by OBJ index), tangents from the uvs
+    GeometryGenerator::MeshData mesh_data() const;
+    // Faces as written, before they are cut to triangles
+    const std::vector<obj_corner>& corners() const { return corners_; }
+    const std::vector<uint32_t>& face_starts() const { return face_starts_; }
+    const std::vector<std::string>& materials() const { return materials_; }
+    const std::vector<std::string>& material_libs() const { return material_libs_; }
+    const std::vector<int>& face_material() const { return face_material_; }
+    const std::vector<uint32_t>& face_group() const { return face_group_; }
+    const std::vector<uint32_t>& face_smoothing() const { return face_smoothing_; }
+    // Bytes held by the parsed arrays
+    size_t memory_bytes() const;
+    // Position, normal n (the corner's own or one made for it) and uv of the corner as 8 floats
+    void corner_values(const obj_corner& c, const XMFLOAT3& n, float* out) const;
 };
 
+struct ModelParseBenchmark {
+    size_t Bytes = 0;
+    int Threads = 0;
+    double LegacyMs = 0.0;   // getline + istringstream per line, the parser Model had before
+    double MappedMs = 0.0;   // map + chunked parse, both averaged over the repeats
+    double LegacyMBps = 0.0;
+    double MappedMBps = 0.0;
+};
+
+// Time both parsers on the file
+ModelParseBenchmark BenchmarkModelParse(const std::string& filename, int repeats);
+
+struct ModelMeshStats {
+    size_t Triangles = 0;
+    size_t Corners = 0;          // three per triangle, what the faces held
+    size_t Vertices = 0;         // after welding
+    size_t FaceBytes = 0;        // CPU memory of the per-triangle vertex copies
+    size_t MeshBytes = 0;        // ... and of the welded vertices and 32-bit indices
+    size_t UnindexedUploadBytes = 0; // vertex buffer of three vertices per triangle
+    size_t IndexedUploadBytes = 0;   // welded vertex buffer + index buffer (16-bit where the vertices fit)
+    double WeldMs = 0.0;
+};
+
+// Load the file and weld it into a mesh
+ModelMeshStats MeasureModelMesh(const std::string& filename);
+
+// Check of the chunked parser: synthetic text (relative indices, v//vn corners, CRLF, no final newline,
+// comments) gives the expected model for every chunk size, and the file, if given (triangles with
+// v/vt/vn corners), parses to what the old line-by-line parser reads from it. Returns false with a reason on failure.
+bool ValidateModelParse(const std::string& filename, std::string* error = nullptr);
+
+// Check of mesh_data on synthetic faces (a quad, a pentagon, repeated values under different indices,
+// a face too short to draw) and the file, if given: every triangle's corners read back the face
+// corners' values, no two vertices are the same and the indices are in range. Returns false with a
+// reason on failure.
+bool ValidateModelMesh(const std::string& filename, std::string* error = nullptr);
+
+// ImportModel flags: the conversions of aiProcess_ConvertToLeftHanded, which BuildCustomMeshGeometry relies on
+constexpr uint32_t kModelImportLeftHanded = 1; // z negated, winding reversed
+constexpr uint32_t kModelImportFlipV = 2;      // v = 1 - v
+constexpr uint32_t kModelImportDefault = kModelImportLeftHanded | kModelImportFlipV;
+
+// An OBJ with its MTL libraries, as BuildCustomMeshGeometry draws it
+struct ModelImport {
+    // One per run of faces with one material within one o/g object, in file order (where Assimp's OBJ
+    // loader splits meshes); matName names the material
+    std::vector<GeometryGenerator::MeshData> Meshes;
+    // "DefaultMaterial" (faces before any usemtl, or naming no material of the libraries) and then the
+    // libraries' materials in file order; diffFile is map_Kd, normFile map_Disp or else map_bump
+    std::vector<GeometryGenerator::Material> Materials;
+    // Files read: the OBJ, then its mtllib paths whether they opened or not (left empty when importing
+    // an already parsed Model)
+    std::vector<std::string> Sources;
+};
+
+struct ModelImportStats {
+    size_t FileBytes = 0;
+    size_t ModelBytes = 0;  // parsed OBJ arrays, freed once the meshes are built
+    size_t MeshBytes = 0;   // vertices and 32-bit indices of the meshes
+    size_t Meshes = 0;
+    size_t Vertices = 0;
+    size_t Triangles = 0;
+    double ParseMs = 0.0;
+    double MaterialMs = 0.0;
+    double MeshMs = 0.0;
+    double TotalMs = 0.0;
+};
+
+// Materials of MTL text (newmtl, map_Kd, map_Disp/disp, map_bump/bump; texture options are skipped)
+void ParseModelMaterials(const char* data, size_t size, std::vector<GeometryGenerator::Material>& materials);
+
+// Meshes of a parsed model and the materials of its libraries. Corners without a normal get the area-
+// weighted normal of the faces around their position in the same smoothing group, or their face's
+// normal where smoothing is off; vertices are welded per mesh (Model::mesh_data) and tangents follow u.
+void ImportModel(const Model& model, const std::vector<GeometryGenerator::Material>& libraryMaterials,
+    uint32_t flags, ModelImport& out);
+
+// Loads filename and the mtllib files next to it; false if the OBJ cannot be read (a missing library
+// only leaves its materials out)
+bool ImportModel(const std::string& filename, uint32_t flags, ModelImport& out, ModelImportStats* stats = nullptr);
+
+// Averages of `repeats` ImportModel calls
+ModelImportStats BenchmarkModelImport(const std::string& filename, int repeats);
+
+// Check of ImportModel on synthetic OBJ and MTL text: the meshes split at every object and material
+// change (across chunk boundaries too), unknown materials fall back to DefaultMaterial, smoothing
+// groups share normals across faces only within a group, the left-handed conversion keeps faces facing
+// their normals, and the texture paths come out of the MTL. Returns false with a reason on failure.
+bool ValidateModelImport(std::string* error = nullptr);
+
 #endif
\ No newline at end of file